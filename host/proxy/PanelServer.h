@@ -0,0 +1,335 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file PanelServer.h
+  *
+  * Plain HTTP/1.1 server of the payload for the panels on the LAN.
+  */
+#pragma once
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "Upstream.h"
+
+#define SERVER_IDLE_S     30    //!< Idle keep-alive connections are closed after this
+#define SERVER_MAX_HEADER 8192  //!< Larger requests are refused
+#define SERVER_EVENTS     256   //!< Events of one epoll_wait
+
+/**
+  * Every thread runs an epoll loop with a listening socket of its own on
+  * the same port (SO_REUSEPORT), so the kernel spreads the connections
+  * and the threads share nothing but the counters and the payload copy.
+  * A panel connects, requests "GET /panel" and closes, HTTP/1.1 keep-alive
+  * and pipelined requests work too. "GET /status" shows the counters and
+  * the poll states as text. Further paths are answered by the handlers
+  * added with Handle() before Start().
+  */
+class PanelServer
+{
+public:
+   /* Fills the body of a request with the query, false answers 503 */
+   typedef std::function<bool(const std::string &query, std::string &body)> Handler;
+
+protected:
+   /* Open connection of a panel */
+   struct Connection
+   {
+      std::string in;     //!< Received bytes of the next requests
+      std::string out;    //!< Response bytes not sent yet
+      size_t      sent;   //!< Sent bytes of out
+      bool        close;  //!< Close after out is sent
+      time_t      active; //!< Last activity
+   };
+
+   Upstream                 &upstream;    //!< Source of the payload
+   int                       port;        //!< Listen port
+   std::vector<std::thread>  threads;     //!< Server threads
+   std::atomic<bool>         running;     //!< Cleared by Stop()
+   std::atomic<unsigned>     connections; //!< Accepted connections
+   std::atomic<unsigned>     requests;    //!< Answered requests
+   std::atomic<uint64_t>     bytes;       //!< Sent body bytes
+   std::map<std::string, std::pair<std::string, Handler>> handlers; //!< Content type and handler of a path
+
+   static void NonBlocking(int fd)
+   {
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+   }
+
+   static int Listen(int port)
+   {
+      int                fd  = socket(AF_INET, SOCK_STREAM, 0);
+      int                one = 1;
+      struct sockaddr_in address;
+
+      memset(&address, 0, sizeof(address));
+      address.sin_family      = AF_INET;
+      address.sin_port        = htons(port);
+      address.sin_addr.s_addr = htonl(INADDR_ANY);
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+      setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+      if (fd < 0 || bind(fd, (struct sockaddr *) &address, sizeof(address)) != 0 || listen(fd, 1024) != 0) {
+         fprintf(stderr, "Listening on port %d failed: %s\n", port, strerror(errno));
+         if (fd >= 0) {
+            close(fd);
+         }
+         return -1;
+      }
+      NonBlocking(fd);
+      return fd;
+   }
+
+   /* Case insensitive search of the header line */
+   static bool HasHeader(const std::string &head, const char *line)
+   {
+      std::string lower(head);
+
+      for (char &c : lower) {
+         c = tolower(c);
+      }
+      return lower.find(line) != std::string::npos;
+   }
+
+   /* Append the response of the request head to the connection */
+   void Answer(Connection &connection, const std::string &head)
+   {
+      std::string line    = head.substr(0, head.find("\r\n"));
+      size_t      first   = line.find(' ');
+      size_t      second  = first == std::string::npos ? std::string::npos : line.find(' ', first + 1);
+      std::string method  = line.substr(0, first);
+      std::string path    = first == std::string::npos ? "" : line.substr(first + 1, second - first - 1);
+      std::string version = second == std::string::npos ? "" : line.substr(second + 1);
+      std::string body;
+      std::string type    = "application/octet-stream";
+      const char *status  = "200 OK";
+
+      // a malformed request line is answered and the connection closed
+      bool malformed = method.empty() || path.empty() || path[0] != '/' || version.compare(0, 7, "HTTP/1.") != 0 ||
+                       version.size() != 8;
+      bool http10    = version == "HTTP/1.0";
+      connection.close = malformed || (http10 ? !HasHeader(head, "\r\nconnection: keep-alive") : HasHeader(head, "\r\nconnection: close"));
+
+      if (malformed) {
+         status = "400 Bad Request";
+         type   = "text/plain";
+      } else if (method != "GET") {
+         status = "405 Method Not Allowed";
+         type   = "text/plain";
+      } else if (path == "/panel" || path.compare(0, 7, "/panel?") == 0) {
+         std::shared_ptr<const ProxyPayload> payload = upstream.Current();
+
+         body.assign((const char *) payload.get(), sizeof(ProxyPayload));
+      } else if (path == "/status") {
+         type = "text/plain";
+         body = "connections " + std::to_string(connections) + ", requests " + std::to_string(requests) + ", body bytes "
+              + std::to_string(bytes) + ", payload " + std::to_string(upstream.Current()->sequence) + "\n" + upstream.Status();
+      } else if (handlers.count(path.substr(0, path.find('?')))) {
+         const auto &handler = handlers.find(path.substr(0, path.find('?')))->second;
+         size_t      query   = path.find('?');
+
+         type = handler.first;
+         if (!handler.second(query == std::string::npos ? "" : path.substr(query + 1), body)) {
+            status = "503 Service Unavailable";
+            type   = "text/plain";
+            body.clear();
+         }
+      } else {
+         status = "404 Not Found";
+         type   = "text/plain";
+      }
+      connection.out += std::string("HTTP/1.1 ") + status + "\r\nContent-Type: " + type + "\r\nContent-Length: "
+                      + std::to_string(body.size()) + (connection.close ? "\r\nConnection: close" : "") + "\r\n\r\n" + body;
+      requests++;
+      bytes += body.size();
+   }
+
+   /* Read and answer the complete requests, false if the connection is done */
+   bool Receive(int fd, Connection &connection)
+   {
+      char buffer[4096];
+
+      for (;;) {
+         ssize_t length = recv(fd, buffer, sizeof(buffer), 0);
+
+         if (length > 0) {
+            connection.in.append(buffer, length);
+         } else if (length == 0) {
+            return false; // closed by the panel
+         } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+         } else {
+            return false;
+         }
+      }
+      size_t end;
+      while (!connection.close && (end = connection.in.find("\r\n\r\n")) != std::string::npos) {
+         Answer(connection, connection.in.substr(0, end + 4));
+         connection.in.erase(0, end + 4);
+      }
+      return connection.in.size() <= SERVER_MAX_HEADER;
+   }
+
+   /* Send the pending response bytes, false if the connection is done */
+   bool Send(int fd, Connection &connection)
+   {
+      while (connection.sent < connection.out.size()) {
+         ssize_t length = send(fd, connection.out.data() + connection.sent, connection.out.size() - connection.sent, MSG_NOSIGNAL);
+
+         if (length < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+         }
+         connection.sent += length;
+      }
+      connection.out.clear();
+      connection.sent = 0;
+      return !connection.close;
+   }
+
+   void Run(int listener)
+   {
+      int                             epoll = epoll_create1(0);
+      struct epoll_event              events[SERVER_EVENTS];
+      struct epoll_event              event;
+      std::map<int, Connection>       open;
+      time_t                          sweep = time(NULL);
+
+      event.events  = EPOLLIN;
+      event.data.fd = listener;
+      epoll_ctl(epoll, EPOLL_CTL_ADD, listener, &event);
+
+      while (running) {
+         int count = epoll_wait(epoll, events, SERVER_EVENTS, 1000);
+         time_t now = time(NULL);
+
+         for (int i = 0; i < count; i++) {
+            int fd = events[i].data.fd;
+
+            if (fd == listener) {
+               int client;
+
+               while ((client = accept(listener, NULL, NULL)) >= 0) {
+                  int one = 1;
+
+                  NonBlocking(client);
+                  setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                  event.events  = EPOLLIN;
+                  event.data.fd = client;
+                  epoll_ctl(epoll, EPOLL_CTL_ADD, client, &event);
+                  open[client] = Connection{ "", "", 0, false, now };
+                  connections++;
+               }
+               continue;
+            }
+            Connection &connection = open[fd];
+            bool        alive      = true;
+
+            connection.active = now;
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+               alive = Receive(fd, connection);
+            }
+            if (alive || !connection.out.empty()) {
+               alive = Send(fd, connection) || !connection.out.empty();
+            }
+            if (!alive) {
+               epoll_ctl(epoll, EPOLL_CTL_DEL, fd, NULL);
+               close(fd);
+               open.erase(fd);
+               continue;
+            }
+            event.events  = EPOLLIN | (connection.out.empty() ? 0u : (uint32_t) EPOLLOUT);
+            event.data.fd = fd;
+            epoll_ctl(epoll, EPOLL_CTL_MOD, fd, &event);
+         }
+         if (now != sweep) {
+            sweep = now;
+            for (auto it = open.begin(); it != open.end();) {
+               if (now - it->second.active > SERVER_IDLE_S) {
+                  close(it->first);
+                  it = open.erase(it);
+               } else {
+                  ++it;
+               }
+            }
+         }
+      }
+      for (auto &connection : open) {
+         close(connection.first);
+      }
+      close(listener);
+      close(epoll);
+   }
+
+public:
+   PanelServer(Upstream &u, int p)
+      : upstream(u)
+      , port(p)
+      , running(false)
+      , connections(0)
+      , requests(0)
+      , bytes(0)
+   {
+   }
+
+   ~PanelServer()
+   {
+      Stop();
+   }
+
+   /* Answer the path with the handler, only before Start() */
+   void Handle(const std::string &path, const std::string &type, Handler handler)
+   {
+      handlers[path] = std::make_pair(type, handler);
+   }
+
+   /* Listen with the number of threads, false if the port is not free */
+   bool Start(int count)
+   {
+      running = true;
+      for (int i = 0; i < count; i++) {
+         int listener = Listen(port);
+
+         if (listener < 0) {
+            Stop();
+            return false;
+         }
+         threads.emplace_back(&PanelServer::Run, this, listener);
+      }
+      return true;
+   }
+
+   /* Stop the threads within a second */
+   void Stop()
+   {
+      running = false;
+      for (std::thread &thread : threads) {
+         thread.join();
+      }
+      threads.clear();
+   }
+};
@@ -0,0 +1,122 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file ProxyConfig.h
+  *
+  * Configuration of the proxy from a json file, see proxy.json.example.
+  */
+#pragma once
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <json/json.h>
+#include "ProxyPayload.h"
+
+/* Upstream service of a section of the payload */
+struct ServiceConfig
+{
+   std::string url;     //!< Scheme, host and port, e.g. "https://maps.googleapis.com"
+   std::string key;     //!< Api key, empty if the service needs none
+   int         minutes; //!< Poll interval
+};
+
+/* Place of the commute like COMMUTE_PLACES of the firmware */
+struct PlaceConfig
+{
+   std::string name;  //!< Name, only for the log
+   std::string coord; //!< "latitude,longitude"
+};
+
+/**
+  * All the settings of the proxy. The location, the district and the
+  * routes must be the ones of the Config.h of the panels, the routes in
+  * the order of COMMUTE_ROUTES.
+  */
+struct ProxyConfig
+{
+   int                              port;          //!< Listen port of the panels
+   int                              threads;       //!< Server threads
+   int                              maxAgeMinutes; //!< A section older than this is sent as invalid
+   double                           latitude;      //!< Location of the weather
+   double                           longitude;     //!< Location of the weather
+   std::string                      ags;           //!< Allgemeiner Gemeindeschluessel of the corona district
+   ServiceConfig                    openweather;   //!< Onecall and air pollution
+   ServiceConfig                    maps;          //!< Distance matrix
+   ServiceConfig                    astronauts;    //!< open-notify
+   ServiceConfig                    corona;        //!< corona-zahlen api
+   std::vector<PlaceConfig>         places;        //!< Places of the routes
+   std::vector<std::pair<int, int>> routes;        //!< Origin and destination index of the routes
+
+   /* Read a service with the defaults */
+   static ServiceConfig Service(const Json::Value &value, const char *url, int minutes)
+   {
+      ServiceConfig service;
+
+      service.url     = value.get("url", url).asString();
+      service.key     = value.get("key", "").asString();
+      service.minutes = value.get("minutes", minutes).asInt();
+      return service;
+   }
+
+   /* Load the file, throws on any error */
+   void Load(const std::string &path)
+   {
+      std::ifstream           file(path);
+      Json::CharReaderBuilder builder;
+      Json::Value             root;
+      std::string             errors;
+
+      if (!file) {
+         throw std::runtime_error("Cannot open " + path);
+      }
+      if (!Json::parseFromStream(builder, file, &root, &errors)) {
+         throw std::runtime_error(path + ": " + errors);
+      }
+      port          = root.get("port", 8080).asInt();
+      threads       = root.get("threads", 2).asInt();
+      maxAgeMinutes = root.get("max_age_minutes", 180).asInt();
+      latitude      = root["latitude"].asDouble();
+      longitude     = root["longitude"].asDouble();
+      ags           = root["corona"].get("ags", "").asString();
+      openweather   = Service(root["openweather"], "http://api.openweathermap.org", 10);
+      maps          = Service(root["maps"], "https://maps.googleapis.com", 10);
+      astronauts    = Service(root["astronauts"], "http://api.open-notify.org", 360);
+      corona        = Service(root["corona"], "https://api.corona-zahlen.org", 360);
+
+      places.clear();
+      for (const Json::Value &place : root["maps"]["places"]) {
+         places.push_back({ place["name"].asString(), place["coord"].asString() });
+      }
+      routes.clear();
+      for (const Json::Value &route : root["maps"]["routes"]) {
+         int from = route[0].asInt();
+         int to   = route[1].asInt();
+
+         if (from < 0 || to < 0 || from >= (int) places.size() || to >= (int) places.size()) {
+            throw std::runtime_error(path + ": route to an unknown place");
+         }
+         routes.push_back(std::make_pair(from, to));
+      }
+      if (routes.size() > PROXY_ROUTES) {
+         throw std::runtime_error(path + ": more than " + std::to_string(PROXY_ROUTES) + " routes");
+      }
+      if (threads < 1) {
+         threads = 1;
+      }
+   }
+};
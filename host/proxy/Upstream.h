@@ -0,0 +1,407 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Upstream.h
+  *
+  * Polling of the services and the cached payload of the panels.
+  */
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <curl/curl.h>
+#include <json/json.h>
+#include "ProxyConfig.h"
+#include "ProxyPayload.h"
+
+#define UPSTREAM_TIMEOUT_S   20 //!< Max time of a request
+#define UPSTREAM_RETRY_S     60 //!< Wait after a failed request
+#define UPSTREAM_SECTIONS    5  //!< Weather, air, astronauts, corona, maps
+
+/**
+  * Json GET requests of one service over one curl handle, so the
+  * connection and the TLS session are kept between the polls.
+  */
+class HttpGet
+{
+protected:
+   CURL *curl; //!< Handle of the service
+
+   static size_t Write(char *data, size_t size, size_t count, void *body)
+   {
+      ((std::string *) body)->append(data, size * count);
+      return size * count;
+   }
+
+public:
+   HttpGet()
+      : curl(curl_easy_init())
+   {
+   }
+
+   ~HttpGet()
+   {
+      curl_easy_cleanup(curl);
+   }
+
+   /* Request the url and parse the json body, false on any error */
+   bool Json(const std::string &url, Json::Value &root, double &seconds)
+   {
+      std::string body;
+      long        status = 0;
+
+      curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+      curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, Write);
+      curl_easy_setopt(curl, CURLOPT_WRITEDATA, &body);
+      curl_easy_setopt(curl, CURLOPT_TIMEOUT, (long) UPSTREAM_TIMEOUT_S);
+      curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+      curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+      curl_easy_setopt(curl, CURLOPT_USERAGENT, "m5proxy/1");
+
+      CURLcode code = curl_easy_perform(curl);
+      curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+      curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &seconds);
+      if (code != CURLE_OK || status != 200) {
+         fprintf(stderr, "Requesting %s failed: %s, status %ld\n", url.c_str(), curl_easy_strerror(code), status);
+         return false;
+      }
+
+      Json::CharReaderBuilder           builder;
+      std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+      std::string                       errors;
+
+      if (!reader->parse(body.data(), body.data() + body.size(), &root, &errors)) {
+         fprintf(stderr, "Parsing %s failed: %s\n", url.c_str(), errors.c_str());
+         return false;
+      }
+      return true;
+   }
+};
+
+/**
+  * Polls every service on its own interval into a ProxyPayload and
+  * publishes a copy of it after every change. The server threads only
+  * take the current copy, they never wait for a request to a service.
+  * A failed poll keeps the last data of the section until it is older
+  * than max_age_minutes.
+  */
+class Upstream
+{
+protected:
+   /* Poll state of a section */
+   struct Section
+   {
+      const char    *name;     //!< Name in the log and the status
+      ProxyValid     valid;    //!< Bit of the section
+      int            minutes;  //!< Poll interval
+      time_t         next;     //!< Next poll
+      time_t         updated;  //!< Last successful poll, 0 never
+      unsigned       polls;    //!< Requests of the section
+      unsigned       failures; //!< Failed requests
+      double         seconds;  //!< Request time of the last poll
+   };
+
+   const ProxyConfig                   &config;                       //!< Settings
+   ProxyPayload                         payload;                      //!< Data of the poll thread
+   Section                              sections[UPSTREAM_SECTIONS];  //!< Poll states
+   HttpGet                              openweather;                  //!< Connection to openweathermap
+   HttpGet                              maps;                         //!< Connection to the distance matrix
+   HttpGet                              astronauts;                   //!< Connection to open-notify
+   HttpGet                              corona;                       //!< Connection to the corona api
+   std::mutex                           mutex;                        //!< Protects the published copy and the poll states
+   std::shared_ptr<const ProxyPayload>  published;                    //!< Copy of the panels
+   std::atomic<bool>                    running;                      //!< Cleared by Stop()
+   std::thread                          thread;                       //!< Poll thread
+
+   static std::string Fixed(double value)
+   {
+      std::ostringstream text;
+
+      text.precision(5);
+      text << std::fixed << value;
+      return text.str();
+   }
+
+   /* Percent encoding of a query value */
+   static std::string Escape(const std::string &value)
+   {
+      char       *escaped = curl_easy_escape(NULL, value.c_str(), (int) value.size());
+      std::string text    = escaped ? escaped : "";
+
+      curl_free(escaped);
+      return text;
+   }
+
+   /* Copy the text with a terminating zero */
+   template <size_t N> static void Text(char (&field)[N], const std::string &text)
+   {
+      memset(field, 0, N);
+      strncpy(field, text.c_str(), N - 1);
+   }
+
+   bool PollWeather(double &seconds)
+   {
+      Json::Value root;
+      std::string url = config.openweather.url + "/data/2.5/onecall?lat=" + Fixed(config.latitude) + "&lon=" + Fixed(config.longitude)
+                      + "&units=metric&lang=de&exclude=alerts&appid=" + Escape(config.openweather.key);
+
+      if (!openweather.Json(url, root, seconds) || !root["current"].isObject()) {
+         return false;
+      }
+      const Json::Value &current = root["current"];
+
+      payload.currentTime   = current["dt"].asUInt();
+      payload.sunrise       = current["sunrise"].asUInt();
+      payload.sunset        = current["sunset"].asUInt();
+      payload.windspeed     = current["wind_speed"].asFloat();
+      payload.temp          = current["temp"].asFloat();
+      payload.tempFeelsLike = current["feels_like"].asFloat();
+      payload.humidity      = current["humidity"].asFloat();
+      payload.pressure      = current["pressure"].asFloat();
+
+      for (int i = 0; i < PROXY_DAYS; i++) {
+         const Json::Value &day = root["daily"][i];
+
+         payload.dailyTime[i]    = day["dt"].asUInt();
+         payload.dailyMaxTemp[i] = day["temp"]["max"].asFloat();
+         Text(payload.dailyMain[i], day["weather"][0]["main"].asString());
+         Text(payload.dailyIcon[i], day["weather"][0]["icon"].asString());
+      }
+      payload.hours = std::min((int) root["hourly"].size(), PROXY_HOURS);
+      for (int i = 0; i < PROXY_HOURS; i++) {
+         const Json::Value &hour = root["hourly"][i];
+
+         payload.hourlyTemp[i] = hour["temp"].asFloat();
+         payload.hourlyRain[i] = hour["rain"]["1h"].asFloat();
+         payload.hourlySnow[i] = hour["snow"]["1h"].asFloat();
+      }
+      payload.minutes = std::min((int) root["minutely"].size(), PROXY_MINUTES);
+      for (int i = 0; i < PROXY_MINUTES; i++) {
+         payload.minutelyRain[i] = root["minutely"][i]["precipitation"].asFloat();
+      }
+      return true;
+   }
+
+   bool PollAir(double &seconds)
+   {
+      Json::Value root;
+      std::string url = config.openweather.url + "/data/2.5/air_pollution?lat=" + Fixed(config.latitude) + "&lon=" + Fixed(config.longitude)
+                      + "&appid=" + Escape(config.openweather.key);
+
+      if (!openweather.Json(url, root, seconds) || !root["list"][0].isObject()) {
+         return false;
+      }
+      const Json::Value &hour = root["list"][0];
+
+      payload.airQuality = hour["main"]["aqi"].asInt();
+      payload.airPm25    = hour["components"]["pm2_5"].asFloat();
+      payload.airPm10    = hour["components"]["pm10"].asFloat();
+      payload.airNo2     = hour["components"]["no2"].asFloat();
+      payload.airO3      = hour["components"]["o3"].asFloat();
+      return true;
+   }
+
+   bool PollAstronauts(double &seconds)
+   {
+      Json::Value root;
+
+      if (!astronauts.Json(config.astronauts.url + "/astros.json", root, seconds) || !root["number"].isInt()) {
+         return false;
+      }
+      payload.astronauts = root["number"].asInt();
+      return true;
+   }
+
+   bool PollCorona(double &seconds)
+   {
+      Json::Value local;
+      Json::Value germany;
+      double      germanySeconds = 0;
+
+      if (!corona.Json(config.corona.url + "/districts/" + config.ags, local, seconds) ||
+          !corona.Json(config.corona.url + "/germany", germany, germanySeconds)) {
+         return false;
+      }
+      const Json::Value &district = local["data"][config.ags];
+
+      payload.coronaWeekIncidenceLocal   = district["weekIncidence"].asFloat();
+      payload.coronaWeekIncidenceGermany = germany["weekIncidence"].asFloat();
+      Text(payload.coronaName, district["name"].asString());
+      Text(payload.coronaUpdated, local["meta"]["lastUpdate"].asString());
+      seconds += germanySeconds;
+      return true;
+   }
+
+   /* All the routes in one matrix of all the places */
+   bool PollMaps(double &seconds)
+   {
+      Json::Value root;
+      std::string coords;
+
+      if (config.routes.empty()) {
+         return false;
+      }
+      for (size_t i = 0; i < config.places.size(); i++) {
+         coords += (i ? "|" : "") + config.places[i].coord;
+      }
+      std::string url = config.maps.url + "/maps/api/distancematrix/json?key=" + Escape(config.maps.key)
+                      + "&language=de&departure_time=now&origins=" + coords + "&destinations=" + coords;
+
+      if (!maps.Json(url, root, seconds) || root["status"].asString() != "OK") {
+         return false;
+      }
+      payload.routes = config.routes.size();
+      for (size_t r = 0; r < config.routes.size(); r++) {
+         const Json::Value &element = root["rows"][config.routes[r].first]["elements"][config.routes[r].second];
+
+         payload.mapsMinutes[r] = element["duration_in_traffic"]["value"].asInt() / 60;
+      }
+      return true;
+   }
+
+   /* Poll the due sections, true if the payload changed */
+   bool Poll(time_t now)
+   {
+      bool changed = false;
+
+      for (Section &section : sections) {
+         if (section.minutes <= 0 || now < section.next) {
+            continue;
+         }
+         bool   success = false;
+         double seconds = 0;
+
+         switch (section.valid) {
+         case PROXY_VALID_WEATHER:    success = PollWeather(seconds);    break;
+         case PROXY_VALID_AIR:        success = PollAir(seconds);        break;
+         case PROXY_VALID_ASTRONAUTS: success = PollAstronauts(seconds); break;
+         case PROXY_VALID_CORONA:     success = PollCorona(seconds);     break;
+         case PROXY_VALID_MAPS:       success = PollMaps(seconds);       break;
+         }
+         std::lock_guard<std::mutex> lock(mutex);
+
+         section.polls++;
+         section.seconds = seconds;
+         if (success) {
+            section.updated = now;
+            section.next    = now + section.minutes * 60;
+            payload.valid  |= section.valid;
+            changed         = true;
+         } else {
+            section.failures++;
+            section.next = now + UPSTREAM_RETRY_S;
+         }
+         printf("Poll %-10s %s in %.0f ms\n", section.name, success ? "ok" : "failed", section.seconds * 1000);
+      }
+      std::lock_guard<std::mutex> lock(mutex);
+
+      for (Section &section : sections) {
+         if ((payload.valid & section.valid) && now - section.updated > config.maxAgeMinutes * 60) {
+            payload.valid &= ~section.valid;
+            changed        = true;
+         }
+      }
+      return changed;
+   }
+
+   void Run()
+   {
+      while (running) {
+         if (Poll(time(NULL))) {
+            payload.sequence++;
+            std::shared_ptr<const ProxyPayload> copy = std::make_shared<ProxyPayload>(payload);
+            std::lock_guard<std::mutex>         lock(mutex);
+
+            published = copy;
+         }
+         std::this_thread::sleep_for(std::chrono::seconds(1));
+      }
+   }
+
+public:
+   Upstream(const ProxyConfig &c)
+      : config(c)
+      , running(false)
+   {
+      memset(&payload, 0, sizeof(payload));
+      payload.magic   = PROXY_MAGIC;
+      payload.version = PROXY_VERSION;
+      payload.size    = sizeof(payload);
+
+      Section init[UPSTREAM_SECTIONS] = {
+         { "weather",    PROXY_VALID_WEATHER,    config.openweather.minutes, 0, 0, 0, 0, 0 },
+         { "air",        PROXY_VALID_AIR,        config.openweather.minutes, 0, 0, 0, 0, 0 },
+         { "astronauts", PROXY_VALID_ASTRONAUTS, config.astronauts.minutes,  0, 0, 0, 0, 0 },
+         { "corona",     PROXY_VALID_CORONA,     config.ags.empty() ? 0 : config.corona.minutes, 0, 0, 0, 0, 0 },
+         { "maps",       PROXY_VALID_MAPS,       config.routes.empty() ? 0 : config.maps.minutes, 0, 0, 0, 0, 0 },
+      };
+      memcpy(sections, init, sizeof(sections));
+      published = std::make_shared<ProxyPayload>(payload);
+   }
+
+   ~Upstream()
+   {
+      Stop();
+   }
+
+   /* Start the poll thread */
+   void Start()
+   {
+      running = true;
+      thread  = std::thread(&Upstream::Run, this);
+   }
+
+   /* Stop the poll thread after the current request */
+   void Stop()
+   {
+      running = false;
+      if (thread.joinable()) {
+         thread.join();
+      }
+   }
+
+   /* Current payload of the panels, never blocks on a request */
+   std::shared_ptr<const ProxyPayload> Current()
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      return published;
+   }
+
+   /* Text of the poll states */
+   std::string Status()
+   {
+      std::ostringstream          text;
+      time_t                      now = time(NULL);
+      std::lock_guard<std::mutex> lock(mutex);
+
+      text << "section     polls  failed  age s  last ms\n";
+      for (const Section &section : sections) {
+         char line[128];
+
+         snprintf(line, sizeof(line), "%-10s %6u %7u %6ld %8.0f\n", section.name, section.polls, section.failures,
+            section.updated ? (long) (now - section.updated) : -1L, section.seconds * 1000);
+         text << line;
+      }
+      return text.str();
+   }
+};
@@ -0,0 +1,331 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file loadtest.cpp
+  *
+  * Load test of the proxy with many simulated panels.
+  *
+  *    m5proxy-load [--host 127.0.0.1] [--port 8080] [--panels 1000] [--threads 2]
+  *                 [--seconds 10] [--interval-ms 0]
+  *
+  * Every panel does what the firmware does in a wake: connect, request
+  * "GET /panel", read the Content-Length bytes, check the magic, the
+  * version and the size, and close. With --interval-ms a panel sleeps
+  * that long between its wakes, the first wakes are spread over the
+  * interval. Without it every panel wakes again at once, which measures
+  * the throughput. The latency is counted from the connect to the last
+  * byte. Before the load a few malformed requests check that the proxy
+  * answers them with 400 and keeps running.
+  */
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "ProxyPayload.h"
+
+/* Options of the test */
+struct Options
+{
+   std::string host     = "127.0.0.1";
+   int         port     = 8080;
+   int         panels   = 1000;
+   int         threads  = 2;
+   int         seconds  = 10;
+   int         interval = 0;
+};
+
+/* Results of one thread */
+struct Results
+{
+   std::vector<uint32_t> latencies; //!< Microseconds of the complete wakes
+   unsigned              errors;    //!< Failed wakes
+   uint64_t              bytes;     //!< Received bytes
+};
+
+/* Simulated panel */
+struct Panel
+{
+   int         fd;      //!< Socket of the current wake, -1 while sleeping
+   int64_t     start;   //!< Connect of the wake in us
+   int64_t     wake;    //!< Next wake in us
+   size_t      sent;    //!< Sent bytes of the request
+   std::string in;      //!< Received bytes of the response
+};
+
+static int64_t Now()
+{
+   return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static const std::string request = "GET /panel?v=" + std::to_string(PROXY_VERSION) + " HTTP/1.1\r\nHost: proxy\r\nUser-Agent: ESP32HTTPClient\r\n"
+                                   "Connection: keep-alive\r\n\r\n";
+
+/* Check a complete response, -1 while incomplete, 0 on an error, 1 on success */
+static int Complete(const std::string &in)
+{
+   size_t end = in.find("\r\n\r\n");
+
+   if (end == std::string::npos) {
+      return -1;
+   }
+   if (in.compare(0, 12, "HTTP/1.1 200") != 0) {
+      return 0;
+   }
+   size_t header = in.find("Content-Length: ");
+
+   if (header == std::string::npos || header > end) {
+      return 0;
+   }
+   size_t length = strtoul(in.c_str() + header + 16, NULL, 10);
+
+   if (in.size() < end + 4 + length) {
+      return -1;
+   }
+   ProxyPayload payload;
+
+   if (length != sizeof(payload)) {
+      return 0;
+   }
+   memcpy(&payload, in.data() + end + 4, sizeof(payload));
+   return payload.magic == PROXY_MAGIC && payload.version == PROXY_VERSION && payload.size == sizeof(payload);
+}
+
+/* Requests with a broken request line */
+static const char *malformedRequests[] = { "X\r\n\r\n", "\r\n\r\n", "GET\r\n\r\n", "GET /panel\r\n\r\n",
+                                           "GET panel HTTP/1.1\r\n\r\n", "GET /panel HTTP/2\r\n\r\n", "GET  HTTP/1.1\r\n\r\n" };
+static const int   malformedCount     = sizeof(malformedRequests) / sizeof(malformedRequests[0]);
+
+/* Send the malformed requests one by one, the number of the ones not answered with 400 */
+static int Malformed(const Options &options)
+{
+   struct sockaddr_in address;
+   int                failed = 0;
+
+   memset(&address, 0, sizeof(address));
+   address.sin_family = AF_INET;
+   address.sin_port   = htons(options.port);
+   inet_pton(AF_INET, options.host.c_str(), &address.sin_addr);
+
+   for (const char *request : malformedRequests) {
+      int         fd = socket(AF_INET, SOCK_STREAM, 0);
+      std::string in;
+      char        buffer[1024];
+      ssize_t     length;
+
+      if (connect(fd, (struct sockaddr *) &address, sizeof(address)) == 0 && send(fd, request, strlen(request), MSG_NOSIGNAL) > 0) {
+         while ((length = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+            in.append(buffer, length);
+         }
+      }
+      close(fd);
+      if (in.compare(0, 12, "HTTP/1.1 400") != 0) {
+         fprintf(stderr, "malformed request \"%.*s\" not answered with 400\n", (int) strcspn(request, "\r"), request);
+         failed++;
+      }
+   }
+   return failed;
+}
+
+static void Run(const Options &options, int panels, unsigned seed, Results &results)
+{
+   int                 epoll = epoll_create1(0);
+   std::vector<Panel>  all(panels);
+   struct epoll_event  events[256];
+   struct sockaddr_in  address;
+   std::mt19937        random(seed);
+   int64_t             end = Now() + options.seconds * 1000000LL;
+
+   memset(&address, 0, sizeof(address));
+   address.sin_family = AF_INET;
+   address.sin_port   = htons(options.port);
+   inet_pton(AF_INET, options.host.c_str(), &address.sin_addr);
+
+   for (Panel &panel : all) {
+      panel.fd   = -1;
+      panel.wake = Now() + (options.interval ? random() % (options.interval * 1000LL) : 0);
+   }
+   auto finish = [&](Panel &panel, bool success) {
+      if (success) {
+         results.latencies.push_back((uint32_t) (Now() - panel.start));
+         results.bytes += panel.in.size();
+      } else {
+         results.errors++;
+      }
+      epoll_ctl(epoll, EPOLL_CTL_DEL, panel.fd, NULL);
+      close(panel.fd);
+      panel.fd   = -1;
+      panel.wake = Now() + options.interval * 1000LL;
+   };
+
+   while (Now() < end) {
+      int64_t now = Now();
+
+      for (size_t i = 0; i < all.size(); i++) {
+         Panel &panel = all[i];
+
+         if (panel.fd >= 0 || panel.wake > now) {
+            continue;
+         }
+         struct epoll_event event;
+         int                one = 1;
+
+         panel.fd    = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+         panel.start = now;
+         panel.sent  = 0;
+         panel.in.clear();
+         setsockopt(panel.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+         if (connect(panel.fd, (struct sockaddr *) &address, sizeof(address)) != 0 && errno != EINPROGRESS) {
+            close(panel.fd);
+            panel.fd   = -1;
+            panel.wake = now + 100000; // out of ports, try again later
+            results.errors++;
+            continue;
+         }
+         event.events   = EPOLLOUT | EPOLLIN;
+         event.data.u32 = i;
+         epoll_ctl(epoll, EPOLL_CTL_ADD, panel.fd, &event);
+      }
+
+      int count = epoll_wait(epoll, events, 256, 1);
+
+      for (int e = 0; e < count; e++) {
+         Panel &panel = all[events[e].data.u32];
+
+         if (events[e].events & EPOLLERR) {
+            finish(panel, false);
+            continue;
+         }
+         if ((events[e].events & EPOLLOUT) && panel.sent < request.size()) {
+            ssize_t length = send(panel.fd, request.data() + panel.sent, request.size() - panel.sent, MSG_NOSIGNAL);
+
+            if (length > 0) {
+               panel.sent += length;
+            }
+            if (panel.sent == request.size()) {
+               struct epoll_event event;
+
+               event.events   = EPOLLIN;
+               event.data.u32 = events[e].data.u32;
+               epoll_ctl(epoll, EPOLL_CTL_MOD, panel.fd, &event);
+            }
+         }
+         if (events[e].events & (EPOLLIN | EPOLLHUP)) {
+            char    buffer[4096];
+            ssize_t length;
+
+            while ((length = recv(panel.fd, buffer, sizeof(buffer), 0)) > 0) {
+               panel.in.append(buffer, length);
+            }
+            int state = Complete(panel.in);
+
+            if (state >= 0) {
+               finish(panel, state == 1);
+            } else if (length == 0 || (length < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+               finish(panel, false);
+            }
+         }
+      }
+   }
+   for (Panel &panel : all) {
+      if (panel.fd >= 0) {
+         close(panel.fd);
+      }
+   }
+   close(epoll);
+}
+
+int main(int argc, char **argv)
+{
+   Options options;
+
+   if (argc % 2 == 0) {
+      fprintf(stderr, "usage: %s [--host 127.0.0.1] [--port 8080] [--panels 1000] [--threads 2] [--seconds 10] [--interval-ms 0]\n", argv[0]);
+      return 2;
+   }
+   for (int i = 1; i + 1 < argc; i += 2) {
+      std::string name  = argv[i];
+      std::string value = argv[i + 1];
+
+      if (name == "--host") {
+         options.host = value;
+      } else if (name == "--port") {
+         options.port = atoi(value.c_str());
+      } else if (name == "--panels") {
+         options.panels = atoi(value.c_str());
+      } else if (name == "--threads") {
+         options.threads = std::max(1, atoi(value.c_str()));
+      } else if (name == "--seconds") {
+         options.seconds = atoi(value.c_str());
+      } else if (name == "--interval-ms") {
+         options.interval = atoi(value.c_str());
+      } else {
+         fprintf(stderr, "unknown option %s\n", name.c_str());
+         return 2;
+      }
+   }
+
+   std::vector<Results>     results(options.threads);
+   std::vector<std::thread> threads;
+   int                      malformed = Malformed(options);
+
+   for (int t = 0; t < options.threads; t++) {
+      int panels = options.panels / options.threads + (t < options.panels % options.threads);
+
+      results[t].errors = 0;
+      results[t].bytes  = 0;
+      threads.emplace_back(Run, std::cref(options), panels, (unsigned) t + 1, std::ref(results[t]));
+   }
+   for (std::thread &thread : threads) {
+      thread.join();
+   }
+
+   std::vector<uint32_t> latencies;
+   unsigned              errors = 0;
+   uint64_t              bytes  = 0;
+
+   for (Results &result : results) {
+      latencies.insert(latencies.end(), result.latencies.begin(), result.latencies.end());
+      errors += result.errors;
+      bytes  += result.bytes;
+   }
+   std::sort(latencies.begin(), latencies.end());
+
+   auto percentile = [&](int percent) {
+      return latencies.empty() ? 0.0 : latencies[std::min(latencies.size() - 1, latencies.size() * percent / 100)] / 1000.0;
+   };
+   printf("%d panels, %d threads, %d s, interval %d ms\n", options.panels, options.threads, options.seconds, options.interval);
+   printf("%d of %d malformed requests not answered with 400\n", malformed, malformedCount);
+   printf("%zu wakes, %u errors, %.0f wakes/s, %.1f MB/s\n", latencies.size(), errors,
+      (double) latencies.size() / options.seconds, bytes / 1e6 / options.seconds);
+   printf("latency p50 %.2f ms, p90 %.2f ms, p99 %.2f ms, max %.2f ms\n", percentile(50), percentile(90), percentile(99),
+      latencies.empty() ? 0.0 : latencies.back() / 1000.0);
+   return errors || malformed ? 1 : 0;
+}
@@ -0,0 +1,75 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file main.cpp
+  *
+  * Aggregation proxy of the panels, polls the services and serves one
+  * ProxyPayload per wake.
+  *
+  *    m5proxy proxy.json
+  */
+#include <csignal>
+#include <cstdio>
+#include <curl/curl.h>
+#include "PanelServer.h"
+#include "ProxyConfig.h"
+#include "Upstream.h"
+
+static volatile sig_atomic_t stopped = 0; //!< Set by SIGINT and SIGTERM
+
+static void Stop(int)
+{
+   stopped = 1;
+}
+
+int main(int argc, char **argv)
+{
+   ProxyConfig config;
+
+   if (argc != 2) {
+      fprintf(stderr, "usage: %s proxy.json\n", argv[0]);
+      return 2;
+   }
+   try {
+      config.Load(argv[1]);
+   } catch (const std::exception &error) {
+      fprintf(stderr, "%s\n", error.what());
+      return 1;
+   }
+   setvbuf(stdout, NULL, _IOLBF, 0);
+   signal(SIGINT, Stop);
+   signal(SIGTERM, Stop);
+   curl_global_init(CURL_GLOBAL_DEFAULT);
+
+   Upstream    upstream(config);
+   PanelServer server(upstream, config.port);
+
+   if (!server.Start(config.threads)) {
+      return 1;
+   }
+   upstream.Start();
+   printf("Serving payload version %d (%d bytes) on port %d with %d threads\n", PROXY_VERSION, (int) sizeof(ProxyPayload),
+      config.port, config.threads);
+
+   while (!stopped) {
+      pause();
+   }
+   server.Stop();
+   upstream.Stop();
+   curl_global_cleanup();
+   return 0;
+}
@@ -0,0 +1,279 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Renderer.h
+  *
+  * Frames of the panels drawn on the host with the WeatherDisplay of the
+  * firmware, sent as the changed tiles.
+  */
+#pragma once
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "Upstream.h"
+
+#include <M5EPD.h>
+#include M5_CONFIG
+#include "Data.h"
+#include "Display.h"
+#include "FrameTiles.h"
+#include "History.h"
+#include "ProxyData.h"
+
+#define RENDER_FRAMES  64      //!< Frames whose tile hashes are kept, a panel with an older one gets all tiles
+#define RENDER_HISTORY 0x10000 //!< Size of the history partition of a panel like in partitions.csv
+
+static_assert(FRAME_DX == 960 && FRAME_DY == 540, "The tiles must cover the frame of the WeatherDisplay");
+
+/**
+  * Draws the frame of a panel from the current payload of the Upstream
+  * and the values the panel reports with "GET /frame". The tile hashes
+  * of the recent frames are kept by their frame hash, so the body only
+  * holds the tiles that differ from the frame the panel reports as shown.
+  *
+  * The firmware keeps its state in globals, so one frame is drawn at a
+  * time. Every panel has its own storage with the history partition,
+  * which portStorage points to while its frame is drawn.
+  */
+class Renderer
+{
+protected:
+   /* State of one panel */
+   struct Panel
+   {
+      PortStorage storage; //!< NVS and history partition of the panel
+      uint32_t    frame;   //!< Last frame sent
+      uint32_t    frames;  //!< Frames sent
+      uint32_t    tiles;   //!< Tiles sent
+      uint64_t    bytes;   //!< Body bytes sent
+      time_t      seen;    //!< Time of the last request
+   };
+
+   /* Tile hashes of a sent frame */
+   struct Frame
+   {
+      uint32_t hashes[TILE_COUNT]; //!< Hashes of the tiles
+      uint64_t used;               //!< Render counter of the last use, the least recently used frame is dropped
+   };
+
+   Upstream                    &upstream; //!< Source of the payload
+   std::mutex                   mutex;    //!< Guards everything below and the globals of the firmware
+   std::map<std::string, Panel> panels;   //!< Panels by their id
+   std::map<uint32_t, Frame>    frames;   //!< Recent frames by their hash
+   uint64_t                     renders;  //!< Rendered frames
+   MyData                       data;     //!< Data of the frame that is drawn
+   WeatherDisplay               display;  //!< Draws into the global canvas
+
+   /* Value of the query parameter, the default if it is missing */
+   static std::string Param(const std::string &query, const char *name, const char *value = "")
+   {
+      std::string key = std::string(name) + "=";
+      size_t      pos = 0;
+
+      while (pos < query.size()) {
+         size_t end = query.find('&', pos);
+
+         if (end == std::string::npos) {
+            end = query.size();
+         }
+         if (query.compare(pos, key.size(), key) == 0) {
+            return query.substr(pos + key.size(), end - pos - key.size());
+         }
+         pos = end + 1;
+      }
+      return value;
+   }
+
+   static double Number(const std::string &query, const char *name, double value)
+   {
+      std::string text = Param(query, name);
+
+      return text.empty() ? value : atof(text.c_str());
+   }
+
+   /* Storage of a new panel, erased like a new device */
+   static void Prepare(Panel &panel)
+   {
+      panel.storage.AddPartition(HISTORY_PARTITION, RENDER_HISTORY);
+      panel.frame  = 0;
+      panel.frames = 0;
+      panel.tiles  = 0;
+      panel.bytes  = 0;
+      panel.seen   = 0;
+   }
+
+   /* Fill the data with the payload and the values of the panel, false without weather */
+   bool Fill(const std::string &query)
+   {
+      std::shared_ptr<const ProxyPayload> payload = upstream.Current();
+
+      data = MyData();
+      if (!ProxyFill(*payload, data)) {
+         return false;
+      }
+      data.sht30Temperatur     = (int) Number(query, "temp", 0);
+      data.sht30Humidity       = (int) Number(query, "hum", 0);
+      data.batteryCapacity     = (int) Number(query, "bat", 0);
+      data.batteryVolt         = (float) Number(query, "volt", 0);
+      data.batteryRuntimeHours = (int) Number(query, "runtime", -1);
+      data.batteryDegraded     = Number(query, "degraded", 0) != 0;
+      data.wifiRSSI            = (int) Number(query, "rssi", 0);
+      data.sleepForMinutes     = (int) Number(query, "sleep", 60);
+      return true;
+   }
+
+   /* Append the values of the wake to the history of the panel like recordHistory() of the firmware */
+   void Record(time_t now)
+   {
+      float values[HISTORY_SERIES];
+
+      values[HISTORY_INDOOR_TEMP]     = data.sht30Temperatur;
+      values[HISTORY_INDOOR_HUMIDITY] = data.sht30Humidity;
+      values[HISTORY_OUTDOOR_TEMP]    = data.weather.temp;
+      values[HISTORY_PRESSURE]        = data.weather.pressure;
+      values[HISTORY_BATTERY]         = data.batteryVolt > 0 ? data.batteryVolt : NAN;
+      history = History();
+      history.Begin();
+      history.Append(now, values);
+   }
+
+   /* Remember the tile hashes of the frame, drops the least recently used one */
+   void Remember(uint32_t hash, const uint32_t hashes[TILE_COUNT])
+   {
+      Frame &frame = frames[hash];
+
+      memcpy(frame.hashes, hashes, sizeof(frame.hashes));
+      frame.used = renders;
+      if (frames.size() > RENDER_FRAMES) {
+         auto oldest = frames.begin();
+
+         for (auto it = frames.begin(); it != frames.end(); ++it) {
+            if (it->second.used < oldest->second.used) {
+               oldest = it;
+            }
+         }
+         frames.erase(oldest);
+      }
+   }
+
+public:
+   Renderer(Upstream &u)
+      : upstream(u)
+      , renders(0)
+      , display(data)
+   {
+   }
+
+   /*
+    * Draw the frame of the panel of the query at the time and fill the
+    * body with the tiles that differ from the reported frame, false
+    * without weather.
+    *
+    *    frame?v=1&dev=<id>&frame=<hex hash>&temp=21&hum=45&bat=80&volt=4.05&runtime=120&degraded=0&rssi=-60&sleep=30
+    */
+   bool Render(const std::string &query, time_t now, std::string &body)
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+      uint32_t                    base = strtoul(Param(query, "frame", "0").c_str(), NULL, 16);
+
+      if (Number(query, "v", FRAME_VERSION) != FRAME_VERSION || !Fill(query)) {
+         return false;
+      }
+      Panel &panel = panels[Param(query, "dev", "unknown")];
+
+      if (panel.storage.partitions.empty()) {
+         Prepare(panel);
+      }
+      portStorage = &panel.storage;
+      Record(now);
+      display.Render(now);
+      portStorage = NULL;
+      renders++;
+
+      const uint8_t *frame = (const uint8_t *) canvas.frameBuffer(1);
+      uint32_t       hashes[TILE_COUNT];
+      uint8_t        tile[TILE_BYTES];
+      uint8_t        packed[TILE_BYTES];
+      FrameHeader    header;
+
+      for (int i = 0; i < TILE_COUNT; i++) {
+         TileCopy(frame, i, tile);
+         hashes[i] = TileHash(tile, TILE_BYTES);
+      }
+      auto known = base ? frames.find(base) : frames.end();
+
+      memset(&header, 0, sizeof(header));
+      header.magic    = FRAME_MAGIC;
+      header.version  = FRAME_VERSION;
+      header.size     = sizeof(header);
+      header.frame    = FrameHash(hashes);
+      header.base     = known != frames.end() ? base : 0;
+      header.time     = now;
+      header.flags    = FRAME_WEATHER | (known != frames.end() ? 0 : FRAME_FULL);
+      header.temp     = data.weather.temp;
+      header.pressure = data.weather.pressure;
+      body.assign(sizeof(header), '\0');
+
+      for (int i = 0; i < TILE_COUNT; i++) {
+         if (known != frames.end() && known->second.hashes[i] == hashes[i]) {
+            continue;
+         }
+         TileHeader tileHeader;
+
+         // raw if the runs do not make it shorter
+         TileCopy(frame, i, tile);
+         size_t length = TileEncode(tile, TILE_BYTES, packed, TILE_BYTES - 1);
+
+         tileHeader.index    = i;
+         tileHeader.encoding = length ? TILE_RLE : TILE_RAW;
+         tileHeader.length   = length ? length : TILE_BYTES;
+         body.append((const char *) &tileHeader, sizeof(tileHeader));
+         body.append((const char *) (length ? packed : tile), tileHeader.length);
+         header.tiles++;
+      }
+      header.bytes = body.size() - sizeof(header);
+      memcpy(&body[0], &header, sizeof(header));
+
+      Remember(header.frame, hashes);
+      panel.frame = header.frame;
+      panel.frames++;
+      panel.tiles += header.tiles;
+      panel.bytes += body.size();
+      panel.seen   = now;
+      return true;
+   }
+
+   /* Text of the panels for "GET /frames" */
+   std::string Status()
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+      std::string                 text = std::to_string(renders) + " frames rendered, " + std::to_string(frames.size()) + " kept\n";
+
+      for (const auto &it : panels) {
+         const Panel &panel = it.second;
+         char         line[160];
+
+         snprintf(line, sizeof(line), "panel %s: frame %08x, %u frames, %.1f tiles and %llu bytes per frame, seen %ld s ago\n",
+            it.first.c_str(), panel.frame, panel.frames, panel.frames ? (double) panel.tiles / panel.frames : 0.0,
+            (unsigned long long) (panel.frames ? panel.bytes / panel.frames : 0), (long) (time(NULL) - panel.seen));
+         text += line;
+      }
+      return text;
+   }
+};
@@ -0,0 +1,196 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file main.cpp
+  *
+  * Render server of the panels, the aggregation proxy of host/proxy that
+  * also draws the frames and sends their changed tiles.
+  *
+  *    m5render proxy.json
+  *    m5render proxy.json --simulate 144
+  */
+#include <csignal>
+#include <cstdio>
+#include <cmath>
+#include <vector>
+#include <curl/curl.h>
+#include "PanelServer.h"
+#include "ProxyConfig.h"
+#include "Upstream.h"
+#include "Renderer.h"
+
+static volatile sig_atomic_t stopped = 0; //!< Set by SIGINT and SIGTERM
+
+static void Stop(int)
+{
+   stopped = 1;
+}
+
+/* Apply the tiles of the body to the frame of the panel, false on a broken body */
+static bool Apply(const std::string &body, std::vector<uint8_t> &panel, FrameHeader &header)
+{
+   size_t  pos = sizeof(header);
+   uint8_t tile[TILE_BYTES];
+
+   memcpy(&header, body.data(), sizeof(header));
+   if (body.size() < sizeof(header) || header.magic != FRAME_MAGIC || header.bytes != body.size() - sizeof(header)) {
+      return false;
+   }
+   for (int t = 0; t < header.tiles; t++) {
+      TileHeader tileHeader;
+
+      memcpy(&tileHeader, body.data() + pos, sizeof(tileHeader));
+      pos += sizeof(tileHeader);
+      if (tileHeader.index >= TILE_COUNT || pos + tileHeader.length > body.size()) {
+         return false;
+      }
+      if (tileHeader.encoding == TILE_RLE) {
+         if (!TileDecode((const uint8_t *) body.data() + pos, tileHeader.length, tile, TILE_BYTES)) {
+            return false;
+         }
+      } else if (tileHeader.length == TILE_BYTES) {
+         memcpy(tile, body.data() + pos, TILE_BYTES);
+      } else {
+         return false;
+      }
+      pos += tileHeader.length;
+
+      uint8_t *dst = panel.data() + ((tileHeader.index / TILE_COLUMNS) * TILE_DY * FRAME_DX + (tileHeader.index % TILE_COLUMNS) * TILE_DX) / 2;
+
+      for (int row = 0; row < TILE_DY; row++) {
+         memcpy(dst + row * FRAME_DX / 2, tile + row * TILE_DX / 2, TILE_DX / 2);
+      }
+   }
+   return pos == body.size();
+}
+
+/*
+ * Render the wakes of a panel every 10 minutes with changing indoor
+ * values, check that the tiles rebuild the frame and print the bytes
+ * against the other ways of the panel to get its frame.
+ */
+static int Simulate(Renderer &renderer, Upstream &upstream, int wakes)
+{
+   std::vector<uint8_t> panel(FRAME_DX * FRAME_DY / 2, 0);
+   uint32_t             frame = 0;
+   uint64_t             bytes = 0;
+   uint64_t             tiles = 0;
+   double               ms    = 0;
+   time_t               start = time(NULL) / 600 * 600;
+
+   for (int i = 0; i < 300 && !(upstream.Current()->valid & PROXY_VALID_WEATHER); i++) {
+      usleep(100000);
+   }
+   if (!(upstream.Current()->valid & PROXY_VALID_WEATHER)) {
+      fprintf(stderr, "No weather from the upstream\n");
+      return 1;
+   }
+   for (int wake = 0; wake < wakes; wake++) {
+      time_t      now   = start + wake * 600;
+      char        query[256];
+      std::string body;
+      FrameHeader header;
+
+      snprintf(query, sizeof(query), "v=%d&dev=simulated&frame=%x&temp=%d&hum=%d&bat=%d&volt=%.2f&runtime=%d&degraded=0&rssi=%d&sleep=10",
+         FRAME_VERSION, frame, 21 + (int) lround(2 * sin(wake / 24.0)), 45 + wake / 36 % 3, 90 - wake / 10, 4.1 - wake * 0.001,
+         200 - wake / 6, -60 - (int) (esp_random() % 6));
+
+      auto begin = std::chrono::steady_clock::now();
+
+      if (!renderer.Render(query, now, body)) {
+         fprintf(stderr, "Wake %d: no frame\n", wake);
+         return 1;
+      }
+      double renderMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+
+      if (!Apply(body, panel, header) || memcmp(panel.data(), canvas.frameBuffer(1), panel.size()) != 0) {
+         fprintf(stderr, "Wake %d: the tiles do not rebuild the frame\n", wake);
+         return 1;
+      }
+      printf("wake %3d %s: %3d tiles, %6d bytes, %6.1f ms%s\n", wake, getDateTimeString(timeZone.Local(now)).c_str(),
+         (int) header.tiles, (int) body.size(), renderMs, (header.flags & FRAME_FULL) ? ", all tiles" : "");
+      frame = header.frame;
+      if (wake > 0) {
+         bytes += body.size();
+         tiles += header.tiles;
+         ms    += renderMs;
+      }
+   }
+   if (wakes > 1) {
+      printf("changed frames: %.1f tiles, %.0f bytes and %.1f ms per wake, all tiles rebuilt the frame\n",
+         (double) tiles / (wakes - 1), (double) bytes / (wakes - 1), ms / (wakes - 1));
+   }
+   printf("raw frame %d bytes, proxy payload %d bytes\n", FRAME_DX * FRAME_DY / 2, (int) sizeof(ProxyPayload));
+   return 0;
+}
+
+int main(int argc, char **argv)
+{
+   ProxyConfig config;
+   int         wakes = 0;
+
+   if (argc == 4 && strcmp(argv[2], "--simulate") == 0) {
+      wakes = atoi(argv[3]);
+   } else if (argc != 2) {
+      fprintf(stderr, "usage: %s proxy.json [--simulate wakes]\n", argv[0]);
+      return 2;
+   }
+   try {
+      config.Load(argv[1]);
+   } catch (const std::exception &error) {
+      fprintf(stderr, "%s\n", error.what());
+      return 1;
+   }
+   setvbuf(stdout, NULL, _IOLBF, 0);
+   signal(SIGINT, Stop);
+   signal(SIGTERM, Stop);
+   curl_global_init(CURL_GLOBAL_DEFAULT);
+
+   Upstream    upstream(config);
+   Renderer    renderer(upstream);
+   PanelServer server(upstream, config.port);
+
+   upstream.Start();
+   if (wakes > 0) {
+      int result = Simulate(renderer, upstream, wakes);
+
+      upstream.Stop();
+      curl_global_cleanup();
+      return result;
+   }
+   server.Handle("/frame", "application/octet-stream", [&renderer](const std::string &query, std::string &body) {
+      return renderer.Render(query, time(NULL), body);
+   });
+   server.Handle("/frames", "text/plain", [&renderer](const std::string &, std::string &body) {
+      body = renderer.Status();
+      return true;
+   });
+   if (!server.Start(config.threads)) {
+      upstream.Stop();
+      return 1;
+   }
+   printf("Serving frames version %d and payload version %d on port %d with %d threads\n", FRAME_VERSION, PROXY_VERSION,
+      config.port, config.threads);
+
+   while (!stopped) {
+      pause();
+   }
+   server.Stop();
+   upstream.Stop();
+   curl_global_cleanup();
+   return 0;
+}
@@ -0,0 +1,255 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Arduino.h
+  *
+  * The part of the Arduino core that the drawing of the firmware uses,
+  * on top of the C++ library of the host.
+  */
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <strings.h>
+#include "freertos.h"
+#include "esp_system.h"
+
+using std::min;
+using std::max;
+
+typedef bool    boolean;
+typedef uint8_t byte;
+
+#define PI       3.1415926535897932384626433832795
+#define WHITE    0xFFFF
+#define BLACK    0x0000
+#define TL_DATUM 0
+
+#define F(text)          text
+#define RTC_DATA_ATTR
+#define RTC_NOINIT_ATTR
+#define IRAM_ATTR
+
+template <class T, class L, class H> T constrain(T value, L low, H high)
+{
+   return value < low ? low : (value > high ? high : value);
+}
+
+/* The Arduino String on a std::string, only the members the firmware uses */
+class String : public std::string
+{
+public:
+   String() {}
+   String(const char *text) : std::string(text ? text : "") {}
+   String(const std::string &text) : std::string(text) {}
+   String(char c) : std::string(1, c) {}
+   String(int value) : std::string(std::to_string(value)) {}
+   String(unsigned value) : std::string(std::to_string(value)) {}
+   String(long value) : std::string(std::to_string(value)) {}
+   String(unsigned long value) : std::string(std::to_string(value)) {}
+   String(long long value) : std::string(std::to_string(value)) {}
+   String(unsigned long long value) : std::string(std::to_string(value)) {}
+   String(float value, unsigned decimals = 2) : String((double) value, decimals) {}
+   String(double value, unsigned decimals = 2)
+   {
+      char buffer[64];
+
+      snprintf(buffer, sizeof(buffer), "%.*f", (int) decimals, value);
+      assign(buffer);
+   }
+
+   String substring(size_t from) const           { return from < size() ? String(substr(from)) : String(); }
+   String substring(size_t from, size_t to) const { return from < to && from < size() ? String(substr(from, to - from)) : String(); }
+   int    indexOf(char c, size_t from = 0) const  { size_t pos = find(c, from); return pos == npos ? -1 : (int) pos; }
+   int    indexOf(const char *text, size_t from = 0) const { size_t pos = find(text, from); return pos == npos ? -1 : (int) pos; }
+   bool   startsWith(const char *text) const      { return compare(0, strlen(text), text) == 0; }
+   bool   equals(const char *text) const          { return *this == text; }
+   bool   equalsIgnoreCase(const String &text) const { return strcasecmp(c_str(), text.c_str()) == 0; }
+   long   toInt() const                           { return atol(c_str()); }
+   float  toFloat() const                         { return atof(c_str()); }
+
+   void toCharArray(char *buffer, unsigned size) const
+   {
+      if (size) {
+         strncpy(buffer, c_str(), size - 1);
+         buffer[size - 1] = '\0';
+      }
+   }
+
+   void trim()
+   {
+      size_t first = find_first_not_of(" \t\r\n");
+      size_t last  = find_last_not_of(" \t\r\n");
+
+      assign(first == npos ? std::string() : substr(first, last - first + 1));
+   }
+
+   String &operator+=(const String &text) { append(text); return *this; }
+   String &operator+=(const char *text)   { append(text); return *this; }
+   String &operator+=(char c)             { push_back(c); return *this; }
+   String &operator+=(int value)          { append(std::to_string(value)); return *this; }
+   String &operator+=(unsigned value)     { append(std::to_string(value)); return *this; }
+   String &operator+=(long value)         { append(std::to_string(value)); return *this; }
+};
+
+inline String operator+(const String &a, const String &b)    { return String((const std::string &) a + (const std::string &) b); }
+inline String operator+(const String &a, const char *b)      { return String((const std::string &) a + b); }
+inline String operator+(const char *a, const String &b)      { return String(a + (const std::string &) b); }
+inline String operator+(const String &a, char b)             { return String((const std::string &) a + b); }
+inline String operator+(const String &a, int b)              { return a + String(b); }
+inline String operator+(const String &a, unsigned b)         { return a + String(b); }
+inline String operator+(const String &a, long b)             { return a + String(b); }
+inline String operator+(const String &a, unsigned long b)    { return a + String(b); }
+inline String operator+(const String &a, float b)            { return a + String(b); }
+inline String operator+(const String &a, double b)           { return a + String(b); }
+
+/* Text output like the Print class of the Arduino core */
+class Print
+{
+public:
+   virtual ~Print() {}
+   virtual size_t write(uint8_t c) = 0;
+   virtual size_t write(const uint8_t *data, size_t len)
+   {
+      for (size_t i = 0; i < len; i++) {
+         write(data[i]);
+      }
+      return len;
+   }
+   size_t write(const char *text)               { return write((const uint8_t *) text, strlen(text)); }
+   size_t print(const String &text)             { return write((const uint8_t *) text.c_str(), text.size()); }
+   size_t print(const char *text)               { return write(text); }
+   size_t print(char c)                         { return write((uint8_t) c); }
+   size_t print(int value)                      { return print(String(value)); }
+   size_t print(unsigned value)                 { return print(String(value)); }
+   size_t print(long value)                     { return print(String(value)); }
+   size_t print(unsigned long value)            { return print(String(value)); }
+   size_t print(double value, int decimals = 2) { return print(String(value, decimals)); }
+   size_t println()                             { return write("\n"); }
+   template <class T> size_t println(const T &value) { return print(value) + println(); }
+
+   size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)))
+   {
+      char    buffer[512];
+      va_list args;
+
+      va_start(args, format);
+      vsnprintf(buffer, sizeof(buffer), format, args);
+      va_end(args);
+      return write(buffer);
+   }
+   virtual void flush() {}
+};
+
+/*
+ * The serial output of the firmware goes to the stderr of the host,
+ * only if enabled, the renders of a server would flood the log.
+ */
+class HardwareSerial : public Print
+{
+public:
+   bool enabled = false; //!< Write the output to the stderr
+
+   using Print::write;
+   void   begin(int) {}
+   size_t write(uint8_t c) override
+   {
+      if (enabled) {
+         fputc(c, stderr);
+      }
+      return 1;
+   }
+   void flush() override { fflush(stderr); }
+};
+
+HardwareSerial Serial; //!< Output of the firmware
+
+/* Milliseconds since the start of the program */
+inline uint32_t millis()
+{
+   static auto start = std::chrono::steady_clock::now();
+
+   return (uint32_t) std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+inline void delay(unsigned long ms)
+{
+   std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+inline uint32_t esp_random()
+{
+   static std::mt19937 random(std::random_device{}());
+
+   return random();
+}
+
+/* Byte input like the Stream class of the Arduino core */
+class Stream : public Print
+{
+protected:
+   unsigned long timeout = 1000; //!< Ms readBytes() waits for the next byte
+
+public:
+   virtual int available() = 0;
+   virtual int read() = 0;
+   virtual int peek() = 0;
+
+   void setTimeout(unsigned long ms)
+   {
+      timeout = ms;
+   }
+
+   virtual size_t readBytes(char *data, size_t count)
+   {
+      size_t   copied = 0;
+      uint32_t start  = millis();
+
+      while (copied < count && millis() - start < timeout) {
+         int c = read();
+
+         if (c < 0) {
+            delay(1);
+            continue;
+         }
+         data[copied++] = (char) c;
+         start          = millis();
+      }
+      return copied;
+   }
+   size_t readBytes(uint8_t *data, size_t count)
+   {
+      return readBytes((char *) data, count);
+   }
+};
+
+/* Connection like the Client class of the Arduino core, the host tests connect it themselves */
+class Client : public Stream
+{
+public:
+   using Stream::read;
+   virtual int     read(uint8_t *data, size_t size) = 0;
+   virtual uint8_t connected() = 0;
+   virtual void    stop() = 0;
+};
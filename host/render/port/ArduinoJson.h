@@ -0,0 +1,335 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file ArduinoJson.h
+  *
+  * The part of ArduinoJson 6 that the firmware uses, on top of jsoncpp.
+  */
+#pragma once
+#include <memory>
+#include <set>
+#include <json/json.h>
+#include "Arduino.h"
+
+#define ARDUINOJSON_SLOT 16 //!< Bytes of a value in the memory pool of ArduinoJson on the ESP32
+
+/*
+ * Value in a document. Reading a missing member or element gives a null
+ * value, a writable value, e.g. of a filter, creates them like the
+ * JsonDocument of ArduinoJson. The JsonObject and the JsonArray are
+ * values too.
+ */
+class JsonVariant
+{
+protected:
+   Json::Value *value;    //!< Value in the document, NULL if missing
+   bool         writable; //!< Missing members and elements are created
+
+public:
+   /* Elements of an array */
+   class Iterator
+   {
+   protected:
+      Json::Value      *array; //!< Array of the elements
+      Json::ArrayIndex  index; //!< Current element
+
+   public:
+      Iterator(Json::Value *a, Json::ArrayIndex i) : array(a), index(i) {}
+      JsonVariant operator*() const            { return JsonVariant(&(*array)[index]); }
+      Iterator   &operator++()                 { index++; return *this; }
+      bool        operator!=(const Iterator &o) const { return index != o.index; }
+   };
+
+   JsonVariant(Json::Value *v = NULL, bool w = false)
+      : value(v)
+      , writable(w)
+   {
+   }
+
+   JsonVariant operator[](const char *key) const
+   {
+      if (value && writable) {
+         return JsonVariant(&(*value)[key], true);
+      }
+      return JsonVariant(value && value->isObject() && value->isMember(key) ? &(*value)[key] : NULL);
+   }
+   JsonVariant operator[](const String &key) const
+   {
+      return (*this)[key.c_str()];
+   }
+   JsonVariant operator[](int index) const
+   {
+      if (value && writable) {
+         return JsonVariant(&(*value)[(Json::ArrayIndex) index], true);
+      }
+      return JsonVariant(value && value->isArray() && index < (int) value->size() ? &(*value)[(Json::ArrayIndex) index] : NULL);
+   }
+
+   JsonVariant &operator=(bool v)
+   {
+      if (value) {
+         *value = v;
+      }
+      return *this;
+   }
+
+   template <class T> T as() const;
+
+   size_t size() const
+   {
+      return value && (value->isArray() || value->isObject()) ? value->size() : 0;
+   }
+
+   bool isNull() const
+   {
+      return !value || value->isNull();
+   }
+
+   Iterator begin() const
+   {
+      return Iterator(value, 0);
+   }
+   Iterator end() const
+   {
+      return Iterator(value, value && value->isArray() ? value->size() : 0);
+   }
+};
+
+typedef JsonVariant JsonObject;
+typedef JsonVariant JsonArray;
+
+template <> inline int JsonVariant::as<int>() const
+{
+   return value && value->isNumeric() ? (value->isDouble() ? (int) value->asDouble() : value->asInt()) : 0;
+}
+template <> inline float JsonVariant::as<float>() const
+{
+   return value && value->isNumeric() ? value->asFloat() : 0;
+}
+template <> inline const char *JsonVariant::as<const char *>() const
+{
+   return value && value->isString() ? value->asCString() : NULL;
+}
+template <> inline char *JsonVariant::as<char *>() const
+{
+   return (char *) as<const char *>();
+}
+template <> inline JsonVariant JsonVariant::as<JsonVariant>() const
+{
+   return JsonVariant(value); // read only
+}
+
+/* Document with the memory limit of ArduinoJson */
+class DynamicJsonDocument : public JsonVariant
+{
+protected:
+   std::unique_ptr<Json::Value> root;     //!< Values of the document
+   size_t                       capacity; //!< Bytes of the memory pool
+   size_t                       used;     //!< Bytes ArduinoJson would use for the values
+
+public:
+   DynamicJsonDocument(size_t bytes)
+      : JsonVariant(NULL, true)
+      , root(new Json::Value())
+      , capacity(bytes)
+      , used(0)
+   {
+      value = root.get();
+   }
+
+   void clear()
+   {
+      *root = Json::Value();
+      used  = 0;
+   }
+
+   size_t memoryUsage() const
+   {
+      return used;
+   }
+
+   /* Replace the document, false if ArduinoJson would run out of memory */
+   bool Assign(const Json::Value &parsed)
+   {
+      std::set<std::string> strings; // ArduinoJson stores each copied string once
+
+      used  = Usage(parsed, strings);
+      *root = used <= capacity ? parsed : Json::Value();
+      return used <= capacity;
+   }
+
+   /* Bytes of the value, a slot per member or element and the copied strings */
+   static size_t Usage(const Json::Value &v, std::set<std::string> &strings)
+   {
+      size_t bytes = 0;
+
+      if (v.isString() && strings.insert(v.asString()).second) {
+         bytes += v.asString().size() + 1;
+      }
+      if (v.isObject()) {
+         for (const std::string &key : v.getMemberNames()) {
+            if (strings.insert(key).second) {
+               bytes += key.size() + 1;
+            }
+            bytes += ARDUINOJSON_SLOT + Usage(v[key], strings);
+         }
+      }
+      if (v.isArray()) {
+         for (const Json::Value &element : v) {
+            bytes += ARDUINOJSON_SLOT + Usage(element, strings);
+         }
+      }
+      return bytes;
+   }
+
+   const Json::Value &Root() const
+   {
+      return *root;
+   }
+};
+
+typedef DynamicJsonDocument JsonDocument;
+
+/* Result of the deserialization */
+class DeserializationError
+{
+public:
+   enum Code { Ok, EmptyInput, IncompleteInput, InvalidInput, NoMemory };
+
+protected:
+   Code code; //!< Result
+
+public:
+   DeserializationError(Code c = Ok)
+      : code(c)
+   {
+   }
+
+   explicit operator bool() const
+   {
+      return code != Ok;
+   }
+
+   const char *c_str() const
+   {
+      const char *names[] = { "Ok", "EmptyInput", "IncompleteInput", "InvalidInput", "NoMemory" };
+
+      return names[code];
+   }
+};
+
+namespace DeserializationOption
+{
+   /* Members and elements kept by the deserialization */
+   class Filter
+   {
+   public:
+      const Json::Value &filter; //!< true keeps the whole value
+
+      Filter(const DynamicJsonDocument &doc)
+         : filter(doc.Root())
+      {
+      }
+   };
+}
+
+/* Keep the parts of the value that the filter allows, false if nothing is kept */
+inline bool JsonFilter(Json::Value &v, const Json::Value &filter)
+{
+   if (filter.isBool()) {
+      return filter.asBool();
+   }
+   if (filter.isObject() && v.isObject()) {
+      for (const std::string &key : v.getMemberNames()) {
+         if (!filter.isMember(key) || !JsonFilter(v[key], filter[key])) {
+            v.removeMember(key);
+         }
+      }
+      return true;
+   }
+   if (filter.isArray() && filter.size() && v.isArray()) {
+      for (Json::Value &element : v) {
+         if (!JsonFilter(element, filter[0])) {
+            element = Json::Value();
+         }
+      }
+      return true;
+   }
+   return false;
+}
+
+/* Read one value from the Stream, up to the closing bracket of an object or an array */
+inline DeserializationError deserializeJson(DynamicJsonDocument &doc, Stream &input, const Json::Value *filter = NULL)
+{
+   std::string text;
+   int         depth = 0;
+   bool        quoted = false;
+   int         c;
+
+   doc.clear();
+   while ((c = input.read()) >= 0) {
+      if (text.empty() && isspace(c)) {
+         continue;
+      }
+      text += (char) c;
+      if (quoted) {
+         if (c == '\\' && (c = input.read()) >= 0) {
+            text += (char) c;
+         } else if (c == '"') {
+            quoted = false;
+            if (depth == 0) {
+               break;
+            }
+         }
+      } else if (c == '"') {
+         quoted = true;
+      } else if (c == '{' || c == '[') {
+         depth++;
+      } else if (c == '}' || c == ']') {
+         if (--depth <= 0) {
+            break;
+         }
+      } else if (depth == 0 && (c == ',' || isspace(c))) {
+         text.pop_back(); // the end of a number or a literal, it is read like ArduinoJson does
+         break;
+      }
+   }
+   if (text.empty()) {
+      return DeserializationError::EmptyInput;
+   }
+   if (depth > 0 || quoted) {
+      return DeserializationError::IncompleteInput;
+   }
+
+   Json::CharReaderBuilder             builder;
+   std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+   Json::Value                         parsed;
+   std::string                         errors;
+
+   if (!reader->parse(text.data(), text.data() + text.size(), &parsed, &errors)) {
+      return DeserializationError::InvalidInput;
+   }
+   if (filter && !JsonFilter(parsed, *filter)) {
+      parsed = Json::Value();
+   }
+   return doc.Assign(parsed) ? DeserializationError::Ok : DeserializationError::NoMemory;
+}
+
+inline DeserializationError deserializeJson(DynamicJsonDocument &doc, Stream &input, DeserializationOption::Filter filter)
+{
+   return deserializeJson(doc, input, &filter.filter);
+}
@@ -0,0 +1,180 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file HTTPClient.h
+  *
+  * The GET requests of the HTTPClient of the ESP32 core, over a connected
+  * WiFiClient of the host tests.
+  */
+#pragma once
+#include <vector>
+#include "WiFi.h"
+
+#define HTTP_CODE_OK                200
+#define HTTPC_ERROR_CONNECTION_LOST -5
+#define HTTPC_ERROR_READ_TIMEOUT    -11
+#define HTTPC_TIMEOUT               5000 //!< Ms of the response header
+
+/* HTTP/1.1 GET requests with kept connections */
+class HTTPClient
+{
+protected:
+   WiFiClient          *client;   //!< Connection of the requests
+   String               host;     //!< Host header
+   uint16_t             port;     //!< Port of a new connection
+   String               uri;      //!< Path of the request
+   bool                 reuse;    //!< Keep the connection after the response
+   bool                 canReuse; //!< The server keeps the connection
+   int                  size;     //!< Content-Length, -1 without
+   std::vector<String>  keys;     //!< Names of the collected headers
+   std::vector<String>  values;   //!< Values of the collected headers of the last response
+
+   /* Line of the response header without the CRLF, false after the timeout */
+   bool ReadLine(String &line)
+   {
+      uint32_t start = millis();
+
+      line = "";
+      while (millis() - start < HTTPC_TIMEOUT) {
+         int c = client->read();
+
+         if (c < 0) {
+            if (!client->connected()) {
+               return false;
+            }
+            delay(1);
+         } else if (c == '\n') {
+            return true;
+         } else if (c != '\r') {
+            line += (char) c;
+         }
+      }
+      return false;
+   }
+
+public:
+   HTTPClient()
+      : client(NULL)
+      , port(0)
+      , reuse(true)
+      , canReuse(false)
+      , size(-1)
+   {
+   }
+
+   void setReuse(bool r)
+   {
+      reuse = r;
+   }
+
+   void collectHeaders(const char *names[], size_t count)
+   {
+      keys.assign(names, names + count);
+      values.assign(count, String());
+   }
+
+   bool begin(WiFiClient &c, const String &h, uint16_t p, const String &u, bool https)
+   {
+      client = &c;
+      host   = h;
+      port   = p;
+      uri    = u;
+      return true;
+   }
+
+   bool setURL(const String &u)
+   {
+      uri = u;
+      return true;
+   }
+
+   /* Send the request and read the response header, the body is left in the connection */
+   int GET()
+   {
+      String line;
+
+      if (!client->connected() && !client->connect(host.c_str(), port)) {
+         return HTTPC_ERROR_CONNECTION_LOST;
+      }
+      while (client->available()) {
+         client->read(); // the rest of the last response
+      }
+      String request = "GET " + uri + " HTTP/1.1\r\nHost: " + host + "\r\nUser-Agent: ESP32HTTPClient\r\nConnection: "
+         + (reuse ? "keep-alive" : "close") + "\r\nAccept-Encoding: identity;q=1,chunked;q=0.1,*;q=0\r\n\r\n";
+
+      client->write((const uint8_t *) request.c_str(), request.length());
+      if (!ReadLine(line) || line.compare(0, 5, "HTTP/") != 0 || line.length() < 12) {
+         return HTTPC_ERROR_READ_TIMEOUT;
+      }
+      int code = atoi(line.c_str() + 9);
+
+      size     = -1;
+      canReuse = reuse;
+      values.assign(keys.size(), String());
+      while (ReadLine(line) && line.length()) {
+         int    colon = line.indexOf(':');
+         String name  = line.substring(0, colon);
+         String value = line.substring(colon + 1);
+
+         value.trim();
+         if (strcasecmp(name.c_str(), "Content-Length") == 0) {
+            size = value.toInt();
+         } else if (strcasecmp(name.c_str(), "Connection") == 0 && value.indexOf("close") >= 0) {
+            canReuse = false;
+         }
+         for (size_t k = 0; k < keys.size(); k++) {
+            if (strcasecmp(name.c_str(), keys[k].c_str()) == 0) {
+               values[k] = value;
+            }
+         }
+      }
+      return code;
+   }
+
+   int getSize()
+   {
+      return size;
+   }
+
+   String header(const char *name)
+   {
+      for (size_t k = 0; k < keys.size(); k++) {
+         if (strcasecmp(name, keys[k].c_str()) == 0) {
+            return values[k];
+         }
+      }
+      return String();
+   }
+
+   WiFiClient *getStreamPtr()
+   {
+      return client && client->connected() ? client : NULL;
+   }
+
+   /* Keep the connection for the next request if possible */
+   void end()
+   {
+      if (client && !(reuse && canReuse)) {
+         client->stop();
+      }
+   }
+
+   static String errorToString(int code)
+   {
+      return code == HTTPC_ERROR_CONNECTION_LOST ? "connection lost" : "read Timeout";
+   }
+};
@@ -0,0 +1,364 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file M5EPD.h
+  *
+  * The canvas of the M5EPD library on the host, it rasterizes like the
+  * library into the same 4 bit frame buffer, two pixels per byte with
+  * the left one in the high nibble, 0 is white and 15 black. The e-paper
+  * and the RTC are stand-ins without a panel.
+  */
+#pragma once
+#include <cstdlib>
+#include <cstring>
+#include "Arduino.h"
+#include "Font5x7.h"
+
+typedef enum
+{
+   UPDATE_MODE_INIT  = 0,
+   UPDATE_MODE_DU    = 1,
+   UPDATE_MODE_GC16  = 2,
+   UPDATE_MODE_GL16  = 3,
+   UPDATE_MODE_GLR16 = 4,
+   UPDATE_MODE_GLD16 = 5,
+   UPDATE_MODE_DU4   = 6,
+   UPDATE_MODE_A2    = 7,
+   UPDATE_MODE_NONE  = 8
+} m5epd_update_mode_t;
+
+/* E-paper without a panel, the renderer only needs the canvas */
+class M5EPD_Driver
+{
+public:
+   void SetRotation(int) {}
+   void Clear(bool) {}
+   void CheckAFSR() {}
+   void UpdateFull(m5epd_update_mode_t) {}
+   void UpdateArea(uint16_t, uint16_t, uint16_t, uint16_t, m5epd_update_mode_t) {}
+   void WritePartGram4bpp(uint16_t, uint16_t, uint16_t, uint16_t, const uint8_t *) {}
+};
+
+/* Canvas with the drawing functions of the M5EPD_Canvas that the firmware uses */
+class M5EPD_Canvas
+{
+protected:
+   int16_t  dx;          //!< Width
+   int16_t  dy;          //!< Height
+   uint8_t *buffer;      //!< 4 bit pixels, NULL before createCanvas()
+   uint8_t  textSize;    //!< Scale of the 6x8 cells of the font
+   uint8_t  textColor;   //!< Gray level of the text
+   uint8_t  textBgColor; //!< Gray level of the cell background, the same as the text is transparent
+   uint8_t  textDatum;   //!< Reference point of drawString(), TL_DATUM is top left
+
+   void Fill(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color)
+   {
+      for (int32_t yi = max(y, (int32_t) 0); yi < min(y + h, (int32_t) dy); yi++) {
+         for (int32_t xi = max(x, (int32_t) 0); xi < min(x + w, (int32_t) dx); xi++) {
+            drawPixel(xi, yi, color);
+         }
+      }
+   }
+
+   /* Midpoint circle, the outline or the filled disc */
+   void Circle(int32_t x0, int32_t y0, int32_t r, uint32_t color, bool fill)
+   {
+      int32_t f  = 1 - r;
+      int32_t fx = 1;
+      int32_t fy = -2 * r;
+      int32_t x  = 0;
+      int32_t y  = r;
+
+      if (fill) {
+         drawFastHLine(x0 - r, y0, 2 * r + 1, color);
+      } else {
+         drawPixel(x0, y0 + r, color);
+         drawPixel(x0, y0 - r, color);
+         drawPixel(x0 + r, y0, color);
+         drawPixel(x0 - r, y0, color);
+      }
+      while (x < y) {
+         if (f >= 0) {
+            y--;
+            fy += 2;
+            f  += fy;
+         }
+         x++;
+         fx += 2;
+         f  += fx;
+         if (fill) {
+            drawFastHLine(x0 - x, y0 + y, 2 * x + 1, color);
+            drawFastHLine(x0 - x, y0 - y, 2 * x + 1, color);
+            drawFastHLine(x0 - y, y0 + x, 2 * y + 1, color);
+            drawFastHLine(x0 - y, y0 - x, 2 * y + 1, color);
+         } else {
+            drawPixel(x0 + x, y0 + y, color);
+            drawPixel(x0 - x, y0 + y, color);
+            drawPixel(x0 + x, y0 - y, color);
+            drawPixel(x0 - x, y0 - y, color);
+            drawPixel(x0 + y, y0 + x, color);
+            drawPixel(x0 - y, y0 + x, color);
+            drawPixel(x0 + y, y0 - x, color);
+            drawPixel(x0 - y, y0 - x, color);
+         }
+      }
+   }
+
+   void DrawChar(int32_t x, int32_t y, char c)
+   {
+      int index = (c < FONT_FIRST || c > FONT_LAST ? '?' : c) - FONT_FIRST;
+
+      for (int column = 0; column < 6; column++) {
+         uint8_t bits = column < 5 ? font5x7[index * 5 + column] : 0;
+
+         for (int row = 0; row < 8; row++) {
+            if (bits & (1 << row)) {
+               Fill(x + column * textSize, y + row * textSize, textSize, textSize, textColor);
+            } else if (textBgColor != textColor) {
+               Fill(x + column * textSize, y + row * textSize, textSize, textSize, textBgColor);
+            }
+         }
+      }
+   }
+
+public:
+   enum { G0, G1, G2, G3, G4, G5, G6, G7, G8, G9, G10, G11, G12, G13, G14, G15 };
+
+   M5EPD_Canvas(M5EPD_Driver *)
+      : dx(0)
+      , dy(0)
+      , buffer(NULL)
+      , textSize(1)
+      , textColor(15)
+      , textBgColor(15)
+      , textDatum(TL_DATUM)
+   {
+   }
+
+   ~M5EPD_Canvas()
+   {
+      deleteCanvas();
+   }
+
+   /* Allocate the white canvas, a created canvas stays as it is like in the library */
+   void *createCanvas(uint16_t w, uint16_t h)
+   {
+      if (!buffer) {
+         dx     = w;
+         dy     = h;
+         buffer = (uint8_t *) calloc((w * h + 1) / 2, 1);
+      }
+      return buffer;
+   }
+
+   void deleteCanvas()
+   {
+      free(buffer);
+      buffer = NULL;
+      dx     = 0;
+      dy     = 0;
+   }
+
+   void   *frameBuffer(int = 1) { return buffer; }
+   int16_t width()              { return dx; }
+   int16_t height()             { return dy; }
+
+   void pushCanvas(int32_t, int32_t, m5epd_update_mode_t) {}
+   void pushCanvas(m5epd_update_mode_t) {}
+
+   void fillCanvas(uint32_t color)
+   {
+      memset(buffer, (color & 0x0F) * 0x11, (dx * dy + 1) / 2);
+   }
+
+   void drawPixel(int32_t x, int32_t y, uint32_t color)
+   {
+      if (!buffer || x < 0 || y < 0 || x >= dx || y >= dy) {
+         return;
+      }
+      uint8_t &pixels = buffer[(y * dx + x) / 2];
+
+      pixels = x & 1 ? (pixels & 0xF0) | (color & 0x0F) : (pixels & 0x0F) | (color & 0x0F) << 4;
+   }
+
+   uint16_t readPixel(int32_t x, int32_t y)
+   {
+      if (!buffer || x < 0 || y < 0 || x >= dx || y >= dy) {
+         return 0;
+      }
+      uint8_t pixels = buffer[(y * dx + x) / 2];
+
+      return x & 1 ? pixels & 0x0F : pixels >> 4;
+   }
+
+   void drawFastHLine(int32_t x, int32_t y, int32_t w, uint32_t color) { Fill(x, y, w, 1, color); }
+   void drawFastVLine(int32_t x, int32_t y, int32_t h, uint32_t color) { Fill(x, y, 1, h, color); }
+   void fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color) { Fill(x, y, w, h, color); }
+
+   void drawRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color)
+   {
+      drawFastHLine(x, y, w, color);
+      drawFastHLine(x, y + h - 1, w, color);
+      drawFastVLine(x, y, h, color);
+      drawFastVLine(x + w - 1, y, h, color);
+   }
+
+   /* Bresenham line */
+   void drawLine(int32_t x0, int32_t y0, int32_t x1, int32_t y1, uint32_t color)
+   {
+      int32_t sx    = x0 < x1 ? 1 : -1;
+      int32_t sy    = y0 < y1 ? 1 : -1;
+      int32_t ddx   = abs(x1 - x0);
+      int32_t ddy   = -abs(y1 - y0);
+      int32_t error = ddx + ddy;
+
+      for (;;) {
+         drawPixel(x0, y0, color);
+         if (x0 == x1 && y0 == y1) {
+            break;
+         }
+         int32_t e2 = 2 * error;
+
+         if (e2 >= ddy) {
+            error += ddy;
+            x0    += sx;
+         }
+         if (e2 <= ddx) {
+            error += ddx;
+            y0    += sy;
+         }
+      }
+   }
+
+   void drawCircle(int32_t x0, int32_t y0, int32_t r, uint32_t color)
+   {
+      Circle(x0, y0, r, color, false);
+   }
+
+   void fillCircle(int32_t x0, int32_t y0, int32_t r, uint32_t color)
+   {
+      Circle(x0, y0, r, color, true);
+   }
+
+   void setTextSize(uint8_t size)                  { textSize = max((uint8_t) 1, size); }
+   void setTextColor(uint16_t color)               { textColor = color & 0x0F; textBgColor = textColor; }
+   void setTextColor(uint16_t color, uint16_t bg)  { textColor = color & 0x0F; textBgColor = bg & 0x0F; }
+   void setTextDatum(uint8_t datum)                { textDatum = datum; }
+
+   int16_t textWidth(const String &text)
+   {
+      return text.length() * 6 * textSize;
+   }
+
+   /* Draw the text with font 1 at the datum, the width is returned */
+   int16_t drawString(const String &text, int32_t x, int32_t y, uint8_t = 1)
+   {
+      int16_t width = textWidth(text);
+
+      x -= (textDatum % 3) * width / 2;
+      y -= (textDatum / 3) * 8 * textSize / 2;
+      for (size_t i = 0; i < text.length(); i++) {
+         DrawChar(x + i * 6 * textSize, y, text[i]);
+      }
+      return width;
+   }
+
+   int16_t drawCentreString(const String &text, int32_t x, int32_t y, uint8_t font)
+   {
+      uint8_t datum = textDatum;
+
+      textDatum = TL_DATUM;
+      x -= textWidth(text) / 2;
+      int16_t width = drawString(text, x, y, font);
+      textDatum = datum;
+      return width;
+   }
+
+   int16_t drawRightString(const String &text, int32_t x, int32_t y, uint8_t font)
+   {
+      uint8_t datum = textDatum;
+
+      textDatum = TL_DATUM;
+      x -= textWidth(text);
+      int16_t width = drawString(text, x, y, font);
+      textDatum = datum;
+      return width;
+   }
+};
+
+typedef struct
+{
+   int8_t hour;
+   int8_t min;
+   int8_t sec;
+} rtc_time_t;
+
+typedef struct
+{
+   int8_t  week;
+   int8_t  mon;
+   int8_t  day;
+   int16_t year;
+} rtc_date_t;
+
+/* RTC on the UTC of the host */
+class PortRTC
+{
+public:
+   void begin() {}
+   void getTime(rtc_time_t *time)
+   {
+      time_t    now = ::time(NULL);
+      struct tm fields;
+
+      gmtime_r(&now, &fields);
+      time->hour = fields.tm_hour;
+      time->min  = fields.tm_min;
+      time->sec  = fields.tm_sec;
+   }
+   void getDate(rtc_date_t *date)
+   {
+      time_t    now = ::time(NULL);
+      struct tm fields;
+
+      gmtime_r(&now, &fields);
+      date->week = fields.tm_wday;
+      date->mon  = fields.tm_mon + 1;
+      date->day  = fields.tm_mday;
+      date->year = fields.tm_year + 1900;
+   }
+   void setTime(rtc_time_t *) {}
+   void setDate(rtc_date_t *) {}
+};
+
+/* The M5 object of the library with the parts the drawing uses */
+class M5EPD
+{
+public:
+   M5EPD_Driver EPD;            //!< E-paper without a panel
+   PortRTC      RTC;            //!< Clock of the host
+   uint32_t     batteryVoltage; //!< Voltage in mV of the next reading, set by the host tests
+
+   M5EPD()
+      : batteryVoltage(4200)
+   {
+   }
+
+   uint32_t getBatteryVoltage() { return batteryVoltage; }
+};
+
+M5EPD M5; //!< The M5Paper of the host
@@ -0,0 +1,62 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file PortStorage.h
+  *
+  * Non volatile memory and flash partitions of one panel in the memory
+  * of the host.
+  */
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+/* Flash partition with its content, erased bytes are 0xff */
+struct PortPartition
+{
+   uint32_t             address;  //!< Always 0
+   uint32_t             size;     //!< Bytes of the partition
+   char                 label[17];//!< Name in partitions.csv
+   std::vector<uint8_t> data;     //!< Content
+};
+
+/**
+  * The state that the firmware keeps in the NVS and the partitions, e.g.
+  * the history of the measured values. The renderer keeps one storage
+  * per panel and points portStorage to it while it draws the frame of
+  * the panel, so every panel has its own history as on the device.
+  */
+struct PortStorage
+{
+   std::map<std::string, std::vector<uint8_t>> nvs;        //!< Blobs by "namespace/key"
+   std::map<std::string, PortPartition>         partitions; //!< Partitions by label
+
+   /* Add an erased partition */
+   void AddPartition(const char *label, uint32_t size)
+   {
+      PortPartition &partition = partitions[label];
+
+      partition.address = 0;
+      partition.size    = size;
+      snprintf(partition.label, sizeof(partition.label), "%s", label);
+      partition.data.assign(size, 0xff);
+   }
+};
+
+PortStorage *portStorage = NULL; //!< Storage of the panel that is drawn, NULL fails all accesses
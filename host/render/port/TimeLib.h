@@ -0,0 +1,84 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file TimeLib.h
+  *
+  * The calendar functions of the Time library, like the library they
+  * treat the time_t as plain seconds without a timezone.
+  */
+#pragma once
+#include <cstdint>
+#include <ctime>
+
+#define SECS_PER_MIN  ((time_t) 60UL)
+#define SECS_PER_HOUR ((time_t) 3600UL)
+#define SECS_PER_DAY  ((time_t) 86400UL)
+#define SECS_PER_WEEK ((time_t) (SECS_PER_DAY * 7))
+
+/* Calendar fields, the Year counts from 1970 */
+typedef struct
+{
+   uint8_t Second;
+   uint8_t Minute;
+   uint8_t Hour;
+   uint8_t Wday;   //!< Day of the week, 1 is sunday
+   uint8_t Day;
+   uint8_t Month;
+   uint8_t Year;
+} tmElements_t;
+
+inline struct tm PortBreak(time_t time)
+{
+   struct tm fields;
+
+   gmtime_r(&time, &fields);
+   return fields;
+}
+
+inline int year(time_t time)    { return PortBreak(time).tm_year + 1900; }
+inline int month(time_t time)   { return PortBreak(time).tm_mon + 1; }
+inline int day(time_t time)     { return PortBreak(time).tm_mday; }
+inline int hour(time_t time)    { return PortBreak(time).tm_hour; }
+inline int minute(time_t time)  { return PortBreak(time).tm_min; }
+inline int second(time_t time)  { return PortBreak(time).tm_sec; }
+inline int weekday(time_t time) { return PortBreak(time).tm_wday + 1; }
+
+inline void breakTime(time_t time, tmElements_t &elements)
+{
+   struct tm fields = PortBreak(time);
+
+   elements.Second = fields.tm_sec;
+   elements.Minute = fields.tm_min;
+   elements.Hour   = fields.tm_hour;
+   elements.Wday   = fields.tm_wday + 1;
+   elements.Day    = fields.tm_mday;
+   elements.Month  = fields.tm_mon + 1;
+   elements.Year   = fields.tm_year - 70;
+}
+
+inline time_t makeTime(const tmElements_t &elements)
+{
+   struct tm fields = {};
+
+   fields.tm_sec  = elements.Second;
+   fields.tm_min  = elements.Minute;
+   fields.tm_hour = elements.Hour;
+   fields.tm_mday = elements.Day;
+   fields.tm_mon  = elements.Month - 1;
+   fields.tm_year = elements.Year + 70;
+   return timegm(&fields);
+}
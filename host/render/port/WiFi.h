@@ -0,0 +1,169 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file WiFi.h
+  *
+  * The WiFi of the host tests, the name resolution and the TCP client
+  * on the sockets of the host.
+  */
+#pragma once
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "Arduino.h"
+
+/* IPv4 address */
+class IPAddress
+{
+public:
+   uint32_t address; //!< Address in the network byte order
+
+   IPAddress(uint32_t a = 0)
+      : address(a)
+   {
+   }
+};
+
+/* Name resolution of the WiFi class */
+class WiFiClass
+{
+public:
+   int hostByName(const char *host, IPAddress &ip)
+   {
+      addrinfo  hints = {};
+      addrinfo *result;
+
+      hints.ai_family   = AF_INET;
+      hints.ai_socktype = SOCK_STREAM;
+      if (getaddrinfo(host, NULL, &hints, &result) != 0) {
+         return 0;
+      }
+      ip = IPAddress(((sockaddr_in *) result->ai_addr)->sin_addr.s_addr);
+      freeaddrinfo(result);
+      return 1;
+   }
+};
+
+WiFiClass WiFi; //!< The network of the host
+
+/* TCP connection on a socket of the host */
+class WiFiClient : public Client
+{
+protected:
+   int fd; //!< Socket, -1 if not connected
+
+public:
+   WiFiClient()
+      : fd(-1)
+   {
+   }
+
+   WiFiClient(const WiFiClient &) = delete;
+
+   virtual ~WiFiClient()
+   {
+      stop();
+   }
+
+   virtual int connect(IPAddress ip, uint16_t port)
+   {
+      sockaddr_in address = {};
+      int         on      = 1;
+
+      stop();
+      address.sin_family      = AF_INET;
+      address.sin_port        = htons(port);
+      address.sin_addr.s_addr = ip.address;
+      fd = socket(AF_INET, SOCK_STREAM, 0);
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+      if (::connect(fd, (sockaddr *) &address, sizeof(address)) != 0) {
+         stop();
+         return 0;
+      }
+      return 1;
+   }
+
+   virtual int connect(const char *host, uint16_t port)
+   {
+      IPAddress ip;
+
+      return WiFi.hostByName(host, ip) ? connect(ip, port) : 0;
+   }
+
+   int available() override
+   {
+      int count = 0;
+
+      return fd >= 0 && ioctl(fd, FIONREAD, &count) == 0 ? count : 0;
+   }
+
+   int read() override
+   {
+      uint8_t c;
+
+      return read(&c, 1) == 1 ? c : -1;
+   }
+
+   int read(uint8_t *data, size_t size) override
+   {
+      if (!available()) {
+         return -1;
+      }
+      ssize_t count = recv(fd, data, size, MSG_DONTWAIT);
+
+      return count > 0 ? (int) count : -1;
+   }
+
+   int peek() override
+   {
+      uint8_t c;
+
+      return available() && recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) == 1 ? c : -1;
+   }
+
+   using Print::write;
+   size_t write(uint8_t c) override
+   {
+      return write(&c, 1);
+   }
+   size_t write(const uint8_t *data, size_t size) override
+   {
+      return fd >= 0 && send(fd, data, size, MSG_NOSIGNAL) == (ssize_t) size ? size : 0;
+   }
+
+   /* Open until the peer closed and all its data is read */
+   uint8_t connected() override
+   {
+      uint8_t c;
+
+      if (fd < 0) {
+         return 0;
+      }
+      return available() || recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) != 0;
+   }
+
+   void stop() override
+   {
+      if (fd >= 0) {
+         close(fd);
+         fd = -1;
+      }
+   }
+};
@@ -0,0 +1,47 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file WiFiClientSecure.h
+  *
+  * The host tests talk to local servers, there is no TLS.
+  */
+#pragma once
+#include "WiFi.h"
+
+/* TLS connection, connecting always fails on the host */
+class WiFiClientSecure : public WiFiClient
+{
+public:
+   void setInsecure()
+   {
+   }
+
+   int connect(IPAddress ip, uint16_t port) override
+   {
+      return 0;
+   }
+
+   int connect(const char *host, uint16_t port) override
+   {
+      return 0;
+   }
+
+   int connect(IPAddress ip, uint16_t port, const char *host, const char *caCert, const char *cert, const char *privateKey)
+   {
+      return 0;
+   }
+};
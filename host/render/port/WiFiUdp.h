@@ -0,0 +1,36 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file WiFiUdp.h
+  *
+  * The renderer has no WiFi, the SNTP request of the clock always fails.
+  */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+class WiFiUDP
+{
+public:
+   uint8_t begin(uint16_t)                       { return 0; }
+   int     beginPacket(const char *, uint16_t)   { return 0; }
+   size_t  write(const uint8_t *, size_t)        { return 0; }
+   int     endPacket()                           { return 0; }
+   int     parsePacket()                         { return 0; }
+   int     read(uint8_t *, size_t)               { return 0; }
+   void    stop()                                {}
+};
@@ -0,0 +1,37 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file esp_heap_caps.h
+  *
+  * Heap capabilities of the ESP-IDF, the host reports no heap at all.
+  */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+#define MALLOC_CAP_8BIT     0x0004
+#define MALLOC_CAP_SPIRAM   0x0400
+#define MALLOC_CAP_INTERNAL 0x0800
+#define MALLOC_CAP_DEFAULT  0x1000
+
+inline size_t heap_caps_get_free_size(uint32_t)          { return 0; }
+inline size_t heap_caps_get_total_size(uint32_t)         { return 0; }
+inline size_t heap_caps_get_largest_free_block(uint32_t) { return 0; }
+inline size_t heap_caps_get_minimum_free_size(uint32_t)  { return 0; }
+inline void  *heap_caps_malloc(size_t size, uint32_t)    { return malloc(size); }
+inline void  *ps_malloc(size_t size)                     { return malloc(size); }
@@ -0,0 +1,80 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file esp_partition.h
+  *
+  * Flash partitions of the ESP-IDF in the PortStorage of the current panel.
+  */
+#pragma once
+#include <cstring>
+#include "esp_system.h"
+#include "PortStorage.h"
+
+typedef PortPartition esp_partition_t;
+
+typedef enum
+{
+   ESP_PARTITION_TYPE_APP  = 0x00,
+   ESP_PARTITION_TYPE_DATA = 0x01
+} esp_partition_type_t;
+
+typedef enum
+{
+   ESP_PARTITION_SUBTYPE_ANY = 0xff
+} esp_partition_subtype_t;
+
+inline const esp_partition_t *esp_partition_find_first(esp_partition_type_t, esp_partition_subtype_t, const char *label)
+{
+   if (!portStorage || !label) {
+      return NULL;
+   }
+   auto it = portStorage->partitions.find(label);
+
+   return it == portStorage->partitions.end() ? NULL : &it->second;
+}
+
+inline esp_err_t esp_partition_read(const esp_partition_t *partition, size_t offset, void *data, size_t len)
+{
+   if (!partition || offset + len > partition->size) {
+      return ESP_FAIL;
+   }
+   memcpy(data, partition->data.data() + offset, len);
+   return ESP_OK;
+}
+
+/* Like the NOR flash a write only clears bits, the erase sets them again */
+inline esp_err_t esp_partition_write(const esp_partition_t *partition, size_t offset, const void *data, size_t len)
+{
+   if (!partition || offset + len > partition->size) {
+      return ESP_FAIL;
+   }
+   uint8_t *dst = const_cast<uint8_t *>(partition->data.data()) + offset;
+
+   for (size_t i = 0; i < len; i++) {
+      dst[i] &= ((const uint8_t *) data)[i];
+   }
+   return ESP_OK;
+}
+
+inline esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t len)
+{
+   if (!partition || offset + len > partition->size || offset % 4096 || len % 4096) {
+      return ESP_FAIL;
+   }
+   memset(const_cast<uint8_t *>(partition->data.data()) + offset, 0xff, len);
+   return ESP_OK;
+}
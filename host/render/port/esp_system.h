@@ -0,0 +1,64 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file esp_system.h
+  *
+  * The system functions of the ESP-IDF that the drawing of the firmware
+  * uses, the host has no reset reasons and no heap limits.
+  */
+#pragma once
+#include <cstdint>
+
+typedef int esp_err_t;
+
+#define ESP_OK                0
+#define ESP_FAIL              -1
+#define ESP_ERR_NVS_NOT_FOUND 0x1102
+#define ESP_ERR_NVS_INVALID_LENGTH 0x110c
+
+typedef enum
+{
+   ESP_RST_UNKNOWN,
+   ESP_RST_POWERON,
+   ESP_RST_EXT,
+   ESP_RST_SW,
+   ESP_RST_PANIC,
+   ESP_RST_INT_WDT,
+   ESP_RST_TASK_WDT,
+   ESP_RST_WDT,
+   ESP_RST_DEEPSLEEP,
+   ESP_RST_BROWNOUT,
+   ESP_RST_SDIO
+} esp_reset_reason_t;
+
+inline esp_reset_reason_t esp_reset_reason()
+{
+   return ESP_RST_POWERON;
+}
+
+/* The ESP object of the Arduino core */
+struct EspClass
+{
+   uint32_t getFreeHeap()    { return 0; }
+   uint32_t getMinFreeHeap() { return 0; }
+   uint32_t getMaxAllocHeap(){ return 0; }
+   uint32_t getHeapSize()    { return 0; }
+   uint32_t getFreePsram()   { return 0; }
+   uint32_t getPsramSize()   { return 0; }
+};
+
+EspClass ESP; //!< System of the host
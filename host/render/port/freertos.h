@@ -0,0 +1,192 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file freertos.h
+  *
+  * The tasks, semaphores and critical sections of FreeRTOS that the
+  * drawing of the firmware uses, on top of the threads of the host.
+  */
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+typedef int      BaseType_t;
+typedef unsigned UBaseType_t;
+typedef uint32_t TickType_t;
+typedef void    *TaskHandle_t;
+
+#define pdTRUE            1
+#define pdFALSE           0
+#define pdPASS            1
+#define portMAX_DELAY     0xffffffffu
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t) (ms))
+
+/* Counting semaphore, also used as the mutex */
+struct PortSemaphore
+{
+   std::mutex              mutex;     //!< Protects the count
+   std::condition_variable available; //!< Signaled by every give
+   unsigned                count;     //!< Available takes
+   unsigned                limit;     //!< Max count
+};
+
+typedef PortSemaphore *SemaphoreHandle_t;
+
+inline SemaphoreHandle_t xSemaphoreCreateCounting(unsigned limit, unsigned initial)
+{
+   SemaphoreHandle_t semaphore = new PortSemaphore;
+
+   semaphore->count = initial;
+   semaphore->limit = limit;
+   return semaphore;
+}
+
+inline SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+   return xSemaphoreCreateCounting(1, 1);
+}
+
+inline SemaphoreHandle_t xSemaphoreCreateBinary()
+{
+   return xSemaphoreCreateCounting(1, 0);
+}
+
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks)
+{
+   std::unique_lock<std::mutex> lock(semaphore->mutex);
+
+   if (ticks == portMAX_DELAY) {
+      semaphore->available.wait(lock, [semaphore] { return semaphore->count > 0; });
+   } else if (!semaphore->available.wait_for(lock, std::chrono::milliseconds(ticks), [semaphore] { return semaphore->count > 0; })) {
+      return pdFALSE;
+   }
+   semaphore->count--;
+   return pdTRUE;
+}
+
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+   std::lock_guard<std::mutex> lock(semaphore->mutex);
+
+   if (semaphore->count >= semaphore->limit) {
+      return pdFALSE;
+   }
+   semaphore->count++;
+   semaphore->available.notify_one();
+   return pdTRUE;
+}
+
+inline void vSemaphoreDelete(SemaphoreHandle_t semaphore)
+{
+   delete semaphore;
+}
+
+/* Event group, the bits are waited for under the mutex */
+struct PortEventGroup
+{
+   std::mutex              mutex;   //!< Protects the bits
+   std::condition_variable changed; //!< Signaled by every set
+   uint32_t                bits;    //!< Set bits
+};
+
+typedef uint32_t        EventBits_t;
+typedef PortEventGroup *EventGroupHandle_t;
+
+inline EventGroupHandle_t xEventGroupCreate()
+{
+   EventGroupHandle_t group = new PortEventGroup;
+
+   group->bits = 0;
+   return group;
+}
+
+inline EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits)
+{
+   std::lock_guard<std::mutex> lock(group->mutex);
+
+   group->bits |= bits;
+   group->changed.notify_all();
+   return group->bits;
+}
+
+inline EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits)
+{
+   std::lock_guard<std::mutex> lock(group->mutex);
+   EventBits_t                 before = group->bits;
+
+   group->bits &= ~bits;
+   return before;
+}
+
+/* The bits at the end of the wait like FreeRTOS, the waited bits are cleared only if the wait was met */
+inline EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear, BaseType_t all, TickType_t ticks)
+{
+   std::unique_lock<std::mutex> lock(group->mutex);
+   auto                         met = [group, bits, all] { return all ? (group->bits & bits) == bits : (group->bits & bits) != 0; };
+
+   if (ticks == portMAX_DELAY) {
+      group->changed.wait(lock, met);
+   } else if (!group->changed.wait_for(lock, std::chrono::milliseconds(ticks), met)) {
+      return group->bits;
+   }
+   EventBits_t result = group->bits;
+
+   if (clear) {
+      group->bits &= ~bits;
+   }
+   return result;
+}
+
+inline void vEventGroupDelete(EventGroupHandle_t group)
+{
+   delete group;
+}
+
+/* A task is a detached thread, it ends with its function */
+inline BaseType_t xTaskCreatePinnedToCore(void (*function)(void *), const char *, uint32_t, void *param, UBaseType_t, TaskHandle_t *handle, int)
+{
+   std::thread(function, param).detach();
+   if (handle) {
+      *handle = NULL;
+   }
+   return pdPASS;
+}
+
+inline BaseType_t xTaskCreate(void (*function)(void *), const char *name, uint32_t stack, void *param, UBaseType_t priority, TaskHandle_t *handle)
+{
+   return xTaskCreatePinnedToCore(function, name, stack, param, priority, handle, 0);
+}
+
+inline void vTaskDelete(TaskHandle_t) {}
+inline void vTaskDelay(TickType_t ticks)           { std::this_thread::sleep_for(std::chrono::milliseconds(ticks)); }
+inline int  xPortGetCoreID()                        { return 0; }
+inline void xTaskNotifyGive(TaskHandle_t)           {}
+inline uint32_t ulTaskNotifyTake(BaseType_t, TickType_t ticks) { vTaskDelay(ticks); return 0; }
+
+/* Critical section of the dual core ESP32 */
+struct portMUX_TYPE
+{
+   std::mutex mutex; //!< Held inside the section
+};
+
+inline void portMUX_INITIALIZE(portMUX_TYPE *) {}
+inline void portENTER_CRITICAL(portMUX_TYPE *mux) { mux->mutex.lock(); }
+inline void portEXIT_CRITICAL(portMUX_TYPE *mux)  { mux->mutex.unlock(); }
@@ -0,0 +1,114 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file nvs.h
+  *
+  * Non volatile storage of the ESP-IDF in the PortStorage of the current panel.
+  */
+#pragma once
+#include <cstring>
+#include <string>
+#include <vector>
+#include "esp_system.h"
+#include "PortStorage.h"
+
+typedef uint32_t nvs_handle;
+
+typedef enum
+{
+   NVS_READONLY,
+   NVS_READWRITE
+} nvs_open_mode;
+
+/* Namespaces of the open handles, the handle is the index + 1 */
+inline std::vector<std::string> &PortNamespaces()
+{
+   static std::vector<std::string> names;
+
+   return names;
+}
+
+inline esp_err_t nvs_open(const char *name, nvs_open_mode, nvs_handle *handle)
+{
+   std::vector<std::string> &names = PortNamespaces();
+
+   *handle = 0;
+   if (!portStorage) {
+      return ESP_FAIL;
+   }
+   for (size_t i = 0; i < names.size(); i++) {
+      if (names[i] == name) {
+         *handle = i + 1;
+         return ESP_OK;
+      }
+   }
+   names.push_back(name);
+   *handle = names.size();
+   return ESP_OK;
+}
+
+inline void      nvs_close(nvs_handle) {}
+inline esp_err_t nvs_commit(nvs_handle) { return ESP_OK; }
+
+inline std::string PortKey(nvs_handle handle, const char *key)
+{
+   return PortNamespaces()[handle - 1] + "/" + key;
+}
+
+inline esp_err_t nvs_get_blob(nvs_handle handle, const char *key, void *data, size_t *len)
+{
+   if (!portStorage || !handle) {
+      return ESP_FAIL;
+   }
+   auto it = portStorage->nvs.find(PortKey(handle, key));
+
+   if (it == portStorage->nvs.end()) {
+      return ESP_ERR_NVS_NOT_FOUND;
+   }
+   if (data && *len < it->second.size()) {
+      *len = it->second.size();
+      return ESP_ERR_NVS_INVALID_LENGTH;
+   }
+   if (data) {
+      memcpy(data, it->second.data(), it->second.size());
+   }
+   *len = it->second.size();
+   return ESP_OK;
+}
+
+inline esp_err_t nvs_set_blob(nvs_handle handle, const char *key, const void *data, size_t len)
+{
+   if (!portStorage || !handle) {
+      return ESP_FAIL;
+   }
+   portStorage->nvs[PortKey(handle, key)].assign((const uint8_t *) data, (const uint8_t *) data + len);
+   return ESP_OK;
+}
+
+template <class T> esp_err_t PortGet(nvs_handle handle, const char *key, T *value)
+{
+   size_t len = sizeof(T);
+
+   return nvs_get_blob(handle, key, value, &len) == ESP_OK && len == sizeof(T) ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}
+
+inline esp_err_t nvs_get_u16(nvs_handle handle, const char *key, uint16_t *value) { return PortGet(handle, key, value); }
+inline esp_err_t nvs_get_u32(nvs_handle handle, const char *key, uint32_t *value) { return PortGet(handle, key, value); }
+inline esp_err_t nvs_get_i32(nvs_handle handle, const char *key, int32_t *value)  { return PortGet(handle, key, value); }
+inline esp_err_t nvs_set_u16(nvs_handle handle, const char *key, uint16_t value)  { return nvs_set_blob(handle, key, &value, sizeof(value)); }
+inline esp_err_t nvs_set_u32(nvs_handle handle, const char *key, uint32_t value)  { return nvs_set_blob(handle, key, &value, sizeof(value)); }
+inline esp_err_t nvs_set_i32(nvs_handle handle, const char *key, int32_t value)   { return nvs_set_blob(handle, key, &value, sizeof(value)); }
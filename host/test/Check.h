@@ -0,0 +1,56 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Check.h
+  *
+  * Checks and timing of the host tests.
+  */
+#pragma once
+#include <chrono>
+#include <cstdio>
+
+int checkFailures = 0; //!< Failed checks of the test
+
+#define CHECK(condition) Check((condition), #condition, __FILE__, __LINE__)
+
+/* Count and print a failed check */
+bool Check(bool condition, const char *text, const char *file, int line)
+{
+   if (!condition) {
+      fprintf(stderr, "%s:%d: check failed: %s\n", file, line, text);
+      checkFailures++;
+   }
+   return condition;
+}
+
+/* Exit code of the test */
+int CheckResult(const char *name)
+{
+   printf("%s: %s, %d failed checks\n", name, checkFailures ? "FAILED" : "passed", checkFailures);
+   return checkFailures ? 1 : 0;
+}
+
+/* Mean microseconds of a call of the function */
+template <class Function> double MeasureUs(int calls, Function function)
+{
+   auto start = std::chrono::steady_clock::now();
+
+   for (int i = 0; i < calls; i++) {
+      function();
+   }
+   return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / calls;
+}
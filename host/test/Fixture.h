@@ -0,0 +1,72 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Fixture.h
+  *
+  * tools/fixtureserver.py started by a host test.
+  */
+#pragma once
+#include <signal.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+#include <WiFi.h>
+
+/* The fixture server on FIXTURE_PORT while the object lives */
+class FixtureServer
+{
+protected:
+   pid_t pid; //!< Process of the server, 0 if not started
+
+public:
+   /* Start the server with the options and wait until it accepts connections */
+   FixtureServer(std::vector<const char *> options = {})
+      : pid(0)
+   {
+      String                    port = String(FIXTURE_PORT);
+      std::vector<const char *> args = { "python3", FIXTURE_SERVER, "--port", port.c_str() };
+
+      args.insert(args.end(), options.begin(), options.end());
+      args.push_back(NULL);
+      fflush(stdout); // the buffer is not written twice by the child
+      if ((pid = fork()) == 0) {
+         prctl(PR_SET_PDEATHSIG, SIGTERM); // no server is left behind by a crashed test
+         freopen("/dev/null", "w", stdout);
+         freopen("/dev/null", "w", stderr);
+         execvp(args[0], (char **) args.data());
+         _exit(127);
+      }
+      for (int i = 0; i < 100; i++) {
+         WiFiClient client;
+
+         if (client.connect(IPAddress(htonl(INADDR_LOOPBACK)), FIXTURE_PORT)) {
+            return;
+         }
+         delay(50);
+      }
+      fprintf(stderr, "%s does not start\n", FIXTURE_SERVER);
+   }
+
+   ~FixtureServer()
+   {
+      if (pid > 0) {
+         kill(pid, SIGTERM);
+         waitpid(pid, NULL, 0);
+      }
+   }
+};
@@ -0,0 +1,36 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file TestConfig.h
+  *
+  * Config.h of the host tests, the ConfigTemplate.h with the weather
+  * providers on the fixture server of Fixture.h.
+  */
+#pragma once
+#include "ConfigTemplate.h"
+
+#define FIXTURE_PORT 18095 //!< Port of tools/fixtureserver.py during the tests
+
+#undef OPENWEATHER_SRV
+#undef OPENWEATHER_PORT
+#define OPENWEATHER_SRV  "127.0.0.1"
+#define OPENWEATHER_PORT FIXTURE_PORT
+#define OPENMETEO_SRV    "127.0.0.1"
+#define OPENMETEO_PORT   FIXTURE_PORT
+
+#undef OPENWEATHER_API
+#define OPENWEATHER_API  "fixture" //!< Without the blanks of the template, they break the request line
@@ -0,0 +1,180 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file battery.cpp
+  *
+  * Replay of battery voltage traces through GetBatteryValues(): the
+  * discharge curve, the smoothing of the readings, the discharge rate
+  * of the least squares fit and the switch into the degraded mode.
+  */
+#include <M5EPD.h>
+#include M5_CONFIG
+#include <random>
+#include "Data.h"
+#include "Log.h"
+#include "Battery.h"
+#include "Check.h"
+
+#define BATTERY_START 1634600000
+#define BATTERY_WAKE  600  //!< Seconds between the wakes
+#define BATTERY_RATE  0.4f //!< Discharge in % per hour of the traces, about ten days
+
+/* Voltage in mV of the capacity in %, the inverse of the discharge curve */
+float VoltFromCapacity(float capacity)
+{
+   const int points = sizeof(batteryCurve) / sizeof(batteryCurve[0]);
+
+   for (int i = 1; i < points; i++) {
+      if (capacity <= batteryCurve[i][1]) {
+         float part = (capacity - batteryCurve[i - 1][1]) / (batteryCurve[i][1] - batteryCurve[i - 1][1]);
+         return batteryCurve[i - 1][0] + part * (batteryCurve[i][0] - batteryCurve[i - 1][0]);
+      }
+   }
+   return batteryCurve[points - 1][0];
+}
+
+/* One wake with the voltage of the trace */
+MyData Wake(float mV, time_t time)
+{
+   MyData data;
+
+   M5.batteryVoltage = (uint32_t) lroundf(mV);
+   GetBatteryValues(data, time);
+   return data;
+}
+
+/* Smoothed voltage of the stored history */
+float Smoothed()
+{
+   BatteryHistory history;
+
+   LoadBatteryHistory(history);
+   return history.smoothedVolt;
+}
+
+/* Result of a replayed discharge */
+struct Replay
+{
+   int   wakes;        //!< Wakes until the battery was empty
+   int   degradedWake; //!< First wake in the degraded mode, -1 if none
+   int   flips;        //!< Changes of the degraded mode
+   float worstRate;    //!< Largest relative error of the rate after a full history
+   float meanRate;     //!< Mean relative error of the rate after a full history
+};
+
+/* Replay a discharge from the capacity with the noise of the readings in mV */
+Replay Discharge(float capacity, float noise, int seed)
+{
+   std::mt19937                          random(seed);
+   std::uniform_real_distribution<float> adc(-noise, noise);
+   Replay                                replay = { 0, -1, 0, 0, 0 };
+   bool                                  degraded = false;
+   int                                   rates = 0;
+
+   for (time_t time = BATTERY_START; capacity > 0; time += BATTERY_WAKE, replay.wakes++) {
+      MyData data = Wake(VoltFromCapacity(capacity) + adc(random), time);
+
+      if (data.batteryDegraded != degraded) {
+         degraded = data.batteryDegraded;
+         replay.flips++;
+         if (degraded && replay.degradedWake < 0) {
+            replay.degradedWake = replay.wakes;
+         }
+      }
+      if (replay.wakes >= BATTERY_HISTORY && capacity > 5) {
+         float rate  = data.batteryRuntimeHours > 0 ? data.batteryCapacity / (float) data.batteryRuntimeHours : 0;
+         float error = fabs(rate - BATTERY_RATE) / BATTERY_RATE;
+
+         replay.worstRate = max(replay.worstRate, error);
+         replay.meanRate += error;
+         rates++;
+      }
+      capacity -= BATTERY_RATE * BATTERY_WAKE / SECS_PER_HOUR;
+   }
+   replay.meanRate /= max(rates, 1);
+   return replay;
+}
+
+int main()
+{
+   PortStorage storage;
+   MyData      data;
+
+   portStorage = &storage;
+
+   // the curve at its points, in between and outside
+   CHECK(BatteryCapacityFromVolt(3000) == 0 && BatteryCapacityFromVolt(3300) == 0 && BatteryCapacityFromVolt(4300) == 100);
+   CHECK(BatteryCapacityFromVolt(3690) == 10 && BatteryCapacityFromVolt(3840) == 50 && BatteryCapacityFromVolt(4200) == 100);
+   CHECK(fabs(BatteryCapacityFromVolt(3455) - 2.5f) < 1e-3 && fabs(BatteryCapacityFromVolt(4180) - 98) < 1e-3);
+   for (int mV = 3000; mV < 4300; mV++) {
+      CHECK(BatteryCapacityFromVolt(mV + 1) >= BatteryCapacityFromVolt(mV));
+   }
+
+   // the smoothed voltage follows a step with the weight of a new reading
+   storage.nvs.clear();
+   Wake(3950, BATTERY_START);
+   CHECK(Smoothed() == 3950);
+   for (int n = 1; n <= 10; n++) {
+      Wake(3900, BATTERY_START + n * BATTERY_WAKE);
+      CHECK(fabs(Smoothed() - (3900 + 50 * powf(1 - BATTERY_SMOOTHING, n))) < 0.01f);
+   }
+   // a step of more than 200 mV is a charger, the smoothing starts again
+   data = Wake(4150, BATTERY_START + 11 * BATTERY_WAKE);
+   CHECK(Smoothed() == 4150 && data.batteryRuntimeHours == -1 && data.batteryCapacity == 95);
+
+   // the least squares rate of a clean trace is the discharge, the runtime the remaining capacity
+   storage.nvs.clear();
+   for (int n = 0; n < 60; n++) {
+      float capacity = 60 - BATTERY_RATE * n * BATTERY_WAKE / SECS_PER_HOUR;
+
+      data = Wake(VoltFromCapacity(capacity), BATTERY_START + n * BATTERY_WAKE);
+      if (n == 0) {
+         CHECK(data.batteryRuntimeHours == -1);
+      }
+   }
+   CHECK(fabs(data.batteryRuntimeHours - data.batteryCapacity / BATTERY_RATE) < 0.05f * data.batteryCapacity / BATTERY_RATE);
+
+   // a charged battery starts a new history once the smoothed capacity rose
+   bool charged = false;
+   int  before  = data.batteryCapacity;
+   for (int n = 60; n < 63; n++) {
+      data    = Wake(VoltFromCapacity(before + 15), BATTERY_START + n * BATTERY_WAKE);
+      charged = charged || data.batteryRuntimeHours == -1;
+   }
+   CHECK(charged);
+
+   // replays of a discharge of the full battery with the noise of the adc
+   for (float noise : { 0.0f, 5.0f, 10.0f, 20.0f }) {
+      storage.nvs.clear();
+      Replay replay = Discharge(100, noise, 1);
+
+      // the degraded mode starts when the smoothed capacity is below the threshold and stays
+      int crossing = (int) ((100 - BATTERY_DEGRADED_CAPACITY) / BATTERY_RATE * SECS_PER_HOUR / BATTERY_WAKE);
+
+      CHECK(replay.degradedWake >= crossing - 6 && replay.degradedWake <= crossing + 6);
+      printf("noise %2.0f mV: degraded at wake %d of %d (%+d), %d changes, rate error mean %.0f%% worst %.0f%%\n", noise,
+         replay.degradedWake, replay.wakes, replay.degradedWake - crossing, replay.flips, replay.meanRate * 100, replay.worstRate * 100);
+      CHECK(replay.flips == 1);
+      CHECK(replay.meanRate < (noise == 0 ? 0.05f : (noise <= 10 ? 0.25f : 1)));
+   }
+
+   time_t time = BATTERY_START;
+   printf("GetBatteryValues() %.2f us\n", MeasureUs(10000, [&] { Wake(3900, time += BATTERY_WAKE); }));
+
+   portStorage = NULL;
+   return CheckResult("battery");
+}
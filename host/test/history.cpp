@@ -0,0 +1,258 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file history.cpp
+  *
+  * Test of the History: the samples read back are the appended ones
+  * after the ring wrapped around several times, after a restart and
+  * after the NVS state was lost. Prints the bytes per sample and the
+  * times of an append and a scan of the whole ring.
+  */
+#include <M5EPD.h>
+#include M5_CONFIG
+#include <random>
+#include <vector>
+#include "History.h"
+#include "Check.h"
+
+#define HISTORY_SECTORS 4   //!< Sectors of the test partition, the ring wraps around early
+#define HISTORY_START   1634600000
+#define HISTORY_STEP    600 //!< About 10 minutes between the wakes
+
+/* Appended sample with its values rounded like the History does */
+struct Sample
+{
+   time_t time;
+   float  values[HISTORY_SERIES];
+};
+
+/* Weather of the wakes, random walks with repeated values and missing ones */
+class Wakes
+{
+protected:
+   std::mt19937 random;   //!< Fixed seed
+   float        walk[HISTORY_SERIES]; //!< Current values
+   float        last[HISTORY_SERIES]; //!< Rounded values of the last sample
+
+public:
+   std::vector<Sample> appended; //!< All appended samples
+   time_t              time;     //!< Time of the last sample
+
+   Wakes()
+      : random(42)
+      , time(HISTORY_START)
+   {
+      const float start[HISTORY_SERIES] = { 21.5f, 45, 8.2f, 1013, 4.05f };
+
+      memcpy(walk, start, sizeof(walk));
+      memset(last, 0, sizeof(last));
+   }
+
+   /* The history lost the last values, a missing value stays unknown */
+   void Forget()
+   {
+      for (int s = 0; s < HISTORY_SERIES; s++) {
+         last[s] = NAN;
+      }
+   }
+
+   /* Append the next sample to the history */
+   bool Append(History &history)
+   {
+      std::uniform_int_distribution<int> jitter(-30, 30);
+      std::uniform_int_distribution<int> percent(0, 99);
+      std::normal_distribution<float>    step(0, 1);
+      Sample                             sample;
+      float                              values[HISTORY_SERIES];
+
+      // a wake is missed now and then, the panel was in the drawer for a day
+      time += percent(random) < 5 ? 86400 : HISTORY_STEP + jitter(random);
+      for (int s = 0; s < HISTORY_SERIES; s++) {
+         walk[s]  += percent(random) < 50 ? 0 : step(random) * historyResolution[s];
+         values[s] = percent(random) < 2 ? NAN : walk[s];
+         // a missing value repeats the last one
+         last[s]   = isnan(values[s]) ? last[s] : roundf(walk[s] / historyResolution[s]) * historyResolution[s];
+      }
+      sample.time = time;
+      memcpy(sample.values, last, sizeof(last));
+      if (!history.Append(time, values)) {
+         return false;
+      }
+      appended.push_back(sample);
+      return true;
+   }
+};
+
+/* The history holds the newest appended samples without a gap, from the index on */
+bool Matches(History &history, const std::vector<Sample> &appended, size_t first)
+{
+   size_t next  = 0;
+   bool   match = true;
+
+   history.Scan(0, INT32_MAX, [&](time_t time, const float *values) {
+      if (!next) {
+         while (first < appended.size() && appended[first].time < time) {
+            first++; // older than the oldest block of the ring
+         }
+      }
+      const Sample &sample = appended[min(first + next++, appended.size() - 1)];
+
+      match = match && sample.time == time && !memcmp(sample.values, values, sizeof(sample.values));
+   });
+   return match && first + next == appended.size();
+}
+
+/* Drop the samples of the lost open block, the number of the dropped ones */
+size_t Lost(History &history, Wakes &samples)
+{
+   time_t last  = 0;
+   size_t count = samples.appended.size();
+
+   history.Scan(0, INT32_MAX, [&](time_t time, const float *) { last = time; });
+   while (!samples.appended.empty() && samples.appended.back().time > last) {
+      samples.appended.pop_back();
+   }
+   samples.Forget();
+   return count - samples.appended.size();
+}
+
+/* Samples in the ring */
+size_t Count(History &history)
+{
+   return history.Scan(0, INT32_MAX, [](time_t, const float *) {});
+}
+
+int main()
+{
+   PortStorage storage;
+   Wakes       samples;
+
+   storage.AddPartition(HISTORY_PARTITION, HISTORY_SECTORS * HISTORY_SECTOR);
+   portStorage = &storage;
+
+   // the ring wraps around several times, the newest blocks are kept
+   {
+      History history;
+
+      while (samples.appended.size() < 10000) {
+         CHECK(samples.Append(history));
+      }
+      CHECK(Matches(history, samples.appended, 0));
+      CHECK(history.Last() == samples.time);
+      CHECK(Count(history) < samples.appended.size());
+
+      // the time has to increase
+      float values[HISTORY_SERIES] = { 1, 2, 3, 4, 5 };
+      CHECK(!history.Append(samples.time, values) && !history.Append(samples.time - 600, values));
+      CHECK(Matches(history, samples.appended, 0));
+   }
+
+   // a restart continues the open block from the NVS
+   {
+      History history;
+
+      CHECK(Matches(history, samples.appended, 0));
+      for (int i = 0; i < 100; i++) {
+         CHECK(samples.Append(history));
+      }
+      CHECK(Matches(history, samples.appended, 0));
+   }
+
+   // without the NVS the open block is lost, the next block starts behind it
+   {
+      History history;
+
+      storage.nvs.clear();
+      CHECK(history.Last() == 0 && Lost(history, samples) > 0);
+      CHECK(Matches(history, samples.appended, 0));
+      for (int i = 0; i < 500; i++) {
+         CHECK(samples.Append(history));
+      }
+      CHECK(Matches(history, samples.appended, 0));
+   }
+
+   // an NVS state of an older block is replaced like a lost one
+   {
+      std::vector<uint8_t> old = storage.nvs["Setting/history"];
+      History              history;
+
+      for (int i = 0; i < 2000; i++) {
+         CHECK(samples.Append(history));
+      }
+      storage.nvs["Setting/history"] = old;
+   }
+   {
+      History history;
+
+      CHECK(history.Last() == 0 && Lost(history, samples) > 0);
+      CHECK(Matches(history, samples.appended, 0));
+      for (int i = 0; i < 500; i++) {
+         CHECK(samples.Append(history));
+      }
+      CHECK(Matches(history, samples.appended, 0));
+   }
+
+   // the buckets of the query are the means of the samples
+   {
+      PortStorage query;
+      Wakes       fresh;
+      History     history;
+      float       mean[24];
+      float       minimum[24];
+      float       maximum[24];
+
+      query.AddPartition(HISTORY_PARTITION, HISTORY_SECTORS * HISTORY_SECTOR);
+      portStorage = &query;
+      for (int i = 0; i < 400; i++) {
+         CHECK(fresh.Append(history));
+      }
+      time_t from = fresh.appended[100].time;
+      time_t to   = fresh.appended[300].time;
+      CHECK(history.Query(from, to, HISTORY_OUTDOOR_TEMP, 24, mean, minimum, maximum) == 200);
+      for (int b = 0; b < 24; b++) {
+         double sum   = 0;
+         int    count = 0;
+         float  low   = INFINITY;
+         float  high  = -INFINITY;
+
+         for (const Sample &sample : fresh.appended) {
+            if (sample.time >= from && sample.time < to && (sample.time - from) * 24 / (to - from) == b) {
+               sum  += sample.values[HISTORY_OUTDOOR_TEMP];
+               low   = min(low, sample.values[HISTORY_OUTDOOR_TEMP]);
+               high  = max(high, sample.values[HISTORY_OUTDOOR_TEMP]);
+               count++;
+            }
+         }
+         CHECK(count ? fabs(mean[b] - sum / count) < 1e-3 && minimum[b] == low && maximum[b] == high : isnan(mean[b]));
+      }
+
+      // benchmark of an append and a scan of the whole ring
+      History *bench  = &history;
+      double   append = MeasureUs(5000, [&] { fresh.Append(*bench); });
+      double   scan   = MeasureUs(20, [&] { Count(*bench); });
+
+      CHECK(Matches(history, fresh.appended, 0));
+      printf("append %.1f us, scan of %d samples %.0f us\n", append, (int) Count(history), scan);
+      fflush(stdout);
+      Serial.enabled = true;
+      history.Dump(Serial);
+      Serial.enabled = false;
+   }
+
+   portStorage = NULL;
+   return CheckResult("history");
+}
@@ -0,0 +1,215 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file httpbody.cpp
+  *
+  * Test of the HttpBody: bodies with a Content-Length, in chunks and up to
+  * the end of the connection leave the connection at the next response.
+  */
+#include <M5EPD.h>
+#include M5_CONFIG
+#include "HttpBody.h"
+#include "Check.h"
+
+/* Connection of a recorded response, read in small pieces like the WiFi */
+class MemoryClient : public Client
+{
+protected:
+   String   data;    //!< Bytes of the connection
+   size_t   pos;     //!< Next byte
+   size_t   piece;   //!< Max bytes of one read
+   uint32_t holdMs;  //!< The data arrives this ms after the start
+   uint32_t start;   //!< Ms of the start
+   bool     open;    //!< The connection stays open after the data
+
+public:
+   MemoryClient(const String &d, size_t p, bool o = true, uint32_t hold = 0)
+      : data(d)
+      , pos(0)
+      , piece(p)
+      , holdMs(hold)
+      , start(millis())
+      , open(o)
+   {
+   }
+
+   int available() override
+   {
+      return millis() - start < holdMs ? 0 : (int) min(data.length() - pos, piece);
+   }
+
+   int read() override
+   {
+      return available() ? (uint8_t) data[pos++] : -1;
+   }
+
+   int read(uint8_t *buffer, size_t size) override
+   {
+      size_t count = min((size_t) available(), size);
+
+      memcpy(buffer, data.c_str() + pos, count);
+      pos += count;
+      return count;
+   }
+
+   int peek() override
+   {
+      return available() ? (uint8_t) data[pos] : -1;
+   }
+
+   size_t write(uint8_t c) override
+   {
+      return 0;
+   }
+
+   uint8_t connected() override
+   {
+      return open || pos < data.length();
+   }
+
+   void stop() override
+   {
+   }
+
+   /* Bytes behind the read position */
+   String Rest()
+   {
+      return data.substr(pos);
+   }
+};
+
+/* The body in chunks of the sizes, with an extension and a trailer */
+String Chunks(const String &body, std::mt19937 &random)
+{
+   std::uniform_int_distribution<int> size(1, 700);
+   String                             chunks;
+   char                               line[32];
+
+   for (size_t pos = 0; pos < body.length();) {
+      size_t length = min((size_t) size(random), body.length() - pos);
+
+      snprintf(line, sizeof(line), pos ? "%x\r\n" : "%X;name=value\r\n", (unsigned) length);
+      chunks += line + body.substr(pos, length) + "\r\n";
+      pos    += length;
+   }
+   return chunks + "0\r\nExpires: never\r\n\r\n";
+}
+
+/* Read the body with the reads of a parser, a byte, a peek or a block */
+String ReadAll(HttpBody &body, std::mt19937 &random)
+{
+   std::uniform_int_distribution<int> kind(0, 3);
+   String                             text;
+   char                               block[100];
+
+   for (;;) {
+      int c;
+
+      switch (kind(random)) {
+      case 0:
+         if ((c = body.read()) < 0) {
+            return text;
+         }
+         text += (char) c;
+         break;
+      case 1:
+         if (body.peek() < 0) {
+            return text;
+         }
+         break;
+      default:
+         size_t count = body.readBytes(block, kind(random) ? 1 : sizeof(block));
+
+         if (!count) {
+            return text;
+         }
+         text += String(std::string(block, count));
+         break;
+      }
+   }
+}
+
+int main()
+{
+   std::mt19937 random(7);
+   String       json;
+   String       next = "HTTP/1.1 200 OK\r\n";
+
+   for (int i = 0; i < 48; i++) {
+      json += String(i ? "," : "{\"hourly\":[") + "{\"dt\":" + String(1634630400 + i * 3600) + ",\"temp\":" + String(10.5 + i % 7) + "}";
+   }
+   json += "]}";
+
+   // Content-Length
+   for (size_t piece : { 1, 13, 1460 }) {
+      MemoryClient client(json + next, piece);
+      HttpBody     body(client, json.length(), false);
+
+      CHECK(ReadAll(body, random) == json);
+      CHECK(body.Finish() && !body.Failed());
+      CHECK(body.Bytes() == json.length());
+      CHECK(client.Rest() == next);
+   }
+
+   // chunks, also read only partly before the rest is skipped
+   for (size_t piece : { 1, 13, 1460 }) {
+      String       chunks = Chunks(json, random);
+      MemoryClient client(chunks + next, piece);
+      HttpBody     body(client, -1, true);
+
+      CHECK(ReadAll(body, random) == json);
+      CHECK(body.Finish() && body.Bytes() == json.length());
+      CHECK(client.Rest() == next);
+
+      MemoryClient partly(chunks + next, piece);
+      HttpBody     skipped(partly, -1, true);
+      char         start[20];
+
+      CHECK(skipped.readBytes(start, sizeof(start)) == sizeof(start));
+      CHECK(skipped.Finish() && partly.Rest() == next);
+   }
+
+   // up to the end of the connection
+   MemoryClient closing(json, 100, false);
+   HttpBody     toEnd(closing, -1, false);
+
+   CHECK(ReadAll(toEnd, random) == json);
+   CHECK(toEnd.Finish() && toEnd.Bytes() == json.length());
+
+   // broken bodies fail, a silent connection after HTTP_BODY_TIMEOUT
+   MemoryClient short1(json.substr(0, 100), 100, false);
+   HttpBody     shortBody(short1, json.length(), false);
+   MemoryClient short2(Chunks(json, random).substr(0, 300), 100, false);
+   HttpBody     shortChunks(short2, -1, true);
+   MemoryClient broken(String("zz\r\n") + json, 100);
+   HttpBody     brokenChunks(broken, -1, true);
+   MemoryClient silent(json.substr(0, 100), 100, true);
+   HttpBody     silentBody(silent, json.length(), false);
+
+   CHECK(!shortBody.Finish() && shortBody.Failed());
+   CHECK(!shortChunks.Finish() && shortChunks.Failed());
+   CHECK(brokenChunks.read() < 0 && brokenChunks.Failed());
+   CHECK(!silentBody.Finish() && silentBody.Failed() && silentBody.WaitMs() >= HTTP_BODY_TIMEOUT);
+
+   // the ms waited for the data are the body stage
+   MemoryClient late(json, 1460, true, 30);
+   HttpBody     lateBody(late, json.length(), false);
+
+   CHECK(ReadAll(lateBody, random) == json && lateBody.WaitMs() >= 30 && lateBody.WaitMs() < 100);
+
+   return CheckResult("httpbody");
+}
@@ -0,0 +1,124 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file moon.cpp
+  *
+  * Test of the Moon: the phases at published new and full moons, the
+  * rise and the set of every day of a year against a search of the
+  * horizon crossings minute by minute. Prints the largest errors and
+  * the time of a Day().
+  */
+#include <M5EPD.h>
+#include M5_CONFIG
+#include "Moon.h"
+#include "Check.h"
+
+#define MOON_YEAR 1609459200 //!< 2021-01-01 00:00 UTC
+
+/* Access to the altitude */
+class TestMoon : public Moon
+{
+public:
+   using Moon::Altitude;
+};
+
+/* Published new and full moons in UTC */
+struct Lunation
+{
+   time_t utc;  //!< Time of the phase
+   bool   full; //!< Full moon, else new moon
+} lunations[] = {
+   { 947182440, false }, // 2000-01-06 18:14
+   { 948429600, true },  // 2000-01-21 04:40
+   { 1633518300, false }, // 2021-10-06 11:05
+   { 1634741760, true },  // 2021-10-20 14:56
+   { 1704974220, false }, // 2024-01-11 11:57
+   { 1706205240, true },  // 2024-01-25 17:54
+};
+
+int main()
+{
+   PortStorage storage;
+   TestMoon    test;
+   double      worstRise = 0;
+   double      worstSet  = 0;
+   int         rises = 0;
+   int         sets  = 0;
+
+   portStorage = &storage;
+
+   // the moon moves half a degree per hour away from the sun
+   for (const Lunation &lunation : lunations) {
+      float illumination;
+      float elongation;
+
+      test.Phase(lunation.utc, illumination, elongation);
+      if (lunation.full) {
+         CHECK(illumination > 0.99f && fabs(elongation - 180) < 2);
+      } else {
+         CHECK(illumination < 0.01f && min(elongation, 360 - elongation) < 2);
+      }
+      CHECK(test.Day(lunation.utc).phase == (lunation.full ? MOON_PHASES / 2 : 0));
+      test.Phase(lunation.utc + 7 * 86400 + 9 * 3600, illumination, elongation);
+      CHECK(fabs(illumination - 0.5f) < 0.1f && fabs(elongation - (lunation.full ? 270 : 90)) < 15);
+   }
+
+   // every crossing of the horizon of the day is found, the first rise and set
+   for (int d = 0; d < 365; d++) {
+      time_t  utc      = MOON_YEAR + d * 86400 + 12 * 3600;
+      MoonDay day      = test.Day(utc);
+      time_t  midnight = utc - ((timeZone.Local(utc) % 86400) + 86400) % 86400;
+      time_t  rise     = 0;
+      time_t  set      = 0;
+      float   last     = test.Altitude(midnight);
+
+      for (time_t time = midnight + 60; time <= midnight + 86400; time += 60) {
+         float alt = test.Altitude(time);
+
+         if (last < 0 && alt >= 0 && !rise) {
+            rise = time - 30;
+         } else if (last >= 0 && alt < 0 && !set) {
+            set = time - 30;
+         }
+         last = alt;
+      }
+      CHECK(!day.rise == !rise && !day.set == !set);
+      if (day.rise && rise) {
+         worstRise = max(worstRise, fabs((double) (day.rise - rise)));
+         rises++;
+      }
+      if (day.set && set) {
+         worstSet = max(worstSet, fabs((double) (day.set - set)));
+         sets++;
+      }
+   }
+   // one day of every month without a rise and one without a set
+   CHECK(rises >= 365 - 14 && rises < 365 && sets >= 365 - 14 && sets < 365);
+   CHECK(worstRise <= 31 && worstSet <= 31);
+
+   printf("%d rises and %d sets, largest difference to the minute search %.0f s and %.0f s\n", rises, sets, worstRise, worstSet);
+   time_t utc = MOON_YEAR;
+   printf("Day() %.1f us, Phase() %.2f us\n", MeasureUs(2000, [&] { test.Day(utc += 86400); }), MeasureUs(100000, [&] {
+      float illumination;
+      float elongation;
+
+      test.Phase(utc += 600, illumination, elongation);
+   }));
+
+   portStorage = NULL;
+   return CheckResult("moon");
+}
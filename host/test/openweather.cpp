@@ -0,0 +1,192 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file openweather.cpp
+  *
+  * Test of the OpenWeather provider against tools/fixtureserver.py: the
+  * weather filled while the onecall body arrives is the weather of the
+  * whole document, with a Content-Length and in chunks.
+  */
+#include <M5EPD.h>
+#include M5_CONFIG
+#include "OpenWeather.h"
+#include "Check.h"
+#include "Fixture.h"
+
+/* Body of a response as a Stream */
+class StringStream : public Stream
+{
+protected:
+   String text; //!< Body
+   size_t pos;  //!< Next character
+
+public:
+   StringStream(const String &t)
+      : text(t)
+      , pos(0)
+   {
+   }
+
+   int    available() override        { return text.length() - pos; }
+   int    read() override             { return pos < text.length() ? (uint8_t) text[pos++] : -1; }
+   int    peek() override             { return pos < text.length() ? (uint8_t) text[pos] : -1; }
+   size_t write(uint8_t c) override   { return 0; }
+};
+
+/* Access to the parsing of the onecall body */
+class TestOpenWeather : public OpenWeather
+{
+public:
+   using OpenWeather::Parse;
+};
+
+/* Body of the request to the fixture server */
+String Get(const String &uri)
+{
+   WiFiClient client;
+   HTTPClient http;
+   String     text;
+   const char *headers[] = { "Transfer-Encoding" };
+
+   http.collectHeaders(headers, 1);
+   http.begin(client, OPENWEATHER_SRV, OPENWEATHER_PORT, uri, false);
+   if (http.GET() != HTTP_CODE_OK) {
+      return text;
+   }
+   HttpBody body(*http.getStreamPtr(), http.getSize(), http.header("Transfer-Encoding").equalsIgnoreCase("chunked"));
+
+   for (int c; (c = body.read()) >= 0;) {
+      text += (char) c;
+   }
+   return text;
+}
+
+/* Both series hold the same buckets */
+template <int N> bool Same(const Decimator<N> &a, const Decimator<N> &b)
+{
+   bool same = a.Size() == b.Size() && a.Factor() == b.Factor();
+
+   for (int i = 0; same && i < a.Size(); i++) {
+      same = a.Min(i) == b.Min(i) && a.Max(i) == b.Max(i) && fabs(a.Mean(i) - b.Mean(i)) < 1e-4;
+   }
+   return same;
+}
+
+/* The weather filled from the body is the weather of the whole document */
+void CheckBody(const String &text)
+{
+   TestOpenWeather provider;
+   Weather         weather;
+   Weather         expected;
+   StringStream    body(text);
+   Json::Value     root;
+   std::string     errors;
+
+   std::unique_ptr<Json::CharReader>(Json::CharReaderBuilder().newCharReader())->parse(text.data(), text.data() + text.size(), &root, &errors);
+   CHECK(provider.Parse(body, weather));
+
+   // the fill of the whole document like before the walk
+   const Json::Value &current = root["current"];
+   const Json::Value &hourly  = root["hourly"];
+   const Json::Value &minutes = root["minutely"];
+
+   CHECK(weather.currentTime == current["dt"].asInt());
+   CHECK(weather.sunrise == Weather::LocalTime(current["sunrise"].asInt()));
+   CHECK(weather.temp == current["temp"].asFloat() && weather.tempFeelsLike == current["feels_like"].asFloat());
+   CHECK(weather.humidity == current["humidity"].asFloat() && weather.pressure == current["pressure"].asFloat());
+   CHECK(weather.windspeed == current["wind_speed"].asFloat());
+   for (int i = 0; i < min((int) root["daily"].size(), MAX_FORECAST_DAILY); i++) {
+      const Json::Value &day = root["daily"][i];
+
+      CHECK(weather.dailyTime[i] == Weather::LocalTime(day["dt"].asInt()));
+      CHECK(weather.dailyMaxTemp[i] == day["temp"]["max"].asFloat());
+      CHECK(weather.dailyMain[i] == day["weather"][0]["main"].asString() && weather.dailyIcon[i] == day["weather"][0]["icon"].asString());
+   }
+   // the onecall has 48 + 1 hours and 61 minutes, the counts of the old Begin(size)
+   expected.forecastTemp.Begin(FORECAST_HOURS + 1);
+   expected.forecastRain.Begin(FORECAST_HOURS + 1);
+   expected.forecastSnow.Begin(FORECAST_HOURS + 1);
+   for (int i = 0; i < min((int) hourly.size(), FORECAST_HOURS + 1); i++) {
+      expected.forecastTemp.Add(hourly[i]["temp"].asFloat());
+      expected.forecastRain.Add(hourly[i].get("rain", Json::Value())["1h"].asFloat());
+      expected.forecastSnow.Add(hourly[i].get("snow", Json::Value())["1h"].asFloat());
+   }
+   expected.nowcastRain.Begin(OPENWEATHER_MINUTES);
+   for (const Json::Value &minute : minutes) {
+      expected.nowcastRain.Add(minute["precipitation"].asFloat());
+   }
+   CHECK(Same(weather.forecastTemp, expected.forecastTemp));
+   CHECK(Same(weather.forecastRain, expected.forecastRain));
+   CHECK(Same(weather.forecastSnow, expected.forecastSnow));
+   CHECK(Same(weather.nowcastRain, expected.nowcastRain));
+   CHECK(weather.forecastTemp.Size() > 0);
+}
+
+int main()
+{
+   String onecall;
+
+   {
+      FixtureServer server;
+      TestOpenWeather provider;
+      Weather         weather;
+
+      onecall = Get("/data/2.5/onecall?lat=0&lon=0");
+      CHECK(onecall.length() > 1000);
+      CheckBody(onecall);
+
+      // the onecall body with a Content-Length, the air pollution over the same connection
+      CHECK(provider.Fetch(weather) && weather.currentTime && weather.airQuality == 3);
+   }
+   {
+      FixtureServer   server({ "--chunked" });
+      TestOpenWeather provider;
+      Weather         weather;
+
+      CHECK(provider.Fetch(weather) && weather.currentTime && weather.forecastTemp.Size() && weather.airQuality == 3);
+   }
+
+   // a body of another layout, extra members and no minutes
+   CheckBody("{\"lat\": 1.5, \"timezone\": \"Europe/Berlin\", \"current\": {\"dt\": 1634630400, \"temp\": 9.5, "
+      "\"weather\": [{\"main\": \"Rain\", \"icon\": \"10d\", \"text\": \"a [quoted] \\\"}\\\" text\"}]}, "
+      "\"hourly\": [{\"dt\": 1, \"temp\": 7, \"rain\": {\"1h\": 0.5}}, {\"temp\": 8, \"snow\": {\"3h\": 9, \"1h\": 0.2}}], "
+      "\"alerts\": [[1, 2], {\"a\": null}], \"daily\": [], \"flag\": true}");
+
+   // broken bodies fail
+   for (const char *broken : { "", "[]", "{\"current\": {\"dt\": 5", "{\"hourly\": [{\"temp\": 7}, {\"temp\":", "{\"current\": {\"dt\": 0}}" }) {
+      TestOpenWeather provider;
+      Weather         weather;
+      StringStream    body(broken);
+
+      CHECK(!provider.Parse(body, weather));
+   }
+
+   // memory of the whole filtered document of the parse before the walk
+   Json::Value root;
+   Json::Value filter;
+   std::string errors;
+
+   std::unique_ptr<Json::CharReader>(Json::CharReaderBuilder().newCharReader())->parse(onecall.data(), onecall.data() + onecall.size(), &root, &errors);
+   Json::Reader().parse("{\"current\": true, \"daily\": [{\"dt\": true, \"temp\": {\"max\": true}, \"weather\": [{\"main\": true, \"icon\": true}]}],"
+      "\"hourly\": [{\"temp\": true, \"rain\": {\"1h\": true}, \"snow\": {\"1h\": true}}], \"minutely\": [{\"precipitation\": true}]}", filter);
+   JsonFilter(root, filter);
+   std::set<std::string> strings;
+   printf("onecall body %d bytes, the filtered document needed %d bytes of the ArduinoJson pool\n", (int) onecall.length(),
+      (int) DynamicJsonDocument::Usage(root, strings));
+
+   return CheckResult("openweather");
+}
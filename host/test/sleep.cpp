@@ -0,0 +1,289 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file sleep.cpp
+  *
+  * Simulation of two weeks of wakes of the SleepScheduler with the end of
+  * the daylight saving time, outages of the weather service, a low and a
+  * degraded battery: the backoff with its jitter, the quiet hours, the
+  * commute windows, the alignment to the openweathermap updates and the
+  * daily full clean of the panel.
+  * The same weeks replayed with the fixed rule of the old getSleepTime,
+  * without the local wakes and in the degraded mode project the days on
+  * a full battery of every policy from the currents of Timeline.h.
+  */
+#include <M5EPD.h>
+#include M5_CONFIG
+#include <vector>
+#include "Data.h"
+#include "Log.h"
+#include "Sleep.h"
+#include "Refresh.h"
+#include "Timeline.h"
+#include "Check.h"
+
+#define SIM_START     1635112800 //!< Monday 2021-10-25 00:00 CEST, the daylight saving time ends on Sunday
+#define SIM_DAYS      14
+#define SIM_NETWORK_S 8          //!< Duration of a network wake, the schedule is at its end
+#define SIM_LOCAL_S   2          //!< Duration of a local wake
+#define SIM_PUSH_S    2          //!< EPD power and push of both wake types
+#define SIM_RENDER_S  1          //!< Parallel rendering of a network wake
+#define SIM_SLEEP_UA  10         //!< Current of the RTC while the panel is off
+#define SIM_BATTERY   1150       //!< Capacity of the battery of the M5Paper in mAh
+
+/* Sleep policies of the projection */
+enum Policy
+{
+   POLICY_FIXED,    //!< 30 minutes, up to 120 minutes before 05:00, 2 minutes after a failure
+   POLICY_ADAPTIVE, //!< The SleepScheduler with the local wakes
+   POLICY_NETWORK,  //!< The SleepScheduler without the local wakes
+   POLICY_DEGRADED, //!< The SleepScheduler with a degraded battery all the time
+   POLICIES
+};
+
+/* One wake of the simulation */
+struct Wake
+{
+   time_t time;     //!< Start of the wake
+   bool   network;  //!< Network wake
+   bool   success;  //!< The weather was fetched
+   time_t schedule; //!< Time of the schedule of the network wake
+   int    minutes;  //!< Minutes of the schedule
+   int    failures; //!< Failed requests in a row
+};
+
+/* Local time of the day in minutes */
+int LocalMinute(time_t utc)
+{
+   time_t local = timeZone.Local(utc);
+
+   return hour(local) * 60 + minute(local);
+}
+
+/* Local day since the start of the simulation, 0 is Monday */
+int Day(time_t utc)
+{
+   return (int) ((timeZone.Local(utc) - timeZone.Local(SIM_START)) / SECS_PER_DAY);
+}
+
+bool IsQuiet(time_t utc)
+{
+   return LocalMinute(utc) < QUIET_HOURS_TO * 60;
+}
+
+bool IsCommute(time_t utc)
+{
+   int minutes = LocalMinute(utc);
+
+   return Day(utc) % 7 < 5 && ((minutes >= 6 * 60 + 30 && minutes < 8 * 60 + 30) || (minutes >= 16 * 60 && minutes < 18 * 60));
+}
+
+/* The weather service is down on Wednesday and Thursday from 10 to 13 */
+bool IsOutage(time_t utc)
+{
+   return (Day(utc) == 2 || Day(utc) == 3) && LocalMinute(utc) >= 10 * 60 && LocalMinute(utc) < 13 * 60;
+}
+
+/* Battery of the day, low on the second Friday and degraded on the second Saturday */
+void Battery(MyData &data, time_t utc)
+{
+   data.batteryCapacity = Day(utc) == 11 ? 15 : (Day(utc) == 12 ? 5 : 80);
+   data.batteryDegraded = data.batteryCapacity < BATTERY_DEGRADED_CAPACITY;
+}
+
+/* Sleep of the getSleepTime before the SleepScheduler, from the local time like the RTC */
+int FixedMinutes(bool success, time_t utc)
+{
+   int minutes = LocalMinute(utc);
+
+   if (!success) {
+      return 2;
+   } else if (minutes < 5 * 60) {
+      return min(5 * 60 - minutes, 120);
+   }
+   return 30;
+}
+
+/* Wakes of the simulation with the policy */
+std::vector<Wake> Simulate(Policy policy = POLICY_ADAPTIVE)
+{
+   SleepScheduler    scheduler;
+   std::vector<Wake> wakes;
+   int               failures = 0;
+
+   for (time_t time = SIM_START; time < SIM_START + SIM_DAYS * SECS_PER_DAY;) {
+      Wake   wake = { time, policy == POLICY_FIXED || !scheduler.IsLocalWake(time), false, 0, 0, 0 };
+      time_t end  = time + (wake.network ? SIM_NETWORK_S : SIM_LOCAL_S);
+
+      if (wake.network) {
+         MyData data;
+
+         Battery(data, time);
+         if (policy == POLICY_DEGRADED) {
+            data.batteryCapacity = 5;
+            data.batteryDegraded = true;
+         }
+         data.weather.success = !IsOutage(time);
+         failures             = data.weather.success ? 0 : failures + 1;
+         scheduler.Schedule(data, end);
+         if (data.weather.success) {
+            scheduler.FrameShown(end);
+         }
+         if (policy == POLICY_NETWORK) {
+            scheduler.DisableLocalWakes();
+         }
+         wake.success  = data.weather.success;
+         wake.schedule = end;
+         wake.minutes  = data.sleepForMinutes;
+         wake.failures = failures;
+      }
+      int minutes = policy == POLICY_FIXED ? FixedMinutes(wake.success, end) : scheduler.SleepMinutes(end);
+
+      scheduler.LogWake(wake.network ? WAKE_NETWORK : WAKE_LOCAL, (end - time) * 1000);
+      wakes.push_back(wake);
+      time = end + minutes * 60;
+   }
+   return wakes;
+}
+
+/* Charge of a wake in mAh, the radio runs the network wake up to the push */
+double WakeMAh(const Wake &wake)
+{
+   double mAs = wake.network
+              ? CURRENT_BASE_MA * SIM_NETWORK_S + CURRENT_WIFI_MA * (SIM_NETWORK_S - SIM_PUSH_S) + CURRENT_EPD_MA * SIM_PUSH_S + CURRENT_RENDER_MA * SIM_RENDER_S
+              : CURRENT_BASE_MA * SIM_LOCAL_S + CURRENT_EPD_MA * SIM_PUSH_S;
+
+   return mAs / 3600;
+}
+
+/* Days on a full battery with the wakes of the policy and the RTC in between */
+double ProjectDays(const std::vector<Wake> &wakes, int &network, int &local)
+{
+   double mAh = SIM_SLEEP_UA / 1000.0 * SIM_DAYS * 24;
+
+   network = 0;
+   local   = 0;
+   for (const Wake &wake : wakes) {
+      mAh += WakeMAh(wake);
+      (wake.network ? network : local)++;
+   }
+   return SIM_BATTERY / (mAh / SIM_DAYS);
+}
+
+int main()
+{
+   PortStorage storage;
+
+   portStorage = &storage;
+
+   std::vector<Wake> wakes = Simulate();
+   std::vector<int>  retries[8];
+   RefreshScheduler  refresh;
+   int               cleans[SIM_DAYS] = {};
+   int               quiet[SIM_DAYS] = {};
+   int               network = 0;
+   int               local   = 0;
+   const Wake       *last    = NULL;
+
+   for (size_t i = 0; i < wakes.size(); i++) {
+      const Wake &wake = wakes[i];
+
+      if (!wake.network) {
+         // the local wakes refresh the frame between the network wakes, not in the quiet hours
+         CHECK(!IsQuiet(wake.time));
+         CHECK(last && wake.time - wakes[i - 1].time <= LOCAL_WAKE_MINUTES * 60 + 60);
+         CHECK(Day(wake.time) != 12);
+         local++;
+         continue;
+      }
+      network++;
+      if (wake.success && refresh.IsFullCleanDue(timeZone.Local(wake.schedule))) {
+         refresh.FullCleaned(timeZone.Local(wake.schedule));
+         cleans[Day(wake.schedule)]++;
+      }
+      if (IsQuiet(wake.time) && i > 0) {
+         quiet[Day(wake.time)]++;
+      }
+      if (last) {
+         int slept  = (int) (wake.time - last->schedule);
+         int base   = IsCommute(last->schedule) ? COMMUTE_MINUTES : SLEEP_MINUTES;
+         int factor = Day(last->schedule) == 12 ? 4 : (Day(last->schedule) == 11 ? 2 : 1);
+
+         if (!last->success) {
+            // exponential backoff with +-20% jitter
+            int expected = min(SLEEP_RETRY_MINUTES << min(last->failures - 1, 8), SLEEP_RETRY_MAX_MINUTES);
+
+            CHECK(slept >= expected * 48 - 60 && slept <= expected * 72 + 60);
+            retries[min(last->failures, 8) - 1].push_back(slept);
+         } else if (IsQuiet(last->schedule) || IsQuiet(last->schedule + base * factor * 60)) {
+            // behind the quiet hours one minute after the update, or at the longest sleep
+            CHECK(!IsQuiet(wake.time) ? LocalMinute(wake.time) >= QUIET_HOURS_TO * 60 + 1 && LocalMinute(wake.time) <= QUIET_HOURS_TO * 60 + 11
+                                      : slept >= SLEEP_MAX_MINUTES * 60);
+         } else {
+            // one minute after an update of openweathermap, at most one minute shorter than planned
+            CHECK(slept >= (base * factor - 1) * 60 && slept < (base * factor + OWM_UPDATE_MINUTES) * 60 + 60);
+            CHECK((minute(wake.time) + OWM_UPDATE_MINUTES - 1) % OWM_UPDATE_MINUTES <= 1);
+         }
+         if (last->success && IsCommute(last->schedule) && factor == 1) {
+            CHECK(slept <= (COMMUTE_MINUTES + 1) * 60 + 60);
+         }
+      }
+      last = &wake;
+   }
+   // at most one fetch in the quiet hours of a night, the longest sleep is shorter than them
+   for (int d = 0; d < SIM_DAYS; d++) {
+      CHECK(quiet[d] <= 1);
+      CHECK(cleans[d] == 1); // the full clean of the panel once a day
+   }
+   // the retries are jittered and the backoff ends after the outages
+   float lowest  = 2;
+   float highest = 0;
+
+   for (int k = 3; k < 8; k++) {
+      for (int slept : retries[k]) {
+         float ratio = slept / 60.0f / min(SLEEP_RETRY_MINUTES << k, SLEEP_RETRY_MAX_MINUTES);
+
+         lowest  = min(lowest, ratio);
+         highest = max(highest, ratio);
+      }
+   }
+   CHECK(highest - lowest > 0.05f);
+   CHECK(retries[0].size() == 2 && last->success);
+
+   printf("%d network and %d local wakes in %d days, retries:", network, local, SIM_DAYS);
+   for (int k = 0; k < 8 && retries[k].size(); k++) {
+      printf(" %d", (int) retries[k].size());
+   }
+   printf("\n");
+
+   // projected battery life of the policies over the same weeks
+   const char *names[POLICIES] = { "fixed 30 min, 2 min retry", "adaptive with local wakes", "adaptive without local wakes", "degraded" };
+   double      days[POLICIES];
+
+   for (int p = 0; p < POLICIES; p++) {
+      storage.nvs.clear();
+      days[p] = ProjectDays(Simulate((Policy) p), network, local);
+      printf("%-29s %4d network, %4d local wakes: %5.1f days on %d mAh\n", names[p], network, local, days[p], SIM_BATTERY);
+   }
+   CHECK(days[POLICY_NETWORK] > days[POLICY_FIXED]);
+   CHECK(days[POLICY_NETWORK] > days[POLICY_ADAPTIVE]);
+   CHECK(days[POLICY_DEGRADED] > days[POLICY_NETWORK]);
+   CHECK(days[POLICY_DEGRADED] > days[POLICY_FIXED]);
+
+   portStorage = NULL;
+   return CheckResult("sleep");
+}
@@ -0,0 +1,139 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file sun.cpp
+  *
+  * Test of the Sun: the times of every day of a year against the NOAA
+  * algorithm in double precision with the crossings found by bisection,
+  * and the noon elevations of the solstices. Prints the largest errors
+  * and the time of a Day().
+  */
+#include <M5EPD.h>
+#include M5_CONFIG
+#include "Sun.h"
+#include "Check.h"
+
+#define SUN_YEAR 1609459200 //!< 2021-01-01 00:00 UTC
+
+/* The NOAA algorithm in double precision */
+double Elevation(double utc)
+{
+   double rad      = M_PI / 180;
+   double jc       = (utc - SUN_J2000) / (86400.0 * 36525);
+   double meanLong = fmod(280.46646 + jc * (36000.76983 + jc * 0.0003032), 360);
+   double meanAnom = 357.52911 + jc * (35999.05029 - 0.0001537 * jc);
+   double ecc      = 0.016708634 - jc * (0.000042037 + 0.0000001267 * jc);
+   double center   = sin(meanAnom * rad) * (1.914602 - jc * (0.004817 + 0.000014 * jc))
+                   + sin(2 * meanAnom * rad) * (0.019993 - 0.000101 * jc) + sin(3 * meanAnom * rad) * 0.000289;
+   double omega    = (125.04 - 1934.136 * jc) * rad;
+   double appLong  = meanLong + center - 0.00569 - 0.00478 * sin(omega);
+   double obliq    = 23 + (26 + (21.448 - jc * (46.815 + jc * (0.00059 - jc * 0.001813))) / 60) / 60 + 0.00256 * cos(omega);
+   double y        = tan(obliq * rad / 2) * tan(obliq * rad / 2);
+   double l        = meanLong * rad;
+   double m        = meanAnom * rad;
+   double dec      = asin(sin(obliq * rad) * sin(appLong * rad));
+   double eqTime   = 4 / rad * (y * sin(2 * l) - 2 * ecc * sin(m) + 4 * ecc * y * sin(m) * cos(2 * l)
+                   - 0.5 * y * y * sin(4 * l) - 1.25 * ecc * ecc * sin(2 * m));
+   double solar    = fmod(utc, 86400) / 60 + eqTime + 4 * LONGITUDE;
+   double ha       = (solar / 4 - 180) * rad;
+   double lat      = LATITUDE * rad;
+
+   return asin(sin(lat) * sin(dec) + cos(lat) * cos(dec) * cos(ha)) / rad;
+}
+
+/* Time the elevation is crossed between the two times, the elevation is monotonic in between */
+double Crossing(double from, double to, double elevation)
+{
+   bool rising = Elevation(from) < Elevation(to);
+
+   for (int i = 0; i < 50; i++) {
+      double mid = (from + to) / 2;
+
+      if ((Elevation(mid) < elevation) == rising) {
+         from = mid;
+      } else {
+         to = mid;
+      }
+   }
+   return (from + to) / 2;
+}
+
+/* Time of the highest elevation between the two times */
+double Noon(double from, double to)
+{
+   for (int i = 0; i < 100; i++) {
+      double a = from + (to - from) / 3;
+      double b = to - (to - from) / 3;
+
+      if (Elevation(a) < Elevation(b)) {
+         from = a;
+      } else {
+         to = b;
+      }
+   }
+   return (from + to) / 2;
+}
+
+int main()
+{
+   PortStorage storage;
+   double      worst[5] = { 0, 0, 0, 0, 0 };
+   double      worstElevation = 0;
+
+   portStorage = &storage;
+
+   for (int d = 0; d < 365; d++) {
+      time_t utc   = SUN_YEAR + d * 86400 + 12 * 3600;
+      SunDay day   = sun.Day(utc);
+      double noon  = Noon(day.noon - 3600, day.noon + 3600);
+      double times[5] = {
+         Crossing(noon - 12 * 3600, noon, SUN_TWILIGHT_ELEVATION), Crossing(noon - 12 * 3600, noon, SUN_RISE_ELEVATION), noon,
+         Crossing(noon, noon + 12 * 3600, SUN_RISE_ELEVATION), Crossing(noon, noon + 12 * 3600, SUN_TWILIGHT_ELEVATION),
+      };
+      time_t found[5] = { day.dawn, day.sunrise, day.noon, day.sunset, day.dusk };
+
+      // the local day of the times
+      CHECK(timeZone.Local(day.noon) / 86400 == timeZone.Local(utc) / 86400);
+      for (int t = 0; t < 5; t++) {
+         worst[t] = max(worst[t], fabs(found[t] - times[t]));
+      }
+      worstElevation = max(worstElevation, fabs(day.noonElevation - Elevation(noon)));
+   }
+   // within a minute of the NOAA results, the noon within the flat top of the curve
+   for (int t = 0; t < 5; t++) {
+      CHECK(worst[t] < 60);
+   }
+   CHECK(worstElevation < 0.05);
+
+   // the noon at the solstices, the sunrise before the sunset
+   SunDay summer = sun.Day(SUN_YEAR + 171 * 86400);
+   SunDay winter = sun.Day(SUN_YEAR + 354 * 86400);
+
+   CHECK(fabs(summer.noonElevation - (90 - LATITUDE + 23.44)) < 0.2);
+   CHECK(fabs(winter.noonElevation - (90 - LATITUDE - 23.44)) < 0.2);
+   CHECK(summer.dawn < summer.sunrise && summer.sunrise < summer.noon && summer.noon < summer.sunset && summer.sunset < summer.dusk);
+   CHECK(summer.sunset - summer.sunrise > 15 * 3600 && winter.sunset - winter.sunrise < 9 * 3600);
+
+   printf("largest error of dawn %.0f s, sunrise %.0f s, noon %.0f s, sunset %.0f s, dusk %.0f s, noon elevation %.3f deg\n",
+      worst[0], worst[1], worst[2], worst[3], worst[4], worstElevation);
+   time_t utc = SUN_YEAR;
+   printf("Day() %.1f us, Elevation() %.2f us\n", MeasureUs(10000, [&] { sun.Day(utc += 86400); }),
+      MeasureUs(100000, [&] { sun.Elevation(utc += 600); }));
+
+   portStorage = NULL;
+   return CheckResult("sun");
+}
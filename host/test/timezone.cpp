@@ -0,0 +1,83 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file timezone.cpp
+  *
+  * Test of the TimeZone: the offset of every hour of some years against
+  * the C library with the same TZ string, forwards and backwards, and
+  * the NVS is only written when the stored table moves to a later year.
+  */
+#include <M5EPD.h>
+#include M5_CONFIG
+#include <TimeLib.h>
+#include "TimeZone.h"
+#include "Check.h"
+
+#define TZ_FROM 1577836800 //!< 2020-01-01 00:00 UTC
+#define TZ_TO   1830297600 //!< 2028-01-01 00:00 UTC
+#define TZ_KEY  "Setting/timezone"
+
+/* Offset of the C library for the TIMEZONE */
+int32_t LibcOffset(time_t utc)
+{
+   struct tm tm;
+
+   localtime_r(&utc, &tm);
+   return tm.tm_gmtoff;
+}
+
+int main()
+{
+   PortStorage storage;
+   TimeZone    zone;
+   int         errors = 0;
+
+   portStorage = &storage;
+   setenv("TZ", TIMEZONE, 1);
+   tzset();
+
+   // forwards the stored table follows the years, backwards the older ones are built in the memory
+   for (time_t utc = TZ_FROM; utc < TZ_TO; utc += 3600) {
+      errors += zone.Offset(utc) != LibcOffset(utc);
+   }
+   for (time_t utc = TZ_TO - 3600; utc >= TZ_FROM; utc -= 3600) {
+      errors += zone.Offset(utc) != LibcOffset(utc);
+   }
+   printf("%d of %d hours differ from the C library\n", errors, (int) (TZ_TO - TZ_FROM) / 1800);
+   CHECK(errors == 0);
+
+   // New Year moves the stored table once, then the history of the last week
+   // alternates between the years without writing the NVS
+   zone.Offset(TZ_TO);
+   CHECK(storage.nvs.count(TZ_KEY) == 1);
+   storage.nvs.erase(TZ_KEY);
+   for (int i = 0; i < 100; i++) {
+      time_t utc = TZ_TO + i * 3600;
+      zone.Offset(utc);
+      zone.Offset(utc - SECS_PER_WEEK);
+   }
+   CHECK(storage.nvs.count(TZ_KEY) == 0);
+
+   // a later year moves the stored table, a restart reads it
+   zone.Offset(TZ_TO + 2 * 366 * SECS_PER_DAY);
+   CHECK(storage.nvs.count(TZ_KEY) == 1);
+   TimeZone restarted;
+   CHECK(restarted.Offset(TZ_TO + 2 * 366 * SECS_PER_DAY) == LibcOffset(TZ_TO + 2 * 366 * SECS_PER_DAY));
+
+   portStorage = NULL;
+   return CheckResult("timezone");
+}
@@ -0,0 +1,129 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file traffic.cpp
+  *
+  * Simulation of the TrafficModel: a bucket learns the mean and the
+  * deviation of its responses without a bias, and after weeks of
+  * roadworks the model predicts as many routes as before.
+  */
+#include <M5EPD.h>
+#include M5_CONFIG
+#include <random>
+#include "Traffic.h"
+#include "Check.h"
+
+#define WEEKS_BEFORE    8  //!< Weeks of the usual traffic
+#define WEEKS_ROADWORKS 4  //!< Weeks of the roadworks
+#define WEEKS_AFTER     52 //!< Weeks of the usual traffic after the roadworks
+
+/* Access to the learned cells */
+class TestModel : public TrafficModel
+{
+public:
+   /* Mean seconds of the route and bucket */
+   double Mean(int route, time_t local)
+   {
+      Load();
+      return table->cells[route][Bucket(local)].mean / (double) TRAFFIC_FRACTION;
+   }
+
+   /* Mean absolute deviation in seconds of the route and bucket */
+   double Spread(int route, time_t local)
+   {
+      Load();
+      return table->cells[route][Bucket(local)].spread / (double) TRAFFIC_FRACTION;
+   }
+};
+
+/* Week of wakes about every 10 minutes of the morning commute, the share of the predicted routes */
+double Week(TestModel &model, time_t monday, int usual, int noise, std::mt19937 &random)
+{
+   std::uniform_int_distribution<int> deviation(-noise, noise);
+   std::uniform_int_distribution<int> jitter(0, 180);
+   int                                routes = 0;
+   int                                predicted = 0;
+
+   for (int day = 0; day < 5; day++) {
+      for (int minutes = 7 * 60; minutes < 9 * 60; minutes += 10) {
+         time_t local = monday + day * SECS_PER_DAY + minutes * 60 + jitter(random);
+
+         for (int r = 0; r < commuteRouteCount; r++) {
+            uint32_t seconds;
+
+            routes++;
+            if (model.Predict(r, local, seconds)) {
+               predicted++;
+            } else {
+               model.Learn(r, local, usual + deviation(random));
+            }
+         }
+         model.Save();
+      }
+   }
+   return (double) predicted / routes;
+}
+
+int main()
+{
+   PortStorage  storage;
+   TestModel    model;
+   std::mt19937 random(42);
+   time_t       monday = 1634515200; // 18.10.2021
+   time_t       sunday = monday + 6 * SECS_PER_DAY + 12 * SECS_PER_HOUR;
+   double       before = 0;
+   double       after = 0;
+   uint32_t     seconds = 0;
+
+   storage.AddPartition(TRAFFIC_PARTITION, 0x10000);
+   portStorage = &storage;
+
+   // a bucket with a jam of 40 minutes +-5, then 30 minutes +-40 seconds: the mean
+   // swings less than 4 seconds around the 30 minutes and the deviation predicts again
+   for (int i = 0; i < 10; i++) {
+      model.Learn(1, sunday, i & 1 ? 2700 : 2100);
+   }
+   for (int i = 0; i < 60; i++) {
+      model.Learn(1, sunday, i & 1 ? 1840 : 1760);
+   }
+   printf("bucket of 1800 +-40 s after a jam: mean %.2f s, deviation %.2f s\n", model.Mean(1, sunday), model.Spread(1, sunday));
+   CHECK(fabs(model.Mean(1, sunday) - 1800) < 4);
+   CHECK(model.Spread(1, sunday) < 45);
+   CHECK(model.Predict(1, sunday, seconds) && seconds / 10 == 180);
+   model.Save();
+
+   // 30 minutes +-40 seconds, 40 minutes +-6 minutes in the roadworks, a bucket gets
+   // about one response a week, so the model needs months to forget the roadworks
+   for (int week = 0; week < WEEKS_BEFORE + WEEKS_ROADWORKS + WEEKS_AFTER; week++) {
+      bool   roadworks = week >= WEEKS_BEFORE && week < WEEKS_BEFORE + WEEKS_ROADWORKS;
+      double hits      = Week(model, monday + week * SECS_PER_WEEK, roadworks ? 2400 : 1800, roadworks ? 360 : 40, random);
+
+      printf("week %2d%s: %3.0f%% predicted\n", week + 1, roadworks ? " roadworks" : "          ", hits * 100);
+      if (week >= WEEKS_BEFORE - 4 && week < WEEKS_BEFORE) {
+         before += hits / 4;
+      }
+      if (week >= WEEKS_BEFORE + WEEKS_ROADWORKS + WEEKS_AFTER - 4) {
+         after += hits / 4;
+      }
+   }
+   printf("predicted %.0f%% before and %.0f%% in the last weeks after the roadworks\n", before * 100, after * 100);
+   CHECK(before > 0.5);
+   CHECK(after > before * 0.9);
+
+   portStorage = NULL;
+   return CheckResult("traffic");
+}
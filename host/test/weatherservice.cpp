@@ -0,0 +1,150 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file weatherservice.cpp
+  *
+  * Test of the weather providers and the hedged requests against
+  * tools/fixtureserver.py: openweathermap and open-meteo fill the same
+  * weather from the same synthetic forecast, a slow or failing primary
+  * provider is replaced by the next one.
+  */
+#include <M5EPD.h>
+#include M5_CONFIG
+#include "WeatherService.h"
+#include "Check.h"
+#include "Fixture.h"
+
+/* Both series hold the same buckets */
+template <int N> bool Same(const Decimator<N> &a, const Decimator<N> &b)
+{
+   bool same = a.Size() == b.Size() && a.Factor() == b.Factor();
+
+   for (int i = 0; same && i < a.Size(); i++) {
+      same = fabs(a.Min(i) - b.Min(i)) < 1e-3 && fabs(a.Max(i) - b.Max(i)) < 1e-3 && fabs(a.Mean(i) - b.Mean(i)) < 1e-3;
+   }
+   return same;
+}
+
+/* Both providers translate the answers of the fixture server into the same weather */
+void CheckProviders()
+{
+   Weather onecall;
+   Weather forecast;
+
+   CHECK(openWeather.Fetch(onecall) && onecall.currentTime);
+   CHECK(openMeteo.Fetch(forecast) && forecast.currentTime);
+
+   CHECK(abs(onecall.currentTime - forecast.currentTime) <= 1); // the second may pass between the requests
+   CHECK(onecall.sunrise == forecast.sunrise && onecall.sunset == forecast.sunset);
+   CHECK(onecall.temp == forecast.temp && onecall.tempFeelsLike == forecast.tempFeelsLike);
+   CHECK(onecall.humidity == forecast.humidity && onecall.pressure == forecast.pressure && onecall.windspeed == forecast.windspeed);
+   for (int i = 0; i < MAX_FORECAST_DAILY; i++) {
+      CHECK(onecall.dailyTime[i] == forecast.dailyTime[i] && onecall.dailyMaxTemp[i] == forecast.dailyMaxTemp[i]);
+      CHECK(onecall.dailyMain[i] == forecast.dailyMain[i] && onecall.dailyIcon[i] == forecast.dailyIcon[i]);
+   }
+   CHECK(Same(onecall.forecastTemp, forecast.forecastTemp) && onecall.forecastTemp.Size() > 0);
+   CHECK(Same(onecall.forecastRain, forecast.forecastRain) && onecall.forecastRain.Highest() > 0);
+   CHECK(Same(onecall.forecastSnow, forecast.forecastSnow));
+   CHECK(onecall.minTemp == forecast.minTemp && onecall.maxTemp == forecast.maxTemp && onecall.maxRain == forecast.maxRain);
+
+   // the 61 minutes of mm/h and the 4 quarters of mm
+   CHECK(onecall.nowcastRain.Size() > 0 && forecast.nowcastRain.Size() == 4);
+   CHECK(fabs(onecall.nowcastRain.Highest() - forecast.nowcastRain.Highest()) < 1);
+
+   // open-meteo has no air quality
+   CHECK(onecall.airQuality == 3 && forecast.airQuality == 0);
+}
+
+/* Weather of the service and the time of the request in ms */
+bool Get(Weather &weather, uint32_t &ms)
+{
+   uint32_t start = millis();
+   bool     success;
+
+   success = weatherService.Get(weather);
+   ms      = millis() - start;
+   weatherService.Join();
+   return success;
+}
+
+int main()
+{
+   Weather  weather;
+   uint32_t ms;
+
+   {
+      FixtureServer server;
+
+      CheckProviders();
+   }
+   {
+      FixtureServer server({ "--chunked" });
+
+      CheckProviders();
+   }
+   {
+      FixtureServer server;
+
+      // the percentile of the primary provider is learned by the requests, on
+      // the loopback it is that short that open-meteo may be hedged and win
+      for (int i = 0; i < 20; i++) {
+         CHECK(Get(weather, ms) && weather.currentTime);
+      }
+      int hedge = netStats.Latency(NET_WEATHER, NET_TOTAL, WEATHER_HEDGE_PERCENT);
+
+      CHECK(hedge > 0 && hedge < 200);
+      printf("openweathermap answered within %d ms, %d ms the last time\n", hedge, (int) ms);
+   }
+   {
+      FixtureServer server({ "--delay", "openweathermap=1500" });
+
+      // the slow primary provider is hedged behind its percentile
+      CHECK(Get(weather, ms) && weather.airQuality == 0);
+      CHECK(ms < 1000);
+      printf("open-meteo answered after %d ms for the slow openweathermap\n", (int) ms);
+   }
+   {
+      FixtureServer server({ "--fail", "openweathermap=1" });
+
+      // the failed primary provider is replaced at once
+      CHECK(Get(weather, ms) && weather.airQuality == 0 && weather.currentTime);
+      CHECK(ms < 1000);
+   }
+   {
+      FixtureServer server({ "--fail", "openweathermap=1", "--fail", "open-meteo=1" });
+
+      CHECK(!Get(weather, ms) && !weather.success);
+      CHECK(ms < 1000);
+   }
+   {
+      FixtureServer server;
+
+      CHECK(Get(weather, ms) && weather.success);
+   }
+
+   // benchmark of the fill of the providers
+   {
+      FixtureServer server;
+      Weather       onecall;
+      Weather       forecast;
+
+      printf("fetch openweathermap %.0f us, open-meteo %.0f us\n",
+         MeasureUs(20, [&] { openWeather.Fetch(onecall); }), MeasureUs(20, [&] { openMeteo.Fetch(forecast); }));
+   }
+
+   return CheckResult("weatherservice");
+}
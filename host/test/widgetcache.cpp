@@ -0,0 +1,175 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file widgetcache.cpp
+  *
+  * Test and benchmark of the WidgetCache: a frame from the cache is the
+  * same as the drawn one and a hit is cheaper than the drawing.
+  */
+#include <M5EPD.h>
+#include M5_CONFIG
+#include "Display.h"
+#include "Check.h"
+
+#define DAILY_DX 113 //!< Width of a cell of the daily forecast
+#define DAILY_DY 122 //!< Height of a cell of the daily forecast
+
+MyData myData; //!< Data of the frames
+
+/* Access to the drawing of the widgets */
+class TestDisplay : public WeatherDisplay
+{
+public:
+   TestDisplay(MyData &md)
+      : WeatherDisplay(md)
+   {
+   }
+
+   /* Draw the whole frame like Show() without the push, with or without the cache */
+   void Frame(time_t time, bool cached)
+   {
+      SetFrameTime(time);
+      PrepareHistory();
+      canvas.createCanvas(maxX, maxY);
+      if (cached) {
+         widgetCache.LoadNVS();
+      }
+      RenderRegions(LAYER_ALL);
+      if (cached) {
+         widgetCache.SaveNVS();
+      }
+      FreeRegions();
+   }
+
+   /* Draw a daily cell like DrawFrame() */
+   void Daily(M5EPD_Canvas &target, int x, int index)
+   {
+      DrawDaily(target, x, 0, DAILY_DX, DAILY_DY, myData.weather, index);
+   }
+
+   WidgetCache &Cache()
+   {
+      return widgetCache;
+   }
+};
+
+/* The pixel per pixel copy of a hit before the rows were copied with memcpy */
+void BlitPixels(M5EPD_Canvas &target, int x, int y, int dx, int dy, const uint8_t *pixels)
+{
+   for (int i = 0; i < dx * dy; i++) {
+      uint8_t pixel = (i & 1) ? pixels[i / 2] & 0x0F : pixels[i / 2] >> 4;
+      target.drawPixel(x + i % dx, y + i / dx, pixel);
+   }
+}
+
+/* Background of the daily row, the cell is G3 and the pixels around it G5 */
+void Prepare(M5EPD_Canvas &target, int x)
+{
+   target.fillCanvas(M5EPD_Canvas::G5);
+   target.fillRect(x, 0, DAILY_DX, DAILY_DY, M5EPD_Canvas::G3);
+}
+
+int main()
+{
+   PortStorage storage;
+   time_t      now = 1634630400; // 19.10.2021 08:00 UTC
+   uint8_t     drawn[960 * 540 / 2];
+
+   storage.AddPartition(WIDGET_CACHE_PARTITION, WIDGET_CACHE_BYTES);
+   storage.AddPartition(HISTORY_PARTITION, 0x10000);
+   portStorage = &storage;
+
+   const char *icons[] = { "01d", "10d", "13d", "04d", "50d" };
+   for (int i = 0; i < MAX_FORECAST_DAILY; i++) {
+      myData.weather.dailyTime[i]    = now + i * SECS_PER_DAY;
+      myData.weather.dailyMaxTemp[i] = 10 + i;
+      myData.weather.dailyIcon[i]    = icons[i % 5];
+   }
+   myData.weather.success = true;
+   myData.astronauts      = 7;
+
+   // the frame from the cache is the drawn frame
+   TestDisplay uncached(myData);
+   TestDisplay cached(myData);
+
+   uncached.Frame(now, false);
+   memcpy(drawn, canvas.frameBuffer(1), sizeof(drawn));
+   cached.Frame(now, true);
+   CHECK(memcmp(drawn, canvas.frameBuffer(1), sizeof(drawn)) == 0);
+   cached.Frame(now, true);
+   CHECK(memcmp(drawn, canvas.frameBuffer(1), sizeof(drawn)) == 0);
+
+   // a hit at the odd positions of the cells keeps the pixels left and right of them,
+   // other temperatures keep the cells of the frame with its white background out
+   for (int i = 0; i < MAX_FORECAST_DAILY; i++) {
+      myData.weather.dailyMaxTemp[i] += 20;
+   }
+   M5EPD_Canvas row(&M5.EPD);
+   M5EPD_Canvas expected(&M5.EPD);
+
+   row.createCanvas(468, DAILY_DY);
+   expected.createCanvas(468, DAILY_DY);
+   cached.Cache().LoadNVS();
+   for (int i = 0, x = 13; i < 4; i++, x += DAILY_DX) {
+      Prepare(expected, x);
+      uncached.Daily(expected, x, i);
+      Prepare(row, x);
+      cached.Daily(row, x, i); // miss, stores
+      Prepare(row, x);
+      cached.Daily(row, x, i); // hit from the memory
+      CHECK(memcmp(row.frameBuffer(1), expected.frameBuffer(1), 468 * DAILY_DY / 2) == 0);
+   }
+   cached.Cache().SaveNVS();
+   cached.Cache().LoadNVS();
+   for (int i = 0, x = 13; i < 4; i++, x += DAILY_DX) {
+      Prepare(expected, x);
+      uncached.Daily(expected, x, i);
+      Prepare(row, x);
+      cached.Daily(row, x, i); // hit from the flash
+      CHECK(memcmp(row.frameBuffer(1), expected.frameBuffer(1), 468 * DAILY_DY / 2) == 0);
+   }
+
+   // hit against the drawing of a daily cell and of the astronaut digit
+   std::vector<uint8_t> pixels(DAILY_DX * DAILY_DY / 2 + 1);
+   int                  calls = 2000;
+
+   row.fillCanvas(0);
+   uncached.Daily(row, 126, 1);
+   for (int i = 0; i < DAILY_DX * DAILY_DY; i++) {
+      uint8_t pixel = row.readPixel(126 + i % DAILY_DX, i / DAILY_DX) & 0x0F;
+      pixels[i / 2] = (i & 1) ? (pixels[i / 2] | pixel) : pixel << 4;
+   }
+   double drawDaily   = MeasureUs(calls, [&]() { uncached.Daily(row, 126, 1); });
+   double hitDaily    = MeasureUs(calls, [&]() { cached.Daily(row, 126, 1); });
+   double pixelsDaily = MeasureUs(calls, [&]() { BlitPixels(row, 126, 0, DAILY_DX, DAILY_DY, pixels.data()); });
+
+   uint32_t key = 0x12345678;
+   row.setTextSize(3);
+   row.drawRightString("7", 182, 70, 1);
+   CHECK(cached.Cache().Store(row, 115, 70, 67, 24, key));
+   double drawDigit   = MeasureUs(calls, [&]() { row.drawRightString("7", 182, 70, 1); });
+   double hitDigit    = MeasureUs(calls, [&]() { cached.Cache().Blit(row, 115, 70, 67, 24, key); });
+   double pixelsDigit = MeasureUs(calls, [&]() { BlitPixels(row, 115, 70, 67, 24, pixels.data()); });
+
+   printf("daily cell %dx%d: drawn %.1f us, hit %.1f us, hit pixel by pixel %.1f us\n", DAILY_DX, DAILY_DY, drawDaily, hitDaily, pixelsDaily);
+   printf("astronaut digit 67x24: drawn %.1f us, hit %.1f us, hit pixel by pixel %.1f us\n", drawDigit, hitDigit, pixelsDigit);
+   CHECK(hitDaily < drawDaily);
+   CHECK(hitDaily < pixelsDaily);
+
+   portStorage = NULL;
+   return CheckResult("widgetcache");
+}
@@ -0,0 +1,107 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file workers.cpp
+  *
+  * Test and benchmark of the parallel rendering: the frame of
+  * RENDER_WORKERS tasks is byte for byte the frame of the single task,
+  * also in repeated runs, and the render time of both.
+  */
+#include <M5EPD.h>
+#include M5_CONFIG
+#include <thread>
+#include "Display.h"
+#include "Check.h"
+
+#define FRAME_BYTES (960 * 540 / 2) //!< Size of the 4 bit frame buffer
+#define RUNS        20              //!< Renderings with the workers, the order of the regions differs
+
+MyData myData; //!< Data of the frames
+
+/* Rendering with a chosen number of workers */
+class TestDisplay : public WeatherDisplay
+{
+public:
+   TestDisplay(MyData &md)
+      : WeatherDisplay(md)
+   {
+   }
+
+   /* Draw the whole frame like Show() without the push with the number of workers */
+   void Frame(time_t time, int count)
+   {
+      SetFrameTime(time);
+      PrepareHistory();
+      canvas.createCanvas(maxX, maxY);
+      workers = count;
+      RenderRegions(LAYER_ALL);
+      FreeRegions();
+   }
+};
+
+int main()
+{
+   PortStorage storage;
+   time_t      now = 1634630400; // 19.10.2021 08:00 UTC
+   uint8_t     single[FRAME_BYTES];
+
+   storage.AddPartition(WIDGET_CACHE_PARTITION, WIDGET_CACHE_BYTES);
+   storage.AddPartition(HISTORY_PARTITION, 0x10000);
+   portStorage = &storage;
+
+   const char *icons[] = { "01d", "10d", "13d", "04d", "50d" };
+   for (int i = 0; i < MAX_FORECAST_DAILY; i++) {
+      myData.weather.dailyTime[i]    = now + i * SECS_PER_DAY;
+      myData.weather.dailyMaxTemp[i] = 10 + i;
+      myData.weather.dailyIcon[i]    = icons[i % 5];
+   }
+   myData.weather.forecastTemp.Begin(FORECAST_HOURS + 1);
+   myData.weather.forecastRain.Begin(FORECAST_HOURS + 1);
+   myData.weather.forecastSnow.Begin(FORECAST_HOURS + 1);
+   for (int i = 0; i <= FORECAST_HOURS; i++) {
+      myData.weather.forecastTemp.Add(8 + i % 12);
+      myData.weather.forecastRain.Add((i % 5) * 0.4);
+      myData.weather.forecastSnow.Add(0);
+   }
+   myData.weather.Finish();
+   myData.weather.success = true;
+   myData.astronauts      = 7;
+
+   TestDisplay display(myData);
+
+   display.Frame(now, 1);
+   memcpy(single, canvas.frameBuffer(1), FRAME_BYTES);
+   CHECK(std::count(single, single + FRAME_BYTES, 0) < FRAME_BYTES * 9 / 10); // the frame is drawn
+
+   int differs = 0;
+   for (int run = 0; run < RUNS; run++) {
+      display.Frame(now, RENDER_WORKERS);
+      differs += memcmp(single, canvas.frameBuffer(1), FRAME_BYTES) != 0;
+   }
+   printf("%d workers: %d of %d frames differ from the single task\n", RENDER_WORKERS, differs, RUNS);
+   CHECK(differs == 0);
+
+   // the workers of the port are threads, the speedup depends on the cores of the host
+   double singleUs   = MeasureUs(RUNS, [&]() { display.Frame(now, 1); });
+   double parallelUs = MeasureUs(RUNS, [&]() { display.Frame(now, RENDER_WORKERS); });
+
+   printf("frame with 1 worker %.0f us, with %d workers %.0f us, speedup %.2f on %u cores\n",
+      singleUs, RENDER_WORKERS, parallelUs, singleUs / parallelUs, std::thread::hardware_concurrency());
+
+   portStorage = NULL;
+   return CheckResult("workers");
+}
@@ -20,10 +20,11 @@
   * Class for reading astronauts in space data.
   */
 #pragma once
-#include <HTTPClient.h>
-#include <WiFiClient.h>
 #include <ArduinoJson.h>
 #include "Data.h"
+#include "HttpFetch.h"
+#include "Timeline.h"
+#include "Trace.h"
 
 class Astronaut
 {
@@ -33,41 +34,10 @@ protected:
    /* Calls the open-notify request and deserialisation the json data. */
    bool GetAstronautJsonDoc(DynamicJsonDocument &doc)
    {
-      WiFiClient client;
-      HTTPClient http;
-      String     server;
-      int        port;
-      String     uri;
-      
-      server += "api.open-notify.org";
-      port = 80;
-      uri += "/astros.json";
+      TimelineScope phase("astronaut", CURRENT_WIFI_MA);
+      TRACE_FUNCTION();
 
-      Serial.printf("Requesting %s to %s\n", uri.c_str(), server.c_str());
-
-      client.stop();
-      http.begin(client, server, port, uri);
-      
-      int httpCode = http.GET();
-      
-      Serial.printf("Read %d bytes\n", http.getSize());
-
-      if (httpCode != HTTP_CODE_OK) {
-         Serial.printf("GetAstronaut failed, error: %s", http.errorToString(httpCode).c_str());
-         client.stop();
-         http.end();
-         return false;
-      } else {
-         DeserializationError error = deserializeJson(doc, http.getStream());
-         
-         if (error) {
-            Serial.print(F("deserializeJson() failed: "));
-            Serial.println(error.c_str());
-            return false;
-         } else {
-            return true;
-         }
-      }
+      return HttpFetchJson(NET_ASTRONAUT, "api.open-notify.org", 80, "/astros.json", doc);
    }
 
 
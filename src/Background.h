@@ -0,0 +1,96 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Background.h
+  * 
+  * Static layer of the frame cached in the 'chrome' flash partition.
+  */
+#pragma once
+#include <esp_partition.h>
+#include "Log.h"
+
+#define BACKGROUND_PARTITION "chrome"     //!< Label of the partition in partitions.csv
+#define BACKGROUND_MAGIC     0x43485231u  //!< 'CHR1'
+#define BACKGROUND_OFFSET    4096         //!< Image offset behind the header sector
+
+/**
+  * Stores the packed 4 bit image of the static layer (frame, headings, 
+  * fixed icons and labels) once in the flash. Every wake starts with a bulk 
+  * copy of it instead of drawing the static parts again.
+  */
+class BackgroundLayer
+{
+protected:
+   /* Header in the first sector of the partition */
+   struct Header
+   {
+      uint32_t magic; //!< BACKGROUND_MAGIC
+      uint32_t key;   //!< Key of the layout the image belongs to
+      uint32_t len;   //!< Length of the image in bytes
+   };
+
+   const esp_partition_t *Partition()
+   {
+      return esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, BACKGROUND_PARTITION);
+   }
+
+public:
+   BackgroundLayer()
+   {
+   }
+
+   /* Read the image if it belongs to the current layout key */
+   bool Load(uint8_t *frame, size_t len, uint32_t key)
+   {
+      const esp_partition_t *partition = Partition();
+      Header                 header;
+
+      if (!partition) {
+         LOG(LOG_BACKGROUND_MISSING, BACKGROUND_PARTITION);
+         return false;
+      }
+      if (esp_partition_read(partition, 0, &header, sizeof(header)) != ESP_OK) {
+         return false;
+      }
+      if (header.magic != BACKGROUND_MAGIC || header.key != key || header.len != len) {
+         LOG(LOG_BACKGROUND_OUTDATED);
+         return false;
+      }
+      return esp_partition_read(partition, BACKGROUND_OFFSET, frame, len) == ESP_OK;
+   }
+
+   /* Write the image of the current layout key */
+   bool Store(const uint8_t *frame, size_t len, uint32_t key)
+   {
+      const esp_partition_t *partition = Partition();
+      Header                 header    = { BACKGROUND_MAGIC, key, (uint32_t) len };
+      size_t                 eraseLen  = (BACKGROUND_OFFSET + len + 4095) & ~4095;
+
+      if (!partition || eraseLen > partition->size) {
+         LOG(LOG_BACKGROUND_SMALL);
+         return false;
+      }
+      // the header is written last, an interrupted write leaves an invalid image
+      if (esp_partition_erase_range(partition, 0, eraseLen) != ESP_OK ||
+          esp_partition_write(partition, BACKGROUND_OFFSET, frame, len) != ESP_OK ||
+          esp_partition_write(partition, 0, &header, sizeof(header)) != ESP_OK) {
+         LOG(LOG_BACKGROUND_FAILED);
+         return false;
+      }
+      return true;
+   }
+};
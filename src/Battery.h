@@ -20,35 +20,152 @@
   * Helperfunctions for reading the battery value.
   */
 #pragma once
-
+#include <nvs.h>
 #include "Data.h"
 
+// Defaults, can be overwritten in the Config.h
+#ifndef BATTERY_LOW_CAPACITY
+#define BATTERY_LOW_CAPACITY      20 //!< Below this capacity the update intervals are doubled
+#endif
+#ifndef BATTERY_DEGRADED_CAPACITY
+#define BATTERY_DEGRADED_CAPACITY 10 //!< Below this capacity the device runs in the degraded mode
+#endif
+
+#define BATTERY_HISTORY           8  //!< Readings of the last wakes for the discharge rate
+#define BATTERY_SPACING        3600  //!< Min seconds between the readings of the history, the rate spans hours
+#define BATTERY_SMOOTHING       0.3f //!< Weight of a new reading in the smoothed voltage
+
+/* Li-ion discharge curve, voltage in mV to capacity in %, sorted by voltage */
+const int batteryCurve[][2] = {
+   { 3300,   0 }, { 3610,   5 }, { 3690,  10 }, { 3710,  15 }, { 3730,  20 },
+   { 3750,  25 }, { 3770,  30 }, { 3790,  35 }, { 3800,  40 }, { 3820,  45 },
+   { 3840,  50 }, { 3850,  55 }, { 3870,  60 }, { 3910,  65 }, { 3950,  70 },
+   { 3980,  75 }, { 4020,  80 }, { 4080,  85 }, { 4110,  90 }, { 4150,  95 },
+   { 4200, 100 }
+};
+
+/* Battery readings of the last wakes stored in the non volatile memory */
+struct BatteryHistory
+{
+   float    smoothedVolt;              //!< Smoothed voltage in mV
+   uint8_t  count;                     //!< Number of valid readings
+   uint32_t time[BATTERY_HISTORY];     //!< Time of the readings, the newest first
+   float    capacity[BATTERY_HISTORY]; //!< Capacity of the readings in %
+};
+
+/* Capacity in % of the voltage in mV from the discharge curve */
+float BatteryCapacityFromVolt(float mV)
+{
+   const int points = sizeof(batteryCurve) / sizeof(batteryCurve[0]);
+
+   if (mV <= batteryCurve[0][0]) {
+      return 0;
+   }
+   for (int i = 1; i < points; i++) {
+      if (mV < batteryCurve[i][0]) {
+         float part = (mV - batteryCurve[i - 1][0]) / (batteryCurve[i][0] - batteryCurve[i - 1][0]);
+         return batteryCurve[i - 1][1] + part * (batteryCurve[i][1] - batteryCurve[i - 1][1]);
+      }
+   }
+   return 100;
+}
+
+/* Load the battery history from the non volatile memory */
+void LoadBatteryHistory(BatteryHistory &history)
+{
+   nvs_handle nvs_arg;
+   size_t     len = sizeof(history);
+
+   memset(&history, 0, sizeof(history));
+   if (nvs_open("Setting", NVS_READONLY, &nvs_arg) == ESP_OK) {
+      if (nvs_get_blob(nvs_arg, "battery", &history, &len) != ESP_OK || len != sizeof(history)) {
+         memset(&history, 0, sizeof(history));
+      }
+      nvs_close(nvs_arg);
+   }
+}
+
+/* Store the battery history to the non volatile memory */
+void SaveBatteryHistory(BatteryHistory &history)
+{
+   nvs_handle nvs_arg;
+   nvs_open("Setting", NVS_READWRITE, &nvs_arg);
+   nvs_set_blob(nvs_arg, "battery", &history, sizeof(history));
+   nvs_commit(nvs_arg);
+   nvs_close(nvs_arg);
+}
+
+/* Discharge rate in % per hour from the history, 0 if unknown */
+float BatteryDischargeRate(BatteryHistory &history)
+{
+   if (history.count < 2) {
+      return 0;
+   }
+   // least squares slope over the stored readings
+   float meanT = 0, meanC = 0, covar = 0, var = 0;
+   for (int i = 0; i < history.count; i++) {
+      meanT += (float) (history.time[i] - history.time[history.count - 1]) / SECS_PER_HOUR;
+      meanC += history.capacity[i];
+   }
+   meanT /= history.count;
+   meanC /= history.count;
+   for (int i = 0; i < history.count; i++) {
+      float t = (float) (history.time[i] - history.time[history.count - 1]) / SECS_PER_HOUR - meanT;
+      covar += t * (history.capacity[i] - meanC);
+      var   += t * t;
+   }
+   if (var <= 0 || covar >= 0) {
+      return 0;
+   }
+   return -covar / var;
+}
+
 /**
-  * Read the battery voltage
+  * Read the battery voltage, smooth it with the readings of the last wakes,
+  * map it on the discharge curve and predict the remaining runtime.
   */
-bool GetBatteryValues(MyData &myData)
+bool GetBatteryValues(MyData &myData, time_t now)
 {
-   uint32_t vol = M5.getBatteryVoltage();
+   BatteryHistory history;
+   uint32_t       vol = M5.getBatteryVoltage();
+
+   LoadBatteryHistory(history);
 
-   if (vol < 3300) {
-      vol = 3300;
-   } else if (vol > 4350) {
-      vol = 4350;
+   // a large step is a charger, start again
+   if (history.smoothedVolt == 0 || fabs(vol - history.smoothedVolt) > 200) {
+      history.smoothedVolt = vol;
+      history.count        = 0;
+   } else {
+      history.smoothedVolt += BATTERY_SMOOTHING * (vol - history.smoothedVolt);
    }
-  
-   float battery = (float)(vol - 3300) / (float)(4350 - 3300);
 
-   myData.batteryVolt = vol / 1000.0f;
-   Serial.println("batteryVolt: " + String(myData.batteryVolt));
-   
-   if (battery <= 0.01) {
-      battery = 0.01;
+   float capacity = BatteryCapacityFromVolt(history.smoothedVolt);
+
+   if (history.count > 0 && capacity > history.capacity[0] + 5) {
+      history.count = 0; // charged
    }
-   if (battery > 1) {
-      battery = 1;
+   // the readings of 10 minutes apart differ less than the noise of the adc,
+   // the history keeps one reading per BATTERY_SPACING
+   if (history.count == 0 || now - history.time[0] >= BATTERY_SPACING) {
+      memmove(&history.time[1],     &history.time[0],     sizeof(history.time[0])     * (BATTERY_HISTORY - 1));
+      memmove(&history.capacity[1], &history.capacity[0], sizeof(history.capacity[0]) * (BATTERY_HISTORY - 1));
+      history.time[0]     = now;
+      history.capacity[0] = capacity;
+      history.count       = min(history.count + 1, BATTERY_HISTORY);
    }
-   myData.batteryCapacity = (int) (battery * 100);
-   Serial.println("batteryCapacity: " + String(myData.batteryCapacity));
+
+   float rate = BatteryDischargeRate(history);
+
+   SaveBatteryHistory(history);
+
+   myData.batteryVolt          = vol / 1000.0f;
+   myData.batteryCapacity      = max(1, (int) capacity);
+   myData.batteryRuntimeHours  = rate > 0 ? (int) (capacity / rate) : -1;
+   myData.batteryDegraded      = myData.batteryCapacity < BATTERY_DEGRADED_CAPACITY;
+
+   LOG(LOG_BATTERY_VOLT, myData.batteryVolt, history.smoothedVolt / 1000.0f);
+   LOG(LOG_BATTERY_RATE, myData.batteryCapacity, rate);
+   LOG(LOG_BATTERY_RUNTIME, myData.batteryRuntimeHours, myData.batteryDegraded ? " degraded mode" : "");
    
    return true;
 }
@@ -0,0 +1,297 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Clock.h
+  *
+  * Time of the wake from the RTC, corrected by its measured drift and
+  * synchronized by SNTP when the predicted error gets too large.
+  */
+#pragma once
+#include <WiFiUdp.h>
+#include <nvs.h>
+#include "Utils.h"
+#include "Log.h"
+
+#ifndef NTP_SERVER
+#define NTP_SERVER         "pool.ntp.org" //!< SNTP server, e.g. a local server for testing
+#endif
+#define NTP_PORT           123            //!< SNTP port of the server
+#define NTP_LOCAL_PORT     2390           //!< Local port of the request
+#define NTP_TIMEOUT_MS     1500           //!< Max time for the response
+#define NTP_EPOCH          2208988800UL   //!< Seconds from 1900 to 1970
+
+#define CLOCK_MAX_ERROR_MS 5000           //!< Sync when the predicted error gets larger
+#define CLOCK_DEFAULT_PPM  50.0f          //!< Uncertainty of an uncalibrated RTC crystal
+#define CLOCK_MIN_PPM      1.0f           //!< Lower limit of the uncertainty
+#define CLOCK_MAX_PPM      500.0f         //!< Larger drift measurements are rejected
+#define CLOCK_MIN_HOURS    12             //!< Min time between two syncs for a drift measurement
+#define CLOCK_VALID_YEAR   2021           //!< Older RTC times are not set yet
+
+/**
+  * The RTC is read once at the start of the wake, all later times are
+  * derived from this snapshot and the millis(), so one wake sees one
+  * consistent time without further I2C traffic.
+  *
+  * The BM8563 runs fast or slow by some ppm. The drift is measured at
+  * every sync and averaged over the syncs, the times between the syncs
+  * are corrected by it. A sync only runs if the remaining uncertainty
+  * of the drift could have shifted the clock by more than
+  * CLOCK_MAX_ERROR_MS since the last sync.
+  *
+  * The RTC holds the UTC, TimeZone.h converts it to the local time.
+  */
+class WakeClock
+{
+protected:
+   /* Data stored in the non volatile memory */
+   struct State
+   {
+      time_t   syncUtc;        //!< UTC the RTC was set to at the last sync, 0 never
+      float    driftPpm;       //!< Drift of the RTC, positive runs fast
+      float    uncertaintyPpm; //!< Uncertainty of the drift
+      uint16_t syncs;          //!< Number of syncs
+      uint16_t measurements;   //!< Number of drift measurements
+   };
+
+   State    state;  //!< Current state
+   time_t   rtc;    //!< RTC time of the snapshot
+   time_t   now;    //!< Corrected UTC of the snapshot
+   uint32_t readMs; //!< millis() of the snapshot, 0 before the RTC was read
+
+   /* Load the state from the non volatile memory */
+   void LoadNVS()
+   {
+      nvs_handle nvs_arg;
+      size_t     len = sizeof(state);
+
+      memset(&state, 0, sizeof(state));
+      state.uncertaintyPpm = CLOCK_DEFAULT_PPM;
+      if (nvs_open("Setting", NVS_READONLY, &nvs_arg) == ESP_OK) {
+         if (nvs_get_blob(nvs_arg, "clock", &state, &len) != ESP_OK || len != sizeof(state)) {
+            memset(&state, 0, sizeof(state));
+            state.uncertaintyPpm = CLOCK_DEFAULT_PPM;
+         }
+         nvs_close(nvs_arg);
+      }
+   }
+
+   /* Store the state to the non volatile memory */
+   void SaveNVS()
+   {
+      nvs_handle nvs_arg;
+      nvs_open("Setting", NVS_READWRITE, &nvs_arg);
+      nvs_set_blob(nvs_arg, "clock", &state, sizeof(state));
+      nvs_commit(nvs_arg);
+      nvs_close(nvs_arg);
+   }
+
+   /* Read the RTC once per wake */
+   void Read()
+   {
+      LoadNVS();
+      rtc    = GetRTCTime();
+      readMs = max(millis(), (uint32_t) 1);
+      now    = rtc;
+      if (state.syncUtc && Valid()) {
+         time_t elapsed = rtc - state.syncUtc;
+
+         if (elapsed > 0) {
+            now -= (time_t) (elapsed * (double) state.driftPpm / 1e6 + 0.5);
+         }
+      }
+   }
+
+   /* Write the UTC to the RTC */
+   void SetRTC(time_t time)
+   {
+      rtc_time_t RTCtime;
+      rtc_date_t RTCDate;
+
+      RTCDate.year = year(time);
+      RTCDate.mon  = month(time);
+      RTCDate.day  = day(time);
+      M5.RTC.setDate(&RTCDate);
+
+      RTCtime.hour = hour(time);
+      RTCtime.min  = minute(time);
+      RTCtime.sec  = second(time);
+      M5.RTC.setTime(&RTCtime);
+
+      rtc    = time;
+      now    = time;
+      readMs = max(millis(), (uint32_t) 1);
+   }
+
+   /* Poll the RTC until its seconds change, returns the new second and its millis() */
+   time_t WaitRTCSecond(uint32_t &edgeMs)
+   {
+      uint32_t start = millis();
+      time_t   first = GetRTCTime();
+      time_t   time  = first;
+
+      while (time == first && millis() - start < 1100) {
+         delay(5);
+         time = GetRTCTime();
+      }
+      edgeMs = millis();
+      return time;
+   }
+
+   /* Request the UTC in ms from the SNTP server, atMs is the millis() of the result */
+   bool Query(uint64_t &utcMs, uint32_t &atMs)
+   {
+      WiFiUDP udp;
+      uint8_t packet[48];
+
+      memset(packet, 0, sizeof(packet));
+      packet[0] = 0x23; // version 4, client mode
+
+      udp.begin(NTP_LOCAL_PORT);
+      uint32_t sent = millis();
+      if (!udp.beginPacket(NTP_SERVER, NTP_PORT)) {
+         udp.stop();
+         return false;
+      }
+      udp.write(packet, sizeof(packet));
+      udp.endPacket();
+
+      while (millis() - sent < NTP_TIMEOUT_MS) {
+         if (udp.parsePacket() >= (int) sizeof(packet)) {
+            atMs = millis();
+            udp.read(packet, sizeof(packet));
+            udp.stop();
+            if ((packet[0] & 0x07) != 4 || packet[1] == 0) {
+               return false; // no server response or a kiss of death
+            }
+            uint32_t seconds  = (uint32_t) packet[40] << 24 | (uint32_t) packet[41] << 16 | (uint32_t) packet[42] << 8 | packet[43];
+            uint32_t fraction = (uint32_t) packet[44] << 24 | (uint32_t) packet[45] << 16 | (uint32_t) packet[46] << 8 | packet[47];
+
+            // the transmit time of the server plus half of the round trip
+            utcMs = (uint64_t) (seconds - NTP_EPOCH) * 1000 + (((uint64_t) fraction * 1000) >> 32) + (atMs - sent) / 2;
+            return true;
+         }
+         delay(10);
+      }
+      udp.stop();
+      return false;
+   }
+
+   /* Average the drift measured over the time since the last sync */
+   void Measure(int32_t errorMs, time_t elapsed)
+   {
+      float measured = errorMs * 1000.0f / elapsed;
+      float residual = fabs(measured - state.driftPpm);
+      float weight   = max(1.0f / (state.measurements + 1), 0.25f);
+
+      if (fabs(measured) > CLOCK_MAX_PPM) {
+         return; // the RTC was set by someone else or lost its time
+      }
+      state.uncertaintyPpm = max(CLOCK_MIN_PPM, (state.uncertaintyPpm + residual) / 2);
+      state.driftPpm      += (measured - state.driftPpm) * weight;
+      state.measurements++;
+   }
+
+public:
+   WakeClock()
+      : rtc(0)
+      , now(0)
+      , readMs(0)
+   {
+      memset(&state, 0, sizeof(state));
+   }
+
+   /* Corrected UTC, the RTC is only read at the first call */
+   time_t Now()
+   {
+      if (!readMs) {
+         Read();
+      }
+      return now + (millis() - readMs) / 1000;
+   }
+
+   /* Check if the RTC holds a time at all */
+   bool Valid()
+   {
+      return year(rtc) >= CLOCK_VALID_YEAR;
+   }
+
+   /* Error of the clock in ms the remaining uncertainty of the drift may have caused */
+   uint32_t PredictedErrorMs()
+   {
+      time_t time = Now();
+
+      if (!state.syncUtc || !Valid() || time < state.syncUtc) {
+         return UINT32_MAX;
+      }
+      return (uint32_t) ((time - state.syncUtc) * (double) state.uncertaintyPpm / 1000);
+   }
+
+   /* Check if the clock needs a sync */
+   bool SyncDue()
+   {
+      return PredictedErrorMs() > CLOCK_MAX_ERROR_MS;
+   }
+
+   /* Set the RTC from the SNTP server and measure its drift since the last sync */
+   bool Sync()
+   {
+      uint64_t utcMs;
+      uint32_t atMs;
+      uint32_t edgeMs;
+      int32_t  errorMs = 0;
+
+      Now();
+      if (!Query(utcMs, atMs)) {
+         LOG(LOG_CLOCK_FAILED, NTP_SERVER);
+         return false;
+      }
+      // the RTC only counts seconds, its error is measured at the start of a second
+      time_t   edge     = WaitRTCSecond(edgeMs);
+      uint64_t utcAtEdge = utcMs + (edgeMs - atMs);
+
+      if (state.syncUtc && Valid()) {
+         time_t elapsed = (time_t) (utcAtEdge / 1000) - state.syncUtc;
+
+         errorMs = (int32_t) ((int64_t) edge * 1000 - (int64_t) utcAtEdge);
+         if (elapsed >= CLOCK_MIN_HOURS * 3600) {
+            Measure(errorMs, elapsed);
+         }
+      }
+      // set the RTC at the start of the next second
+      uint64_t nowMs = utcAtEdge + (millis() - edgeMs);
+      delay(1000 - nowMs % 1000);
+      time_t utc = nowMs / 1000 + 1;
+
+      SetRTC(utc);
+      state.syncUtc = utc;
+      state.syncs++;
+      SaveNVS();
+      LOG(LOG_CLOCK_SYNC, (int) errorMs, state.driftPpm, state.uncertaintyPpm, (int) state.measurements);
+      return true;
+   }
+
+   /* Set the RTC without SNTP, e.g. from the time of the weather request */
+   void Set(time_t utc)
+   {
+      Now();
+      SetRTC(utc);
+      state.syncUtc = 0; // unknown precision, no drift measurement from here
+      SaveNVS();
+   }
+};
+
+WakeClock wakeClock; //!< Time of the current wake
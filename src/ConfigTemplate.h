@@ -20,6 +20,9 @@
 
 #define CITY_NAME        "City"
 
+// POSIX TZ string of the local time, the RTC runs in UTC (see TimeZone.h)
+#define TIMEZONE         "CET-1CEST,M3.5.0,M10.5.0/3"
+
 // change to your location
 #define LATITUDE         47.69732 
 #define LONGITUDE         8.63493
@@ -28,6 +31,23 @@
 #define OPENWEATHER_PORT 80
 #define OPENWEATHER_API  "your openweathermap api key"
 
+// optional, secondary weather provider without a key and the hedging (see WeatherService.h),
+// tools/fixtureserver.py serves both providers for testing
+// #define OPENMETEO_SRV    "api.open-meteo.com"
+// #define OPENMETEO_PORT   80
+// #define WEATHER_PROVIDERS { &openMeteo, &openWeather }
+// #define WEATHER_HEDGE_PERCENT 90
+
+// optional, host of the aggregation proxy of host/proxy, one request per wake for all panels,
+// the direct requests are the fallback if it is down
+// #define PROXY_SRV        "192.168.1.2"
+// #define PROXY_PORT       8080
+
+// optional, host of the render server of host/render, draws the frame and sends the changed tiles,
+// the panel draws the frame itself if it is down
+// #define RENDER_SRV       "192.168.1.2"
+// #define RENDER_PORT      8080
+
 // Allgemeiner Gemeindeschlüssel. e.g. Bremen 04011
 #define CORONA_AGS       "04011"
 
@@ -36,5 +56,30 @@
 #define WORK_COORD       "50.123456,9.123456" 
 #define HOME_COORD       "51.123456,8.123456"
 
+// optional, more places and routes of the traffic panel in one matrix request (see Traffic.h)
+// #define COMMUTE_PLACES   { { CITY_NAME, HOME_COORD }, { WORK_NAME, WORK_COORD }, { "Gym", "50.5,9.5" } }
+// #define COMMUTE_ROUTES   { { 0, 1 }, { 1, 0 }, { 1, 2 } }
+// #define TRAFFIC_MAX_INTERVAL 120
+
+// optional, update schedule (see Sleep.h for the defaults)
+// #define SLEEP_MINUTES    30
+// #define QUIET_HOURS_FROM  0
+// #define QUIET_HOURS_TO    5
+// #define COMMUTE_MINUTES  10
+// #define COMMUTE_WINDOWS  { { 6 * 60 + 30, 8 * 60 + 30 }, { 16 * 60, 18 * 60 } }
+// #define LOCAL_WAKE_MINUTES 5
+
+// optional, hours of the forecast graph, 12, 24 or 48 (see Weather.h)
+// #define FORECAST_HOURS   48
+
+// optional, SNTP server of the clock sync, e.g. a local one for testing (see Clock.h)
+// #define NTP_SERVER       "192.168.1.2"
+
+// optional, chrome trace events of a wake on the serial (see Trace.h)
+// #define TRACE_ENABLED    1
+
+// optional, text instead of binary log records (see Log.h and tools/logdecode.py)
+// #define LOG_BINARY       0
+
 #define WIFI_SSID        "your wifi ssid"
 #define WIFI_PW          "your wifi password" 
\ No newline at end of file
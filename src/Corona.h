@@ -20,69 +20,35 @@
   * Class for reading Corona data.
   */
 #pragma once
-#include <HTTPClient.h>
 #include <ArduinoJson.h>
 #include "Data.h"
+#include "HttpFetch.h"
+#include "Timeline.h"
+#include "Trace.h"
 #include <Config.h>
 
 class Corona
 {
 protected:
    const String district = CORONA_AGS;
-   const String server = "https://api.corona-zahlen.org";
+   const String server = "api.corona-zahlen.org";
    const String uri_district = "/districts/" + district;
    const String uri_germany = "/germany";
 
    bool GetCoronaLocalJsonDoc(DynamicJsonDocument &doc)
    {
-      HTTPClient http;
-
-      String uri = server + uri_district;
-      Serial.printf("Requesting %s\n", uri.c_str());
-      http.begin(uri);
-      int httpCode = http.GET();
-
-      if (httpCode != HTTP_CODE_OK) {
-         Serial.printf("Error on requesting %s: %s\n", uri.c_str(), http.errorToString(httpCode).c_str());
-         http.end();
-         return false;
-      } else {
-         DeserializationError error = deserializeJson(doc, http.getStream());
-         http.end();
-         if (error) {
-            Serial.printf("deserializeJson() failed: %s", error.c_str());
-            return false;
-         } else {
-            return true;
-         }
-      }
+      TimelineScope phase("corona-lk", CURRENT_WIFI_MA);
+      TRACE_FUNCTION();
 
+      return HttpFetchJson(NET_CORONA_LOCAL, server, 443, uri_district, doc);
    }
 
    bool GetCoronaGermanyJsonDoc(DynamicJsonDocument &doc)
    {
-      HTTPClient http;
-
-      String uri = server + uri_germany;
-      Serial.printf("Requesting %s\n", uri.c_str());
-      http.begin(uri);
-      int httpCode = http.GET();
-
-      if (httpCode != HTTP_CODE_OK) {
-         Serial.printf("Error on requesting %s: %s\n", uri.c_str(), http.errorToString(httpCode).c_str());
-         http.end();
-         return false;
-      } else {
-         DeserializationError error = deserializeJson(doc, http.getStream());
-         http.end();
-         if (error) {
-            Serial.printf("deserializeJson() failed: %s", error.c_str());
-            return false;
-         } else {
-            return true;
-         }
-      }
+      TimelineScope phase("corona-de", CURRENT_WIFI_MA);
+      TRACE_FUNCTION();
 
+      return HttpFetchJson(NET_CORONA_GERMANY, server, 443, uri_germany, doc);
    }
 
 public:
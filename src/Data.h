@@ -22,6 +22,10 @@
 #pragma once
 
 #include "Weather.h"
+#include "Log.h"
+#include "Clock.h"
+#include "TimeZone.h"
+#include "Traffic.h"
 #include <nvs.h>
 
 
@@ -36,6 +40,8 @@ public:
    int     wifiRSSI;         //!< The wifi signal strength
    float   batteryVolt;      //!< The current battery voltage
    int     batteryCapacity;  //!< The current battery capacity
+   int     batteryRuntimeHours; //!< Predicted remaining runtime, -1 if unknown
+   bool    batteryDegraded;  //!< Low battery, only the weather is updated
    int     sht30Temperatur;  //!< SHT30 temperature
    int     sht30Humidity;    //!< SHT30 humidity
 
@@ -47,10 +53,10 @@ public:
    String  coronaName;  
    String  coronaUpdated;  
 
-   int  mapsWorkDurationInTraffic;
-   int  mapsHomeDurationInTraffic;
+   int  mapsDurations[COMMUTE_MAX_ROUTES]; //!< Minutes in traffic of the COMMUTE_ROUTES
+   bool mapsPredicted[COMMUTE_MAX_ROUTES]; //!< The duration is learned, not requested
 
-   Weather weather;          //!< All the openweathermap data
+   Weather weather;          //!< Weather of the first answering provider
 
    int sleepForMinutes;
 
@@ -59,38 +65,36 @@ public:
       : wifiRSSI(0)
       , batteryVolt(0.0)
       , batteryCapacity(0)
+      , batteryRuntimeHours(-1)
+      , batteryDegraded(false)
       , sht30Temperatur(0)
       , sht30Humidity(0)
       , astronauts(0)
       , coronaWeekIncidenceGermany(0)
       , coronaWeekIncidenceLocal(0)
-      , mapsWorkDurationInTraffic(0)
-      , mapsHomeDurationInTraffic(0)
       , sleepForMinutes(60)
    {
+      memset(mapsDurations, 0, sizeof(mapsDurations));
+      memset(mapsPredicted, 0, sizeof(mapsPredicted));
    }
 
    /* helper function to dump all the collected data */
    void Dump()
    {
-      Serial.println("DateTime: "        + getRTCDateTimeString());
-      
-      Serial.println("Latitude: "        + String(LATITUDE));
-      Serial.println("Longitude: "       + String(LONGITUDE));
-      Serial.println("WifiRSSI: "        + String(wifiRSSI));
-      Serial.println("BatteryVolt: "     + String(batteryVolt));
-      Serial.println("BatteryCapacity: " + String(batteryCapacity));
-      Serial.println("Sht30Temperatur: " + String(sht30Temperatur));
-      Serial.println("Sht30Humidity: "   + String(sht30Humidity));
-      Serial.println("Astronauts: "      + String(astronauts));
-
-      Serial.println("WeekIncidenceHb: " + String(coronaWeekIncidenceLocal));
-      
-      Serial.println("Duration: "        + mapsWorkDurationInTraffic + String("/") + mapsHomeDurationInTraffic);
-      
-      Serial.println("Sunrise: "         + getDateTimeString(weather.sunrise));
-      Serial.println("Sunset: "          + getDateTimeString(weather.sunset));
-      Serial.println("Windspeed: "       + String(weather.windspeed));
+      LOG(LOG_DATETIME,   getDateTimeString(timeZone.Local(wakeClock.Now())));
+      LOG(LOG_LOCATION,   (double) LATITUDE, (double) LONGITUDE);
+      LOG(LOG_WIFI_RSSI,  wifiRSSI);
+      LOG(LOG_BATTERY,    batteryVolt, batteryCapacity, batteryRuntimeHours);
+      LOG(LOG_SHT30,      sht30Temperatur, sht30Humidity);
+      LOG(LOG_ASTRONAUTS, astronauts);
+      LOG(LOG_CORONA,     coronaWeekIncidenceLocal);
+      for (int r = 0; r < commuteRouteCount; r++) {
+         LOG(LOG_MAPS_ROUTE, commutePlaces[commuteRoutes[r].from].name, commutePlaces[commuteRoutes[r].to].name,
+            mapsDurations[r], mapsPredicted[r] ? " (predicted)" : "");
+      }
+      LOG(LOG_SUN,        getDateTimeString(weather.sunrise), getDateTimeString(weather.sunset));
+      LOG(LOG_WINDSPEED,  weather.windspeed);
+      LOG(LOG_AIR,        weather.airQuality, weather.airPm25, weather.airPm10, weather.airNo2, weather.airO3);
    }
 
    /* Load the NVS data from the non volatile memory */
@@ -0,0 +1,117 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Decimator.h
+  *
+  * Fixed size series of min, max and mean buckets filled value by value.
+  */
+#pragma once
+
+/**
+  * Collects a stream of a known number of values into at most N buckets.
+  * Every bucket covers the same number of following values, so the
+  * buckets stay evenly spaced on the time axis. The memory does not
+  * depend on the number of the values.
+  *
+  *    series.Begin(hourly.size());
+  *    for (JsonObject hour : hourly) series.Add(hour["temp"]);
+  */
+template <int N> class Decimator
+{
+protected:
+   float minimum[N]; //!< Smallest value of the bucket
+   float maximum[N]; //!< Largest value of the bucket
+   float sum[N];     //!< Sum of the values of the bucket
+   int   factor;     //!< Values per bucket
+   int   added;      //!< Values added since Begin()
+
+public:
+   Decimator()
+   {
+      Begin(0);
+   }
+
+   /* Start a new series of count values */
+   void Begin(int count)
+   {
+      factor = max((count + N - 1) / N, 1);
+      added  = 0;
+      memset(minimum, 0, sizeof(minimum));
+      memset(maximum, 0, sizeof(maximum));
+      memset(sum,     0, sizeof(sum));
+   }
+
+   /* Add the next value, the values behind the announced count are ignored */
+   void Add(float value)
+   {
+      int bucket = added / factor;
+
+      if (bucket >= N) {
+         return;
+      }
+      if (added % factor == 0) {
+         minimum[bucket] = value;
+         maximum[bucket] = value;
+      } else {
+         minimum[bucket] = min(minimum[bucket], value);
+         maximum[bucket] = max(maximum[bucket], value);
+      }
+      sum[bucket] += value;
+      added++;
+   }
+
+   /* Number of the filled buckets */
+   int Size() const
+   {
+      return min((added + factor - 1) / factor, N);
+   }
+
+   /* Values per bucket */
+   int Factor() const
+   {
+      return factor;
+   }
+
+   float Min(int bucket) const  { return minimum[bucket]; }
+   float Max(int bucket) const  { return maximum[bucket]; }
+   float Mean(int bucket) const
+   {
+      int count = bucket < added / factor ? factor : added % factor;
+
+      return count ? sum[bucket] / count : 0;
+   }
+
+   /* Smallest and largest value of all buckets */
+   float Lowest() const
+   {
+      float value = 0;
+
+      for (int b = 0; b < Size(); b++) {
+         value = b ? min(value, minimum[b]) : minimum[b];
+      }
+      return value;
+   }
+   float Highest() const
+   {
+      float value = 0;
+
+      for (int b = 0; b < Size(); b++) {
+         value = b ? max(value, maximum[b]) : maximum[b];
+      }
+      return value;
+   }
+};
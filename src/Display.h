@@ -20,11 +20,72 @@
   * Main class for drawing the content to the e-paper display.
   */
 #pragma once
+#include <atomic>
 #include "Data.h"
 #include "Icons.h"
+#include "Refresh.h"
+#include "Background.h"
+#include "WidgetCache.h"
+#include "Timeline.h"
+#include "Trace.h"
+#include "Log.h"
+#include "Clock.h"
+#include "TimeZone.h"
+#include "Sun.h"
+#include "Moon.h"
+#include "MoonIcons.h"
+#include "History.h"
+
+#ifndef RENDER_WORKERS
+#define RENDER_WORKERS 2 //!< Number of render tasks, 1 renders the whole frame on the calling task
+#endif
+#define RENDER_REGIONS 9 //!< Number of independent regions of the frame
+#define BACKGROUND_LAYER 1 //!< Start from the static layer cached in the flash, 0 redraws the whole frame
+#define BACKGROUND_VERSION 4 //!< Increment on every change of the static layer
+#define HISTORY_DAY_BUCKETS  48 //!< Half hours of the 24h history graph
+#define HISTORY_WEEK_BUCKETS 42 //!< Four hours of the 7 day history graph
 
 M5EPD_Canvas canvas(&M5.EPD); // Main canvas of the e-paper
 
+/**
+  * One independent part of the frame that is rasterized by one render worker
+  * into its own canvas. The regions tile the whole frame.
+  */
+struct RenderRegion
+{
+   const char   *name;   //!< Name for the log
+   int           x;      //!< Left position in the frame
+   int           y;      //!< Top position in the frame
+   int           dx;     //!< Width in the frame
+   int           dy;     //!< Height in the frame
+   M5EPD_Canvas *canvas; //!< Canvas of the region, created by the worker
+   int           canvasX;//!< Left position of the canvas in the frame
+   uint32_t      ms;     //!< Render time of the region
+};
+
+static_assert(RENDER_REGIONS <= REFRESH_MAX_REGIONS, "The refresh scheduler stores too few regions");
+
+/* Layout of the frame regions, sorted by the estimated render cost, the icons are the expensive part */
+const RenderRegion frameLayout[RENDER_REGIONS] = {
+   { "daily",    0,   286, 465, 122, NULL, 0, 0 },
+   { "sun",      0,    35, 232, 251, NULL, 0, 0 },
+   { "outdoor",  232,  35, 233, 251, NULL, 0, 0 },
+   { "indoor",   465,  35, 232, 251, NULL, 0, 0 },
+   { "graph",    465, 286, 495, 122, NULL, 0, 0 },
+   { "status",   697,  35, 263, 251, NULL, 0, 0 },
+   { "head",     0,     0, 960,  35, NULL, 0, 0 },
+   { "traffic",  0,   408, 465, 132, NULL, 0, 0 },
+   { "corona",   465, 408, 495, 132, NULL, 0, 0 },
+};
+
+/* Parts of the frame that are drawn */
+enum DrawLayer
+{
+   LAYER_ALL,     //!< Draw the whole frame
+   LAYER_STATIC,  //!< Draw only the parts that never change
+   LAYER_DYNAMIC  //!< Draw only the values on top of the static layer
+};
+
 /* Main class for drawing the content to the e-paper display. */
 class WeatherDisplay
 {
@@ -36,43 +97,97 @@ protected:
    int maxX;       //!< Max width of the e-paper
    int maxY;       //!< Max height of the e-paper
 
-protected:
-   void DrawCircle(int32_t x, int32_t y, int32_t r, uint32_t color, int32_t degFrom = 0, int32_t degTo = 360);
-   // void DisplayDisplayWindSection(int x, int y, float angle, float windspeed, int radius);
+   String rtcDate; //!< Date of this frame, set once before the workers start
+   String rtcTime; //!< Time of this frame, set once before the workers start
+   int    rtcHour; //!< Hour of this frame, set once before the workers start
+   time_t frameUtc;//!< UTC of this frame for the sun and the moon, set once before the workers start
 
-   void DrawIcon(int x, int y, const uint16_t *icon, int dx = 64, int dy = 64, bool highContrast = false);
+   float historyDay[2][HISTORY_DAY_BUCKETS];   //!< Indoor and outdoor temperature of the last day, queried before the workers start
+   float historyWeek[2][HISTORY_WEEK_BUCKETS]; //!< Indoor and outdoor temperature of the last week, queried before the workers start
 
-   void DrawHead();
-   void DrawRSSI(int x, int y);
-   void DrawBattery(int x, int y);
+   RenderRegion      regions[RENDER_REGIONS]; //!< Regions of the current frame
+   int               workers;                 //!< Number of render tasks of the next frame, RENDER_WORKERS
+   std::atomic<int>  nextRegion;              //!< Shared work queue index of the next free region
+   SemaphoreHandle_t workersDone;             //!< Signaled by every helper worker at its end
+   uint32_t          regionMask;              //!< Bits of the regions that are rendered
 
-   void DrawSunInfo(int x, int y, int dx, int dy);
-   void DrawOutdoorInfo(int x, int y, int dx, int dy);
-   void DrawIndoorInfo(int x, int y, int dx, int dy);
-   void DrawStatusInfo(int x, int y, int dx, int dy);
+   RefreshScheduler  refresh;                 //!< Chooses the update mode of the regions
+   BackgroundLayer   background;              //!< Static layer of the frame in the flash
+   WidgetCache       widgetCache;             //!< Rendered pixels of the rarely changing widgets
+   DrawLayer         layer;                   //!< Layer of the current drawing
 
-   void DrawDaily(int x, int y, int dx, int dy, Weather &weather, int index);
-   void DrawWeatherGraph(int x, int y, int dx, int dy);
+   bool IsStaticLayer()  { return layer != LAYER_DYNAMIC; }
+   bool IsDynamicLayer() { return layer != LAYER_STATIC; }
 
-   void DrawTraffic(int x, int y, int dx, int dy);
-   void DrawCorona(int x, int y, int dx, int dy);
+protected:
+   void DrawCircle(M5EPD_Canvas &canvas, int32_t x, int32_t y, int32_t r, uint32_t color, int32_t degFrom = 0, int32_t degTo = 360);
+   // void DisplayDisplayWindSection(int x, int y, float angle, float windspeed, int radius);
 
-   void DrawGraph(int x, int y, int dx, int dy, String title, boolean titleRight, int xMin, int xMax, int yMin, int yMax, float values[]);
+   void DrawIcon(M5EPD_Canvas &canvas, int x, int y, const uint16_t *icon, int dx = 64, int dy = 64, bool highContrast = false);
+   void BlitIcon(M5EPD_Canvas &canvas, int x, int y, const uint8_t *icon, int dx, int dy);
+
+   void DrawHead(M5EPD_Canvas &canvas, int x, int y, int dx, int dy);
+   void DrawRSSI(M5EPD_Canvas &canvas, int x, int y);
+   void DrawBattery(M5EPD_Canvas &canvas, int x, int y);
+
+   void DrawSunInfo(M5EPD_Canvas &canvas, int x, int y, int dx, int dy);
+   void DrawSunPath(M5EPD_Canvas &canvas, int x, int y, int dx, int dy);
+   void DrawMoon(M5EPD_Canvas &canvas, int x, int y, int dx, int dy);
+   void DrawOutdoorInfo(M5EPD_Canvas &canvas, int x, int y, int dx, int dy);
+   void DrawIndoorInfo(M5EPD_Canvas &canvas, int x, int y, int dx, int dy);
+   void DrawStatusInfo(M5EPD_Canvas &canvas, int x, int y, int dx, int dy);
+   void DrawHistory(M5EPD_Canvas &canvas, int x, int y, int dx, int dy, String title, const float *indoor, const float *outdoor, int buckets);
+
+   void DrawDaily(M5EPD_Canvas &canvas, int x, int y, int dx, int dy, Weather &weather, int index);
+   void DrawWeatherGraph(M5EPD_Canvas &canvas, int x, int y, int dx, int dy);
+
+   void DrawTraffic(M5EPD_Canvas &canvas, int x, int y, int dx, int dy);
+   void DrawCorona(M5EPD_Canvas &canvas, int x, int y, int dx, int dy);
+   void DrawAirQuality(M5EPD_Canvas &canvas, int x, int y, int dx, int dy);
+
+   void DrawNowcast(M5EPD_Canvas &canvas, int x, int y, int dx, int dy);
+   void DrawGraph(M5EPD_Canvas &canvas, int x, int y, int dx, int dy, String title, boolean titleRight, int xMin, int xSteps, int hours, int yMin, int yMax, float values[], int points, int pointHours);
+
+   bool IsVisible(const RenderRegion &region, int x, int y, int dx, int dy);
+   void DrawFrame(M5EPD_Canvas &canvas, const RenderRegion &region);
+
+   void SetFrameTime(time_t utc, time_t updated = 0);
+   void PrepareHistory();
+   uint32_t RegionMask(const char *name);
+   uint32_t BackgroundKey();
+   uint32_t WidgetKey(const String &inputs);
+   void PrepareBackground();
+   void RenderRegions(DrawLayer drawLayer, uint32_t mask = ~0u);
+   void RenderWork();
+   static void RenderTask(void *param);
+   void PushRegions(bool local = false);
+   void FreeRegions();
 
 public:
    WeatherDisplay(MyData &md, int x = 960, int y = 540)
        : myData(md), maxX(x), maxY(y)
+       , rtcHour(0)
+       , frameUtc(0)
+       , workers(RENDER_WORKERS)
+       , nextRegion(0)
+       , workersDone(NULL)
+       , regionMask(~0u)
+       , layer(LAYER_ALL)
    {
+      memcpy(regions, frameLayout, sizeof(regions));
    }
 
-   void Show();
+   void Show(time_t time);
+   void ShowLocal(time_t now, time_t updated);
+   void Render(time_t time);
 
    void ShowStatusInfo();
 };
 
 /* Draw a circle with optional start and end point */
-void WeatherDisplay::DrawCircle(int32_t x, int32_t y, int32_t r, uint32_t color, int32_t degFrom /* = 0 */, int32_t degTo /* = 360 */)
+void WeatherDisplay::DrawCircle(M5EPD_Canvas &canvas, int32_t x, int32_t y, int32_t r, uint32_t color, int32_t degFrom /* = 0 */, int32_t degTo /* = 360 */)
 {
+   TRACE_FUNCTION();
    for (int i = degFrom; i < degTo; i++)
    {
       double radians = i * PI / 180;
@@ -84,24 +199,26 @@ void WeatherDisplay::DrawCircle(int32_t x, int32_t y, int32_t r, uint32_t color,
 }
 
 /* Draw a the rssi value as circle parts */
-void WeatherDisplay::DrawRSSI(int x, int y)
+void WeatherDisplay::DrawRSSI(M5EPD_Canvas &canvas, int x, int y)
 {
+   TRACE_FUNCTION();
    int iQuality = WifiGetRssiAsQualityInt(myData.wifiRSSI);
 
    if (iQuality >= 80)
-      DrawCircle(x + 12, y, 16, M5EPD_Canvas::G15, 225, 315);
+      DrawCircle(canvas, x + 12, y, 16, M5EPD_Canvas::G15, 225, 315);
    if (iQuality >= 40)
-      DrawCircle(x + 12, y, 12, M5EPD_Canvas::G15, 225, 315);
+      DrawCircle(canvas, x + 12, y, 12, M5EPD_Canvas::G15, 225, 315);
    if (iQuality >= 20)
-      DrawCircle(x + 12, y, 8, M5EPD_Canvas::G15, 225, 315);
+      DrawCircle(canvas, x + 12, y, 8, M5EPD_Canvas::G15, 225, 315);
    if (iQuality >= 10)
-      DrawCircle(x + 12, y, 4, M5EPD_Canvas::G15, 225, 315);
-   DrawCircle(x + 12, y, 2, M5EPD_Canvas::G15, 225, 315);
+      DrawCircle(canvas, x + 12, y, 4, M5EPD_Canvas::G15, 225, 315);
+   DrawCircle(canvas, x + 12, y, 2, M5EPD_Canvas::G15, 225, 315);
 }
 
 /* Draw a the battery icon */
-void WeatherDisplay::DrawBattery(int x, int y)
+void WeatherDisplay::DrawBattery(M5EPD_Canvas &canvas, int x, int y)
 {
+   TRACE_FUNCTION();
    canvas.drawRect(x, y, 40, 16, M5EPD_Canvas::G15);
    canvas.drawRect(x + 40, y + 3, 4, 10, M5EPD_Canvas::G15);
    for (int i = x; i < x + 40; i++)
@@ -115,19 +232,32 @@ void WeatherDisplay::DrawBattery(int x, int y)
 }
 
 /* Draw a the head */
-void WeatherDisplay::DrawHead()
+void WeatherDisplay::DrawHead(M5EPD_Canvas &canvas, int x, int y, int dx, int dy)
 {
-   canvas.drawString("", 20, 10); // top left corner
-   canvas.drawCentreString(CITY_NAME, maxX / 2, 10, 1);
-   canvas.drawString(WifiGetRssiAsQuality(myData.wifiRSSI) + "%", maxX - 200, 10);
-   DrawRSSI(maxX - 155, 25);
-   canvas.drawString(String(myData.batteryCapacity) + "%", maxX - 110, 10);
-   DrawBattery(maxX - 65, 10);
+   TRACE_FUNCTION();
+   if (IsStaticLayer()) {
+      canvas.drawCentreString(CITY_NAME, x + dx / 2, y + 10, 1);
+   }
+   if (IsDynamicLayer()) {
+      // top left corner
+      if (myData.batteryDegraded) {
+         canvas.drawString("Energiesparmodus", x + 20, y + 10);
+      } else if (myData.batteryRuntimeHours >= 48) {
+         canvas.drawString("Akku ~" + String(myData.batteryRuntimeHours / 24) + " Tage", x + 20, y + 10);
+      } else if (myData.batteryRuntimeHours >= 0) {
+         canvas.drawString("Akku ~" + String(myData.batteryRuntimeHours) + " Std.", x + 20, y + 10);
+      }
+      canvas.drawString(WifiGetRssiAsQuality(myData.wifiRSSI) + "%", x + dx - 200, y + 10);
+      DrawRSSI(canvas, x + dx - 155, y + 25);
+      canvas.drawString(String(myData.batteryCapacity) + "%", x + dx - 110, y + 10);
+      DrawBattery(canvas, x + dx - 65, y + 10);
+   }
 }
 
 /* Draw one icon from the binary data */
-void WeatherDisplay::DrawIcon(int x, int y, const uint16_t *icon, int dx /*= 64*/, int dy /*= 64*/, bool highContrast /*= false*/)
+void WeatherDisplay::DrawIcon(M5EPD_Canvas &canvas, int x, int y, const uint16_t *icon, int dx /*= 64*/, int dy /*= 64*/, bool highContrast /*= false*/)
 {
+   TRACE_FUNCTION();
    for (int yi = 0; yi < dy; yi++)
    {
       for (int xi = 0; xi < dx; xi++)
@@ -147,37 +277,88 @@ void WeatherDisplay::DrawIcon(int x, int y, const uint16_t *icon, int dx /*= 64*
    }
 }
 
+/* 
+ * Copy an icon in the 4 bit layout of the canvas row by row into the 
+ * frame buffer, icons at odd positions or across the border are drawn 
+ * pixel by pixel.
+ */
+void WeatherDisplay::BlitIcon(M5EPD_Canvas &canvas, int x, int y, const uint8_t *icon, int dx, int dy)
+{
+   uint8_t *frame = (uint8_t *) canvas.frameBuffer(1);
+
+   if (frame && (x & 1) == 0 && (dx & 1) == 0 && x >= 0 && y >= 0 && 
+       x + dx <= canvas.width() && y + dy <= canvas.height()) {
+      for (int yi = 0; yi < dy; yi++) {
+         memcpy(frame + ((y + yi) * canvas.width() + x) / 2, icon + yi * dx / 2, dx / 2);
+      }
+      return;
+   }
+   for (int i = 0; i < dx * dy; i++) {
+      uint8_t pixel = (i & 1) ? icon[i / 2] & 0x0F : icon[i / 2] >> 4;
+      canvas.drawPixel(x + i % dx, y + i / dx, pixel);
+   }
+}
+
 /* Draw the sun information with sunrise and sunset */
-void WeatherDisplay::DrawSunInfo(int x, int y, int dx, int dy)
+void WeatherDisplay::DrawSunInfo(M5EPD_Canvas &canvas, int x, int y, int dx, int dy)
 {
+   TRACE_FUNCTION();
    canvas.setTextSize(3);
-   canvas.drawCentreString("Astro", x + dx / 2, y + 7, 1); 
-   canvas.drawLine(x, y + 35, x + dx, y + 35, M5EPD_Canvas::G15);
+   if (IsStaticLayer()) {
+      canvas.drawCentreString("Astro", x + dx / 2, y + 7, 1); 
+      canvas.drawLine(x, y + 35, x + dx, y + 35, M5EPD_Canvas::G15);
 
-   DrawIcon(x + 25, y + 40, (uint16_t *)ASTRONAUT64x64);
-   DrawIcon(x + 25, y + 110, (uint16_t *)SUNRISE64x64);
-   DrawIcon(x + 25, y + 180, (uint16_t *)SUNSET64x64);
+      DrawIcon(canvas, x + 25, y + 40, (uint16_t *)ASTRONAUT64x64);
+      DrawIcon(canvas, x + 25, y + 110, (uint16_t *)SUNRISE64x64);
+      DrawIcon(canvas, x + 25, y + 180, (uint16_t *)SUNSET64x64);
+   }
+   if (!IsDynamicLayer()) {
+      return;
+   }
 
-   canvas.drawRightString(String(myData.astronauts), x + dx - 50, y + 70, 1);
+   // the lines change rarely, the cache keeps their pixels
+   String   astronauts = String(myData.astronauts);
+   uint32_t key        = WidgetKey("astronauts " + astronauts);
 
-   if(myData.weather.success) {
-      canvas.drawRightString(getHourMinString(myData.weather.sunrise), x + dx - 10, y + 140, 1);
-      canvas.drawRightString(getHourMinString(myData.weather.sunset), x + dx - 10, y + 210, 1);
+   if (!widgetCache.Blit(canvas, x + 100, y + 70, dx - 150, 24, key)) {
+      canvas.drawRightString(astronauts, x + dx - 50, y + 70, 1);
+      widgetCache.Store(canvas, x + 100, y + 70, dx - 150, 24, key);
+   }
+
+   // computed on the device, so they are also shown without the weather request
+   SunDay day     = sun.Day(frameUtc);
+   String sunrise = day.sunrise ? getHourMinString(timeZone.Local(day.sunrise)) : "--:--";
+   String sunset  = day.sunset  ? getHourMinString(timeZone.Local(day.sunset))  : "--:--";
+
+   key = WidgetKey("sunrise " + sunrise);
+   if (!widgetCache.Blit(canvas, x + 100, y + 140, dx - 110, 24, key)) {
+      canvas.drawRightString(sunrise, x + dx - 10, y + 140, 1);
+      widgetCache.Store(canvas, x + 100, y + 140, dx - 110, 24, key);
+   }
+   key = WidgetKey("sunset " + sunset);
+   if (!widgetCache.Blit(canvas, x + 100, y + 210, dx - 110, 24, key)) {
+      canvas.drawRightString(sunset, x + dx - 10, y + 210, 1);
+      widgetCache.Store(canvas, x + 100, y + 210, dx - 110, 24, key);
    }
 }
 
 /* Outdoor weather */
-void WeatherDisplay::DrawOutdoorInfo(int x, int y, int dx, int dy)
+void WeatherDisplay::DrawOutdoorInfo(M5EPD_Canvas &canvas, int x, int y, int dx, int dy)
 {
+   TRACE_FUNCTION();
    canvas.setTextSize(3);
-   canvas.drawCentreString("Aussen", x + dx / 2, y + 7, 1);
-   canvas.drawLine(x, y + 35, x + dx, y + 35, M5EPD_Canvas::G15);
+   if (IsStaticLayer()) {
+      canvas.drawCentreString("Aussen", x + dx / 2, y + 7, 1);
+      canvas.drawLine(x, y + 35, x + dx, y + 35, M5EPD_Canvas::G15);
 
-   DrawIcon(x + 25, y + 40, (uint16_t *)WIND64x64);
-   DrawIcon(x + 25, y + 110, (uint16_t *)TEMPERATURE64x64);
-   DrawIcon(x + 25, y + 180, (uint16_t *)HUMIDITY64x64);
+      DrawIcon(canvas, x + 25, y + 40, (uint16_t *)WIND64x64);
+      DrawIcon(canvas, x + 25, y + 110, (uint16_t *)TEMPERATURE64x64);
+      DrawIcon(canvas, x + 25, y + 180, (uint16_t *)HUMIDITY64x64);
+   }
        
-   if(myData.weather.success) {
+   if(myData.weather.success && IsDynamicLayer()) {
+      DrawNowcast(canvas, x + 100, y + 40, dx - 110, 26);
+      canvas.setTextSize(3);
       canvas.drawRightString(String(toKmh(myData.weather.windspeed), 0) + " km/h", x + dx - 10, y + 70, 1);
       canvas.setTextSize(4);
       canvas.drawString(String(myData.weather.temp, 0) + " C", x + 100, y + 125, 1);
@@ -189,38 +370,176 @@ void WeatherDisplay::DrawOutdoorInfo(int x, int y, int dx, int dy)
 }
 
 /* Indoor temp and hum */
-void WeatherDisplay::DrawIndoorInfo(int x, int y, int dx, int dy)
+void WeatherDisplay::DrawIndoorInfo(M5EPD_Canvas &canvas, int x, int y, int dx, int dy)
 {
+   TRACE_FUNCTION();
    canvas.setTextSize(3);
-   canvas.drawCentreString("Innen", x + dx / 2, y + 7, 1);
-   canvas.drawLine(x, y + 35, x + dx, y + 35, M5EPD_Canvas::G15);
+   if (IsStaticLayer()) {
+      canvas.drawCentreString("Innen", x + dx / 2, y + 7, 1);
+      canvas.drawLine(x, y + 35, x + dx, y + 35, M5EPD_Canvas::G15);
 
-   canvas.setTextSize(4);
-   DrawIcon(x + 25, y + 110, (uint16_t *)TEMPERATURE64x64);
-   canvas.drawString(String(myData.sht30Temperatur) + " C", x + 100, y + 125, 1);
+      DrawIcon(canvas, x + 25, y + 110, (uint16_t *)TEMPERATURE64x64);
+      DrawIcon(canvas, x + 25, y + 180, (uint16_t *)HUMIDITY64x64);
+   }
+   DrawHistory(canvas, x + 10, y + 42, dx - 20, 28, "24h", historyDay[0], historyDay[1], HISTORY_DAY_BUCKETS);
+   DrawHistory(canvas, x + 10, y + 76, dx - 20, 28, "7T", historyWeek[0], historyWeek[1], HISTORY_WEEK_BUCKETS);
 
-   DrawIcon(x + 25, y + 180, (uint16_t *)HUMIDITY64x64);
-   canvas.drawString(String(myData.sht30Humidity) + " %", x + 100, y + 195, 1);
+   if (IsDynamicLayer()) {
+      canvas.setTextSize(4);
+      canvas.drawString(String(myData.sht30Temperatur) + " C", x + 100, y + 125, 1);
+      canvas.drawString(String(myData.sht30Humidity) + " %", x + 100, y + 195, 1);
+   }
 }
 
-void WeatherDisplay::DrawStatusInfo(int x, int y, int dx, int dy)
+/* 
+ * Graph of the indoor (black) and the outdoor (gray) temperature history
+ * with the common range of both at the right side.
+ */
+void WeatherDisplay::DrawHistory(M5EPD_Canvas &canvas, int x, int y, int dx, int dy, String title, const float *indoor, const float *outdoor, int buckets)
 {
-   canvas.setTextSize(3);
-   canvas.drawCentreString("Status", x + dx / 2, y + 7, 1);
-   canvas.drawLine(x, y + 35, x + dx, y + 35, M5EPD_Canvas::G15);
+   TRACE_FUNCTION();
+   const float *series[] = { outdoor, indoor };
+   int          graphX   = x + 40;
+   int          graphDX  = dx - 40 - 28;
+   float        yMin     = NAN;
+   float        yMax     = NAN;
+
+   if (IsStaticLayer()) {
+      canvas.setTextSize(2);
+      canvas.drawString(title, x, y + dy / 2 - 8, 1);
+   }
+   if (!IsDynamicLayer()) {
+      return;
+   }
+   for (int s = 0; s < 2; s++) {
+      for (int b = 0; b < buckets; b++) {
+         if (!isnan(series[s][b])) {
+            yMin = isnan(yMin) ? series[s][b] : min(yMin, series[s][b]);
+            yMax = isnan(yMax) ? series[s][b] : max(yMax, series[s][b]);
+         }
+      }
+   }
+   if (isnan(yMin)) {
+      return; // no history yet
+   }
+   yMin = floorf(yMin);
+   yMax = max(ceilf(yMax), yMin + 2);
+   for (int s = 0; s < 2; s++) {
+      int lastX = -1;
+      int lastY = 0;
+
+      for (int b = 0; b < buckets; b++) {
+         if (isnan(series[s][b])) {
+            lastX = -1; // gap in the history
+            continue;
+         }
+         int px = graphX + b * (graphDX - 1) / (buckets - 1);
+         int py = y + dy - 1 - (int) ((series[s][b] - yMin) * (dy - 1) / (yMax - yMin));
 
+         if (lastX >= 0) {
+            canvas.drawLine(lastX, lastY, px, py, s ? M5EPD_Canvas::G15 : M5EPD_Canvas::G8);
+         } else {
+            canvas.drawPixel(px, py, s ? M5EPD_Canvas::G15 : M5EPD_Canvas::G8);
+         }
+         lastX = px;
+         lastY = py;
+      }
+   }
+   canvas.setTextSize(1);
+   canvas.drawRightString(String(yMax, 0), x + dx, y, 1);
+   canvas.drawRightString(String(yMin, 0), x + dx, y + dy - 8, 1);
+}
+
+void WeatherDisplay::DrawStatusInfo(M5EPD_Canvas &canvas, int x, int y, int dx, int dy)
+{
+   TRACE_FUNCTION();
    canvas.setTextSize(3);
-   canvas.drawCentreString(getRTCDateString(), x + dx / 2, y + 95, 1);
-   canvas.drawCentreString(getRTCTimeString(), x + dx / 2, y + 143, 1);
+   if (IsStaticLayer()) {
+      canvas.drawCentreString("Status", x + dx / 2, y + 7, 1);
+      canvas.drawLine(x, y + 35, x + dx, y + 35, M5EPD_Canvas::G15);
+   }
+
    canvas.setTextSize(2);
-   canvas.drawCentreString("updated", x + dx / 2, y + 120, 1);
-   canvas.drawCentreString("next update ", x + dx / 2, y + 200, 1);
-   canvas.drawCentreString("in " + String(myData.sleepForMinutes) + " Min.", x + dx / 2, y + 220, 1);
+   if (IsStaticLayer()) {
+      canvas.drawCentreString("updated", x + dx / 2, y + 88, 1);
+      canvas.drawCentreString("next update ", x + dx / 2, y + 200, 1);
+   }
+   if (IsDynamicLayer()) {
+      DrawSunPath(canvas, x + 10, y + 40, dx - 20, 44);
+      canvas.drawCentreString(rtcDate + " " + rtcTime, x + dx / 2, y + 106, 1);
+      DrawMoon(canvas, x + 10, y + 132, dx - 20, 56);
+      canvas.drawCentreString("in " + String(myData.sleepForMinutes) + " Min.", x + dx / 2, y + 220, 1);
+   }
+}
+
+/*
+ * Draw the elevation of the sun over the local day from midnight to 
+ * midnight above the horizon line, the ticks mark the civil twilight
+ * and the dot the sun at the time of the frame.
+ */
+void WeatherDisplay::DrawSunPath(M5EPD_Canvas &canvas, int x, int y, int dx, int dy)
+{
+   TRACE_FUNCTION();
+   const int steps   = 48;
+   SunDay    day     = sun.Day(frameUtc);
+   time_t    local   = timeZone.Local(frameUtc);
+   time_t    start   = frameUtc - ((local % SECS_PER_DAY) + SECS_PER_DAY) % SECS_PER_DAY;
+   int       horizon = y + dy - 8;
+   float     scale   = (horizon - y) / max(day.noonElevation, 10.0f);
+   int       lastX   = 0;
+   int       lastY   = 0;
+
+   for (int i = 0; i <= steps; i++) {
+      time_t time = start + (time_t) i * SECS_PER_DAY / steps;
+      int    px   = x + i * dx / steps;
+      int    py   = constrain(horizon - (int) (sun.Elevation(time) * scale), y, y + dy);
+
+      if (i > 0) {
+         canvas.drawLine(lastX, lastY, px, py, py < horizon ? M5EPD_Canvas::G15 : M5EPD_Canvas::G6);
+      }
+      lastX = px;
+      lastY = py;
+   }
+   canvas.drawFastHLine(x, horizon, dx, M5EPD_Canvas::G15);
+
+   time_t twilight[] = { day.dawn, day.dusk };
+   for (int i = 0; i < 2; i++) {
+      if (twilight[i]) {
+         int px = x + (int) ((twilight[i] - start) * dx / SECS_PER_DAY);
+         canvas.drawFastVLine(px, horizon - 3, 7, M5EPD_Canvas::G15);
+      }
+   }
+
+   int px = x + (int) ((frameUtc - start) * dx / SECS_PER_DAY);
+   int py = constrain(horizon - (int) (sun.Elevation(frameUtc) * scale), y + 4, y + dy - 4);
+   if (py < horizon) {
+      canvas.fillCircle(px, py, 4, M5EPD_Canvas::G15);
+   } else {
+      canvas.drawCircle(px, py, 4, M5EPD_Canvas::G15);
+   }
+}
+
+/* Draw the phase icon, the illumination, moonrise and moonset of the local day */
+void WeatherDisplay::DrawMoon(M5EPD_Canvas &canvas, int x, int y, int dx, int dy)
+{
+   TRACE_FUNCTION();
+   MoonDay day   = moon.Day(frameUtc);
+   int     phase = LATITUDE < 0 ? (MOON_PHASES - day.phase) % MOON_PHASES : day.phase; // mirrored in the south
+   String  rise  = day.rise ? getHourMinString(timeZone.Local(day.rise)) : "--:--";
+   String  set   = day.set  ? getHourMinString(timeZone.Local(day.set))  : "--:--";
+
+   // an even x copies the icon by rows, the canvas of the region starts at an even x
+   BlitIcon(canvas, x + (x & 1), y + (dy - MOON_ICON_SIZE) / 2, MOON_ICONS[phase], MOON_ICON_SIZE, MOON_ICON_SIZE);
+   canvas.setTextSize(2);
+   canvas.drawRightString(String((int) (day.illumination * 100 + 0.5f)) + " %", x + dx, y + 2, 1);
+   canvas.drawRightString("auf " + rise, x + dx, y + 20, 1);
+   canvas.drawRightString("unter " + set, x + dx, y + 38, 1);
 }
 
 /* Draw one hourly weather information */
-void WeatherDisplay::DrawDaily(int x, int y, int dx, int dy, Weather &weather, int index)
+void WeatherDisplay::DrawDaily(M5EPD_Canvas &canvas, int x, int y, int dx, int dy, Weather &weather, int index)
 {
+   TRACE_FUNCTION();
    time_t time = weather.dailyTime[index];
    int temp = weather.dailyMaxTemp[index];
    String main = weather.dailyMain[index];
@@ -229,6 +548,17 @@ void WeatherDisplay::DrawDaily(int x, int y, int dx, int dy, Weather &weather, i
 
    char const *weekdays[] = {"", "So", "Mo", "Di", "Mi", "Do", "Fr", "Sa"};
    const char *wd = weekdays[weekday(time)];
+
+   if (!IsDynamicLayer()) {
+      return;
+   }
+
+   // the cells change once a day, the cache keeps their pixels
+   uint32_t key = WidgetKey("daily " + String(index) + wd + String(temp) + icon + String(myData.weather.success));
+
+   if (widgetCache.Blit(canvas, x, y, dx, dy, key)) {
+      return;
+   }
    
    if(myData.weather.success) {
       canvas.setTextSize(2);
@@ -240,90 +570,178 @@ void WeatherDisplay::DrawDaily(int x, int y, int dx, int dy, Weather &weather, i
    int iconY = y + 50;
 
    if (icon == "01d")
-      DrawIcon(iconX, iconY, (uint16_t *)image_data_01d, 64, 64, true);
+      DrawIcon(canvas, iconX, iconY, (uint16_t *)image_data_01d, 64, 64, true);
    else if (icon == "01n")
-      DrawIcon(iconX, iconY, (uint16_t *)image_data_03n, 64, 64, true);
+      DrawIcon(canvas, iconX, iconY, (uint16_t *)image_data_03n, 64, 64, true);
    else if (icon == "02d")
-      DrawIcon(iconX, iconY, (uint16_t *)image_data_02d, 64, 64, true);
+      DrawIcon(canvas, iconX, iconY, (uint16_t *)image_data_02d, 64, 64, true);
    else if (icon == "02n")
-      DrawIcon(iconX, iconY, (uint16_t *)image_data_02n, 64, 64, true);
+      DrawIcon(canvas, iconX, iconY, (uint16_t *)image_data_02n, 64, 64, true);
    else if (icon == "03d")
-      DrawIcon(iconX, iconY, (uint16_t *)image_data_03d, 64, 64, true);
+      DrawIcon(canvas, iconX, iconY, (uint16_t *)image_data_03d, 64, 64, true);
    else if (icon == "03n")
-      DrawIcon(iconX, iconY, (uint16_t *)image_data_03n, 64, 64, true);
+      DrawIcon(canvas, iconX, iconY, (uint16_t *)image_data_03n, 64, 64, true);
    else if (icon == "04d")
-      DrawIcon(iconX, iconY, (uint16_t *)image_data_04d, 64, 64, true);
+      DrawIcon(canvas, iconX, iconY, (uint16_t *)image_data_04d, 64, 64, true);
    else if (icon == "04n")
-      DrawIcon(iconX, iconY, (uint16_t *)image_data_03n, 64, 64, true);
+      DrawIcon(canvas, iconX, iconY, (uint16_t *)image_data_03n, 64, 64, true);
    else if (icon == "09d")
-      DrawIcon(iconX, iconY, (uint16_t *)image_data_09d, 64, 64, true);
+      DrawIcon(canvas, iconX, iconY, (uint16_t *)image_data_09d, 64, 64, true);
    else if (icon == "09n")
-      DrawIcon(iconX, iconY, (uint16_t *)image_data_09n, 64, 64, true);
+      DrawIcon(canvas, iconX, iconY, (uint16_t *)image_data_09n, 64, 64, true);
    else if (icon == "10d")
-      DrawIcon(iconX, iconY, (uint16_t *)image_data_10d, 64, 64, true);
+      DrawIcon(canvas, iconX, iconY, (uint16_t *)image_data_10d, 64, 64, true);
    else if (icon == "10n")
-      DrawIcon(iconX, iconY, (uint16_t *)image_data_03n, 64, 64, true);
+      DrawIcon(canvas, iconX, iconY, (uint16_t *)image_data_03n, 64, 64, true);
    else if (icon == "11d")
-      DrawIcon(iconX, iconY, (uint16_t *)image_data_11d, 64, 64, true);
+      DrawIcon(canvas, iconX, iconY, (uint16_t *)image_data_11d, 64, 64, true);
    else if (icon == "11n")
-      DrawIcon(iconX, iconY, (uint16_t *)image_data_11n, 64, 64, true);
+      DrawIcon(canvas, iconX, iconY, (uint16_t *)image_data_11n, 64, 64, true);
    else if (icon == "13d")
-      DrawIcon(iconX, iconY, (uint16_t *)image_data_13d, 64, 64, true);
+      DrawIcon(canvas, iconX, iconY, (uint16_t *)image_data_13d, 64, 64, true);
    else if (icon == "13n")
-      DrawIcon(iconX, iconY, (uint16_t *)image_data_13n, 64, 64, true);
+      DrawIcon(canvas, iconX, iconY, (uint16_t *)image_data_13n, 64, 64, true);
    else if (icon == "50d")
-      DrawIcon(iconX, iconY, (uint16_t *)image_data_50d, 64, 64, true);
+      DrawIcon(canvas, iconX, iconY, (uint16_t *)image_data_50d, 64, 64, true);
    else if (icon == "50n")
-      DrawIcon(iconX, iconY, (uint16_t *)image_data_50n, 64, 64, true);
+      DrawIcon(canvas, iconX, iconY, (uint16_t *)image_data_50n, 64, 64, true);
    else
-      DrawIcon(iconX, iconY, (uint16_t *)image_data_unknown, 64, 64, true);
+      DrawIcon(canvas, iconX, iconY, (uint16_t *)image_data_unknown, 64, 64, true);
+
+   widgetCache.Store(canvas, x, y, dx, dy, key);
 }
 
-void WeatherDisplay::DrawTraffic(int x, int y, int dx, int dy)
+void WeatherDisplay::DrawTraffic(M5EPD_Canvas &canvas, int x, int y, int dx, int dy)
 {
+   TRACE_FUNCTION();
+   // two routes keep the old spacing, more routes share the height below the title
+   int rowDY = commuteRouteCount <= 2 ? 40 : 90 / commuteRouteCount;
+
    canvas.setTextSize(2);
-   canvas.setTextSize(2);
-   canvas.drawCentreString("Fahrzeit", x + dx / 2, y + 10, 1);
-   canvas.drawString(String(CITY_NAME) + " -> " + String(WORK_NAME) + " in       Minuten", x + 10, y + 46);
-   canvas.drawString(String(WORK_NAME) + " -> " + String(CITY_NAME) + " in       Minuten", x + 10, y + 86);
+   if (IsStaticLayer()) {
+      canvas.drawCentreString("Fahrzeit", x + dx / 2, y + 10, 1);
+      for (int r = 0; r < commuteRouteCount; r++) {
+         canvas.drawString(String(commutePlaces[commuteRoutes[r].from].name) + " -> " + String(commutePlaces[commuteRoutes[r].to].name)
+            + " in       Minuten", x + 10, y + 46 + r * rowDY);
+      }
+   }
    canvas.setTextSize(3);
-   canvas.drawRightString(String(myData.mapsWorkDurationInTraffic), x + dx - 165, y + 40, 1);
-   canvas.drawRightString(String(myData.mapsHomeDurationInTraffic), x + dx - 165, y + 80, 1);
+   if (IsDynamicLayer()) {
+      for (int r = 0; r < commuteRouteCount; r++) {
+         // a learned duration is marked with a tilde
+         canvas.drawRightString((myData.mapsPredicted[r] ? "~" : "") + String(myData.mapsDurations[r]), x + dx - 165, y + 40 + r * rowDY, 1);
+      }
+   }
 }
 
-void WeatherDisplay::DrawCorona(int x, int y, int dx, int dy)
+void WeatherDisplay::DrawCorona(M5EPD_Canvas &canvas, int x, int y, int dx, int dy)
 {
+   TRACE_FUNCTION();
    canvas.setTextSize(2);
-   canvas.drawCentreString("Corona  " + GermanDate(myData.coronaUpdated), x + dx / 2, y + 5, 1);
+   if (IsDynamicLayer()) {
+      canvas.drawCentreString("Corona  " + GermanDate(myData.coronaUpdated), x + dx / 2, y + 5, 1);
+   }
 
    canvas.setTextSize(2);
-   canvas.drawString("Inzidenz " + String(myData.coronaName) + ":", x + 10, y + 45);
-   canvas.drawString("Inzidenz Dtl.:", x + 10, y + 85);
+   if (IsDynamicLayer()) {
+      canvas.drawString("Inzidenz " + String(myData.coronaName) + ":", x + 10, y + 45);
+   }
+   if (IsStaticLayer()) {
+      canvas.drawString("Inzidenz Dtl.:", x + 10, y + 85);
+   }
    canvas.setTextSize(4);
-   canvas.drawRightString(String(myData.coronaWeekIncidenceLocal, 0), x + 330, y + 35, 1);
-   canvas.drawRightString(String(myData.coronaWeekIncidenceGermany, 0), x + 330, y + 75, 1);
+   if (IsDynamicLayer()) {
+      canvas.drawRightString(String(myData.coronaWeekIncidenceLocal, 0), x + 330, y + 35, 1);
+      canvas.drawRightString(String(myData.coronaWeekIncidenceGermany, 0), x + 330, y + 75, 1);
+   }
+}
+
+/* Air quality index of openweathermap with the fine particles and the nitrogen dioxide */
+void WeatherDisplay::DrawAirQuality(M5EPD_Canvas &canvas, int x, int y, int dx, int dy)
+{
+   TRACE_FUNCTION();
+   const char *labels[] = { "-", "gut", "ok", "mittel", "schlecht", "kritisch" };
+   Weather    &weather  = myData.weather;
+   int         aqi      = constrain(weather.airQuality, 0, 5);
+
+   canvas.setTextSize(2);
+   if (IsStaticLayer()) {
+      canvas.drawCentreString("Luft", x + dx / 2, y + 5, 1);
+   }
+   if (IsDynamicLayer()) {
+      canvas.setTextSize(4);
+      canvas.drawCentreString(aqi ? String(aqi) : "-", x + dx / 2, y + 30, 1);
+      canvas.setTextSize(2);
+      canvas.drawCentreString(labels[aqi], x + dx / 2, y + 68, 1);
+      if (aqi) {
+         canvas.setTextSize(1);
+         canvas.drawCentreString("PM2.5 " + String(weather.airPm25, 0) + "  NO2 " + String(weather.airNo2, 0), x + dx / 2, y + 94, 1);
+      }
+   }
 }
 
-void WeatherDisplay::DrawWeatherGraph(int x, int y, int dx, int dy)
+void WeatherDisplay::DrawWeatherGraph(M5EPD_Canvas &canvas, int x, int y, int dx, int dy)
 {
-   rtc_time_t RTCtime;
-   M5.RTC.getTime(&RTCtime);
-   int xMin = RTCtime.hour;
+   TRACE_FUNCTION();
+   if (!IsDynamicLayer()) {
+      return;
+   }
+   Weather &weather    = myData.weather;
+   int      points     = weather.forecastTemp.Size();
+   int      pointHours = weather.forecastTemp.Factor();
+   float    temp[FORECAST_POINTS];
+   float    rain[FORECAST_POINTS];
+   float    snow[FORECAST_POINTS];
+
+   // the bars show the peak of the hours of a point, the line their mean
+   for (int i = 0; i < points; i++) {
+      temp[i] = weather.forecastTemp.Mean(i);
+      rain[i] = weather.forecastRain.Max(i);
+      snow[i] = weather.forecastSnow.Max(i);
+   }
+   int xMin = rtcHour;
    int xSteps = 12;
-   DrawGraph(x + 15, y + 2, 415, 115, "mm", RIGHT, xMin, xSteps, 0, myData.weather.maxRain, myData.weather.forecastHourlyRain);
-   DrawGraph(x + 15, y + 2, 415, 115, "mm", RIGHT, xMin, xSteps, 0, myData.weather.maxRain, myData.weather.forecastHourlySnow);
-   DrawGraph(x + 15, y + 2, 415, 115, "'C", LEFT, xMin, xSteps, myData.weather.minTemp, myData.weather.maxTemp, myData.weather.forecastHourlyTemp);
+   DrawGraph(canvas, x + 15, y + 2, 415, 115, "mm", RIGHT, xMin, xSteps, FORECAST_HOURS, 0, weather.maxRain, rain, points, pointHours);
+   DrawGraph(canvas, x + 15, y + 2, 415, 115, "mm", RIGHT, xMin, xSteps, FORECAST_HOURS, 0, weather.maxRain, snow, points, pointHours);
+   DrawGraph(canvas, x + 15, y + 2, 415, 115, "'C", LEFT, xMin, xSteps, FORECAST_HOURS, weather.minTemp, weather.maxTemp, temp, points, pointHours);
+}
+
+/* Bars of the rain of the next hour, the height grows with the root of the intensity up to 4 mm/h */
+void WeatherDisplay::DrawNowcast(M5EPD_Canvas &canvas, int x, int y, int dx, int dy)
+{
+   TRACE_FUNCTION();
+   Decimator<NOWCAST_BARS> &rain = myData.weather.nowcastRain;
+   int                      bars = rain.Size();
+
+   if (!bars) {
+      return; // no minutely forecast at the location
+   }
+   canvas.setTextSize(1);
+   canvas.drawString("Regen 60 Min", x, y, 1);
+   canvas.drawFastHLine(x, y + dy - 1, dx, M5EPD_Canvas::G15);
+   for (int i = 0; i <= 2; i++) {
+      canvas.drawFastVLine(x + i * (dx - 1) / 2, y + dy - 4, 4, M5EPD_Canvas::G15);
+   }
+   for (int i = 0; i < bars; i++) {
+      int barX = x + i * dx / bars;
+      int barH = (int) ((dy - 11) * sqrtf(min(rain.Max(i) / 4.0f, 1.0f)));
+
+      if (barH > 0) {
+         canvas.fillRect(barX, y + dy - 1 - barH, max(dx / bars - 1, 1), barH, M5EPD_Canvas::G10);
+      }
+   }
 }
 
 /* Draw a graph with x- and y-axis and values */
-void WeatherDisplay::DrawGraph(int x, int y, int dx, int dy, String title, boolean titleRight, int xMin, int xSteps, int yMin, int yMax, float values[])
+void WeatherDisplay::DrawGraph(M5EPD_Canvas &canvas, int x, int y, int dx, int dy, String title, boolean titleRight, int xMin, int xSteps, int hours, int yMin, int yMax, float values[], int points, int pointHours)
 {
+   TRACE_FUNCTION();
    int textWidth = 12;
    int graphX = x + textWidth + 20;
    int graphY = y + 10;
    int graphDX = dx - textWidth - 20;
    int graphDY = dy - 30;
-   float xStep = graphDX / xSteps;
+   float xStep = (float) graphDX / xSteps;
    int iOldX = 0;
    int iOldY = 0;
 
@@ -352,7 +770,7 @@ void WeatherDisplay::DrawGraph(int x, int y, int dx, int dy, String title, boole
       for (int i = 0; i <= xSteps; i++)
       {
          // x scale mod 24
-         canvas.drawString(String((xMin + i)%24), graphX + i * xStep - 10, graphY + graphDY + 5);
+         canvas.drawString(String((xMin + i * hours / xSteps)%24), graphX + i * xStep - 10, graphY + graphDY + 5);
       }
    }
 
@@ -377,12 +795,12 @@ void WeatherDisplay::DrawGraph(int x, int y, int dx, int dy, String title, boole
          canvas.drawLine(xDash, yPos, xDash + 5, yPos, M5EPD_Canvas::G15);
       }
    }
-   for (int i = 0; i <= xSteps; i++)
+   for (int i = 0; i < points; i++)
    {
       float yValue = values[i];
       float yValueDY = (float)graphDY / (yMax - yMin);
       int h = (yValue - yMin) * yValueDY;
-      int xPos = graphX + graphDX / xSteps * i;
+      int xPos = graphX + graphDX * i * pointHours / hours;
       int yPos = graphY + graphDY - h;
 
       if (yPos > graphY + graphDY)
@@ -392,12 +810,12 @@ void WeatherDisplay::DrawGraph(int x, int y, int dx, int dy, String title, boole
 
       if (titleRight) {
          // bar chart for right side data 
-         uint barWidth =  xStep;
+         uint barWidth = graphDX * pointHours / hours;
          uint xbar = xPos - barWidth/2;
          if (i == 0) {
             barWidth = barWidth / 2;
             xbar = xPos;
-         } else if (i == xSteps) {
+         } else if (i * pointHours >= hours) {
             barWidth = barWidth / 2;
             xbar = xPos - barWidth;
          }
@@ -416,59 +834,418 @@ void WeatherDisplay::DrawGraph(int x, int y, int dx, int dy, String title, boole
    }
 }
 
-/* Main function to show all the data to the e-paper */
-void WeatherDisplay::Show()
+/* Check if a part of the frame is inside the canvas of the region */
+bool WeatherDisplay::IsVisible(const RenderRegion &region, int x, int y, int dx, int dy)
 {
-   Serial.println("WeatherDisplay::Show");
+   // the separator lines of the widgets end on the right border pixel
+   return x < region.x + region.dx && x + dx >= region.x
+       && y < region.y + region.dy && y + dy > region.y;
+}
 
-   canvas.createCanvas(960, 540);
+/* 
+ * Draw the whole frame into the canvas of one region.
+ * The canvas clips everything outside of the region, the widgets that 
+ * could not touch the region are skipped completely. Because every region 
+ * keeps the original drawing order the composed frame is identical to 
+ * drawing the frame at once.
+ */
+void WeatherDisplay::DrawFrame(M5EPD_Canvas &canvas, const RenderRegion &region)
+{
+   TRACE_FUNCTION();
+   int ox = region.x;
+   int oy = region.y;
 
    canvas.setTextSize(2);
    canvas.setTextColor(WHITE, BLACK);
    canvas.setTextDatum(TL_DATUM);
 
-   DrawHead();
+   if (IsVisible(region, 0, 0, maxX, 34)) {
+      DrawHead(canvas, -ox, -oy, maxX, 34);
+   }
 
    // x = 960 y = 540
    // 540 - oben 35 - unten 10 = 495
 
    // top
-   canvas.drawRect(14, 34, maxX - 28, maxY - 43, M5EPD_Canvas::G15);
+   if (IsStaticLayer()) {
+      canvas.drawRect(14 - ox, 34 - oy, maxX - 28, maxY - 43, M5EPD_Canvas::G15);
 
-   canvas.drawRect(15, 35, maxX - 30, 251, M5EPD_Canvas::G15);
-   canvas.drawLine(232, 35, 232, 286, M5EPD_Canvas::G15);
-   canvas.drawLine(465, 35, 465, 286, M5EPD_Canvas::G15);
-   canvas.drawLine(697, 35, 697, 286, M5EPD_Canvas::G15);
-   DrawSunInfo(15, 35, 217, 251);
-   DrawOutdoorInfo(232, 35, 232, 251);
-   DrawIndoorInfo(465, 35, 232, 251);
-   DrawStatusInfo(697, 35, 245, 251);
+      canvas.drawRect(15 - ox, 35 - oy, maxX - 30, 251, M5EPD_Canvas::G15);
+      canvas.drawLine(232 - ox, 35 - oy, 232 - ox, 286 - oy, M5EPD_Canvas::G15);
+      canvas.drawLine(465 - ox, 35 - oy, 465 - ox, 286 - oy, M5EPD_Canvas::G15);
+      canvas.drawLine(697 - ox, 35 - oy, 697 - ox, 286 - oy, M5EPD_Canvas::G15);
+   }
+   if (IsVisible(region, 15, 35, 217, 251)) {
+      DrawSunInfo(canvas, 15 - ox, 35 - oy, 217, 251);
+   }
+   if (IsVisible(region, 232, 35, 232, 251)) {
+      DrawOutdoorInfo(canvas, 232 - ox, 35 - oy, 232, 251);
+   }
+   if (IsVisible(region, 465, 35, 232, 251)) {
+      DrawIndoorInfo(canvas, 465 - ox, 35 - oy, 232, 251);
+   }
+   if (IsVisible(region, 697, 35, 245, 251)) {
+      DrawStatusInfo(canvas, 697 - ox, 35 - oy, 245, 251);
+   }
 
    // middle bottom left
-   canvas.drawRect(15, 286, maxX - 30, 122, M5EPD_Canvas::G15);
+   if (IsStaticLayer()) {
+      canvas.drawRect(15 - ox, 286 - oy, maxX - 30, 122, M5EPD_Canvas::G15);
+   }
    for (int x = 13, i = 0; i < 4; x += 113, i += 1)
    {
       // canvas.drawLine(x, 286, x, 408, M5EPD_Canvas::G15);
-      DrawDaily(x, 286, 113, 122, myData.weather, i);
-      canvas.drawLine(x + 113, 286, x + 113, 408, M5EPD_Canvas::G15);
+      if (IsVisible(region, x, 286, 113, 122)) {
+         DrawDaily(canvas, x - ox, 286 - oy, 113, 122, myData.weather, i);
+      }
+      if (IsStaticLayer()) {
+         canvas.drawLine(x + 113 - ox, 286 - oy, x + 113 - ox, 408 - oy, M5EPD_Canvas::G15);
+      }
    }
 
-   DrawWeatherGraph(465, 286, 465, 122);
+   // the graph labels are drawn right of the graph up to the frame border
+   if (IsVisible(region, 465, 286, maxX - 465, 122)) {
+      DrawWeatherGraph(canvas, 465 - ox, 286 - oy, 465, 122);
+   }
    
-   DrawTraffic(15, 408, 465, 122);
-   DrawCorona(465, 415, 465, 122);
+   if (IsVisible(region, 15, 408, 465, 122)) {
+      DrawTraffic(canvas, 15 - ox, 408 - oy, 465, 122);
+   }
+   if (IsVisible(region, 465, 415, 465, 122)) {
+      DrawCorona(canvas, 465 - ox, 415 - oy, 465, 122);
+   }
+   // the air quality uses the right part of the corona panel
+   if (IsVisible(region, 810, 408, 135, 122)) {
+      DrawAirQuality(canvas, 815 - ox, 415 - oy, 125, 115);
+   }
    // bottom
    
-   canvas.drawRect(15, 408, maxX - 30, 122, M5EPD_Canvas::G15);
-   canvas.drawLine(465, 408, 465, 530, M5EPD_Canvas::G15);
-   
-   canvas.pushCanvas(0, 0, UPDATE_MODE_GC16);
+   if (IsStaticLayer()) {
+      canvas.drawRect(15 - ox, 408 - oy, maxX - 30, 122, M5EPD_Canvas::G15);
+      canvas.drawLine(465 - ox, 408 - oy, 465 - ox, 530 - oy, M5EPD_Canvas::G15);
+      canvas.drawLine(810 - ox, 408 - oy, 810 - ox, 530 - oy, M5EPD_Canvas::G15);
+   }
+}
+
+/* 
+ * Set the time of the frame once, before the parallel workers start.
+ * The date and time of the status show the update of the data, by default the frame time.
+ */
+void WeatherDisplay::SetFrameTime(time_t utc, time_t updated /* = 0 */)
+{
+   char   buff[32];
+   time_t time = timeZone.Local(updated ? updated : utc);
+
+   frameUtc = utc;
+   rtcHour = hour(timeZone.Local(utc));
+   sprintf(buff, "%d.%d.%04d", day(time), month(time), year(time));
+   rtcDate = buff;
+   sprintf(buff, "%d:%02d:%02d", hour(time), minute(time), second(time));
+   rtcTime = buff;
+}
+
+/* Query the temperature history of the indoor panel, the workers only read the result */
+void WeatherDisplay::PrepareHistory()
+{
+   TRACE_FUNCTION();
+   time_t to = history.Last() + 1;
+
+   history.Query(to - SECS_PER_DAY, to, HISTORY_INDOOR_TEMP, HISTORY_DAY_BUCKETS, historyDay[0]);
+   history.Query(to - SECS_PER_DAY, to, HISTORY_OUTDOOR_TEMP, HISTORY_DAY_BUCKETS, historyDay[1]);
+   history.Query(to - SECS_PER_WEEK, to, HISTORY_INDOOR_TEMP, HISTORY_WEEK_BUCKETS, historyWeek[0]);
+   history.Query(to - SECS_PER_WEEK, to, HISTORY_OUTDOOR_TEMP, HISTORY_WEEK_BUCKETS, historyWeek[1]);
+}
+
+/* Bit of the region with the name in the region masks */
+uint32_t WeatherDisplay::RegionMask(const char *name)
+{
+   for (int i = 0; i < RENDER_REGIONS; i++) {
+      if (strcmp(regions[i].name, name) == 0) {
+         return 1u << i;
+      }
+   }
+   return 0;
+}
+
+/* Render the regions from the shared work queue until it is empty, the canvas of the skipped regions stays NULL */
+void WeatherDisplay::RenderWork()
+{
+   int index;
+
+   // the regions are sorted by cost, every idle worker takes the next one
+   while ((index = nextRegion.fetch_add(1)) < RENDER_REGIONS) {
+      if (!(regionMask & (1u << index))) {
+         continue;
+      }
+      RenderRegion &region = regions[index];
+      uint32_t      start  = millis();
+      TRACE_SCOPE(region.name);
+      
+      // round to the 16 bit words of the 4 bit frame buffer (4 pixels),
+      // the overlapping pixels are drawn identically by both neighbour regions
+      int x  = region.x & ~3;
+      int dx = ((region.x + region.dx + 3) & ~3) - x;
+
+      region.canvas  = new M5EPD_Canvas(&M5.EPD);
+      region.canvas->createCanvas(dx, region.dy);
+      region.canvasX = x;
+
+      if (layer == LAYER_DYNAMIC) {
+         // start from the static layer in the main canvas
+         uint8_t *frame = (uint8_t *) canvas.frameBuffer(1);
+         uint8_t *dst   = (uint8_t *) region.canvas->frameBuffer(1);
+
+         for (int row = 0; row < region.dy; row++) {
+            memcpy(dst + row * dx / 2, frame + ((region.y + row) * maxX + x) / 2, dx / 2);
+         }
+      }
+
+      RenderRegion viewport = region;
+      viewport.x  = x;
+      viewport.dx = dx;
+      DrawFrame(*region.canvas, viewport);
+      region.ms = millis() - start;
+   }
+}
+
+/* Task function of the helper render workers */
+void WeatherDisplay::RenderTask(void *param)
+{
+   WeatherDisplay *display = (WeatherDisplay *) param;
+
+   display->RenderWork();
+   xSemaphoreGive(display->workersDone);
+   vTaskDelete(NULL);
+}
+
+/* 
+ * Render the regions of the mask in parallel and compose them into the main canvas.
+ * The main canvas is only used for all regions.
+ */
+void WeatherDisplay::RenderRegions(DrawLayer drawLayer, uint32_t mask /* = ~0u */)
+{
+   TRACE_FUNCTION();
+   TRACE_COUNTER("free heap", ESP.getFreeHeap());
+   uint32_t start = millis();
+
+   FreeRegions();
+   layer      = drawLayer;
+   regionMask = mask;
+   nextRegion = 0;
+
+   workersDone = xSemaphoreCreateCounting(workers, 0);
+   for (int i = 1; i < workers; i++) {
+      // the arduino loop task runs on core 1, the helpers use the idle core 0
+      xTaskCreatePinnedToCore(RenderTask, "RenderTask", 8192, this, 1, NULL, 0);
+   }
+   RenderWork();
+   for (int i = 1; i < workers; i++) {
+      xSemaphoreTake(workersDone, portMAX_DELAY);
+   }
+   vSemaphoreDelete(workersDone);
+   workersDone = NULL;
+
+   uint32_t sequentialMs = 0;
+   uint8_t *frame        = regionMask == ~0u ? (uint8_t *) canvas.frameBuffer(1) : NULL;
+
+   for (int i = 0; i < RENDER_REGIONS; i++) {
+      RenderRegion &region = regions[i];
+
+      if (!region.canvas) {
+         continue;
+      }
+      int      bytes = region.canvas->width() / 2;
+      uint8_t *src   = (uint8_t *) region.canvas->frameBuffer(1);
+
+      for (int row = 0; frame && row < region.dy; row++) {
+         memcpy(frame + ((region.y + row) * maxX + region.canvasX) / 2, src + row * bytes, bytes);
+      }
+      sequentialMs += region.ms;
+      LOG(LOG_REGION, region.name, (int) region.ms);
+   }
+
+   TRACE_COUNTER("free heap", ESP.getFreeHeap());
+   LOG(LOG_RENDERED, workers, (int) (millis() - start), (int) sequentialMs);
+   layer      = LAYER_ALL;
+   regionMask = ~0u;
+}
+
+/* Key of the static layer, changes with the layout and the configured names */
+uint32_t WeatherDisplay::BackgroundKey()
+{
+   String key = String(BACKGROUND_VERSION) + CITY_NAME + WORK_NAME + maxX + "x" + maxY;
+
+   // the names of the routes are part of the static layer
+   for (int r = 0; r < commuteRouteCount; r++) {
+      key += String(commutePlaces[commuteRoutes[r].from].name) + ">" + commutePlaces[commuteRoutes[r].to].name;
+   }
+
+   return HashBytes((const uint8_t *) key.c_str(), key.length());
+}
+
+/* Key of a cached widget from its inputs, the static layer below it is part of the key */
+uint32_t WeatherDisplay::WidgetKey(const String &inputs)
+{
+   uint32_t key = HashBytes((const uint8_t *) inputs.c_str(), inputs.length(), BackgroundKey());
+
+   return key ? key : 1; // 0 marks a free cache slot
+}
+
+/* Load the static layer into the main canvas, render and store it on the first start */
+void WeatherDisplay::PrepareBackground()
+{
+   uint32_t start = millis();
+   uint8_t *frame = (uint8_t *) canvas.frameBuffer(1);
+   size_t   len   = maxX * maxY / 2;
+
+   if (background.Load(frame, len, BackgroundKey())) {
+      LOG(LOG_BACKGROUND_LOADED, (int) (millis() - start));
+   } else {
+      RenderRegions(LAYER_STATIC);
+      background.Store(frame, len, BackgroundKey());
+      LOG(LOG_BACKGROUND_STORED, (int) (millis() - start));
+   }
+}
+
+/* 
+ * Push the changed regions to the e-paper with the scheduled update mode.
+ * The local wakes only push their regions with the fast waveform.
+ */
+void WeatherDisplay::PushRegions(bool local /* = false */)
+{
+   TRACE_FUNCTION();
+   refresh.LoadNVS();
+
+   if (!local && refresh.IsFullCleanDue(timeZone.Local(wakeClock.Now()))) {
+      uint32_t start = millis();
+
+      // full clean of the whole panel against the ghosting
+      M5.EPD.Clear(true);
+      canvas.pushCanvas(0, 0, UPDATE_MODE_GC16);
+      M5.EPD.CheckAFSR();
+      refresh.Timing(UPDATE_MODE_GC16, millis() - start);
+      for (int i = 0; i < RENDER_REGIONS; i++) {
+         RenderRegion &region = regions[i];
+         refresh.Cleaned(i, HashBytes((uint8_t *) region.canvas->frameBuffer(1), region.canvas->width() / 2 * region.dy));
+      }
+      refresh.FullCleaned(timeZone.Local(wakeClock.Now()));
+   } else {
+      for (int i = 0; i < RENDER_REGIONS; i++) {
+         RenderRegion &region = regions[i];
+
+         if (!region.canvas) {
+            continue;
+         }
+         uint32_t hash = HashBytes((uint8_t *) region.canvas->frameBuffer(1), region.canvas->width() / 2 * region.dy);
+
+         if (!refresh.IsChanged(i, hash)) {
+            LOG(LOG_REFRESH_SKIPPED, region.name);
+            continue;
+         }
+         uint32_t histogram[16];
+
+         GrayHistogram((uint8_t *) region.canvas->frameBuffer(1), region.canvas->width() / 2 * region.dy, histogram);
+
+         // the degraded battery mode uses the fast 1 bit waveform for everything
+         m5epd_update_mode_t mode  = refresh.Mode(i, IsBlackWhite(histogram) || myData.batteryDegraded || local);
+         uint32_t            start = millis();
+         TRACE_SCOPE(region.name);
+
+         region.canvas->pushCanvas(region.canvasX, region.y, mode);
+         // wait for the end of the waveform, otherwise the next update would wait for it
+         M5.EPD.CheckAFSR();
+         refresh.Timing(mode, millis() - start);
+         refresh.Updated(i, hash, mode);
+         LOG(LOG_REFRESH, region.name, UpdateModeName(mode), refresh.PartialUpdates(i));
+      }
+   }
+   refresh.DumpTiming();
+   refresh.SaveNVS();
+}
+
+/* Delete the canvases of the regions */
+void WeatherDisplay::FreeRegions()
+{
+   for (int i = 0; i < RENDER_REGIONS; i++) {
+      RenderRegion &region = regions[i];
+
+      if (region.canvas) {
+         region.canvas->deleteCanvas();
+         delete region.canvas;
+         region.canvas = NULL;
+      }
+   }
+}
+
+/* Main function to show all the data to the e-paper */
+void WeatherDisplay::Show(time_t time)
+{
+   LOG(LOG_SHOW, "Show");
+
+   uint32_t start = millis();
+
+   SetFrameTime(time);
+   PrepareHistory();
+   canvas.createCanvas(maxX, maxY);
+   widgetCache.LoadNVS();
+
+   int phase = timeline.Begin("render", CURRENT_RENDER_MA);
+#if BACKGROUND_LAYER
+   PrepareBackground();
+   RenderRegions(LAYER_DYNAMIC);
+#else
+   RenderRegions(LAYER_ALL);
+#endif
+   timeline.End(phase);
+   LOG(LOG_FRAME_READY, (int) (millis() - start));
+   widgetCache.Dump();
+   widgetCache.SaveNVS();
+
+   phase = timeline.Begin("push", CURRENT_EPD_MA);
+   PushRegions();
+   timeline.End(phase);
+   FreeRegions();
    delay(1000);
 }
 
+/* Render the whole frame into the main canvas without pushing it, used by the renderer of host/render */
+void WeatherDisplay::Render(time_t time)
+{
+   SetFrameTime(time);
+   PrepareHistory();
+   canvas.createCanvas(maxX, maxY);
+   RenderRegions(LAYER_ALL);
+   FreeRegions();
+}
+
+/* 
+ * Refresh only the indoor and status panels of the frame on the display.
+ * The regions are drawn completely, so neither the main canvas nor the 
+ * static layer has to be loaded. The sun and the moon move on with the
+ * time of the wake, the status keeps the time of the last update.
+ */
+void WeatherDisplay::ShowLocal(time_t now, time_t updated)
+{
+   LOG(LOG_SHOW, "ShowLocal");
+
+   uint32_t start = millis();
+
+   SetFrameTime(now, updated);
+   PrepareHistory();
+   int phase = timeline.Begin("render", CURRENT_RENDER_MA);
+   RenderRegions(LAYER_ALL, RegionMask("indoor") | RegionMask("status"));
+   timeline.End(phase);
+
+   phase = timeline.Begin("push", CURRENT_EPD_MA);
+   PushRegions(true);
+   timeline.End(phase);
+   FreeRegions();
+   LOG(LOG_LOCAL_REFRESH, (int) (millis() - start));
+}
+
 void WeatherDisplay::ShowStatusInfo()
 {
-   Serial.println("WeatherDisplay::ShowStatusInfo");
+   LOG(LOG_SHOW, "ShowStatusInfo");
 
    canvas.createCanvas(245, 251);
 
@@ -476,8 +1253,9 @@ void WeatherDisplay::ShowStatusInfo()
    canvas.setTextColor(WHITE, BLACK);
    canvas.setTextDatum(TL_DATUM);
 
+   SetFrameTime(wakeClock.Now());
    canvas.drawRect(0, 0, 245, 251, M5EPD_Canvas::G15);
-   DrawStatusInfo(0, 0, 245, 251);
+   DrawStatusInfo(canvas, 0, 0, 245, 251);
 
    canvas.pushCanvas(697, 35, UPDATE_MODE_GC16);
    delay(1000);
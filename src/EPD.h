@@ -20,12 +20,22 @@
   * Helper functions for initialisizing and shutdown of the M5Paper.
   */
 #pragma once
+#include "Log.h"
 
-/* Initialize the M5Paper */
+#define EPD_POWER_MS 100 //!< Power up of the IT8951 before the first command of a local wake, M5.begin() waits 1000 ms
+
+/* Hold the main power and start the RTC, before the slow initialization of the EPD */
+void InitPower()
+{
+   pinMode(M5EPD_MAIN_PWR_PIN, OUTPUT);
+   M5.enableMainPower();
+   M5.RTC.begin();
+}
+
+/* Initialize the M5Paper, InitPower() must be called before */
 void InitEPD(bool clearDisplay = true)
 {
    M5.begin(false, false, true, true, false);
-   M5.RTC.begin();
    
    M5.EPD.SetRotation(0);
    M5.TP.SetRotation(0);
@@ -33,10 +43,32 @@ void InitEPD(bool clearDisplay = true)
       M5.EPD.Clear(true);
    }
 
-   Serial.printf("Initialized EPD!");
+#if !LOG_BINARY
+   // the logger starts after the EPD, a text line would break the binary records
+   Serial.println("Initialized EPD!");
+#endif
 //   disableCore0WDT();
 }
 
+/*
+ * Reduced initialization of a local wake, InitPower() must be called before.
+ * M5.begin() waits a fixed second after switching on the EPD power, here the
+ * driver only gets EPD_POWER_MS and then waits for the busy pin of the IT8951
+ * itself. No touch, no SD and no battery adc, the RTC and the SHT30 share the
+ * I2C bus started by InitPower().
+ */
+void InitEPDLocal()
+{
+   Serial.begin(115200);
+   pinMode(M5EPD_EXT_PWR_EN_PIN, OUTPUT);
+   pinMode(M5EPD_EPD_PWR_EN_PIN, OUTPUT);
+   M5.enableEXTPower();
+   M5.enableEPDPower();
+   delay(EPD_POWER_MS);
+   M5.EPD.begin(M5EPD_SCK_PIN, M5EPD_MOSI_PIN, M5EPD_MISO_PIN, M5EPD_CS_PIN, M5EPD_BUSY_PIN);
+   M5.EPD.SetRotation(0);
+}
+
 /* 
  *  Shutdown the M5Paper 
  *  NOTE: the M5Paper could not shutdown while on usb connection.
@@ -44,7 +76,7 @@ void InitEPD(bool clearDisplay = true)
 */
 void ShutdownEPD(int sec)
 {
-   Serial.println("Shutdown");
+   LOG(LOG_SHUTDOWN);
 /*
    M5.disableEPDPower();
    M5.disableEXTPower();
@@ -21,43 +21,76 @@
   */
 #pragma once
 #include <WiFi.h>
+#include "Trace.h"
+#include "Log.h"
 
-/* Start and connect to the wifi */
-bool StartWiFi(int &rssi) 
+#define WIFI_TIMEOUT_MS    15000 //!< Max time from the start of the association to the link up
+#define WIFI_CONNECTED_BIT BIT0  //!< Event bit of the link up
+
+EventGroupHandle_t wifiEvents   = NULL; //!< Signals the link up to WaitWiFi
+uint32_t           wifiBeginMs  = 0;    //!< millis() at the start of the association
+uint32_t           wifiLinkUpMs = 0;    //!< millis() at the link up, 0 while not connected
+
+/* Wifi event handler, signals the link up */
+void WiFiGotIP(arduino_event_id_t event, arduino_event_info_t info)
+{
+   wifiLinkUpMs = millis();
+   xEventGroupSetBits(wifiEvents, WIFI_CONNECTED_BIT);
+}
+
+/* Start the association in the background, WaitWiFi waits for the link up */
+void BeginWiFi()
 {
-   IPAddress dns(8, 8, 8, 8); // Google DNS
-   
+   TRACE_FUNCTION();
+   wifiBeginMs  = millis();
+   wifiLinkUpMs = 0;
+   if (!wifiEvents) {
+      wifiEvents = xEventGroupCreate();
+      WiFi.onEvent(WiFiGotIP, ARDUINO_EVENT_WIFI_STA_GOT_IP);
+   }
+   xEventGroupClearBits(wifiEvents, WIFI_CONNECTED_BIT);
+
    WiFi.mode(WIFI_STA);
-   WiFi.disconnect();
    WiFi.setAutoConnect(true);
    WiFi.setAutoReconnect(true);
-
-   Serial.print("Connecting to ");
-   Serial.println(WIFI_SSID);
-   delay(100);
-   
    WiFi.begin(WIFI_SSID, WIFI_PW);
+}
+
+/* Wait for the link up of the association started with BeginWiFi */
+bool WaitWiFi(int &rssi) 
+{
+   TRACE_FUNCTION();
+   uint32_t elapsed = millis() - wifiBeginMs;
+
+   LOG(LOG_WIFI_CONNECTING, WIFI_SSID);
 
-   for (int retry = 0; WiFi.status() != WL_CONNECTED && retry < 30; retry++) {
-      delay(500);
-      Serial.print(".");
+   if (elapsed < WIFI_TIMEOUT_MS) {
+      xEventGroupWaitBits(wifiEvents, WIFI_CONNECTED_BIT, pdFALSE, pdTRUE, pdMS_TO_TICKS(WIFI_TIMEOUT_MS - elapsed));
    }
 
    rssi = 0;
-   if (WiFi.status() == WL_CONNECTED) {
+   if (xEventGroupGetBits(wifiEvents) & WIFI_CONNECTED_BIT) {
       rssi = WiFi.RSSI();
-      Serial.println("WiFi connected at: " + WiFi.localIP().toString());
+      LOG(LOG_WIFI_CONNECTED, (int) (wifiLinkUpMs - wifiBeginMs), WiFi.localIP().toString());
       return true;
    } else {
-      Serial.println("WiFi connection *** FAILED ***");
+      LOG(LOG_WIFI_FAILED);
       return false;
    }
 }
 
+/* Start and connect to the wifi */
+bool StartWiFi(int &rssi) 
+{
+   TRACE_FUNCTION();
+   BeginWiFi();
+   return WaitWiFi(rssi);
+}
+
 /* Stop the wifi connection */
 void StopWiFi() 
 {
-   Serial.println("Stop WiFi");
+   LOG(LOG_WIFI_STOP);
    WiFi.disconnect();
    WiFi.mode(WIFI_OFF);
 }
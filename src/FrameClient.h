@@ -0,0 +1,281 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file FrameClient.h
+  *
+  * Class for showing the frame drawn by the render server of host/render.
+  */
+#pragma once
+#include "Data.h"
+#include "FrameTiles.h"
+#include "HttpFetch.h"
+#include "Refresh.h"
+#include "Timeline.h"
+#include "TimeZone.h"
+#include "Trace.h"
+#include "Log.h"
+
+#ifndef RENDER_PORT
+#define RENDER_PORT 8080
+#endif
+
+static_assert(TILE_ROWS <= REFRESH_MAX_REGIONS, "The refresh scheduler stores too few regions");
+
+/**
+  * With RENDER_SRV in the Config.h the frame is drawn by the render
+  * server of host/render with the same WeatherDisplay. The panel reports
+  * its sensors and the hash of the frame it shows, the body only holds
+  * the tiles that changed since. Every tile is decoded and written into
+  * the memory of the EPD while the body arrives, there is no json and no
+  * canvas on the device. After the WiFi is off, Update() shows the runs
+  * of adjacent changed tiles row by row with the update modes of the
+  * RefreshScheduler, the rows of tiles are its regions under their own
+  * key. The unchanged tiles are never updated, the memory of the EPD
+  * does not keep them while the panel is off.
+  */
+class FrameClient
+{
+protected:
+   /* Data stored in the non volatile memory */
+   struct State
+   {
+      uint32_t frame;  //!< Hash of the frame on the panel, 0 if unknown
+      uint32_t frames; //!< Frames received
+      uint32_t tiles;  //!< Tiles received of all frames
+      uint32_t bytes;  //!< Body bytes of all frames
+   };
+
+   /* Adjacent changed tiles of a row */
+   struct Run
+   {
+      int      first;      //!< Column of the first tile
+      int      last;       //!< Column of the last tile
+      uint32_t hash;       //!< Hash of the tiles
+      bool     blackWhite; //!< The tiles only have black and white pixels
+   };
+
+   /* Changed tiles of a row */
+   struct Row
+   {
+      int count;                       //!< Number of runs, 0 if no tile changed
+      Run runs[(TILE_COLUMNS + 1) / 2]; //!< Runs of adjacent changed tiles, separated by unchanged ones
+   };
+
+   State            state;              //!< Current state
+   FrameHeader      header;             //!< Header of the last body
+   Row              rows[TILE_ROWS];    //!< Changed tiles of the last body
+   bool             clean;              //!< The full clean of the panel is due
+   uint8_t          tile[TILE_BYTES];   //!< Decoded tile
+   uint8_t          packed[TILE_BYTES]; //!< Received data of a tile
+   RefreshScheduler refresh;            //!< Chooses the update mode of the rows
+
+   void LoadNVS()
+   {
+      nvs_handle nvs_arg;
+      size_t     len = sizeof(state);
+
+      memset(&state, 0, sizeof(state));
+      if (nvs_open("Setting", NVS_READONLY, &nvs_arg) == ESP_OK) {
+         if (nvs_get_blob(nvs_arg, "frame", &state, &len) != ESP_OK || len != sizeof(state)) {
+            memset(&state, 0, sizeof(state));
+         }
+         nvs_close(nvs_arg);
+      }
+   }
+
+   void SaveNVS()
+   {
+      nvs_handle nvs_arg;
+      nvs_open("Setting", NVS_READWRITE, &nvs_arg);
+      nvs_set_blob(nvs_arg, "frame", &state, sizeof(state));
+      nvs_commit(nvs_arg);
+      nvs_close(nvs_arg);
+   }
+
+   /* Read the body tile by tile into the memory of the EPD, false on a broken body */
+   bool Read(Stream &body, int length)
+   {
+      if (body.readBytes((uint8_t *) &header, sizeof(header)) != sizeof(header) || header.magic != FRAME_MAGIC ||
+          header.version != FRAME_VERSION || header.size != sizeof(header) || header.bytes + sizeof(header) != (uint32_t) length) {
+         LOG(LOG_FRAME_VERSION, (int) header.version, FRAME_VERSION);
+         return false;
+      }
+      for (int r = 0; r < TILE_ROWS; r++) {
+         rows[r].count = 0;
+      }
+      for (int t = 0; t < header.tiles; t++) {
+         TileHeader tileHeader;
+         uint32_t   histogram[16];
+
+         if (body.readBytes((uint8_t *) &tileHeader, sizeof(tileHeader)) != sizeof(tileHeader) ||
+             tileHeader.index >= TILE_COUNT || tileHeader.length > TILE_BYTES ||
+             body.readBytes(packed, tileHeader.length) != tileHeader.length) {
+            return false;
+         }
+         if (tileHeader.encoding == TILE_RLE) {
+            if (!TileDecode(packed, tileHeader.length, tile, TILE_BYTES)) {
+               return false;
+            }
+         } else if (tileHeader.length == TILE_BYTES) {
+            memcpy(tile, packed, TILE_BYTES);
+         } else {
+            return false;
+         }
+         int  column = tileHeader.index % TILE_COLUMNS;
+         Row &row    = rows[tileHeader.index / TILE_COLUMNS];
+
+         // the server sends the tiles in the order of their index, a gap starts the next run
+         if (row.count == 0 || column != row.runs[row.count - 1].last + 1) {
+            if (row.count == (int) (sizeof(row.runs) / sizeof(row.runs[0]))) {
+               return false;
+            }
+            Run &run       = row.runs[row.count++];
+            run.first      = column;
+            run.hash       = 2166136261u;
+            run.blackWhite = true;
+         }
+         Run &run = row.runs[row.count - 1];
+
+         M5.EPD.WritePartGram4bpp(column * TILE_DX, tileHeader.index / TILE_COLUMNS * TILE_DY, TILE_DX, TILE_DY, tile);
+         GrayHistogram(tile, TILE_BYTES, histogram);
+         run.last       = column;
+         run.hash       = TileHash(tile, TILE_BYTES, run.hash);
+         run.blackWhite = run.blackWhite && IsBlackWhite(histogram);
+      }
+      return true;
+   }
+
+public:
+   FrameClient()
+      : clean(false)
+      , refresh("refreshTiles")
+   {
+      memset(&state, 0, sizeof(state));
+      memset(&header, 0, sizeof(header));
+      memset(rows, 0, sizeof(rows));
+   }
+
+   /* Request the changed tiles of the frame and write them into the EPD, true if the frame is complete */
+   bool Get(MyData &myData, time_t now)
+   {
+#ifdef RENDER_SRV
+      TimelineScope phase("frame", CURRENT_WIFI_MA);
+      HttpSession   session(RENDER_SRV, RENDER_PORT);
+      char          query[160];
+
+      LoadNVS();
+      refresh.LoadNVS();
+      // the full clean needs all the tiles in the memory of the EPD
+      clean = refresh.IsFullCleanDue(timeZone.Local(now));
+      snprintf(query, sizeof(query), "/frame?v=%d&dev=%08x&frame=%x&temp=%d&hum=%d&bat=%d&volt=%.2f&runtime=%d&degraded=%d&rssi=%d&sleep=%d",
+         FRAME_VERSION, (uint32_t) ESP.getEfuseMac(), clean ? 0 : state.frame, myData.sht30Temperatur, myData.sht30Humidity,
+         myData.batteryCapacity, myData.batteryVolt, myData.batteryRuntimeHours, (int) myData.batteryDegraded, myData.wifiRSSI,
+         myData.sleepForMinutes);
+
+      // a broken body leaves unknown tiles in the memory of the EPD
+      state.frame = 0;
+      if (!session.GetStream(NET_FRAME, query, [this](HttpBody &body) { return body.Length() > 0 && Read(body, body.Length()); })) {
+         SaveNVS();
+         return false;
+      }
+      state.frame   = header.frame;
+      state.frames += 1;
+      state.tiles  += header.tiles;
+      state.bytes  += header.bytes + sizeof(header);
+      SaveNVS();
+      LOG(LOG_FRAME_TILES, (int) header.frame, (int) header.base, (int) header.tiles, (int) (header.bytes + sizeof(header)),
+         (int) (state.bytes / state.frames));
+
+      // the panel still records the history of the values for the frames it draws itself
+      myData.weather.temp     = header.temp;
+      myData.weather.pressure = header.pressure;
+      myData.weather.success  = (header.flags & FRAME_WEATHER) != 0;
+      return true;
+#else
+      return false;
+#endif
+   }
+
+   /* UTC of the last frame */
+   time_t Time()
+   {
+      return header.time;
+   }
+
+   /* Hash of the changed tiles of the row from the hashes of its runs */
+   uint32_t RowHash(const Row &row)
+   {
+      uint32_t hash = 2166136261u;
+
+      for (int i = 0; i < row.count; i++) {
+         hash = TileHash((const uint8_t *) &row.runs[i].hash, sizeof(row.runs[i].hash), hash);
+      }
+      return hash;
+   }
+
+   /* Show the tiles written by Get() with the update modes of their rows, after the WiFi is stopped */
+   void Update(time_t now, bool degraded)
+   {
+      TRACE_FUNCTION();
+      if (clean && (header.flags & FRAME_FULL)) {
+         uint32_t start = millis();
+
+         // full clean of the whole panel against the ghosting
+         M5.EPD.UpdateFull(UPDATE_MODE_INIT);
+         M5.EPD.CheckAFSR();
+         M5.EPD.UpdateFull(UPDATE_MODE_GC16);
+         M5.EPD.CheckAFSR();
+         refresh.Timing(UPDATE_MODE_GC16, millis() - start);
+         for (int r = 0; r < TILE_ROWS; r++) {
+            refresh.Cleaned(r, RowHash(rows[r]));
+         }
+         refresh.FullCleaned(timeZone.Local(now));
+      } else {
+         for (int r = 0; r < TILE_ROWS; r++) {
+            Row                &row  = rows[r];
+            m5epd_update_mode_t mode = UPDATE_MODE_NONE;
+
+            if (row.count == 0) {
+               continue;
+            }
+            // only the received tiles, the memory of the EPD behind the unchanged ones is undefined
+            for (int i = 0; i < row.count; i++) {
+               Run     &run   = row.runs[i];
+               uint32_t start = millis();
+
+               mode = refresh.Mode(r, run.blackWhite || degraded);
+               M5.EPD.UpdateArea(run.first * TILE_DX, r * TILE_DY, (run.last - run.first + 1) * TILE_DX, TILE_DY, mode);
+               M5.EPD.CheckAFSR();
+               refresh.Timing(mode, millis() - start);
+            }
+            // the partial updates count once per row, the runs of a row escalate to GC16 together
+            refresh.Updated(r, RowHash(row), mode);
+            LOG(LOG_REFRESH, "row " + String(r), UpdateModeName(mode), refresh.PartialUpdates(r));
+         }
+      }
+      refresh.DumpTiming();
+      refresh.SaveNVS();
+
+      // the regions drawn by the panel itself are gone, a fallback pushes all of them
+      RefreshScheduler regions;
+
+      regions.LoadNVS();
+      if (regions.Forget()) {
+         regions.SaveNVS();
+      }
+   }
+};
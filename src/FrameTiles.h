@@ -0,0 +1,188 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file FrameTiles.h
+  *
+  * Tiles of the frame of the render server in host/render, shared by the
+  * server and the firmware.
+  */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define FRAME_MAGIC   0x3146524d //!< 'MRF1'
+#define FRAME_VERSION 1          //!< Increment on every change of the layout
+#define FRAME_DX      960        //!< Width of the frame
+#define FRAME_DY      540        //!< Height of the frame
+#define TILE_DX       60         //!< Width of a tile, a multiple of 4 like the updates of the e-paper
+#define TILE_DY       60         //!< Height of a tile
+#define TILE_COLUMNS  (FRAME_DX / TILE_DX)        //!< Tiles of a row
+#define TILE_ROWS     (FRAME_DY / TILE_DY)        //!< Rows of tiles
+#define TILE_COUNT    (TILE_COLUMNS * TILE_ROWS)  //!< Tiles of the frame
+#define TILE_BYTES    (TILE_DX * TILE_DY / 2)     //!< Bytes of a tile with 4 bits per pixel
+
+static_assert(FRAME_DX % TILE_DX == 0 && FRAME_DY % TILE_DY == 0, "The tiles must cover the frame");
+static_assert(TILE_DX % 4 == 0, "The e-paper updates start at multiples of 4 pixels");
+
+/* Flags of the frame */
+enum FrameFlags
+{
+   FRAME_WEATHER = 0x01, //!< The server has the weather, temp and pressure are valid
+   FRAME_FULL    = 0x02  //!< All the tiles follow, the base frame was unknown or none was reported
+};
+
+/* Encoding of the data of a tile */
+enum TileEncoding
+{
+   TILE_RAW = 0, //!< TILE_BYTES of the frame buffer
+   TILE_RLE = 1  //!< PackBits of the TILE_BYTES
+};
+
+/**
+  * Body of "GET /frame", the header is followed by the changed tiles in
+  * the order of their index, every tile by its TileHeader and its data.
+  * The device reports the frame of the last body at its next wake and
+  * gets only the tiles that differ from it. Both sides are little endian
+  * with IEEE floats.
+  */
+struct FrameHeader
+{
+   uint32_t magic;    //!< FRAME_MAGIC
+   uint16_t version;  //!< FRAME_VERSION
+   uint16_t size;     //!< sizeof(FrameHeader)
+   uint32_t frame;    //!< Hash of the new frame, never 0
+   uint32_t base;     //!< Frame the tiles change, 0 if all tiles follow
+   uint32_t time;     //!< UTC of the frame
+   uint16_t tiles;    //!< Number of the tiles behind the header
+   uint16_t flags;    //!< FrameFlags
+   uint32_t bytes;    //!< Bytes behind the header
+   float    temp;     //!< Outdoor temperature in C for the history of the device
+   float    pressure; //!< Air pressure in hPa for the history of the device
+};
+
+/* Header of one tile of the body */
+struct TileHeader
+{
+   uint16_t index;    //!< Row major index of the tile
+   uint16_t encoding; //!< TileEncoding
+   uint16_t length;   //!< Bytes of the data behind the header
+};
+
+static_assert(sizeof(float) == 4, "The header needs 32 bit floats");
+static_assert(sizeof(FrameHeader) == 36, "The layout of the header changed, increment FRAME_VERSION");
+static_assert(sizeof(TileHeader) == 6, "The layout of the tile header changed, increment FRAME_VERSION");
+
+/* FNV-1a of the bytes, the same as HashBytes() of the firmware */
+inline uint32_t TileHash(const uint8_t *data, size_t len, uint32_t hash = 2166136261u)
+{
+   for (size_t i = 0; i < len; i++) {
+      hash ^= data[i];
+      hash *= 16777619u;
+   }
+   return hash;
+}
+
+/* Hash of the frame from the hashes of its tiles, 0 marks an unknown frame */
+inline uint32_t FrameHash(const uint32_t hashes[TILE_COUNT])
+{
+   uint32_t hash = TileHash((const uint8_t *) hashes, TILE_COUNT * sizeof(uint32_t));
+
+   return hash ? hash : 1;
+}
+
+/* Copy the tile out of a frame buffer of FRAME_DX pixels per row */
+inline void TileCopy(const uint8_t *frame, int index, uint8_t *tile)
+{
+   const uint8_t *src = frame + ((index / TILE_COLUMNS) * TILE_DY * FRAME_DX + (index % TILE_COLUMNS) * TILE_DX) / 2;
+
+   for (int row = 0; row < TILE_DY; row++) {
+      memcpy(tile + row * TILE_DX / 2, src + row * FRAME_DX / 2, TILE_DX / 2);
+   }
+}
+
+/*
+ * PackBits of the bytes into the dst, 0 if the result does not get
+ * shorter than the capacity. The white areas of the frame are long runs
+ * of zero bytes, the text and the icons mostly literals.
+ */
+inline size_t TileEncode(const uint8_t *src, size_t len, uint8_t *dst, size_t capacity)
+{
+   size_t in  = 0;
+   size_t out = 0;
+
+   while (in < len) {
+      size_t run = 1;
+
+      while (in + run < len && run < 128 && src[in + run] == src[in]) {
+         run++;
+      }
+      if (run >= 2) {
+         if (out + 2 > capacity) {
+            return 0;
+         }
+         dst[out++] = (uint8_t) (257 - run);
+         dst[out++] = src[in];
+         in += run;
+         continue;
+      }
+      // literals up to the next run of two equal bytes
+      size_t start = in;
+
+      while (in < len && in - start < 128 && !(in + 1 < len && src[in] == src[in + 1])) {
+         in++;
+      }
+      if (out + 1 + (in - start) > capacity) {
+         return 0;
+      }
+      dst[out++] = (uint8_t) (in - start - 1);
+      memcpy(dst + out, src + start, in - start);
+      out += in - start;
+   }
+   return out;
+}
+
+/* Decode the PackBits of the src into exactly the len bytes of the dst, false on a broken tile */
+inline bool TileDecode(const uint8_t *src, size_t srcLen, uint8_t *dst, size_t len)
+{
+   size_t in  = 0;
+   size_t out = 0;
+
+   while (in < srcLen) {
+      uint8_t code = src[in++];
+
+      if (code < 128) {
+         size_t count = code + 1;
+
+         if (in + count > srcLen || out + count > len) {
+            return false;
+         }
+         memcpy(dst + out, src + in, count);
+         in  += count;
+         out += count;
+      } else if (code > 128) {
+         size_t count = 257 - code;
+
+         if (in >= srcLen || out + count > len) {
+            return false;
+         }
+         memset(dst + out, src[in++], count);
+         out += count;
+      }
+   }
+   return out == len;
+}
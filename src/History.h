@@ -0,0 +1,547 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file History.h
+  *
+  * Compressed history of the measured values in the 'history' flash partition.
+  */
+#pragma once
+#include <esp_partition.h>
+#include <nvs.h>
+#include <stddef.h>
+#include <math.h>
+
+#define HISTORY_PARTITION "history"  //!< Label of the partition in partitions.csv
+#define HISTORY_SECTOR    4096       //!< Bytes of one block, the flash sector
+#define HISTORY_MAGIC     0x31545348 //!< 'HST1'
+#define HISTORY_OPEN      0xffffffff //!< Sample count of the block that is written, the erased flash
+#define HISTORY_NONE      0xff       //!< No xor window of the series yet
+
+/* Series of the history */
+enum HistorySeries
+{
+   HISTORY_INDOOR_TEMP,     //!< SHT30 temperature in C
+   HISTORY_INDOOR_HUMIDITY, //!< SHT30 humidity in %
+   HISTORY_OUTDOOR_TEMP,    //!< Outdoor temperature of the weather in C
+   HISTORY_PRESSURE,        //!< Air pressure of the weather in hPa
+   HISTORY_BATTERY,         //!< Battery voltage in V
+   HISTORY_SERIES
+};
+
+/* Resolution of the series, the rounding makes repeated values cost one bit */
+const float historyResolution[HISTORY_SERIES] = { 0.1f, 1.0f, 0.1f, 1.0f, 0.01f };
+
+#define HISTORY_MAX_BITS  (36 + HISTORY_SERIES * 44) //!< Max bits of one sample
+
+/**
+  * Append only log of the samples in the style of the Gorilla time series
+  * database. Every flash sector holds one block, the header stores the
+  * first sample, the following ones are a bit stream of the delta of the
+  * delta of the timestamp and the xor of every value with its previous one.
+  * Most samples of the display cost a few bytes, unchanged values one bit.
+  *
+  * The blocks are written as a ring over the partition, every sector is
+  * only erased when the ring wraps around. The bytes of a sample are
+  * written once behind the previous ones, the last partial byte and the
+  * encoder state of the open block are kept in the NVS.
+  */
+class History
+{
+protected:
+   /* First sample of a block at the start of its sector */
+   struct Header
+   {
+      uint32_t magic;                  //!< HISTORY_MAGIC of a written block
+      uint32_t sequence;               //!< Increments with every block
+      uint32_t count;                  //!< Samples of the block, HISTORY_OPEN while it is written
+      uint32_t time;                   //!< Time of the first sample
+      uint32_t values[HISTORY_SERIES]; //!< Float bits of the first values
+   };
+
+   /* Encoder and decoder state of a block */
+   struct Codec
+   {
+      uint32_t time;                     //!< Time of the last sample
+      int32_t  delta;                    //!< Delta of the last two times
+      uint32_t values[HISTORY_SERIES];   //!< Float bits of the last values
+      uint8_t  leading[HISTORY_SERIES];  //!< Leading zeros of the last xor window
+      uint8_t  trailing[HISTORY_SERIES]; //!< Trailing zeros of the last xor window
+
+      void Start(const Header &header)
+      {
+         time  = header.time;
+         delta = 0;
+         memcpy(values, header.values, sizeof(values));
+         memset(leading, HISTORY_NONE, sizeof(leading));
+         memset(trailing, 0, sizeof(trailing));
+      }
+   };
+
+   /* Bit stream, most significant bit first */
+   struct Bits
+   {
+      uint8_t *data; //!< Bytes of the stream, zero behind the written bits
+      uint32_t pos;  //!< Position in bits
+
+      void Write(uint32_t value, int bits)
+      {
+         while (bits > 0) {
+            int free = 8 - (pos & 7);
+            int take = min(free, bits);
+
+            bits -= take;
+            data[pos >> 3] |= ((value >> bits) & ((1u << take) - 1)) << (free - take);
+            pos += take;
+         }
+      }
+
+      uint32_t Read(int bits)
+      {
+         uint32_t value = 0;
+
+         while (bits > 0) {
+            int left = 8 - (pos & 7);
+            int take = min(left, bits);
+
+            value = value << take | ((data[pos >> 3] >> (left - take)) & ((1u << take) - 1));
+            pos  += take;
+            bits -= take;
+         }
+         return value;
+      }
+   };
+
+   /* Data stored in the non volatile memory */
+   struct State
+   {
+      uint32_t sequence; //!< Sequence of the open or the last block
+      uint32_t sector;   //!< Sector of the open or the last block
+      uint32_t count;    //!< Samples of the open block, 0 if no block is open
+      uint32_t bits;     //!< Bits of the stream of the open block
+      uint8_t  pending;  //!< Partial last byte of the stream, not yet in the flash
+      Codec    codec;    //!< Encoder state of the open block
+   };
+
+   const esp_partition_t *partition; //!< The history partition, NULL before Begin()
+   uint32_t               sectors;   //!< Blocks of the partition
+   State                  state;     //!< Current state
+
+   /* Round the value to the resolution of the series, NAN keeps the last value */
+   uint32_t Quantize(int series, float value)
+   {
+      uint32_t bits;
+
+      if (isnan(value)) {
+         return state.codec.values[series];
+      }
+      value = roundf(value / historyResolution[series]) * historyResolution[series];
+      memcpy(&bits, &value, sizeof(bits));
+      return bits;
+   }
+
+   static void EncodeTime(Codec &codec, Bits &bits, uint32_t time)
+   {
+      int32_t delta = (int32_t) (time - codec.time);
+      int32_t dod   = delta - codec.delta;
+
+      if (dod == 0) {
+         bits.Write(0, 1);
+      } else if (dod >= -63 && dod <= 64) {
+         bits.Write(0x2, 2);
+         bits.Write(dod + 63, 7);
+      } else if (dod >= -255 && dod <= 256) {
+         bits.Write(0x6, 3);
+         bits.Write(dod + 255, 9);
+      } else if (dod >= -2047 && dod <= 2048) {
+         bits.Write(0xe, 4);
+         bits.Write(dod + 2047, 12);
+      } else {
+         bits.Write(0xf, 4);
+         bits.Write((uint32_t) dod, 32);
+      }
+      codec.time  = time;
+      codec.delta = delta;
+   }
+
+   static void DecodeTime(Codec &codec, Bits &bits)
+   {
+      int32_t dod = 0;
+
+      if (bits.Read(1)) {
+         if (!bits.Read(1)) {
+            dod = (int32_t) bits.Read(7) - 63;
+         } else if (!bits.Read(1)) {
+            dod = (int32_t) bits.Read(9) - 255;
+         } else if (!bits.Read(1)) {
+            dod = (int32_t) bits.Read(12) - 2047;
+         } else {
+            dod = (int32_t) bits.Read(32);
+         }
+      }
+      codec.delta += dod;
+      codec.time  += codec.delta;
+   }
+
+   /* '0' same value, '10' xor inside the last window, '11' new window with 5 bits leading zeros and 5 bits length */
+   static void EncodeValue(Codec &codec, Bits &bits, int series, uint32_t value)
+   {
+      uint32_t x = value ^ codec.values[series];
+
+      codec.values[series] = value;
+      if (!x) {
+         bits.Write(0, 1);
+         return;
+      }
+      int leading  = __builtin_clz(x);
+      int trailing = __builtin_ctz(x);
+
+      if (codec.leading[series] != HISTORY_NONE && leading >= codec.leading[series] && trailing >= codec.trailing[series]) {
+         bits.Write(0x2, 2);
+         bits.Write(x >> codec.trailing[series], 32 - codec.leading[series] - codec.trailing[series]);
+      } else {
+         bits.Write(0x3, 2);
+         bits.Write(leading, 5);
+         bits.Write(32 - leading - trailing - 1, 5);
+         bits.Write(x >> trailing, 32 - leading - trailing);
+         codec.leading[series]  = leading;
+         codec.trailing[series] = trailing;
+      }
+   }
+
+   static void DecodeValue(Codec &codec, Bits &bits, int series)
+   {
+      if (!bits.Read(1)) {
+         return;
+      }
+      if (bits.Read(1)) {
+         codec.leading[series]  = bits.Read(5);
+         codec.trailing[series] = 32 - codec.leading[series] - (bits.Read(5) + 1);
+      }
+      int meaningful = 32 - codec.leading[series] - codec.trailing[series];
+
+      codec.values[series] ^= bits.Read(meaningful) << codec.trailing[series];
+   }
+
+   /* Read the header of the sector, false if it holds no block */
+   bool ReadHeader(uint32_t sector, Header &header)
+   {
+      return esp_partition_read(partition, sector * HISTORY_SECTOR, &header, sizeof(header)) == ESP_OK
+         && header.magic == HISTORY_MAGIC;
+   }
+
+   /* Load the state from the non volatile memory */
+   void LoadNVS()
+   {
+      nvs_handle nvs_arg;
+      size_t     len = sizeof(state);
+
+      if (nvs_open("Setting", NVS_READONLY, &nvs_arg) == ESP_OK) {
+         if (nvs_get_blob(nvs_arg, "history", &state, &len) != ESP_OK || len != sizeof(state)) {
+            memset(&state, 0, sizeof(state));
+         }
+         nvs_close(nvs_arg);
+      }
+   }
+
+   /* Store the state to the non volatile memory */
+   void SaveNVS()
+   {
+      nvs_handle nvs_arg;
+      nvs_open("Setting", NVS_READWRITE, &nvs_arg);
+      nvs_set_blob(nvs_arg, "history", &state, sizeof(state));
+      nvs_commit(nvs_arg);
+      nvs_close(nvs_arg);
+   }
+
+   /* Continue behind the newest block of the flash, its open part is lost */
+   void Recover()
+   {
+      Header header;
+      float  nan = NAN;
+
+      memset(&state, 0, sizeof(state));
+      state.sector = sectors - 1;
+      for (uint32_t sector = 0; sector < sectors; sector++) {
+         if (ReadHeader(sector, header) && header.sequence > state.sequence) {
+            state.sequence = header.sequence;
+            state.sector   = sector;
+         }
+      }
+      for (int s = 0; s < HISTORY_SERIES; s++) {
+         memcpy(&state.codec.values[s], &nan, sizeof(nan));
+      }
+   }
+
+   /* Write the pending byte and the sample count of the open block */
+   void Close()
+   {
+      uint32_t offset = state.sector * HISTORY_SECTOR;
+
+      if (!state.count) {
+         return;
+      }
+      if (state.bits & 7) {
+         esp_partition_write(partition, offset + sizeof(Header) + state.bits / 8, &state.pending, 1);
+      }
+      esp_partition_write(partition, offset + offsetof(Header, count), &state.count, sizeof(state.count));
+      state.count = 0;
+   }
+
+   /* Erase the oldest sector and start a block with the sample */
+   bool Open(uint32_t time, const uint32_t *values)
+   {
+      Header   header;
+      uint32_t sector = (state.sector + 1) % sectors;
+
+      header.magic    = HISTORY_MAGIC;
+      header.sequence = state.sequence + 1;
+      header.count    = HISTORY_OPEN;
+      header.time     = time;
+      memcpy(header.values, values, sizeof(header.values));
+      if (esp_partition_erase_range(partition, sector * HISTORY_SECTOR, HISTORY_SECTOR) != ESP_OK ||
+          esp_partition_write(partition, sector * HISTORY_SECTOR, &header, sizeof(header)) != ESP_OK) {
+         return false;
+      }
+      state.sequence = header.sequence;
+      state.sector   = sector;
+      state.count    = 1;
+      state.bits     = 0;
+      state.pending  = 0;
+      state.codec.Start(header);
+      return true;
+   }
+
+public:
+   History()
+      : partition(NULL)
+      , sectors(0)
+   {
+      memset(&state, 0, sizeof(state));
+   }
+
+   /* Find the partition and load the state, false without a history partition */
+   bool Begin()
+   {
+      Header header;
+
+      if (partition) {
+         return true;
+      }
+      partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, HISTORY_PARTITION);
+      if (!partition || partition->size < 2 * HISTORY_SECTOR) {
+         partition = NULL;
+         return false;
+      }
+      sectors = partition->size / HISTORY_SECTOR;
+      LoadNVS();
+      if (state.sector >= sectors || !ReadHeader(state.sector, header) || header.sequence != state.sequence ||
+          (state.count && header.count != HISTORY_OPEN)) {
+         Recover();
+      }
+      return true;
+   }
+
+   /* Append the sample, a NAN value repeats the last value of the series */
+   bool Append(time_t time, const float values[HISTORY_SERIES])
+   {
+      uint32_t bits[HISTORY_SERIES];
+      uint8_t  buffer[HISTORY_MAX_BITS / 8 + 2];
+      Bits     stream = { buffer, 0 };
+
+      if (!Begin() || (state.count && (uint32_t) time <= state.codec.time)) {
+         return false;
+      }
+      for (int s = 0; s < HISTORY_SERIES; s++) {
+         bits[s] = Quantize(s, values[s]);
+      }
+      if (!state.count || state.bits + HISTORY_MAX_BITS > (HISTORY_SECTOR - sizeof(Header)) * 8) {
+         Close();
+         bool opened = Open(time, bits);
+
+         SaveNVS();
+         return opened;
+      }
+      memset(buffer, 0, sizeof(buffer));
+      buffer[0]  = state.pending;
+      stream.pos = state.bits & 7;
+      EncodeTime(state.codec, stream, time);
+      for (int s = 0; s < HISTORY_SERIES; s++) {
+         EncodeValue(state.codec, stream, s, bits[s]);
+      }
+      // only the completed bytes go to the flash, every byte is written once
+      uint32_t bytes = stream.pos / 8;
+
+      if (bytes && esp_partition_write(partition, state.sector * HISTORY_SECTOR + sizeof(Header) + state.bits / 8, buffer, bytes) != ESP_OK) {
+         return false;
+      }
+      state.pending = buffer[bytes];
+      state.bits   += stream.pos - (state.bits & 7);
+      state.count++;
+      SaveNVS();
+      return true;
+   }
+
+   /* Time of the last sample, 0 without a sample */
+   time_t Last()
+   {
+      return Begin() && state.count ? state.codec.time : 0;
+   }
+
+   /*
+    * Stream all samples in [from, to) through the callback, the blocks are
+    * decoded one after the other from the oldest one. Returns the number
+    * of the samples.
+    */
+   template <class Callback> uint32_t Scan(time_t from, time_t to, Callback callback)
+   {
+      uint32_t  samples = 0;
+      uint8_t  *block;
+      Header   *headers;
+
+      if (!Begin() || !(block = (uint8_t *) malloc(HISTORY_SECTOR))) {
+         return 0;
+      }
+      if (!(headers = (Header *) malloc(sectors * sizeof(Header)))) {
+         free(block);
+         return 0;
+      }
+      // the ring starts behind the newest block
+      for (uint32_t i = 0; i < sectors; i++) {
+         uint32_t sector = (state.sector + 1 + i) % sectors;
+
+         if (!ReadHeader(sector, headers[i]) || headers[i].sequence > state.sequence) {
+            headers[i].magic = 0;
+         }
+      }
+      for (uint32_t i = 0; i < sectors; i++) {
+         uint32_t sector = (state.sector + 1 + i) % sectors;
+         bool     open   = i == sectors - 1 && state.count;
+         uint32_t count  = open ? state.count : headers[i].count;
+         uint32_t end    = UINT32_MAX;
+
+         for (uint32_t next = i + 1; next < sectors && end == UINT32_MAX; next++) {
+            end = headers[next].magic ? headers[next].time : end;
+         }
+         if (!headers[i].magic || count == HISTORY_OPEN || headers[i].time >= (uint32_t) to || end <= (uint32_t) from) {
+            continue; // no block, lost open block or outside of the range
+         }
+         if (esp_partition_read(partition, sector * HISTORY_SECTOR, block, HISTORY_SECTOR) != ESP_OK) {
+            continue;
+         }
+         if (open) {
+            block[sizeof(Header) + state.bits / 8] = state.pending;
+         }
+         Codec codec;
+         Bits  stream = { block + sizeof(Header), 0 };
+         float values[HISTORY_SERIES];
+
+         codec.Start(headers[i]);
+         for (uint32_t n = 0; n < count; n++) {
+            if (n) {
+               DecodeTime(codec, stream);
+               for (int s = 0; s < HISTORY_SERIES; s++) {
+                  DecodeValue(codec, stream, s);
+               }
+               if (stream.pos > (HISTORY_SECTOR - sizeof(Header)) * 8) {
+                  break; // damaged block
+               }
+            }
+            if (codec.time >= (uint32_t) to) {
+               break;
+            }
+            if (codec.time >= (uint32_t) from) {
+               memcpy(values, codec.values, sizeof(values));
+               callback((time_t) codec.time, values);
+               samples++;
+            }
+         }
+      }
+      free(headers);
+      free(block);
+      return samples;
+   }
+
+   /*
+    * Downsample the series in [from, to) into the buckets, mean and the
+    * optional min and max per bucket, NAN for the buckets without a value.
+    * Returns the number of the samples in the range.
+    */
+   uint32_t Query(time_t from, time_t to, HistorySeries series, int buckets, float *mean, float *minimum = NULL, float *maximum = NULL)
+   {
+      uint16_t *counts = (uint16_t *) calloc(buckets, sizeof(uint16_t));
+      uint32_t  samples;
+
+      for (int b = 0; b < buckets; b++) {
+         mean[b] = NAN;
+         if (minimum) minimum[b] = NAN;
+         if (maximum) maximum[b] = NAN;
+      }
+      if (!counts || to <= from) {
+         free(counts);
+         return 0;
+      }
+      samples = Scan(from, to, [&](time_t time, const float *values) {
+         float value  = values[series];
+         int   bucket = (int) ((int64_t) (time - from) * buckets / (to - from));
+
+         if (isnan(value)) {
+            return;
+         }
+         mean[bucket] = counts[bucket] ? mean[bucket] + value : value;
+         counts[bucket]++;
+         if (minimum && !(minimum[bucket] <= value)) minimum[bucket] = value;
+         if (maximum && !(maximum[bucket] >= value)) maximum[bucket] = value;
+      });
+      for (int b = 0; b < buckets; b++) {
+         mean[b] = counts[b] ? mean[b] / counts[b] : NAN;
+      }
+      free(counts);
+      return samples;
+   }
+
+   /* Print the fill level and the compression */
+   void Dump(Print &out)
+   {
+      uint32_t blocks  = 0;
+      uint32_t samples = 0;
+      uint32_t bytes   = 0;
+      Header   header;
+
+      if (!Begin()) {
+         out.println("history: no partition");
+         return;
+      }
+      for (uint32_t sector = 0; sector < sectors; sector++) {
+         if (ReadHeader(sector, header) && header.sequence <= state.sequence) {
+            bool open = sector == state.sector && state.count;
+
+            if (open || header.count != HISTORY_OPEN) {
+               blocks++;
+               samples += open ? state.count : header.count;
+               bytes   += HISTORY_SECTOR;
+            }
+         }
+      }
+      if (state.count) {
+         bytes -= HISTORY_SECTOR - sizeof(Header) - (state.bits + 7) / 8;
+      }
+      out.printf("history: %d blocks of %d, %d samples, %d.%02d bytes per sample\n", (int) blocks, (int) sectors,
+         (int) samples, (int) (samples ? bytes / samples : 0), (int) (samples ? bytes * 100 / samples % 100 : 0));
+   }
+};
+
+History history; //!< Measured values of the past wakes
@@ -0,0 +1,251 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file HttpBody.h
+  *
+  * Body of a http response read as a Stream, counted and timed.
+  */
+#pragma once
+#include <Arduino.h>
+
+#ifndef HTTP_BODY_TIMEOUT
+#define HTTP_BODY_TIMEOUT 5000 //!< Max ms without new data of the body
+#endif
+#define HTTP_BODY_BUFFER  512  //!< Bytes read from the client at once
+
+/**
+  * Reads the body of a response with a Content-Length, in chunks or up
+  * to the end of the connection, so a parser reads it straight from the
+  * client instead of a copy in a String. The client is read in blocks,
+  * the TLS client decrypts a record per read. The ms spent waiting for
+  * the data are counted apart, the rest of the time of a parser reading
+  * the body is its parsing.
+  *
+  *    HttpBody body(*http.getStreamPtr(), http.getSize(), chunked);
+  *    deserializeJson(doc, body);
+  *    body.Finish(); // the connection is at the next response
+  */
+class HttpBody : public Stream
+{
+protected:
+   Client  &client;                   //!< Connection of the response
+   int      length;                   //!< Content-Length, -1 for the chunks or the end of the connection
+   bool     chunked;                  //!< Transfer-Encoding: chunked
+   int      left;                     //!< Bytes of the body or of the chunk not read from the client
+   int      chunks;                   //!< Chunks started
+   bool     ended;                    //!< The whole body was read from the client
+   bool     failed;                   //!< A timeout, a broken chunk or a connection closed too early
+   uint8_t  buffer[HTTP_BODY_BUFFER]; //!< Bytes read from the client
+   int      pos;                      //!< Next byte of the buffer
+   int      fill;                     //!< Bytes in the buffer
+   uint32_t bytes;                    //!< Bytes of the body read from the client
+   uint32_t waitMs;                   //!< Ms waited for the data
+
+   /* Wait for data of the client, false on a timeout or a closed connection */
+   bool Wait()
+   {
+      uint32_t start = millis();
+
+      while (!client.available()) {
+         if (!client.connected()) {
+            waitMs += millis() - start;
+            return false;
+         }
+         if (millis() - start > HTTP_BODY_TIMEOUT) {
+            failed = true;
+            waitMs += millis() - start;
+            return false;
+         }
+         delay(1);
+      }
+      waitMs += millis() - start;
+      return true;
+   }
+
+   /* Line of the chunk framing without the CRLF */
+   bool ReadLine(String &line)
+   {
+      line = "";
+      while (Wait()) {
+         int c = client.read();
+
+         if (c == '\n') {
+            return true;
+         }
+         if (c >= 0 && c != '\r') {
+            line += (char) c;
+         }
+      }
+      return false;
+   }
+
+   /* Read the size of the next chunk, the empty last chunk ends the body */
+   bool NextChunk()
+   {
+      String line;
+
+      // the CRLF behind the data of the previous chunk
+      if (chunks++ && (!ReadLine(line) || line.length())) {
+         return false;
+      }
+      if (!ReadLine(line) || !line.length()) {
+         return false;
+      }
+      left = strtol(line.c_str(), NULL, 16); // the chunk extensions behind a ';' are ignored
+      if (left > 0) {
+         return true;
+      }
+      // the trailer up to the empty line
+      while (ReadLine(line)) {
+         if (!line.length()) {
+            ended = true;
+            return true;
+         }
+      }
+      return false;
+   }
+
+   /* Read the next block of the body into the buffer, false at the end or on a failure */
+   bool Refill()
+   {
+      pos  = 0;
+      fill = 0;
+      if (ended || failed) {
+         return false;
+      }
+      if (chunked && left == 0 && !NextChunk()) {
+         failed = true;
+         return false;
+      }
+      if (ended || (length >= 0 && left == 0)) {
+         ended = true;
+         return false;
+      }
+      if (!Wait()) {
+         // only a body without a length and chunks ends with the connection
+         ended  = !failed && length < 0 && !chunked;
+         failed = !ended;
+         return false;
+      }
+      int count = client.read(buffer, left > 0 ? min(left, HTTP_BODY_BUFFER) : HTTP_BODY_BUFFER);
+
+      if (count <= 0) {
+         failed = true;
+         return false;
+      }
+      fill   = count;
+      bytes += count;
+      if (left > 0) {
+         left -= count;
+      }
+      return true;
+   }
+
+public:
+   HttpBody(Client &c, int len, bool chunks)
+      : client(c)
+      , length(chunks ? -1 : len)
+      , chunked(chunks)
+      , left(chunks ? 0 : len)
+      , chunks(0)
+      , ended(false)
+      , failed(false)
+      , pos(0)
+      , fill(0)
+      , bytes(0)
+      , waitMs(0)
+   {
+   }
+
+   int available() override
+   {
+      if (pos == fill) {
+         Refill();
+      }
+      return fill - pos;
+   }
+
+   int read() override
+   {
+      if (pos == fill && !Refill()) {
+         return -1;
+      }
+      return buffer[pos++];
+   }
+
+   int peek() override
+   {
+      if (pos == fill && !Refill()) {
+         return -1;
+      }
+      return buffer[pos];
+   }
+
+   using Stream::readBytes;
+
+   /* Copy from the buffer, ArduinoJson reads byte by byte with it and the end of the body does not wait */
+   size_t readBytes(char *data, size_t count)
+   {
+      size_t copied = 0;
+
+      while (copied < count && (pos < fill || Refill())) {
+         size_t part = min((size_t) (fill - pos), count - copied);
+
+         memcpy(data + copied, buffer + pos, part);
+         pos    += part;
+         copied += part;
+      }
+      return copied;
+   }
+
+   size_t write(uint8_t c) override
+   {
+      return 0;
+   }
+
+   /* Read the rest of the body, the connection is at the next response if true */
+   bool Finish()
+   {
+      while (Refill()) {
+      }
+      return ended && !failed;
+   }
+
+   /* Content-Length, -1 for the chunks or the end of the connection */
+   int Length() const
+   {
+      return length;
+   }
+
+   /* Bytes of the body read from the client so far */
+   uint32_t Bytes() const
+   {
+      return bytes;
+   }
+
+   /* Ms waited for the data so far */
+   uint32_t WaitMs() const
+   {
+      return waitMs;
+   }
+
+   /* A timeout, a broken chunk or a connection closed before the end */
+   bool Failed() const
+   {
+      return failed;
+   }
+};
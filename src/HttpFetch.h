@@ -0,0 +1,530 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file HttpFetch.h
+  *
+  * Common json request of all the sources with the timing of every stage.
+  */
+#pragma once
+#include <WiFi.h>
+#include <WiFiClient.h>
+#include <WiFiClientSecure.h>
+#include <HTTPClient.h>
+#include <ArduinoJson.h>
+#include <nvs.h>
+#include "HttpBody.h"
+#include "Trace.h"
+#include "Log.h"
+
+#define NET_BUCKETS 16 //!< Log2 buckets of the milliseconds, the last one is open
+
+/* Sources of the requests */
+enum NetSource
+{
+   NET_WEATHER,
+   NET_ASTRONAUT,
+   NET_CORONA_LOCAL,
+   NET_CORONA_GERMANY,
+   NET_MAPS,
+   NET_OPENMETEO,
+   NET_AIR,
+   NET_PROXY,
+   NET_FRAME,
+   NET_SOURCES
+};
+
+/* Stages of one request */
+enum NetStage
+{
+   NET_DNS,      //!< Name resolution
+   NET_CONNECT,  //!< TCP connect of the plain http requests
+   NET_TLS,      //!< TCP connect and TLS handshake of the https requests
+   NET_TTFB,     //!< Request sent until the response header is read
+   NET_BODY,     //!< Transfer of the body
+   NET_PARSE,    //!< Deserialization of the json
+   NET_TOTAL,    //!< Whole request until the json is parsed
+   NET_STAGES
+};
+
+const char *netSourceNames[NET_SOURCES] = { "weather", "astronaut", "corona-lk", "corona-de", "maps", "openmeteo", "air", "proxy", "frame" };
+const char *netStageNames[NET_STAGES]   = { "dns", "connect", "tls", "ttfb", "body", "parse", "total" };
+
+/**
+  * Histograms of the stage durations per source with log2 buckets
+  * of the milliseconds, stored in the NVS across the wakes.
+  */
+class NetStats
+{
+protected:
+   /* Data stored in the non volatile memory */
+   struct State
+   {
+      uint16_t buckets[NET_SOURCES][NET_STAGES][NET_BUCKETS]; //!< Requests per bucket
+      uint32_t requests[NET_SOURCES];                         //!< Requests per source
+      uint32_t failures[NET_SOURCES];                         //!< Failed requests per source
+      uint32_t bytes[NET_SOURCES];                            //!< Body bytes of the last request
+      uint32_t reused[NET_SOURCES];                           //!< Requests over a kept connection
+      uint32_t savedMs[NET_SOURCES];                          //!< Connection setup of the reused requests
+   };
+
+   State        state;  //!< Current state
+   bool         loaded; //!< The state was loaded from the NVS
+   portMUX_TYPE mux;    //!< Protects the state, the weather providers request in parallel
+
+   /* Bucket of the duration, bucket b holds [2^(b-1), 2^b) ms */
+   int Bucket(uint32_t ms)
+   {
+      int bucket = 0;
+
+      while (ms && bucket < NET_BUCKETS - 1) {
+         ms >>= 1;
+         bucket++;
+      }
+      return bucket;
+   }
+
+   /* Upper bound of the bucket in ms */
+   uint32_t BucketMs(int bucket)
+   {
+      return 1u << bucket;
+   }
+
+   /* Upper bound of the bucket with the percentile, -1 without data */
+   int Percentile(const uint16_t *buckets, int percent)
+   {
+      uint32_t count = 0;
+      uint32_t sum   = 0;
+
+      for (int b = 0; b < NET_BUCKETS; b++) {
+         count += buckets[b];
+      }
+      if (count == 0) {
+         return -1;
+      }
+      for (int b = 0; b < NET_BUCKETS; b++) {
+         sum += buckets[b];
+         if (sum * 100 >= count * percent) {
+            return BucketMs(b);
+         }
+      }
+      return BucketMs(NET_BUCKETS - 1);
+   }
+
+public:
+   NetStats()
+      : loaded(false)
+   {
+      memset(&state, 0, sizeof(state));
+      portMUX_INITIALIZE(&mux);
+   }
+
+   /* Load the state from the non volatile memory */
+   void LoadNVS()
+   {
+      nvs_handle nvs_arg;
+      size_t     len = sizeof(state);
+
+      memset(&state, 0, sizeof(state));
+      if (nvs_open("Setting", NVS_READONLY, &nvs_arg) == ESP_OK) {
+         if (nvs_get_blob(nvs_arg, "netstats", &state, &len) != ESP_OK || len != sizeof(state)) {
+            memset(&state, 0, sizeof(state));
+         }
+         nvs_close(nvs_arg);
+      }
+      loaded = true;
+   }
+
+   /* Store the state to the non volatile memory */
+   void SaveNVS()
+   {
+      if (!loaded) {
+         return; // no request in this wake
+      }
+      nvs_handle nvs_arg;
+      nvs_open("Setting", NVS_READWRITE, &nvs_arg);
+      nvs_set_blob(nvs_arg, "netstats", &state, sizeof(state));
+      nvs_commit(nvs_arg);
+      nvs_close(nvs_arg);
+   }
+
+   /* Add the duration of a stage */
+   void Add(NetSource source, NetStage stage, uint32_t ms)
+   {
+      uint16_t *buckets = state.buckets[source][stage];
+      int       bucket  = Bucket(ms);
+
+      if (!loaded) {
+         LoadNVS();
+      }
+      portENTER_CRITICAL(&mux);
+      if (buckets[bucket] == 0xffff) {
+         // halve the old counts, the newer requests get more weight
+         for (int b = 0; b < NET_BUCKETS; b++) {
+            buckets[b] /= 2;
+         }
+      }
+      buckets[bucket]++;
+      portEXIT_CRITICAL(&mux);
+   }
+
+   /* Count the request of the source */
+   void Request(NetSource source, bool success, uint32_t bytes)
+   {
+      if (!loaded) {
+         LoadNVS();
+      }
+      portENTER_CRITICAL(&mux);
+      state.requests[source]++;
+      if (!success) {
+         state.failures[source]++;
+      }
+      state.bytes[source] = bytes;
+      portEXIT_CRITICAL(&mux);
+   }
+
+   /* Count a request over a kept connection, the setup of the connection was saved */
+   void Reused(NetSource source, uint32_t setupMs)
+   {
+      if (!loaded) {
+         LoadNVS();
+      }
+      portENTER_CRITICAL(&mux);
+      state.reused[source]++;
+      state.savedMs[source] += setupMs;
+      portEXIT_CRITICAL(&mux);
+   }
+
+   /* Upper bound in ms of the percentile of the stage of the source, -1 without data */
+   int Latency(NetSource source, NetStage stage, int percent)
+   {
+      if (!loaded) {
+         LoadNVS();
+      }
+      portENTER_CRITICAL(&mux);
+      int ms = Percentile(state.buckets[source][stage], percent);
+      portEXIT_CRITICAL(&mux);
+      return ms;
+   }
+
+   /* Print p50/p95/p99 of every stage per source */
+   void Dump(Print &out)
+   {
+      if (!loaded) {
+         LoadNVS();
+      }
+      out.println("source     stage      p50 ms  p95 ms  p99 ms");
+      for (int s = 0; s < NET_SOURCES; s++) {
+         out.printf("%-10s %d requests, %d failed, last %d bytes, %d reused saving %d ms\n", netSourceNames[s],
+            (int) state.requests[s], (int) state.failures[s], (int) state.bytes[s], (int) state.reused[s], (int) state.savedMs[s]);
+         for (int t = 0; t < NET_STAGES; t++) {
+            const uint16_t *buckets = state.buckets[s][t];
+
+            if (Percentile(buckets, 50) < 0) {
+               continue;
+            }
+            out.printf("%-10s %-8s <%6d <%6d <%6d\n", "", netStageNames[t],
+               Percentile(buckets, 50), Percentile(buckets, 95), Percentile(buckets, 99));
+         }
+      }
+   }
+};
+
+NetStats          netStats;            //!< Request statistics of all sources
+SemaphoreHandle_t httpDnsMutex = NULL; //!< Serializes the name resolution of parallel requests
+
+/*
+ * Prepare the requests of several tasks in parallel, called before the
+ * tasks start. WiFi.hostByName() waits for a single event bit of the
+ * WiFi library, so only one task may resolve at a time.
+ */
+void HttpFetchBegin()
+{
+   if (!httpDnsMutex) {
+      httpDnsMutex = xSemaphoreCreateMutex();
+   }
+   netStats.Latency(NET_WEATHER, NET_TOTAL, 50); // loads the statistics, the tasks only add
+}
+
+/**
+  * Keep-alive connection to one host for sequential requests, e.g. the
+  * onecall and the air pollution request of openweathermap. The HTTPClient
+  * sends HTTP/1.1 requests with the reuse enabled and reads the body up to
+  * the Content-Length or the last chunk, so the socket is at the start of
+  * the next response. If the server closed the connection in between, the
+  * next request connects again. A session is used by one task only.
+  */
+class HttpSession
+{
+protected:
+   String           host;     //!< Host of all the requests
+   uint16_t         port;     //!< Port, 443 uses TLS
+   bool             secure;   //!< TLS connection
+   WiFiClient       plain;    //!< Client of the plain http requests
+   WiFiClientSecure tls;      //!< Client of the https requests
+   HTTPClient       http;     //!< Request and response parser on top of the client
+   uint32_t         setupMs;  //!< Name resolution, connect and TLS handshake of the open connection
+   int              requests; //!< Requests over the open connection
+
+   WiFiClient &Client()
+   {
+      return secure ? (WiFiClient &) tls : plain;
+   }
+
+   /* Body of the response after Send() */
+   bool Chunked()
+   {
+      return http.header("Transfer-Encoding").equalsIgnoreCase("chunked");
+   }
+
+   /* Resolve and connect, the stages are timed into the ms */
+   bool Connect(const String &uri, uint32_t *ms)
+   {
+      IPAddress ip;
+      uint32_t  start = millis();
+
+      if (httpDnsMutex) {
+         xSemaphoreTake(httpDnsMutex, portMAX_DELAY);
+      }
+      bool resolved = WiFi.hostByName(host.c_str(), ip);
+      if (httpDnsMutex) {
+         xSemaphoreGive(httpDnsMutex);
+      }
+      if (!resolved) {
+         LOG(LOG_RESOLVE_FAILED, host);
+         return false;
+      }
+      ms[NET_DNS] = millis() - start;
+      start       = millis();
+
+      bool connected;
+      if (secure) {
+         // the resolved address with the host name for the SNI, a connect by
+         // the name would resolve it again outside of the mutex
+         tls.setInsecure();
+         connected = tls.connect(ip, port, host.c_str(), NULL, NULL, NULL);
+      } else {
+         connected = plain.connect(ip, port);
+      }
+      ms[secure ? NET_TLS : NET_CONNECT] = millis() - start;
+      if (!connected) {
+         LOG(LOG_CONNECT_FAILED, host, (int) port);
+         return false;
+      }
+      setupMs = ms[NET_DNS] + ms[secure ? NET_TLS : NET_CONNECT];
+
+      // the connected client is used by the HTTPClient
+      http.begin(Client(), host, port, uri, secure);
+      return true;
+   }
+
+   /* Connect or reuse the connection and send the request, the response header is read */
+   bool Send(NetSource source, const String &uri, uint32_t *ms, bool &reused)
+   {
+      uint32_t start;
+
+      reused = requests > 0 && Client().connected();
+      LOG(LOG_REQUEST, uri, host, (int) port);
+      if (reused) {
+         http.setURL(uri);
+      } else {
+         Close(); // the server closed the connection after the last response
+         if (!Connect(uri, ms)) {
+            netStats.Request(source, false, 0);
+            return false;
+         }
+      }
+      start        = millis();
+      int httpCode = http.GET();
+      ms[NET_TTFB] = millis() - start;
+
+      if (httpCode != HTTP_CODE_OK) {
+         LOG(LOG_REQUEST_FAILED, netSourceNames[source], http.errorToString(httpCode));
+         Close();
+         netStats.Request(source, false, 0);
+         return false;
+      }
+      return true;
+   }
+
+   /* Add the stages of a complete response to the NetStats */
+   void Count(NetSource source, const uint32_t *ms, bool reused, bool success, int bytes)
+   {
+      for (int t = 0; t < NET_STAGES; t++) {
+         if (reused && (t == NET_DNS || t == NET_CONNECT || t == NET_TLS)) {
+            continue; // no setup of the connection
+         }
+         if (t != (secure ? NET_CONNECT : NET_TLS)) {
+            netStats.Add(source, (NetStage) t, ms[t]);
+         }
+      }
+      if (reused) {
+         netStats.Reused(source, setupMs);
+         LOG(LOG_REQUEST_REUSED, netSourceNames[source], host, (int) setupMs);
+      }
+      netStats.Request(source, success, bytes);
+      TRACE_COUNTER(netSourceNames[source], bytes);
+
+      LOG(LOG_REQUEST_TIMING, bytes, netSourceNames[source], (int) ms[NET_DNS], secure ? "tls" : "connect",
+         (int) ms[secure ? NET_TLS : NET_CONNECT], (int) ms[NET_TTFB], (int) ms[NET_BODY], (int) ms[NET_PARSE]);
+   }
+
+public:
+   HttpSession(const String &h, uint16_t p)
+      : host(h)
+      , port(p)
+      , secure(p == 443)
+      , setupMs(0)
+      , requests(0)
+   {
+      const char *headers[] = { "Transfer-Encoding" };
+
+      http.setReuse(true);
+      http.collectHeaders(headers, 1);
+   }
+
+   ~HttpSession()
+   {
+      Close();
+   }
+
+   /* Close the connection */
+   void Close()
+   {
+      http.end();
+      Client().stop();
+      requests = 0;
+   }
+
+   /*
+    * Request the uri and deserialize the json body into the doc, only the
+    * fields of the optional filter are kept.
+    * The client is connected before the HTTPClient uses it, so the name
+    * resolution, the connect and the TLS handshake are timed separately.
+    * The WiFiClientSecure connects and shakes hands in one call, so both
+    * are counted as the tls stage of the https requests. The json is
+    * parsed while the body arrives, the waits for its data are the body
+    * stage and the rest is the parse stage.
+    */
+   bool GetJson(NetSource source, const String &uri, DynamicJsonDocument &doc, DynamicJsonDocument *filter = NULL)
+   {
+      TRACE_FUNCTION();
+      uint32_t first = millis();
+      uint32_t start;
+      uint32_t ms[NET_STAGES];
+      bool     reused;
+
+      memset(ms, 0, sizeof(ms));
+      if (!Send(source, uri, ms, reused)) {
+         return false;
+      }
+      start = millis();
+      HttpBody             body(*http.getStreamPtr(), http.getSize(), Chunked());
+      DeserializationError error = filter ? deserializeJson(doc, body, DeserializationOption::Filter(*filter))
+                                          : deserializeJson(doc, body);
+      bool                 complete = body.Finish();
+
+      ms[NET_BODY]  = body.WaitMs();
+      ms[NET_PARSE] = millis() - start - ms[NET_BODY];
+      ms[NET_TOTAL] = millis() - first;
+      if (complete) {
+         http.end(); // keeps the connection unless the server sent "Connection: close"
+         requests++;
+      } else {
+         Close();
+      }
+      Count(source, ms, reused, !error && complete, body.Bytes());
+
+      if (error) {
+         LOG(LOG_JSON_FAILED, error.c_str());
+         return false;
+      }
+      return complete;
+   }
+
+   /* Request the uri and read the body of exactly the length into the data, without any parsing */
+   bool GetBinary(NetSource source, const String &uri, void *data, size_t length)
+   {
+      TRACE_FUNCTION();
+      uint32_t first = millis();
+      uint32_t start;
+      uint32_t ms[NET_STAGES];
+      bool     reused;
+
+      memset(ms, 0, sizeof(ms));
+      if (!Send(source, uri, ms, reused)) {
+         return false;
+      }
+      start = millis();
+      bool complete = http.getSize() == (int) length &&
+                      http.getStreamPtr()->readBytes((uint8_t *) data, length) == length;
+      ms[NET_BODY]  = millis() - start;
+      ms[NET_TOTAL] = millis() - first;
+      if (complete) {
+         http.end();
+         requests++;
+      } else {
+         LOG(LOG_READ_LENGTH, netSourceNames[source], http.getSize(), (int) length);
+         Close();
+      }
+      Count(source, ms, reused, complete, complete ? length : 0);
+      return complete;
+   }
+
+   /*
+    * Request the uri and hand the body to the reader while it arrives,
+    * bool reader(HttpBody &body) returns false on a broken body. The
+    * waits for the data are the body stage, the rest of the reading is
+    * the parse stage.
+    */
+   template <class Reader> bool GetStream(NetSource source, const String &uri, Reader reader)
+   {
+      TRACE_FUNCTION();
+      uint32_t first = millis();
+      uint32_t start;
+      uint32_t ms[NET_STAGES];
+      bool     reused;
+
+      memset(ms, 0, sizeof(ms));
+      if (!Send(source, uri, ms, reused)) {
+         return false;
+      }
+      start = millis();
+      HttpBody body(*http.getStreamPtr(), http.getSize(), Chunked());
+      bool     complete = reader(body) && body.Finish();
+
+      ms[NET_BODY]  = body.WaitMs();
+      ms[NET_PARSE] = millis() - start - ms[NET_BODY];
+      ms[NET_TOTAL] = millis() - first;
+      if (complete) {
+         http.end();
+         requests++;
+      } else {
+         LOG(LOG_READ_FAILED, netSourceNames[source], (int) body.Bytes());
+         Close();
+      }
+      Count(source, ms, reused, complete, body.Bytes());
+      return complete;
+   }
+};
+
+/* Request the uri from the host over a new connection, see HttpSession::GetJson() */
+bool HttpFetchJson(NetSource source, const String &host, uint16_t port, const String &uri, DynamicJsonDocument &doc, DynamicJsonDocument *filter = NULL)
+{
+   HttpSession session(host, port);
+
+   return session.GetJson(source, uri, doc, filter);
+}
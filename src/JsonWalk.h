@@ -0,0 +1,184 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file JsonWalk.h
+  *
+  * Walk through the outer levels of a json document in a Stream.
+  */
+#pragma once
+#include <Arduino.h>
+
+/**
+  * Reads the members and the elements of the outer objects and arrays of
+  * a json document from a Stream, so the large arrays are deserialized
+  * element by element into a small doc and not at once. deserializeJson()
+  * reads an object or an array of the Stream up to its closing bracket,
+  * so the walk goes on behind it.
+  *
+  *    JsonWalk walk(body);
+  *    String   key;
+  *
+  *    walk.Enter('{');
+  *    while (walk.Member(key)) {
+  *       if (key == "hourly" && walk.Enter('[')) {
+  *          while (walk.Element()) {
+  *             deserializeJson(hour, body);
+  *          }
+  *       } else {
+  *          walk.Skip();
+  *       }
+  *    }
+  */
+class JsonWalk
+{
+protected:
+   Stream &in;     //!< Document
+   bool    failed; //!< The document is broken or ends too early
+
+   /* Next character behind the white space, -1 at the end */
+   int Peek()
+   {
+      int c;
+
+      while ((c = in.peek()) == ' ' || c == '\t' || c == '\r' || c == '\n') {
+         in.read();
+      }
+      return c;
+   }
+
+   /* Read the string of the Stream, the escapes are kept as they are */
+   bool ReadString(String *text)
+   {
+      int c;
+
+      if (in.read() != '"') {
+         return false;
+      }
+      while ((c = in.read()) >= 0 && c != '"') {
+         if (c == '\\') {
+            if (text) {
+               *text += (char) c;
+            }
+            c = in.read();
+         }
+         if (text && c >= 0) {
+            *text += (char) c;
+         }
+      }
+      return c == '"';
+   }
+
+   /* Separator of the members or the elements, false at the closing bracket */
+   bool Next(char close)
+   {
+      int c = Peek();
+
+      if (c == ',') {
+         in.read();
+         c = Peek();
+      }
+      if (c == close) {
+         in.read();
+         return false;
+      }
+      if (c < 0) {
+         failed = true;
+      }
+      return !failed;
+   }
+
+public:
+   JsonWalk(Stream &s)
+      : in(s)
+      , failed(false)
+   {
+   }
+
+   /* Check if the next value is an object '{' or an array '[' */
+   bool Is(char open)
+   {
+      return !failed && Peek() == open;
+   }
+
+   /* Enter the object '{' or the array '[' of the next value, false if it is none */
+   bool Enter(char open)
+   {
+      if (!Is(open)) {
+         return false;
+      }
+      in.read();
+      return true;
+   }
+
+   /* Key of the next member of the entered object, false behind the last one */
+   bool Member(String &key)
+   {
+      key = "";
+      if (failed || !Next('}')) {
+         return false;
+      }
+      if (!ReadString(&key) || Peek() != ':') {
+         failed = true;
+         return false;
+      }
+      in.read();
+      return true;
+   }
+
+   /* Check for the next element of the entered array, false behind the last one */
+   bool Element()
+   {
+      return !failed && Next(']');
+   }
+
+   /* Skip the next value */
+   bool Skip()
+   {
+      int depth = 0;
+      int c     = Peek();
+
+      if (c == '"') {
+         failed = failed || !ReadString(NULL);
+         return !failed;
+      }
+      while (!failed && (c = in.peek()) >= 0) {
+         if (c == '"') {
+            failed = !ReadString(NULL);
+            continue;
+         }
+         if (depth == 0 && (c == ',' || c == '}' || c == ']')) {
+            return true; // the end of a number or a literal
+         }
+         in.read();
+         if (c == '{' || c == '[') {
+            depth++;
+         } else if (c == '}' || c == ']') {
+            if (--depth == 0) {
+               return true;
+            }
+         }
+      }
+      failed = true;
+      return false;
+   }
+
+   /* The document is broken or ended too early */
+   bool Failed() const
+   {
+      return failed;
+   }
+};
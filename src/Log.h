@@ -0,0 +1,339 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Log.h
+  *
+  * Binary log records in a ring buffer, drained to the serial by a task.
+  *
+  *    LOG(LOG_SHT30, myData.sht30Temperatur, myData.sht30Humidity);
+  *
+  * The messages are declared in LogMessages.h. A record only holds the
+  * time, the id and the arguments, tools/logdecode.py turns the serial
+  * output back into text. With "#define LOG_BINARY 0" in the Config.h
+  * the messages are printed as text instead.
+  *
+  * The ring buffer is kept in the RTC memory, so it survives a panic or
+  * a watchdog reset. The records of such a wake are stored in the "log"
+  * partition for the post-mortem and printed again at the next start.
+  */
+#pragma once
+#include <esp_partition.h>
+#include <esp_system.h>
+
+#ifndef LOG_BINARY
+#define LOG_BINARY     1     //!< Binary records, 0 prints the messages as text
+#endif
+#ifndef LOG_PERSIST
+#define LOG_PERSIST    1     //!< Store the records of a crashed wake in the log partition
+#endif
+#define LOG_BUFFER     3072  //!< Size of the ring buffer in the RTC memory
+#define LOG_SYNC       0x1e  //!< First byte of a record, never part of the text output
+#define LOG_MAX_STRING 32    //!< Max length of a string argument
+#define LOG_MAGIC      0x31474f4c //!< 'LOG1'
+
+/* Ids of the messages */
+enum LogId
+{
+#define LOG_MESSAGE(id, format) id,
+#include "LogMessages.h"
+#undef LOG_MESSAGE
+   LOG_MESSAGES
+};
+
+#if !LOG_BINARY
+/* Format strings of the messages, only needed for the text output */
+const char *logFormats[LOG_MESSAGES] = {
+#define LOG_MESSAGE(id, format) format "\n",
+#include "LogMessages.h"
+#undef LOG_MESSAGE
+};
+#endif
+
+/* Ring buffer, not initialized at the start so it survives a reset */
+struct LogRing
+{
+   uint32_t magic;              //!< LOG_MAGIC if the ring is valid
+   uint32_t head;               //!< Next write position
+   uint32_t tail;               //!< Next position to drain
+   uint32_t dropped;            //!< Records dropped because the ring was full
+   uint8_t  data[LOG_BUFFER];   //!< Records
+};
+
+RTC_NOINIT_ATTR LogRing logRing; //!< Records of the current wake
+
+/**
+  * Writes the records into the ring buffer and drains them to the serial
+  * in a low priority task, so the callers neither allocate nor wait for
+  * the UART.
+  */
+class Logger
+{
+protected:
+   portMUX_TYPE mux;       //!< Protects the ring, the render workers log too
+   TaskHandle_t drainTask; //!< Task that writes the ring to the serial
+   bool         ready;     //!< The ring is initialized
+
+   /* Used bytes of the ring */
+   uint32_t Used()
+   {
+      return (logRing.head - logRing.tail + LOG_BUFFER) % LOG_BUFFER;
+   }
+
+   /* Append the bytes to the record */
+   static void Put(uint8_t *record, int &len, const void *data, int size)
+   {
+      memcpy(record + len, data, size);
+      len += size;
+   }
+
+   /* Encoding of the arguments, every argument starts with its type */
+   static void Encode(uint8_t *record, int &len, long value)
+   {
+      int32_t i = value;
+
+      record[len++] = 'i';
+      Put(record, len, &i, sizeof(i));
+   }
+   static void Encode(uint8_t *record, int &len, unsigned long value)
+   {
+      uint32_t u = value;
+
+      record[len++] = 'u';
+      Put(record, len, &u, sizeof(u));
+   }
+   static void Encode(uint8_t *record, int &len, int value)
+   {
+      Encode(record, len, (long) value);
+   }
+   static void Encode(uint8_t *record, int &len, unsigned value)
+   {
+      Encode(record, len, (unsigned long) value);
+   }
+   static void Encode(uint8_t *record, int &len, bool value)
+   {
+      Encode(record, len, (long) value);
+   }
+   static void Encode(uint8_t *record, int &len, double value)
+   {
+      float f = value;
+
+      record[len++] = 'f';
+      Put(record, len, &f, sizeof(f));
+   }
+   static void Encode(uint8_t *record, int &len, const char *value)
+   {
+      uint8_t size = min((int) strlen(value), LOG_MAX_STRING);
+
+      record[len++] = 's';
+      record[len++] = size;
+      Put(record, len, value, size);
+   }
+   static void Encode(uint8_t *record, int &len, const String &value)
+   {
+      Encode(record, len, value.c_str());
+   }
+
+   static void EncodeAll(uint8_t *record, int &len)
+   {
+   }
+
+   template <class T, class... Args> static void EncodeAll(uint8_t *record, int &len, const T &value, const Args&... args)
+   {
+      Encode(record, len, value);
+      EncodeAll(record, len, args...);
+   }
+
+   /* Copy the record into the ring, drop it if the ring is full */
+   void Push(const uint8_t *record, int len)
+   {
+      portENTER_CRITICAL(&mux);
+      if (Used() + len >= LOG_BUFFER) {
+         logRing.dropped++;
+      } else {
+         for (int i = 0; i < len; i++) {
+            logRing.data[logRing.head] = record[i];
+            logRing.head = (logRing.head + 1) % LOG_BUFFER;
+         }
+      }
+      portEXIT_CRITICAL(&mux);
+      if (drainTask) {
+         xTaskNotifyGive(drainTask);
+      }
+   }
+
+   /* Write the drained part of the ring to the serial */
+   void Drain()
+   {
+      uint8_t  chunk[64];
+      uint32_t len;
+      uint32_t dropped;
+
+      do {
+         portENTER_CRITICAL(&mux);
+         len     = min(Used(), (uint32_t) sizeof(chunk));
+         dropped = logRing.dropped;
+         for (uint32_t i = 0; i < len; i++) {
+            chunk[i]     = logRing.data[logRing.tail];
+            logRing.tail = (logRing.tail + 1) % LOG_BUFFER;
+         }
+         logRing.dropped = 0;
+         portEXIT_CRITICAL(&mux);
+
+         Serial.write(chunk, len);
+         if (dropped) {
+            Write(LOG_DROPPED, (int) dropped);
+         }
+      } while (len);
+   }
+
+   /* Task function of the drain task */
+   static void DrainTask(void *param)
+   {
+      Logger *logger = (Logger *) param;
+
+      while (true) {
+         ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+         logger->Drain();
+      }
+   }
+
+   /* Store the whole ring in the log partition */
+   void Persist(uint32_t reason)
+   {
+      const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t) 0x42, "log");
+      uint32_t               header[4] = { LOG_MAGIC, reason, logRing.head, LOG_BUFFER };
+
+      if (!partition) {
+         return;
+      }
+      esp_partition_erase_range(partition, 0, 4096);
+      esp_partition_write(partition, sizeof(header), logRing.data, LOG_BUFFER);
+      esp_partition_write(partition, 0, header, sizeof(header));
+   }
+
+public:
+   Logger()
+      : drainTask(NULL)
+      , ready(false)
+   {
+      portMUX_INITIALIZE(&mux);
+   }
+
+   /* Initialize the ring and start the drain task, the Serial must be started before */
+   void Begin()
+   {
+      esp_reset_reason_t reason = esp_reset_reason();
+      bool               crashed = reason == ESP_RST_PANIC || reason == ESP_RST_INT_WDT
+                                || reason == ESP_RST_TASK_WDT || reason == ESP_RST_WDT
+                                || reason == ESP_RST_BROWNOUT;
+
+      if (logRing.magic == LOG_MAGIC && crashed && LOG_PERSIST) {
+         Persist(reason);
+      }
+      logRing.magic   = LOG_MAGIC;
+      logRing.head    = 0;
+      logRing.tail    = 0;
+      logRing.dropped = 0;
+      ready           = true;
+#if LOG_BINARY
+      xTaskCreatePinnedToCore(DrainTask, "LogDrain", 2048, this, 1, &drainTask, 0);
+#endif
+      if (crashed) {
+         PrintPersisted(Serial);
+      }
+   }
+
+   /* Write a record with the arguments of the message */
+   template <class... Args> void Write(LogId id, const Args&... args)
+   {
+#if LOG_BINARY
+      uint8_t  record[160];
+      int      len = 2; // sync and length
+      uint32_t ms  = millis();
+      uint16_t id16 = id;
+
+      if (!ready) {
+         return;
+      }
+      Put(record, len, &ms, sizeof(ms));
+      Put(record, len, &id16, sizeof(id16));
+      EncodeAll(record, len, args...);
+
+      uint8_t sum = 0;
+      for (int i = 2; i < len; i++) {
+         sum += record[i];
+      }
+      record[0]     = LOG_SYNC;
+      record[1]     = len - 2;
+      record[len++] = sum;
+      Push(record, len);
+#else
+      Serial.printf(logFormats[id], Text(args)...);
+#endif
+   }
+
+   /* Wait until the ring is drained, before the shutdown */
+   void Flush()
+   {
+#if LOG_BINARY
+      if (drainTask) {
+         for (int retry = 0; Used() && retry < 50; retry++) {
+            xTaskNotifyGive(drainTask);
+            delay(10);
+         }
+      }
+#endif
+      Serial.flush();
+   }
+
+   /* Print the records of the crashed wake from the log partition as binary records */
+   void PrintPersisted(Print &out)
+   {
+      const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t) 0x42, "log");
+      uint32_t               header[4];
+      uint8_t                chunk[64];
+
+      if (!partition || esp_partition_read(partition, 0, header, sizeof(header)) != ESP_OK || header[0] != LOG_MAGIC) {
+         return;
+      }
+      Write(LOG_POSTMORTEM, (int) header[1]);
+      Flush();
+      // the oldest records start at the write position, the decoder skips the partial first one
+      for (uint32_t pos = 0; pos < LOG_BUFFER; ) {
+         uint32_t offset = (header[2] + pos) % LOG_BUFFER;
+         uint32_t len    = min((uint32_t) sizeof(chunk), min(LOG_BUFFER - pos, LOG_BUFFER - offset));
+
+         esp_partition_read(partition, sizeof(header) + offset, chunk, len);
+         out.write(chunk, len);
+         pos += len;
+      }
+   }
+
+   /* Arguments of the text output */
+   static const char *Text(const String &value) { return value.c_str(); }
+   static const char *Text(const char *value)   { return value; }
+   static double      Text(double value)        { return value; }
+   static int         Text(int value)           { return value; }
+   static int         Text(long value)          { return value; }
+   static int         Text(bool value)          { return value; }
+   static unsigned    Text(unsigned value)      { return value; }
+   static unsigned    Text(unsigned long value) { return value; }
+};
+
+Logger logger; //!< The global logger
+
+#define LOG(id, ...) logger.Write(id, ##__VA_ARGS__)
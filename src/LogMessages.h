@@ -0,0 +1,101 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file LogMessages.h
+  *
+  * Table of the log messages for Log.h and tools/logdecode.py.
+  *
+  * The id of a message is its position in the table, so new messages
+  * are only appended. The binary log does not contain the format strings,
+  * the decoder reads them from this file. The arguments are int, unsigned,
+  * float and strings of up to LOG_MAX_STRING chars, printed with %d, %u,
+  * %x, %f and %s with flags, width and precision. %% is a literal percent.
+  */
+
+LOG_MESSAGE(LOG_DROPPED,          "Log: %d records dropped")
+LOG_MESSAGE(LOG_POSTMORTEM,       "Log: records of the wake before the reset %d")
+LOG_MESSAGE(LOG_DATETIME,         "DateTime: %s")
+LOG_MESSAGE(LOG_LOCATION,         "Latitude: %f Longitude: %f")
+LOG_MESSAGE(LOG_WIFI_RSSI,        "WifiRSSI: %d")
+LOG_MESSAGE(LOG_BATTERY,          "BatteryVolt: %.2f BatteryCapacity: %d BatteryRuntime: %d")
+LOG_MESSAGE(LOG_SHT30,            "Sht30Temperatur: %d Sht30Humidity: %d")
+LOG_MESSAGE(LOG_ASTRONAUTS,       "Astronauts: %d")
+LOG_MESSAGE(LOG_CORONA,           "WeekIncidenceHb: %.1f")
+LOG_MESSAGE(LOG_MAPS,             "Duration: %d/%d")
+LOG_MESSAGE(LOG_SUN,              "Sunrise: %s Sunset: %s")
+LOG_MESSAGE(LOG_WINDSPEED,        "Windspeed: %.1f")
+LOG_MESSAGE(LOG_BATTERY_VOLT,     "batteryVolt: %.2f smoothed: %.3f")
+LOG_MESSAGE(LOG_BATTERY_RATE,     "batteryCapacity: %d rate: %.2f %%/h")
+LOG_MESSAGE(LOG_BATTERY_RUNTIME,  "batteryRuntime: %d h%s")
+LOG_MESSAGE(LOG_SLEEP,            "Sleep %d minutes: %s (battery %d%%)")
+LOG_MESSAGE(LOG_WAKE,             "%s wake: %d ms")
+LOG_MESSAGE(LOG_REQUEST,          "Requesting %s to %s:%d")
+LOG_MESSAGE(LOG_REQUEST_TIMING,   "Read %d bytes from %s: dns %d, %s %d, ttfb %d, body %d, parse %d ms")
+LOG_MESSAGE(LOG_REGION,           "Region %s: %d ms")
+LOG_MESSAGE(LOG_RENDERED,         "Rendered frame with %d workers in %d ms (sum of regions %d ms)")
+LOG_MESSAGE(LOG_FRAME_READY,      "Frame ready in %d ms")
+LOG_MESSAGE(LOG_REFRESH_SKIPPED,  "Refresh %s: unchanged")
+LOG_MESSAGE(LOG_REFRESH,          "Refresh %s: %s, %d partial updates since the last clean")
+LOG_MESSAGE(LOG_LOCAL_REFRESH,    "Local refresh in %d ms")
+LOG_MESSAGE(LOG_CLOCK_SYNC,       "Clock sync: rtc error %d ms, drift %.2f ppm, uncertainty %.2f ppm (%d measurements)")
+LOG_MESSAGE(LOG_CLOCK_FAILED,     "Clock sync with %s failed")
+LOG_MESSAGE(LOG_MAPS_ROUTE,       "Duration %s -> %s: %d min%s")
+LOG_MESSAGE(LOG_TRAFFIC_CHECK,    "Traffic %s -> %s: predicted %d s, measured %d s")
+LOG_MESSAGE(LOG_TRAFFIC_STATS,    "Traffic model: %d of %d routes predicted, mean error %d s of %d checks, %d elements requested")
+LOG_MESSAGE(LOG_WEATHER,          "Weather from %s in %d ms, %d of %d providers requested")
+LOG_MESSAGE(LOG_WEATHER_HEDGE,    "Weather from %s slower than %d ms, requesting %s")
+LOG_MESSAGE(LOG_WEATHER_FAILED,   "Weather from %s failed after %d ms")
+LOG_MESSAGE(LOG_REQUEST_REUSED,   "Reused the connection of %s to %s, saved %d ms of setup")
+LOG_MESSAGE(LOG_AIR,              "Air quality %d: pm2.5 %.1f, pm10 %.1f, no2 %.1f, o3 %.1f")
+LOG_MESSAGE(LOG_PROXY,            "Proxy payload %d with the sections 0x%x")
+LOG_MESSAGE(LOG_FRAME_TILES,      "Frame %x of %x: %d tiles in %d bytes, average %d bytes")
+LOG_MESSAGE(LOG_WIFI_CONNECTING,  "Connecting to %s")
+LOG_MESSAGE(LOG_WIFI_CONNECTED,   "WiFi connected in %d ms at: %s")
+LOG_MESSAGE(LOG_WIFI_FAILED,      "WiFi connection *** FAILED ***")
+LOG_MESSAGE(LOG_WIFI_STOP,        "Stop WiFi")
+LOG_MESSAGE(LOG_SHOW,             "WeatherDisplay::%s")
+LOG_MESSAGE(LOG_SHUTDOWN,         "Shutdown")
+LOG_MESSAGE(LOG_PROXY_VERSION,    "Proxy payload version %d is not %d")
+LOG_MESSAGE(LOG_FRAME_VERSION,    "Frame version %d is not %d")
+LOG_MESSAGE(LOG_BACKGROUND_LOADED, "Background loaded in %d ms")
+LOG_MESSAGE(LOG_BACKGROUND_STORED, "Background rendered and stored in %d ms")
+LOG_MESSAGE(LOG_BACKGROUND_MISSING, "Background partition '%s' not found")
+LOG_MESSAGE(LOG_BACKGROUND_OUTDATED, "Background outdated")
+LOG_MESSAGE(LOG_BACKGROUND_SMALL, "Background partition too small")
+LOG_MESSAGE(LOG_BACKGROUND_FAILED, "Background write failed")
+LOG_MESSAGE(LOG_WIDGET_CACHE,     "WidgetCache: %d hits, %d misses this wake, %d hits, %d misses total")
+LOG_MESSAGE(LOG_REFRESH_TIMING,   "Refresh %s: %d updates in %d ms this wake, avg %d ms of %d updates")
+LOG_MESSAGE(LOG_REFRESH_CLEAN,    "Refresh: full clean")
+LOG_MESSAGE(LOG_WAKE_STATS,       "%s wakes: %d, average %d ms, max %d ms")
+LOG_MESSAGE(LOG_RESOLVE_FAILED,   "Resolving %s failed")
+LOG_MESSAGE(LOG_CONNECT_FAILED,   "Connecting %s:%d failed")
+LOG_MESSAGE(LOG_REQUEST_FAILED,   "Requesting %s failed, error: %s")
+LOG_MESSAGE(LOG_JSON_FAILED,      "deserializeJson() failed: %s")
+LOG_MESSAGE(LOG_READ_LENGTH,      "Reading %s failed, %d bytes instead of %d")
+LOG_MESSAGE(LOG_READ_FAILED,      "Reading %s failed, %d bytes")
+LOG_MESSAGE(LOG_ONECALL_FAILED,   "Parsing the onecall body failed: %s")
+LOG_MESSAGE(LOG_MAPS_STATUS,      "Maps status: %s")
+LOG_MESSAGE(LOG_TIMEZONE_INVALID, "TimeZone: invalid TZ string %s, using UTC")
+LOG_MESSAGE(LOG_MEMORY,           "Memory: internal %d bytes, psram %d bytes")
+LOG_MESSAGE(LOG_MEMORY_HEADER,    "phase       int free  largest frag    peak | psram free  largest frag    peak")
+LOG_MESSAGE(LOG_MEMORY_PHASE,     "%-11s %8d %8d %3d%% %7d | %10d %8d %3d%% %7d")
+LOG_MESSAGE(LOG_MEMORY_INTERNAL,  "Memory warning: %s needed %d bytes of the internal heap, the largest free block has %d bytes")
+LOG_MESSAGE(LOG_MEMORY_PSRAM,     "Memory warning: %s needed %d bytes of the psram, the largest free block has %d bytes")
+LOG_MESSAGE(LOG_MEMORY_FRAGMENTED, "Memory warning: internal heap %d%% fragmented before %s")
+LOG_MESSAGE(LOG_TIMELINE,         "Timeline of %d ms, %d ms per char")
+LOG_MESSAGE(LOG_TIMELINE_PHASE,   "%-11s %6d %6d%s")
+LOG_MESSAGE(LOG_WAKE_CHARGE,      "Wake charge: %.4f mAh in %d ms")
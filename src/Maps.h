@@ -20,45 +20,53 @@
   * Class for reading Google Maps data.
   */
 #pragma once
-#include <HTTPClient.h>
 #include <ArduinoJson.h>
 #include "Data.h"
+#include "HttpFetch.h"
+#include "Timeline.h"
+#include "Trace.h"
 #include <Config.h>
 
+/**
+  * Durations in traffic of the COMMUTE_ROUTES from the Google distance
+  * matrix. The routes the TrafficModel predicts well enough are not
+  * requested, the others share one matrix request of their origins and
+  * destinations.
+  */
 class Maps
 {
 protected:
-   const String server = "https://maps.googleapis.com";
-   String uri_distance = "/maps/api/distancematrix/json?key=" + String(GOOGLE_API_KEY) 
-      + "&language=de&departure_time=now&origins=" + String(HOME_COORD) + "|" + String(WORK_COORD) 
-      + "&destinations="  + String(HOME_COORD) + "|" + String(WORK_COORD);
+   const String server = "maps.googleapis.com";
 
-   bool GetMapsJsonDoc(DynamicJsonDocument &doc)
+   bool GetMapsJsonDoc(const String &uri, DynamicJsonDocument &doc)
    {
-      HTTPClient http;
-
-      String uri = server + uri_distance;
-      Serial.printf("Requesting %s\n", uri.c_str());
-      http.begin(uri);
-      int httpCode = http.GET();
-
-      if (httpCode != HTTP_CODE_OK) {
-         Serial.printf("Error on requesting %s: %s\n", uri.c_str(), http.errorToString(httpCode).c_str());
-         http.end();
-         return false;
-      } else {
-         String payload = http.getString();
-         DeserializationError error = deserializeJson(doc, payload);
-         http.end();
-         if (error) {
-            Serial.printf("deserializeJson() failed. Code:%s\n", String(error.code()));
-            Serial.printf("payload: %s\n", payload.c_str());
-            return false;
-         } else {
-            return true;
+      TimelineScope phase("maps", CURRENT_WIFI_MA);
+      TRACE_FUNCTION();
+
+      return HttpFetchJson(NET_MAPS, server, 443, uri, doc);
+   }
+
+   /* Index of the place in the list, appends it if missing */
+   static int Index(int *places, int &count, int place)
+   {
+      for (int i = 0; i < count; i++) {
+         if (places[i] == place) {
+            return i;
          }
       }
+      places[count] = place;
+      return count++;
+   }
 
+   /* Coordinates of the places separated by '|' */
+   static String Coords(const int *places, int count)
+   {
+      String coords;
+
+      for (int i = 0; i < count; i++) {
+         coords += (i ? "|" : "") + String(commutePlaces[places[i]].coord);
+      }
+      return coords;
    }
 
 public:
@@ -66,18 +74,58 @@ public:
    {
    }
 
-   /* Start the request and the filling. */
+   /* Predict or request the durations of all routes. */
    bool GetMaps(MyData &myData)
    {
-      DynamicJsonDocument doc(5 * 1024);
-
-      if (GetMapsJsonDoc(doc))
-      {
-         Serial.println("Maps status: " + String(doc.as<JsonObject>()["status"].as<const char *>()));
-         myData.mapsWorkDurationInTraffic = doc.as<JsonObject>()["rows"][0]["elements"][1]["duration_in_traffic"]["value"].as<int>() / 60;
-         myData.mapsHomeDurationInTraffic = doc.as<JsonObject>()["rows"][1]["elements"][0]["duration_in_traffic"]["value"].as<int>() / 60;
-         return true;
+      time_t local = timeZone.Local(wakeClock.Now());
+      int    origins[COMMUTE_MAX_ROUTES];
+      int    destinations[COMMUTE_MAX_ROUTES];
+      int    row[COMMUTE_MAX_ROUTES];
+      int    column[COMMUTE_MAX_ROUTES];
+      int    originCount = 0;
+      int    destinationCount = 0;
+      bool   success = true;
+
+      for (int r = 0; r < commuteRouteCount; r++) {
+         uint32_t seconds;
+
+         myData.mapsPredicted[r] = trafficModel.Predict(r, local, seconds);
+         if (myData.mapsPredicted[r]) {
+            myData.mapsDurations[r] = (seconds + 30) / 60;
+            row[r] = -1;
+         } else {
+            row[r]    = Index(origins, originCount, commuteRoutes[r].from);
+            column[r] = Index(destinations, destinationCount, commuteRoutes[r].to);
+         }
+      }
+
+      if (originCount) {
+         DynamicJsonDocument doc(5 * 1024);
+         String              uri = "/maps/api/distancematrix/json?key=" + String(GOOGLE_API_KEY)
+            + "&language=de&departure_time=now&origins=" + Coords(origins, originCount)
+            + "&destinations=" + Coords(destinations, destinationCount);
+
+         trafficModel.Requested(originCount * destinationCount);
+         success = GetMapsJsonDoc(uri, doc);
+         if (success) {
+            JsonObject root = doc.as<JsonObject>();
+
+            LOG(LOG_MAPS_STATUS, String(root["status"].as<const char *>()));
+            for (int r = 0; r < commuteRouteCount; r++) {
+               if (row[r] < 0) {
+                  continue;
+               }
+               JsonObject element = root["rows"][row[r]]["elements"][column[r]];
+               uint32_t   seconds = element["duration_in_traffic"]["value"].as<int>();
+
+               myData.mapsDurations[r] = seconds / 60;
+               if (seconds) {
+                  trafficModel.Learn(r, local, seconds);
+               }
+            }
+         }
       }
-      return false;
+      trafficModel.Save();
+      return success;
    }
 };
@@ -0,0 +1,229 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Memory.h
+  *
+  * Heap and PSRAM usage of the phases of a wake.
+  */
+#pragma once
+#include <nvs.h>
+#include <esp_heap_caps.h>
+#include "Log.h"
+
+#define MEMORY_PHASES 16  //!< Max phases, the same as the timeline
+#define MEMORY_NAME   12  //!< Max length of a phase name with the terminating 0
+#define MEMORY_FRAG   50  //!< Warn above this fragmentation in percent
+
+/* Snapshot of one heap */
+struct HeapSample
+{
+   uint32_t free;    //!< Free bytes
+   uint32_t largest; //!< Largest free block
+   uint32_t minimum; //!< Lowest free bytes since the boot
+
+   /* Take the snapshot of the heap with the capabilities */
+   void Take(uint32_t caps)
+   {
+      free    = heap_caps_get_free_size(caps);
+      largest = heap_caps_get_largest_free_block(caps);
+      minimum = heap_caps_get_minimum_free_size(caps);
+   }
+
+   /* Fragmentation in percent, 0 for an empty heap */
+   int Fragmentation() const
+   {
+      return free ? 100 - (int) ((uint64_t) largest * 100 / free) : 0;
+   }
+};
+
+/**
+  * Samples the internal heap and the PSRAM at the start and the end of
+  * every phase. The peak usage of a phase is kept across the wakes in the
+  * NVS and is used as the need of the phase in the next wake.
+  *
+  * Only the phase boundaries are sampled. The low-water mark of the heap
+  * since the boot shows the peak inside of a phase, as long as the phase
+  * reached a new low.
+  */
+class MemoryTracker
+{
+protected:
+   /* Peak usage of a phase, stored in the non volatile memory */
+   struct Peak
+   {
+      char     name[MEMORY_NAME]; //!< Name of the phase
+      uint32_t internal;          //!< Peak usage of the internal heap
+      uint32_t psram;             //!< Peak usage of the PSRAM
+   };
+
+   /* Samples of a phase in this wake */
+   struct Phase
+   {
+      const char *name;             //!< Name of the phase
+      HeapSample  internalBegin;    //!< Internal heap at the start
+      HeapSample  internalEnd;      //!< Internal heap at the end
+      HeapSample  psramBegin;       //!< PSRAM at the start
+      HeapSample  psramEnd;         //!< PSRAM at the end
+      bool        ended;            //!< End was sampled
+   };
+
+   Peak     peaks[MEMORY_PHASES];  //!< Peaks of all wakes
+   Phase    phases[MEMORY_PHASES]; //!< Phases of this wake
+   int      count;                 //!< Number of phases of this wake
+   uint32_t internalSize;          //!< Size of the internal heap
+   uint32_t psramSize;             //!< Size of the PSRAM, 0 without
+   bool     loaded;                //!< The peaks are loaded from the NVS
+
+   /* Peak entry of the phase name, a free or the last one for a new name */
+   Peak &FindPeak(const char *name)
+   {
+      Peak *found = &peaks[MEMORY_PHASES - 1];
+
+      for (int i = 0; i < MEMORY_PHASES; i++) {
+         if (strncmp(peaks[i].name, name, MEMORY_NAME - 1) == 0) {
+            return peaks[i];
+         }
+         if (peaks[i].name[0] == 0 && found->name[0] != 0) {
+            found = &peaks[i];
+         }
+      }
+      memset(found, 0, sizeof(Peak));
+      strncpy(found->name, name, MEMORY_NAME - 1);
+      return *found;
+   }
+
+   /* Usage of the heap during the phase, taken from the boundaries and the low-water mark */
+   uint32_t Used(uint32_t size, const HeapSample &begin, const HeapSample &end)
+   {
+      uint32_t lowest = min(begin.free, end.free);
+
+      if (end.minimum < begin.minimum) {
+         lowest = min(lowest, end.minimum); // new low-water mark inside of the phase
+      }
+      return size > lowest ? size - lowest : 0;
+   }
+
+public:
+   MemoryTracker()
+      : count(0)
+      , internalSize(0)
+      , psramSize(0)
+      , loaded(false)
+   {
+      memset(peaks, 0, sizeof(peaks));
+   }
+
+   /* Load the peaks from the non volatile memory */
+   void LoadNVS()
+   {
+      nvs_handle nvs_arg;
+      size_t     len = sizeof(peaks);
+
+      memset(peaks, 0, sizeof(peaks));
+      if (nvs_open("Setting", NVS_READONLY, &nvs_arg) == ESP_OK) {
+         if (nvs_get_blob(nvs_arg, "memory", peaks, &len) != ESP_OK || len != sizeof(peaks)) {
+            memset(peaks, 0, sizeof(peaks));
+         }
+         nvs_close(nvs_arg);
+      }
+      internalSize = heap_caps_get_total_size(MALLOC_CAP_INTERNAL);
+      psramSize    = heap_caps_get_total_size(MALLOC_CAP_SPIRAM);
+      loaded       = true;
+   }
+
+   /* Store the peaks to the non volatile memory */
+   void SaveNVS()
+   {
+      nvs_handle nvs_arg;
+      nvs_open("Setting", NVS_READWRITE, &nvs_arg);
+      nvs_set_blob(nvs_arg, "memory", peaks, sizeof(peaks));
+      nvs_commit(nvs_arg);
+      nvs_close(nvs_arg);
+   }
+
+   /* Sample the start of a phase and warn if its need of the last wakes does not fit */
+   int Begin(const char *name)
+   {
+      if (!loaded) {
+         LoadNVS();
+      }
+      if (count >= MEMORY_PHASES) {
+         return -1;
+      }
+      Phase &phase = phases[count];
+      Peak  &peak  = FindPeak(name);
+
+      memset(&phase, 0, sizeof(phase));
+      phase.name = name;
+      phase.internalBegin.Take(MALLOC_CAP_INTERNAL);
+      phase.psramBegin.Take(MALLOC_CAP_SPIRAM);
+
+      // the need is the peak usage above the usage at the start of the phase in the last wakes,
+      // every heap against its own largest block, a free psram block does not serve the internal heap
+      uint32_t internalUsed = internalSize - phase.internalBegin.free;
+      uint32_t psramUsed    = psramSize - phase.psramBegin.free;
+      uint32_t internalNeed = peak.internal > internalUsed ? peak.internal - internalUsed : 0;
+      uint32_t psramNeed    = peak.psram > psramUsed ? peak.psram - psramUsed : 0;
+
+      if (internalNeed > phase.internalBegin.largest) {
+         LOG(LOG_MEMORY_INTERNAL, name, (int) internalNeed, (int) phase.internalBegin.largest);
+      }
+      if (psramNeed > phase.psramBegin.largest) {
+         LOG(LOG_MEMORY_PSRAM, name, (int) psramNeed, (int) phase.psramBegin.largest);
+      }
+      if (phase.internalBegin.Fragmentation() > MEMORY_FRAG) {
+         LOG(LOG_MEMORY_FRAGMENTED, phase.internalBegin.Fragmentation(), name);
+      }
+      return count++;
+   }
+
+   /* Sample the end of the phase and update its peak */
+   void End(int index)
+   {
+      if (index < 0 || index >= count) {
+         return;
+      }
+      Phase &phase = phases[index];
+      Peak  &peak  = FindPeak(phase.name);
+
+      phase.internalEnd.Take(MALLOC_CAP_INTERNAL);
+      phase.psramEnd.Take(MALLOC_CAP_SPIRAM);
+      phase.ended = true;
+      peak.internal = max(peak.internal, Used(internalSize, phase.internalBegin, phase.internalEnd));
+      peak.psram    = max(peak.psram, Used(psramSize, phase.psramBegin, phase.psramEnd));
+   }
+
+   /* Log the samples of this wake and the peaks of all wakes */
+   void Dump()
+   {
+      LOG(LOG_MEMORY, (int) internalSize, (int) psramSize);
+      LOG(LOG_MEMORY_HEADER);
+      for (int i = 0; i < count; i++) {
+         Phase &phase = phases[i];
+         Peak  &peak  = FindPeak(phase.name);
+
+         if (!phase.ended) {
+            continue;
+         }
+         LOG(LOG_MEMORY_PHASE, phase.name,
+            (int) phase.internalEnd.free, (int) phase.internalEnd.largest, phase.internalEnd.Fragmentation(), (int) peak.internal,
+            (int) phase.psramEnd.free, (int) phase.psramEnd.largest, phase.psramEnd.Fragmentation(), (int) peak.psram);
+      }
+   }
+};
+
+MemoryTracker memoryTracker; //!< Heap usage of the phases of the current wake
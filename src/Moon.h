@@ -0,0 +1,174 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Moon.h
+  *
+  * Phase, illumination, moonrise and moonset at LATITUDE and LONGITUDE
+  * without any request.
+  */
+#pragma once
+#include <math.h>
+#include "TimeZone.h"
+
+#define MOON_PHASES     16          //!< Phase buckets of the icons in MoonIcons.h
+#define MOON_J2000      946728000L  //!< UTC of the epoch J2000.0, 2000-01-01 12:00
+#define MOON_STEP       3600        //!< Search step of the rise and the set in seconds
+#define MOON_BISECTIONS 12          //!< Refinements of a crossing, the step / 4096 is below a second
+
+/* Moon of one local day, rise and set are 0 if the moon does not cross the horizon that day */
+struct MoonDay
+{
+   time_t rise;         //!< Moonrise
+   time_t set;          //!< Moonset
+   float  illumination; //!< Illuminated fraction of the disc 0..1 at the time
+   float  elongation;   //!< Elongation from the sun 0..360, 0 new moon, 180 full moon
+   int    phase;        //!< Bucket 0..MOON_PHASES-1 of the elongation, 0 new moon
+};
+
+/**
+  * Low precision lunar theory with the main periodic terms of Meeus,
+  * chapter 47 and 48. The position is within some arcminutes, the rise
+  * and the set within a few minutes and the illumination within a percent.
+  * The arguments are reduced in double precision, the trigonometry runs
+  * in the float unit of the ESP32.
+  */
+class Moon
+{
+protected:
+   /* Fundamental arguments in degrees */
+   struct Arguments
+   {
+      float  d;    //!< Mean elongation of the moon
+      float  m;    //!< Mean anomaly of the sun
+      float  mm;   //!< Mean anomaly of the moon
+      float  f;    //!< Argument of the latitude of the moon
+      float  l;    //!< Mean longitude of the moon
+      double days; //!< Days since J2000
+   };
+
+   static float Rad(float deg) { return deg * (float) M_PI / 180; }
+   static float Deg(float rad) { return rad * 180 / (float) M_PI; }
+
+   static float Reduce(double deg)
+   {
+      double r = fmod(deg, 360.0);
+
+      return (float) (r < 0 ? r + 360 : r);
+   }
+
+   static Arguments Args(time_t utc)
+   {
+      Arguments a;
+
+      a.days = (double) (utc - MOON_J2000) / 86400;
+      a.d    = Reduce(297.8501921 + 12.19074912 * a.days);
+      a.m    = Reduce(357.5291092 + 0.98560028 * a.days);
+      a.mm   = Reduce(134.9633964 + 13.06499295 * a.days);
+      a.f    = Reduce(93.2720950 + 13.22935024 * a.days);
+      a.l    = Reduce(218.3164477 + 13.17639648 * a.days);
+      return a;
+   }
+
+   /* Altitude above the horizon in degrees at the UTC, minus the altitude of the rise */
+   float Altitude(time_t utc)
+   {
+      Arguments a   = Args(utc);
+      float     lon = a.l + 6.289f * sinf(Rad(a.mm)) + 1.274f * sinf(Rad(2 * a.d - a.mm))
+                    + 0.658f * sinf(Rad(2 * a.d)) + 0.214f * sinf(Rad(2 * a.mm))
+                    - 0.186f * sinf(Rad(a.m)) - 0.114f * sinf(Rad(2 * a.f));
+      float     lat = 5.128f * sinf(Rad(a.f)) + 0.281f * sinf(Rad(a.mm + a.f))
+                    + 0.278f * sinf(Rad(a.mm - a.f)) + 0.173f * sinf(Rad(2 * a.d - a.f));
+      float     km  = 385001 - 20905 * cosf(Rad(a.mm)) - 3699 * cosf(Rad(2 * a.d - a.mm)) - 2956 * cosf(Rad(2 * a.d));
+      float     eps = Rad(23.4393f - 0.0000004f * (float) a.days);
+
+      // ecliptic to equatorial coordinates
+      float ra  = atan2f(sinf(Rad(lon)) * cosf(eps) - tanf(Rad(lat)) * sinf(eps), cosf(Rad(lon)));
+      float dec = asinf(sinf(Rad(lat)) * cosf(eps) + cosf(Rad(lat)) * sinf(eps) * sinf(Rad(lon)));
+
+      // hour angle from the sidereal time
+      float gmst = Reduce(280.46061837 + 360.98564736629 * a.days);
+      float ha   = Rad(gmst + (float) LONGITUDE) - ra;
+      float phi  = Rad(LATITUDE);
+      float alt  = Deg(asinf(sinf(phi) * sinf(dec) + cosf(phi) * cosf(dec) * cosf(ha)));
+
+      // the rise is at the upper limb with the refraction and the parallax of the moon
+      float parallax = Deg(asinf(6378.14f / km));
+
+      return alt - (0.7275f * parallax - 0.5667f);
+   }
+
+   /* Time of the crossing between the two times with a sign change of the altitude */
+   time_t Bisect(time_t from, time_t to, float altFrom)
+   {
+      for (int i = 0; i < MOON_BISECTIONS; i++) {
+         time_t mid    = from + (to - from) / 2;
+         float  altMid = Altitude(mid);
+
+         if ((altMid < 0) == (altFrom < 0)) {
+            from    = mid;
+            altFrom = altMid;
+         } else {
+            to = mid;
+         }
+      }
+      return from + (to - from) / 2;
+   }
+
+public:
+   /* Illuminated fraction and elongation at the UTC */
+   void Phase(time_t utc, float &illumination, float &elongation)
+   {
+      Arguments a = Args(utc);
+
+      // phase angle, Meeus 48.4
+      float i = 180 - a.d - 6.289f * sinf(Rad(a.mm)) + 2.100f * sinf(Rad(a.m))
+              - 1.274f * sinf(Rad(2 * a.d - a.mm)) - 0.658f * sinf(Rad(2 * a.d))
+              - 0.214f * sinf(Rad(2 * a.mm)) - 0.110f * sinf(Rad(a.d));
+
+      illumination = (1 + cosf(Rad(i))) / 2;
+      elongation   = Reduce(180 - i);
+   }
+
+   /* Moon of the local day of the UTC, the phase at the UTC */
+   MoonDay Day(time_t utc)
+   {
+      MoonDay day;
+      time_t  local    = timeZone.Local(utc);
+      time_t  midnight = utc - ((local % 86400) + 86400) % 86400;
+      time_t  last     = midnight;
+      float   altLast  = Altitude(midnight);
+
+      day.rise = 0;
+      day.set  = 0;
+      for (time_t time = midnight + MOON_STEP; time <= midnight + 86400; time += MOON_STEP) {
+         float alt = Altitude(time);
+
+         if (altLast < 0 && alt >= 0 && !day.rise) {
+            day.rise = Bisect(last, time, altLast);
+         } else if (altLast >= 0 && alt < 0 && !day.set) {
+            day.set = Bisect(last, time, altLast);
+         }
+         last    = time;
+         altLast = alt;
+      }
+      Phase(utc, day.illumination, day.elongation);
+      day.phase = (int) (day.elongation * MOON_PHASES / 360 + 0.5f) % MOON_PHASES;
+      return day;
+   }
+};
+
+Moon moon; //!< Moon at the location of the display
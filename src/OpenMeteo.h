@@ -0,0 +1,163 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file OpenMeteo.h
+  *
+  * Class for reading the weather data from open-meteo, the secondary
+  * provider without an api key.
+  */
+#pragma once
+#include <ArduinoJson.h>
+#include "WeatherProvider.h"
+#include "Trace.h"
+
+#ifndef OPENMETEO_SRV
+#define OPENMETEO_SRV  "api.open-meteo.com"
+#endif
+#ifndef OPENMETEO_PORT
+#define OPENMETEO_PORT 80
+#endif
+
+#define OPENMETEO_SNOW_CM 0.7f //!< Snowfall in cm of 1 mm of water
+
+/**
+  * The forecast request of open-meteo with the fields of the onecall
+  * request. The WMO weather codes are translated into the main texts and
+  * the icons of openweathermap, the 15 minutes of the precipitation are
+  * converted into mm/h like the minutely data of openweathermap. The
+  * air quality stays unknown, its index has another scale at open-meteo.
+  */
+class OpenMeteo : public WeatherProvider
+{
+protected:
+   /* Main text and icon of openweathermap for a WMO weather code */
+   static void Condition(int code, String &main, String &icon)
+   {
+      if (code == 0) {
+         main = "Clear";        icon = "01d";
+      } else if (code == 1) {
+         main = "Clouds";       icon = "02d";
+      } else if (code == 2) {
+         main = "Clouds";       icon = "03d";
+      } else if (code == 3) {
+         main = "Clouds";       icon = "04d";
+      } else if (code == 45 || code == 48) {
+         main = "Mist";         icon = "50d";
+      } else if (code >= 51 && code <= 57) {
+         main = "Drizzle";      icon = "09d";
+      } else if (code >= 61 && code <= 67) {
+         main = "Rain";         icon = "10d";
+      } else if ((code >= 71 && code <= 77) || code == 85 || code == 86) {
+         main = "Snow";         icon = "13d";
+      } else if (code >= 80 && code <= 82) {
+         main = "Rain";         icon = "09d";
+      } else if (code >= 95) {
+         main = "Thunderstorm"; icon = "11d";
+      } else {
+         main = "";             icon = "";
+      }
+   }
+
+   /* Calls the open-meteo request and deserialisation the json data. */
+   bool GetOpenMeteoJsonDoc(DynamicJsonDocument &doc)
+   {
+      TRACE_FUNCTION();
+      String uri;
+
+      uri += "/v1/forecast";
+      uri += "?latitude=" + String((float) LATITUDE, 5);
+      uri += "&longitude=" + String((float) LONGITUDE, 5);
+      uri += "&current=temperature_2m,relative_humidity_2m,apparent_temperature,pressure_msl,wind_speed_10m";
+      uri += "&hourly=temperature_2m,rain,showers,snowfall";
+      uri += "&daily=weather_code,temperature_2m_max,sunrise,sunset";
+      uri += "&minutely_15=precipitation&forecast_minutely_15=4";
+      uri += "&forecast_hours=" + String(FORECAST_HOURS + 1);
+      uri += "&forecast_days=" + String(MAX_FORECAST_DAILY);
+      uri += "&wind_speed_unit=ms&timeformat=unixtime&timezone=auto";
+
+      return HttpFetchJson(NET_OPENMETEO, OPENMETEO_SRV, OPENMETEO_PORT, uri, doc);
+   }
+
+   /* Fill from the json data into the weather. */
+   bool Fill(Weather &weather, const JsonObject &root)
+   {
+      TRACE_FUNCTION();
+      weather.Clear();
+
+      JsonObject current = root["current"];
+      JsonObject daily   = root["daily"];
+
+      weather.currentTime   = current["time"].as<int>();
+      weather.sunrise       = Weather::LocalTime(daily["sunrise"][0].as<int>());
+      weather.sunset        = Weather::LocalTime(daily["sunset"][0].as<int>());
+      weather.windspeed     = current["wind_speed_10m"].as<float>();
+      weather.temp          = current["temperature_2m"].as<float>();
+      weather.tempFeelsLike = current["apparent_temperature"].as<float>();
+      weather.humidity      = current["relative_humidity_2m"].as<float>();
+      weather.pressure      = current["pressure_msl"].as<float>();
+
+      JsonArray days = daily["time"];
+      for (int i = 0; i < MAX_FORECAST_DAILY; i++) {
+         if (i < (int) days.size()) {
+            // the days start at the local midnight, openweathermap stamps them at noon
+            weather.dailyTime[i]    = Weather::LocalTime(days[i].as<int>() + 12 * 3600);
+            weather.dailyMaxTemp[i] = daily["temperature_2m_max"][i].as<float>();
+            Condition(daily["weather_code"][i].as<int>(), weather.dailyMain[i], weather.dailyIcon[i]);
+         }
+      }
+
+      JsonObject hourly = root["hourly"];
+      int        hours  = min((int) hourly["time"].size(), FORECAST_HOURS + 1);
+
+      weather.forecastTemp.Begin(hours);
+      weather.forecastRain.Begin(hours);
+      weather.forecastSnow.Begin(hours);
+      for (int i = 0; i < hours; i++) {
+         weather.forecastTemp.Add(hourly["temperature_2m"][i].as<float>());
+         weather.forecastRain.Add(hourly["rain"][i].as<float>() + hourly["showers"][i].as<float>());
+         weather.forecastSnow.Add(hourly["snowfall"][i].as<float>() / OPENMETEO_SNOW_CM);
+      }
+
+      JsonArray quarters = root["minutely_15"]["precipitation"];
+
+      weather.nowcastRain.Begin(quarters.size());
+      for (JsonVariant quarter : quarters) {
+         weather.nowcastRain.Add(quarter.as<float>() * 4);
+      }
+      weather.Finish();
+      return weather.currentTime != 0;
+   }
+
+public:
+   const char *Name()
+   {
+      return "open-meteo";
+   }
+
+   NetSource Source()
+   {
+      return NET_OPENMETEO;
+   }
+
+   /* Start the request and the filling. */
+   bool Fetch(Weather &weather)
+   {
+      DynamicJsonDocument doc(12 * 1024);
+
+      return GetOpenMeteoJsonDoc(doc) && Fill(weather, doc.as<JsonObject>());
+   }
+};
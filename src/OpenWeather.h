@@ -0,0 +1,206 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file OpenWeather.h
+  * 
+  * Class for reading all the weather data and the air quality from
+  * openweathermap.
+  */
+#pragma once
+#include <ArduinoJson.h>
+#include "JsonWalk.h"
+#include "WeatherProvider.h"
+#include "Trace.h"
+#include "Log.h"
+
+#define OPENWEATHER_MINUTES 61 //!< Minutes of the precipitation in the onecall response
+
+/**
+  * The onecall and the air pollution request of openweathermap, both
+  * over one connection.
+  */
+class OpenWeather : public WeatherProvider
+{
+protected:
+   /* Calls the openweathermap request, the weather is filled while the body arrives. */
+   bool GetOpenWeather(HttpSession &session, Weather &weather)
+   {
+      TRACE_FUNCTION();
+      String uri;
+      
+      uri += "/data/2.5/onecall";
+      uri += "?lat=" + String((float) LATITUDE, 5);
+      uri += "&lon=" + String((float) LONGITUDE, 5);
+      uri += "&units=metric&lang=de&exclude=alerts";
+      uri += "&appid=" + (String) OPENWEATHER_API;
+
+      return session.GetStream(NET_WEATHER, uri, [&](HttpBody &body) { return Parse(body, weather); });
+   }
+
+   /* Calls the air pollution request of the current hour. */
+   bool GetAirJsonDoc(HttpSession &session, DynamicJsonDocument &doc)
+   {
+      TRACE_FUNCTION();
+      String uri;
+
+      uri += "/data/2.5/air_pollution";
+      uri += "?lat=" + String((float) LATITUDE, 5);
+      uri += "&lon=" + String((float) LONGITUDE, 5);
+      uri += "&appid=" + (String) OPENWEATHER_API;
+
+      return session.GetJson(NET_AIR, uri, doc);
+   }
+
+   /* Fill the air quality, it stays unknown without a measurement */
+   void FillAir(Weather &weather, const JsonObject &root)
+   {
+      JsonObject hour = root["list"][0];
+
+      weather.airQuality = hour["main"]["aqi"].as<int>();
+      weather.airPm25    = hour["components"]["pm2_5"].as<float>();
+      weather.airPm10    = hour["components"]["pm10"].as<float>();
+      weather.airNo2     = hour["components"]["no2"].as<float>();
+      weather.airO3      = hour["components"]["o3"].as<float>();
+   }
+
+   /* Fill the current weather */
+   void FillCurrent(Weather &weather, const JsonObject &current)
+   {
+      weather.currentTime   = current["dt"].as<int>();
+      weather.sunrise       = Weather::LocalTime(current["sunrise"].as<int>());
+      weather.sunset        = Weather::LocalTime(current["sunset"].as<int>());
+      weather.windspeed     = current["wind_speed"].as<float>();
+      weather.temp          = current["temp"].as<float>();
+      weather.tempFeelsLike = current["feels_like"].as<float>();
+      weather.humidity      = current["humidity"].as<float>();
+      weather.pressure      = current["pressure"].as<float>();
+   }
+
+   /* Fill a day of the forecast */
+   void FillDay(Weather &weather, int i, const JsonObject &day)
+   {
+      weather.dailyTime[i]    = Weather::LocalTime(day["dt"].as<int>());
+      weather.dailyMaxTemp[i] = day["temp"]["max"].as<float>();
+      weather.dailyMain[i]    = day["weather"][0]["main"].as<char *>();
+      weather.dailyIcon[i]    = day["weather"][0]["icon"].as<char *>();
+   }
+
+   /*
+    * Fill the weather from the onecall body while it arrives. The members
+    * of the document are walked through and the days, the 48 hours and
+    * the 61 minutes are deserialized one by one into a small doc, so the
+    * memory does not depend on the length of the body.
+    */
+   bool Parse(Stream &body, Weather &weather)
+   {
+      TRACE_FUNCTION();
+      DynamicJsonDocument  doc(1024);
+      DynamicJsonDocument  filter(512);
+      DeserializationError error;
+      JsonWalk             walk(body);
+      String               key;
+      int                  days = 0;
+      int                  hours = 0;
+
+      weather.Clear();
+      // the hours are collected into the points of the graph one by one,
+      // FORECAST_HOURS of 48 averages two hours per point
+      weather.forecastTemp.Begin(FORECAST_HOURS + 1);
+      weather.forecastRain.Begin(FORECAST_HOURS + 1);
+      weather.forecastSnow.Begin(FORECAST_HOURS + 1);
+      weather.nowcastRain.Begin(OPENWEATHER_MINUTES);
+
+      if (!walk.Enter('{')) {
+         return false;
+      }
+      while (!error && walk.Member(key)) {
+         filter.clear();
+         if (key == "current" && walk.Is('{')) {
+            const char *fields[] = { "dt", "sunrise", "sunset", "wind_speed", "temp", "feels_like", "humidity", "pressure" };
+
+            for (const char *field : fields) {
+               filter[field] = true;
+            }
+            if (!(error = deserializeJson(doc, body, DeserializationOption::Filter(filter)))) {
+               FillCurrent(weather, doc.as<JsonObject>());
+            }
+         } else if (key == "daily" && walk.Enter('[')) {
+            filter["dt"] = true;
+            filter["temp"]["max"] = true;
+            filter["weather"][0]["main"] = true;
+            filter["weather"][0]["icon"] = true;
+            while (!error && walk.Element()) {
+               if (!(error = deserializeJson(doc, body, DeserializationOption::Filter(filter))) && days < MAX_FORECAST_DAILY) {
+                  FillDay(weather, days++, doc.as<JsonObject>());
+               }
+            }
+         } else if (key == "hourly" && walk.Enter('[')) {
+            filter["temp"] = true;
+            filter["rain"]["1h"] = true;
+            filter["snow"]["1h"] = true;
+            while (!error && walk.Element()) {
+               if (!(error = deserializeJson(doc, body, DeserializationOption::Filter(filter))) && hours++ <= FORECAST_HOURS) {
+                  weather.forecastTemp.Add(doc["temp"].as<float>());
+                  weather.forecastRain.Add(doc["rain"]["1h"].as<float>());
+                  weather.forecastSnow.Add(doc["snow"]["1h"].as<float>());
+               }
+            }
+         } else if (key == "minutely" && walk.Enter('[')) {
+            filter["precipitation"] = true;
+            while (!error && walk.Element()) {
+               if (!(error = deserializeJson(doc, body, DeserializationOption::Filter(filter)))) {
+                  weather.nowcastRain.Add(doc["precipitation"].as<float>());
+               }
+            }
+         } else {
+            walk.Skip();
+         }
+      }
+      if (error || walk.Failed()) {
+         LOG(LOG_ONECALL_FAILED, error ? error.c_str() : "broken json");
+         return false;
+      }
+      weather.Finish();
+      return weather.currentTime != 0;
+   }
+
+public:
+   const char *Name()
+   {
+      return "openweathermap";
+   }
+
+   NetSource Source()
+   {
+      return NET_WEATHER;
+   }
+
+   /* Start the requests and the filling, the weather is complete without the air quality. */
+   bool Fetch(Weather &weather)
+   {
+      HttpSession         session(OPENWEATHER_SRV, OPENWEATHER_PORT);
+      DynamicJsonDocument doc(1024); // the air pollution answer is small
+   
+      if (!GetOpenWeather(session, weather)) {
+         return false;
+      }
+      if (GetAirJsonDoc(session, doc)) {
+         FillAir(weather, doc.as<JsonObject>());
+      }
+      return true;
+   }
+};
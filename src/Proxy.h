@@ -0,0 +1,73 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Proxy.h
+  *
+  * Class for reading all the data of a wake from the aggregation proxy.
+  */
+#pragma once
+#include "Data.h"
+#include "HttpFetch.h"
+#include "ProxyData.h"
+#include "Timeline.h"
+#include "Trace.h"
+
+#ifndef PROXY_PORT
+#define PROXY_PORT 8080
+#endif
+
+/**
+  * With PROXY_SRV in the Config.h all the data of a wake is one plain
+  * http request to the proxy of host/proxy, which polls the services on
+  * its own schedule. The body is read straight into the ProxyPayload and
+  * copied into MyData, there is no json and no TLS on the device.
+  * Without PROXY_SRV or if the proxy has no weather the services are
+  * requested directly.
+  */
+class Proxy
+{
+protected:
+   ProxyPayload payload; //!< Body of the last request
+
+public:
+   Proxy()
+   {
+      memset(&payload, 0, sizeof(payload));
+   }
+
+   /* Request all the data from the proxy, true if the weather was filled */
+   bool Get(MyData &myData)
+   {
+#ifdef PROXY_SRV
+      TimelineScope phase("proxy", CURRENT_WIFI_MA);
+      HttpSession   session(PROXY_SRV, PROXY_PORT);
+
+      if (!session.GetBinary(NET_PROXY, "/panel?v=" + String(PROXY_VERSION), &payload, sizeof(payload))) {
+         return false;
+      }
+      if (payload.magic != PROXY_MAGIC || payload.version != PROXY_VERSION || payload.size != sizeof(payload)) {
+         LOG(LOG_PROXY_VERSION, (int) payload.version, PROXY_VERSION);
+         return false;
+      }
+      if (ProxyFill(payload, myData)) {
+         LOG(LOG_PROXY, (int) payload.sequence, (int) payload.valid);
+         return true;
+      }
+#endif
+      return false;
+   }
+};
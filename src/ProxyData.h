@@ -0,0 +1,111 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file ProxyData.h
+  *
+  * Copy of the ProxyPayload into MyData, used by the proxy mode of the
+  * firmware and by the renderer of host/render.
+  */
+#pragma once
+#include "Data.h"
+#include "ProxyPayload.h"
+
+static_assert(PROXY_DAYS == MAX_FORECAST_DAILY, "The payload has another number of days");
+static_assert(PROXY_ROUTES >= COMMUTE_MAX_ROUTES, "The payload has too few routes");
+
+/* Copy of a text field, the proxy terminates it */
+String ProxyText(const char *text, size_t size)
+{
+   char buffer[PROXY_TEXT + 1];
+
+   memcpy(buffer, text, min(size, sizeof(buffer) - 1));
+   buffer[min(size, sizeof(buffer) - 1)] = '\0';
+   return String(buffer);
+}
+
+/* Fill the weather in the same way as the providers */
+void ProxyFillWeather(const ProxyPayload &payload, Weather &weather)
+{
+   weather.Clear();
+   weather.currentTime   = payload.currentTime;
+   weather.sunrise       = Weather::LocalTime(payload.sunrise);
+   weather.sunset        = Weather::LocalTime(payload.sunset);
+   weather.windspeed     = payload.windspeed;
+   weather.temp          = payload.temp;
+   weather.tempFeelsLike = payload.tempFeelsLike;
+   weather.humidity      = payload.humidity;
+   weather.pressure      = payload.pressure;
+
+   for (int i = 0; i < MAX_FORECAST_DAILY; i++) {
+      weather.dailyTime[i]    = Weather::LocalTime(payload.dailyTime[i]);
+      weather.dailyMaxTemp[i] = payload.dailyMaxTemp[i];
+      weather.dailyMain[i]    = ProxyText(payload.dailyMain[i], sizeof(payload.dailyMain[i]));
+      weather.dailyIcon[i]    = ProxyText(payload.dailyIcon[i], sizeof(payload.dailyIcon[i]));
+   }
+
+   int hours   = min((int) payload.hours, min(FORECAST_HOURS + 1, PROXY_HOURS));
+   int minutes = min((int) payload.minutes, PROXY_MINUTES);
+
+   weather.forecastTemp.Begin(hours);
+   weather.forecastRain.Begin(hours);
+   weather.forecastSnow.Begin(hours);
+   for (int i = 0; i < hours; i++) {
+      weather.forecastTemp.Add(payload.hourlyTemp[i]);
+      weather.forecastRain.Add(payload.hourlyRain[i]);
+      weather.forecastSnow.Add(payload.hourlySnow[i]);
+   }
+   weather.nowcastRain.Begin(minutes);
+   for (int i = 0; i < minutes; i++) {
+      weather.nowcastRain.Add(payload.minutelyRain[i]);
+   }
+   weather.Finish();
+
+   if (payload.valid & PROXY_VALID_AIR) {
+      weather.airQuality = payload.airQuality;
+      weather.airPm25    = payload.airPm25;
+      weather.airPm10    = payload.airPm10;
+      weather.airNo2     = payload.airNo2;
+      weather.airO3      = payload.airO3;
+   }
+}
+
+/* Copy the valid sections of the payload into MyData, true if the weather was filled */
+bool ProxyFill(const ProxyPayload &payload, MyData &myData)
+{
+   if (payload.valid & PROXY_VALID_ASTRONAUTS) {
+      myData.astronauts = payload.astronauts;
+   }
+   if (payload.valid & PROXY_VALID_CORONA) {
+      myData.coronaWeekIncidenceLocal   = payload.coronaWeekIncidenceLocal;
+      myData.coronaWeekIncidenceGermany = payload.coronaWeekIncidenceGermany;
+      myData.coronaName                 = ProxyText(payload.coronaName, sizeof(payload.coronaName));
+      myData.coronaUpdated              = ProxyText(payload.coronaUpdated, sizeof(payload.coronaUpdated));
+   }
+   // the routes of the proxy configuration must be the COMMUTE_ROUTES in the same order
+   if ((payload.valid & PROXY_VALID_MAPS) && payload.routes == commuteRouteCount) {
+      for (int r = 0; r < commuteRouteCount; r++) {
+         myData.mapsDurations[r] = payload.mapsMinutes[r];
+         myData.mapsPredicted[r] = false;
+      }
+   }
+   if (payload.valid & PROXY_VALID_WEATHER) {
+      ProxyFillWeather(payload, myData.weather);
+      myData.weather.success = true;
+      return true;
+   }
+   return false;
+}
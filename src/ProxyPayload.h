@@ -0,0 +1,101 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file ProxyPayload.h
+  *
+  * Binary payload of the aggregation proxy in host/proxy, shared by the
+  * proxy and the firmware.
+  */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#define PROXY_MAGIC   0x3158504d //!< 'MPX1'
+#define PROXY_VERSION 1          //!< Increment on every change of the layout
+#define PROXY_DAYS    5          //!< Days of the daily forecast
+#define PROXY_HOURS   49         //!< Hours of the hourly forecast, the current one and 48 more
+#define PROXY_MINUTES 61         //!< Minutes of the rain of the next hour
+#define PROXY_ROUTES  4          //!< Routes of the traffic panel
+#define PROXY_TEXT    32         //!< Size of the text fields with the terminating zero
+
+/* Sections of the payload with data */
+enum ProxyValid
+{
+   PROXY_VALID_WEATHER    = 0x01, //!< Weather and forecast of openweathermap
+   PROXY_VALID_AIR        = 0x02, //!< Air quality of openweathermap
+   PROXY_VALID_ASTRONAUTS = 0x04, //!< Astronauts of open-notify
+   PROXY_VALID_CORONA     = 0x08, //!< Incidences of the corona api
+   PROXY_VALID_MAPS       = 0x10  //!< Durations of the distance matrix
+};
+
+/**
+  * The fields of MyData in a fixed layout without any padding, the proxy
+  * sends it as the body of "GET /panel" and the firmware reads it
+  * straight into the struct. Both sides are little endian with IEEE
+  * floats, so the layout only depends on the field sizes, which the
+  * static_asserts below pin. The times are in UTC, the firmware converts
+  * them into the local time like the answers of the services.
+  */
+struct ProxyPayload
+{
+   uint32_t magic;                                //!< PROXY_MAGIC
+   uint16_t version;                              //!< PROXY_VERSION
+   uint16_t size;                                 //!< sizeof(ProxyPayload)
+   uint32_t sequence;                             //!< Increments with every change of the data
+   uint32_t valid;                                //!< ProxyValid of the sections with data
+
+   uint32_t currentTime;                          //!< Time of the current weather
+   uint32_t sunrise;                              //!< Sunrise of today
+   uint32_t sunset;                               //!< Sunset of today
+   float    windspeed;                            //!< Wind speed in m/s
+   float    temp;                                 //!< Temperature in C
+   float    tempFeelsLike;                        //!< Felt temperature in C
+   float    humidity;                             //!< Humidity in %
+   float    pressure;                             //!< Air pressure in hPa
+
+   uint32_t dailyTime[PROXY_DAYS];                //!< Noon of the days
+   float    dailyMaxTemp[PROXY_DAYS];             //!< Max temperature of the days
+   char     dailyMain[PROXY_DAYS][16];            //!< Main text of openweathermap
+   char     dailyIcon[PROXY_DAYS][4];             //!< Icon of openweathermap
+
+   uint16_t hours;                                //!< Filled hours of the hourly arrays
+   uint16_t minutes;                              //!< Filled minutes of the minutely rain
+   uint16_t routes;                               //!< Routes of the proxy configuration
+   uint16_t reserved;                             //!< Zero
+   float    hourlyTemp[PROXY_HOURS];              //!< Temperature in C
+   float    hourlyRain[PROXY_HOURS];              //!< Rain in mm/h
+   float    hourlySnow[PROXY_HOURS];              //!< Snow in mm/h
+   float    minutelyRain[PROXY_MINUTES];          //!< Rain in mm/h
+
+   int32_t  airQuality;                           //!< Air quality index 1 .. 5
+   float    airPm25;                              //!< Fine particles in ug/m3
+   float    airPm10;                              //!< Coarse particles in ug/m3
+   float    airNo2;                               //!< Nitrogen dioxide in ug/m3
+   float    airO3;                                //!< Ozone in ug/m3
+
+   int32_t  astronauts;                           //!< Astronauts in space
+   float    coronaWeekIncidenceLocal;             //!< Incidence of the district
+   float    coronaWeekIncidenceGermany;           //!< Incidence of germany
+   char     coronaName[PROXY_TEXT];               //!< Name of the district
+   char     coronaUpdated[PROXY_TEXT];            //!< Update of the corona api as ISO time
+
+   uint16_t mapsMinutes[PROXY_ROUTES];            //!< Minutes in traffic of the routes
+};
+
+static_assert(sizeof(float) == 4, "The payload needs 32 bit floats");
+static_assert(offsetof(ProxyPayload, hourlyTemp) == 196, "The layout of the payload changed, increment PROXY_VERSION");
+static_assert(sizeof(ProxyPayload) == 1132, "The layout of the payload changed, increment PROXY_VERSION");
@@ -0,0 +1,224 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Refresh.h
+  * 
+  * Scheduler for the e-paper update modes against the ghosting.
+  */
+#pragma once
+#include <nvs.h>
+#include "Utils.h"
+#include "Log.h"
+
+#define REFRESH_MAX_REGIONS   16 //!< Max number of regions stored in the non volatile memory
+#define REFRESH_MAX_PARTIAL   12 //!< Partial updates of a region before a clean GC16 update
+#define REFRESH_CLEAN_FROM     2 //!< Hour of the day from which the daily full clean is due
+#define REFRESH_MODES          8 //!< Number of update modes with timing counters
+
+/* Name of the update mode for the log */
+const char *UpdateModeName(m5epd_update_mode_t mode)
+{
+   switch (mode) {
+      case UPDATE_MODE_INIT: return "INIT";
+      case UPDATE_MODE_DU:   return "DU";
+      case UPDATE_MODE_GC16: return "GC16";
+      case UPDATE_MODE_GL16: return "GL16";
+      case UPDATE_MODE_GLR16:return "GLR16";
+      case UPDATE_MODE_GLD16:return "GLD16";
+      case UPDATE_MODE_DU4:  return "DU4";
+      case UPDATE_MODE_A2:   return "A2";
+      default:               return "NONE";
+   }
+}
+
+/* Gray level histogram of a 4 bit canvas buffer */
+void GrayHistogram(const uint8_t *buffer, size_t len, uint32_t histogram[16])
+{
+   memset(histogram, 0, 16 * sizeof(uint32_t));
+   for (size_t i = 0; i < len; i++) {
+      histogram[buffer[i] >> 4]++;
+      histogram[buffer[i] & 0x0F]++;
+   }
+}
+
+/* Check if the histogram only contains pure white and black */
+bool IsBlackWhite(const uint32_t histogram[16])
+{
+   for (int i = 1; i < 15; i++) {
+      if (histogram[i] > 0) {
+         return false;
+      }
+   }
+   return true;
+}
+
+/**
+  * Tracks the fast partial updates of every screen region since its last 
+  * clean update and escalates to a GC16 update of the region after 
+  * REFRESH_MAX_PARTIAL partial updates. Once a day the whole panel is cleared.
+  * Regions with only black and white pixels use the fast DU waveform, 
+  * regions with gray levels the GL16 waveform.
+  * The counters survive the shutdown in the non volatile memory, every
+  * layout of regions has its own key.
+  */
+class RefreshScheduler
+{
+protected:
+   /* Data stored in the non volatile memory */
+   struct State
+   {
+      uint32_t lastCleanDay;                      //!< Day number of the last full clean, 0 = never
+      uint32_t hash[REFRESH_MAX_REGIONS];         //!< Content hash of the region on the panel
+      uint8_t  partialUpdates[REFRESH_MAX_REGIONS]; //!< Partial updates since the last clean
+      uint32_t modeCount[REFRESH_MODES];          //!< Number of updates per update mode
+      uint32_t modeMs[REFRESH_MODES];             //!< Summed update time per update mode
+   };
+
+   State       state;                 //!< Current state
+   const char *key;                   //!< Key of the state in the non volatile memory
+   uint32_t    wakeCount[REFRESH_MODES]; //!< Number of updates per update mode of this wake
+   uint32_t    wakeMs[REFRESH_MODES];    //!< Summed update time per update mode of this wake
+
+public:
+   RefreshScheduler(const char *k = "refresh")
+      : key(k)
+   {
+      memset(&state, 0, sizeof(state));
+      memset(wakeCount, 0, sizeof(wakeCount));
+      memset(wakeMs, 0, sizeof(wakeMs));
+   }
+
+   /* Load the state from the non volatile memory */
+   void LoadNVS()
+   {
+      nvs_handle nvs_arg;
+      size_t     len = sizeof(state);
+
+      memset(&state, 0, sizeof(state));
+      if (nvs_open("Setting", NVS_READONLY, &nvs_arg) == ESP_OK) {
+         if (nvs_get_blob(nvs_arg, key, &state, &len) != ESP_OK || len != sizeof(state)) {
+            memset(&state, 0, sizeof(state));
+         }
+         nvs_close(nvs_arg);
+      }
+   }
+
+   /* Store the state to the non volatile memory */
+   void SaveNVS()
+   {
+      nvs_handle nvs_arg;
+      nvs_open("Setting", NVS_READWRITE, &nvs_arg);
+      nvs_set_blob(nvs_arg, key, &state, sizeof(state));
+      nvs_commit(nvs_arg);
+      nvs_close(nvs_arg);
+   }
+
+   /*
+    * Full clean on the first start and on the first network wake of a day
+    * from REFRESH_CLEAN_FROM on, now is the local time. The sleep of the
+    * quiet hours decides if that wake is in the night or in the morning.
+    */
+   bool IsFullCleanDue(time_t now)
+   {
+      uint32_t today = now / SECS_PER_DAY;
+
+      if (state.lastCleanDay == 0) {
+         return true;
+      }
+      return today != state.lastCleanDay && hour(now) >= REFRESH_CLEAN_FROM;
+   }
+
+   /* Forget the content of the regions after another layout drew over them, true if any was known */
+   bool Forget()
+   {
+      bool known = false;
+
+      for (int i = 0; i < REFRESH_MAX_REGIONS; i++) {
+         known = known || state.hash[i] != 0;
+         state.hash[i] = 0;
+      }
+      return known;
+   }
+
+   /* Check if the region content differs from the panel */
+   bool IsChanged(int region, uint32_t hash)
+   {
+      return state.hash[region] != hash;
+   }
+
+   /* The update mode of the next update of the region */
+   m5epd_update_mode_t Mode(int region, bool blackWhite)
+   {
+      if (state.partialUpdates[region] >= REFRESH_MAX_PARTIAL) {
+         return UPDATE_MODE_GC16;
+      }
+      return blackWhite ? UPDATE_MODE_DU : UPDATE_MODE_GL16;
+   }
+
+   /* Number of partial updates of the region since its last clean */
+   int PartialUpdates(int region)
+   {
+      return state.partialUpdates[region];
+   }
+
+   /* Remember the update of a region */
+   void Updated(int region, uint32_t hash, m5epd_update_mode_t mode)
+   {
+      state.hash[region] = hash;
+      if (mode == UPDATE_MODE_GC16) {
+         state.partialUpdates[region] = 0;
+      } else if (state.partialUpdates[region] < 255) {
+         state.partialUpdates[region]++;
+      }
+   }
+
+   /* Remember the clean update of a region */
+   void Cleaned(int region, uint32_t hash)
+   {
+      Updated(region, hash, UPDATE_MODE_GC16);
+   }
+
+   /* Add the duration of one update to the timing counters */
+   void Timing(m5epd_update_mode_t mode, uint32_t ms)
+   {
+      if (mode < REFRESH_MODES) {
+         state.modeCount[mode]++;
+         state.modeMs[mode] += ms;
+         wakeCount[mode]++;
+         wakeMs[mode] += ms;
+      }
+   }
+
+   /* Print the timing counters of this wake and of all wakes */
+   void DumpTiming()
+   {
+      for (int mode = 0; mode < REFRESH_MODES; mode++) {
+         if (state.modeCount[mode] > 0) {
+            LOG(LOG_REFRESH_TIMING, UpdateModeName((m5epd_update_mode_t) mode),
+               (int) wakeCount[mode], (int) wakeMs[mode],
+               (int) (state.modeMs[mode] / state.modeCount[mode]), (int) state.modeCount[mode]);
+         }
+      }
+   }
+
+   /* Remember the full clean of the panel */
+   void FullCleaned(time_t now)
+   {
+      state.lastCleanDay = now / SECS_PER_DAY;
+      LOG(LOG_REFRESH_CLEAN);
+   }
+};
@@ -0,0 +1,277 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Sleep.h
+  * 
+  * Scheduler for the sleep time until the next wake.
+  */
+#pragma once
+#include <nvs.h>
+#include "Data.h"
+#include "Battery.h"
+#include "TimeZone.h"
+
+// Defaults, can be overwritten in the Config.h
+#ifndef SLEEP_MINUTES
+#define SLEEP_MINUTES         30  //!< Normal update interval
+#endif
+#ifndef SLEEP_MAX_MINUTES
+#define SLEEP_MAX_MINUTES    240  //!< Longest sleep, limited by the RTC timer of the M5Paper
+#endif
+#ifndef SLEEP_RETRY_MINUTES
+#define SLEEP_RETRY_MINUTES    2  //!< First retry after a failed weather request
+#endif
+#ifndef SLEEP_RETRY_MAX_MINUTES
+#define SLEEP_RETRY_MAX_MINUTES 60 //!< Longest retry interval of the backoff
+#endif
+#ifndef OWM_UPDATE_MINUTES
+#define OWM_UPDATE_MINUTES    10  //!< Update cadence of the openweathermap data
+#endif
+#ifndef QUIET_HOURS_FROM
+#define QUIET_HOURS_FROM       0  //!< Start hour without updates
+#endif
+#ifndef QUIET_HOURS_TO
+#define QUIET_HOURS_TO         5  //!< End hour without updates
+#endif
+#ifndef COMMUTE_MINUTES
+#define COMMUTE_MINUTES       10  //!< Update interval in the commute windows
+#endif
+#ifndef LOCAL_WAKE_MINUTES
+#define LOCAL_WAKE_MINUTES     5  //!< Interval of the local wakes between the network wakes, 0 disables them
+#endif
+#ifndef COMMUTE_WINDOWS
+#define COMMUTE_WINDOWS       { { 6 * 60 + 30, 8 * 60 + 30 }, { 16 * 60, 18 * 60 } } //!< Minutes of the day, Monday to Friday
+#endif
+
+/* Type of the current wake */
+enum WakeType
+{
+   WAKE_NETWORK, //!< Fetch all the data and draw the whole frame
+   WAKE_LOCAL,   //!< Only read the local sensors and refresh the indoor and status panels
+   WAKE_TYPES
+};
+
+/**
+  * Chooses the next wake from the battery level, the failed requests with 
+  * an exponential backoff and jitter, the update cadence of openweathermap,
+  * the commute windows for the travel times and the quiet hours.
+  * Every decision is logged with its reason.
+  * Between the network wakes the scheduler inserts cheap local wakes
+  * without WiFi, the durations of both wake types are logged separately.
+  */
+class SleepScheduler
+{
+protected:
+   /* Data stored in the non volatile memory */
+   struct State
+   {
+      uint8_t  failures;               //!< Failed weather requests in a row
+      bool     localWakes;             //!< Local wakes are allowed until the next network wake
+      time_t   networkWake;            //!< Time of the next network wake
+      time_t   updated;                //!< Time of the frame on the display
+      uint32_t wakeCount[WAKE_TYPES];  //!< Number of the wakes per type
+      uint32_t wakeMs[WAKE_TYPES];     //!< Sum of the wake durations per type
+      uint32_t wakeMaxMs[WAKE_TYPES];  //!< Longest wake per type
+   };
+
+   State state; //!< Current state
+
+   /* Check if the local minute of the day is in a commute window */
+   bool IsCommute(time_t now)
+   {
+      const int windows[][2] = COMMUTE_WINDOWS;
+      time_t    local        = timeZone.Local(now);
+      int       minuteOfDay  = hour(local) * 60 + minute(local);
+
+      if (weekday(local) == 1 || weekday(local) == 7) {
+         return false; // weekend
+      }
+      for (size_t i = 0; i < sizeof(windows) / sizeof(windows[0]); i++) {
+         if (minuteOfDay >= windows[i][0] && minuteOfDay < windows[i][1]) {
+            return true;
+         }
+      }
+      return false;
+   }
+
+   /* Minutes until the end of the local quiet hours, 0 outside of them */
+   int QuietMinutes(time_t now)
+   {
+      time_t local = timeZone.Local(now);
+      int    h     = hour(local);
+      bool quiet = QUIET_HOURS_FROM <= QUIET_HOURS_TO 
+         ? h >= QUIET_HOURS_FROM && h < QUIET_HOURS_TO
+         : h >= QUIET_HOURS_FROM || h < QUIET_HOURS_TO;
+
+      if (!quiet) {
+         return 0;
+      }
+      return ((QUIET_HOURS_TO - h + 24) % 24) * 60 - minute(local);
+   }
+
+public:
+   SleepScheduler()
+   {
+      memset(&state, 0, sizeof(state));
+   }
+
+   /* Load the state from the non volatile memory */
+   void LoadNVS()
+   {
+      nvs_handle nvs_arg;
+      size_t     len = sizeof(state);
+
+      memset(&state, 0, sizeof(state));
+      if (nvs_open("Setting", NVS_READONLY, &nvs_arg) == ESP_OK) {
+         if (nvs_get_blob(nvs_arg, "sleep", &state, &len) != ESP_OK || len != sizeof(state)) {
+            memset(&state, 0, sizeof(state));
+         }
+         nvs_close(nvs_arg);
+      }
+   }
+
+   /* Store the state to the non volatile memory */
+   void SaveNVS()
+   {
+      nvs_handle nvs_arg;
+      nvs_open("Setting", NVS_READWRITE, &nvs_arg);
+      nvs_set_blob(nvs_arg, "sleep", &state, sizeof(state));
+      nvs_commit(nvs_arg);
+      nvs_close(nvs_arg);
+   }
+
+   /* Check if this wake only refreshes the local values of the displayed frame */
+   bool IsLocalWake(time_t now)
+   {
+      LoadNVS();
+      if (LOCAL_WAKE_MINUTES <= 0 || !state.localWakes || state.updated == 0) {
+         return false;
+      }
+      // a changed RTC falls back to a network wake
+      time_t remaining = state.networkWake - now;
+      return remaining > 30 && remaining <= SLEEP_MAX_MINUTES * 60;
+   }
+
+   /* Time of the frame on the display */
+   time_t Updated()
+   {
+      return state.updated;
+   }
+
+   /* Minutes until the next network wake */
+   int NetworkMinutes(time_t now)
+   {
+      return max(1, (int) (state.networkWake - now + 59) / 60);
+   }
+
+   /* Remember the time of the frame that is shown now */
+   void FrameShown(time_t now)
+   {
+      state.updated = now;
+   }
+
+   /* No local wakes until the next network wake, they would draw over the frame of the render server */
+   void DisableLocalWakes()
+   {
+      state.localWakes = false;
+   }
+
+   /* Minutes until the next wake, a local wake if it fits before the next network wake */
+   int SleepMinutes(time_t now)
+   {
+      int minutes = NetworkMinutes(now);
+
+      if (LOCAL_WAKE_MINUTES > 0 && state.localWakes && state.updated != 0 && QuietMinutes(now + LOCAL_WAKE_MINUTES * 60) == 0) {
+         minutes = min(minutes, LOCAL_WAKE_MINUTES);
+      }
+      return constrain(minutes, 1, SLEEP_MAX_MINUTES);
+   }
+
+   /* Log the duration of this wake and store the state */
+   void LogWake(WakeType type, uint32_t ms)
+   {
+      const char *names[WAKE_TYPES] = { "Network", "Local" };
+
+      state.wakeCount[type]++;
+      state.wakeMs[type]   += ms;
+      state.wakeMaxMs[type] = max(state.wakeMaxMs[type], ms);
+      SaveNVS();
+
+      LOG(LOG_WAKE, names[type], (int) ms);
+      for (int i = 0; i < WAKE_TYPES; i++) {
+         if (state.wakeCount[i]) {
+            LOG(LOG_WAKE_STATS, names[i], (int) state.wakeCount[i], (int) (state.wakeMs[i] / state.wakeCount[i]), (int) state.wakeMaxMs[i]);
+         }
+      }
+   }
+
+   /* Choose the sleep time of myData.sleepForMinutes */
+   void Schedule(MyData &myData, time_t now)
+   {
+      String reason;
+      int    minutes;
+
+      LoadNVS();
+      if (!myData.weather.success) {
+         // exponential backoff with +-20% jitter against the hammering of the api
+         state.failures = min(state.failures + 1, 16);
+         minutes = min(SLEEP_RETRY_MINUTES << min(state.failures - 1, 8), SLEEP_RETRY_MAX_MINUTES);
+         minutes = max(1, (int) (minutes * (80 + esp_random() % 41) / 100));
+         reason  = "retry " + String(state.failures) + " after failed weather request";
+      } else {
+         state.failures = 0;
+         if (IsCommute(now)) {
+            minutes = COMMUTE_MINUTES;
+            reason  = "commute window";
+         } else {
+            minutes = SLEEP_MINUTES;
+            reason  = "normal interval";
+         }
+         if (myData.batteryDegraded) {
+            minutes *= 4;
+            reason  += ", degraded battery mode";
+         } else if (myData.batteryCapacity < BATTERY_LOW_CAPACITY) {
+            minutes *= 2;
+            reason  += ", low battery";
+         }
+         // the quiet hours end at the same time with any battery
+         if (QuietMinutes(now) > 0) {
+            minutes = QuietMinutes(now);
+            reason  = "quiet hours";
+         }
+         // a wake in the quiet hours is moved behind them
+         int quiet = QuietMinutes(now + minutes * 60);
+
+         if (quiet > 0) {
+            minutes += quiet;
+            reason  += ", behind the quiet hours";
+         }
+         // wake one minute after the next openweathermap update, the sleep is
+         // shortened by one minute at most, that takes back the delays of the wakes
+         int wake    = minute(now) + minutes;
+         int aligned = (wake + OWM_UPDATE_MINUTES - 3) / OWM_UPDATE_MINUTES * OWM_UPDATE_MINUTES + 1;
+
+         minutes += aligned - wake;
+         reason  += ", aligned to the weather updates";
+      }
+      myData.sleepForMinutes = constrain(minutes, 1, SLEEP_MAX_MINUTES);
+      state.networkWake      = now + myData.sleepForMinutes * 60;
+      state.localWakes       = !myData.batteryDegraded;
+
+      LOG(LOG_SLEEP, myData.sleepForMinutes, reason, myData.batteryCapacity);
+   }
+};
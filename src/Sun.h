@@ -0,0 +1,149 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Sun.h
+  *
+  * Position of the sun, sunrise, sunset and civil twilight at LATITUDE
+  * and LONGITUDE without any request.
+  */
+#pragma once
+#include <math.h>
+#include "TimeZone.h"
+
+#define SUN_RISE_ELEVATION     -0.833f     //!< Elevation of the sun center at sunrise, radius and refraction
+#define SUN_TWILIGHT_ELEVATION -6.0f       //!< Elevation at the begin and the end of the civil twilight
+#define SUN_J2000              946728000L  //!< UTC of the epoch J2000.0, 2000-01-01 12:00
+#define SUN_ITERATIONS         3           //!< Refinements of the crossing times
+
+/* Times of the sun of one local day, 0 if the sun does not cross the elevation */
+struct SunDay
+{
+   time_t dawn;          //!< Begin of the civil twilight
+   time_t sunrise;       //!< Sunrise
+   time_t noon;          //!< Solar noon
+   time_t sunset;        //!< Sunset
+   time_t dusk;          //!< End of the civil twilight
+   float  noonElevation; //!< Elevation at the solar noon in degrees
+};
+
+/**
+  * The algorithm of the NOAA solar calculator (Meeus) in single precision,
+  * the ESP32 only has a float unit. The time is counted from J2000, so the
+  * floats keep enough digits. The times are within a minute of the NOAA
+  * results between the polar circles.
+  */
+class Sun
+{
+protected:
+   float declination; //!< Declination of the last Position() in degrees
+   float eqTime;      //!< Equation of time of the last Position() in minutes
+
+   static float Rad(float deg) { return deg * (float) M_PI / 180; }
+   static float Deg(float rad) { return rad * 180 / (float) M_PI; }
+
+   /* Declination and equation of time at the UTC */
+   void Position(time_t utc)
+   {
+      float jc       = (float) (utc - SUN_J2000) / (86400.0f * 36525);
+      float meanLong = fmodf(280.46646f + jc * (36000.76983f + jc * 0.0003032f), 360);
+      float meanAnom = 357.52911f + jc * (35999.05029f - 0.0001537f * jc);
+      float ecc      = 0.016708634f - jc * (0.000042037f + 0.0000001267f * jc);
+      float center   = sinf(Rad(meanAnom)) * (1.914602f - jc * (0.004817f + 0.000014f * jc))
+                     + sinf(Rad(2 * meanAnom)) * (0.019993f - 0.000101f * jc)
+                     + sinf(Rad(3 * meanAnom)) * 0.000289f;
+      float omega    = Rad(125.04f - 1934.136f * jc);
+      float appLong  = meanLong + center - 0.00569f - 0.00478f * sinf(omega);
+      float obliq    = 23 + (26 + (21.448f - jc * (46.815f + jc * (0.00059f - jc * 0.001813f))) / 60) / 60
+                     + 0.00256f * cosf(omega);
+      float y        = tanf(Rad(obliq) / 2) * tanf(Rad(obliq) / 2);
+      float l        = Rad(meanLong);
+      float m        = Rad(meanAnom);
+
+      declination = Deg(asinf(sinf(Rad(obliq)) * sinf(Rad(appLong))));
+      eqTime      = 4 * Deg(y * sinf(2 * l) - 2 * ecc * sinf(m) + 4 * ecc * y * sinf(m) * cosf(2 * l)
+                          - 0.5f * y * y * sinf(4 * l) - 1.25f * ecc * ecc * sinf(2 * m));
+   }
+
+   /* Hour angle of the last Position() at the UTC in degrees, -180..180 */
+   float HourAngle(time_t utc)
+   {
+      float trueSolar = (float) (((utc % 86400) + 86400) % 86400) / 60 + eqTime + 4 * (float) LONGITUDE;
+      float angle     = fmodf(trueSolar / 4, 360) - 180;
+
+      return angle < -180 ? angle + 360 : (angle >= 180 ? angle - 360 : angle);
+   }
+
+   /* UTC the sun crosses the elevation next to the time, rising or setting, 0 if it does not */
+   time_t Crossing(time_t time, float elevation, bool rising)
+   {
+      for (int i = 0; i < SUN_ITERATIONS; i++) {
+         Position(time);
+
+         float lat = Rad(LATITUDE);
+         float dec = Rad(declination);
+         float cosAngle = (sinf(Rad(elevation)) - sinf(lat) * sinf(dec)) / (cosf(lat) * cosf(dec));
+
+         if (cosAngle < -1 || cosAngle > 1) {
+            return 0; // polar day or night
+         }
+         float  angle = Deg(acosf(cosAngle));
+         time_t noon  = time - (time_t) (HourAngle(time) * 240);
+
+         time = noon + (time_t) ((rising ? -angle : angle) * 240);
+      }
+      return time;
+   }
+
+public:
+   Sun()
+      : declination(0)
+      , eqTime(0)
+   {
+   }
+
+   /* Elevation of the sun center at the UTC in degrees, without refraction */
+   float Elevation(time_t utc)
+   {
+      Position(utc);
+
+      float lat = Rad(LATITUDE);
+      float dec = Rad(declination);
+      float ha  = Rad(HourAngle(utc));
+
+      return Deg(asinf(sinf(lat) * sinf(dec) + cosf(lat) * cosf(dec) * cosf(ha)));
+   }
+
+   /* Times of the local day of the UTC */
+   SunDay Day(time_t utc)
+   {
+      SunDay day;
+      time_t local    = timeZone.Local(utc);
+      time_t midnight = utc - ((local % 86400) + 86400) % 86400;
+      time_t noon     = midnight + 12 * 3600;
+
+      Position(noon);
+      day.noon          = noon - (time_t) (HourAngle(noon) * 240);
+      day.noonElevation = Elevation(day.noon);
+      day.dawn          = Crossing(day.noon, SUN_TWILIGHT_ELEVATION, true);
+      day.sunrise       = Crossing(day.noon, SUN_RISE_ELEVATION, true);
+      day.sunset        = Crossing(day.noon, SUN_RISE_ELEVATION, false);
+      day.dusk          = Crossing(day.noon, SUN_TWILIGHT_ELEVATION, false);
+      return day;
+   }
+};
+
+Sun sun; //!< Sun at the location of the display
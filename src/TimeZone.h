@@ -0,0 +1,366 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file TimeZone.h
+  *
+  * Local time from the UTC with the rules of a POSIX TZ string.
+  */
+#pragma once
+#include <nvs.h>
+#include "Log.h"
+
+#ifndef TIMEZONE
+#define TIMEZONE "CET-1CEST,M3.5.0,M10.5.0/3" //!< POSIX TZ string, e.g. "GMT0BST,M3.5.0/1,M10.5.0"
+#endif
+#define TIMEZONE_YEARS       2  //!< Years in the table of the transitions
+#define TIMEZONE_TRANSITIONS (TIMEZONE_YEARS * 2)
+
+/**
+  * Parses the POSIX TZ string
+  *
+  *    std offset [dst [offset] [,start[/time],end[/time]]]
+  *
+  * with the rules Mm.w.d, Jn and n and precomputes the DST transitions of
+  * the current and the next year into a table in the NVS. The conversion
+  * is a lookup in this table, without any network request.
+  *
+  * The stored table only moves forward with the years. Older years, e.g.
+  * the history of the last week around New Year, are built into a table
+  * in the memory, so alternating years never rewrite the NVS.
+  */
+class TimeZone
+{
+protected:
+   /* Rule of a DST transition */
+   struct Rule
+   {
+      char    type;  //!< 'M' month.week.day, 'J' julian day without Feb 29, 'N' day of the year from 0
+      int     month; //!< Month 1..12 of the M rule
+      int     week;  //!< Week 1..5 of the M rule, 5 is the last one
+      int     day;   //!< Weekday 0 (Sunday)..6 of the M rule, day of the J and N rules
+      int32_t time;  //!< Local time of the transition in seconds of the day
+   };
+
+   /* One transition, the offset applies from its UTC on */
+   struct Transition
+   {
+      int64_t utc;    //!< UTC of the transition
+      int32_t offset; //!< Offset to the UTC in seconds from then on
+   };
+
+   /* Precomputed table, stored in the non volatile memory */
+   struct Table
+   {
+      uint32_t   hash;                              //!< Hash of the TZ string of the table
+      int32_t    firstYear;                         //!< First year of the table
+      int32_t    before;                            //!< Offset before the first transition
+      int32_t    count;                             //!< Number of transitions
+      Transition transitions[TIMEZONE_TRANSITIONS]; //!< Transitions sorted by the UTC
+   };
+
+   Table table;  //!< Table of the current year, stored in the NVS
+   Table older;  //!< Table of a year before the stored one, only in the memory
+   bool  loaded; //!< The table is loaded or built
+
+   int32_t stdOffset; //!< Offset of the standard time to the UTC
+   int32_t dstOffset; //!< Offset of the daylight saving time to the UTC
+   bool    hasDst;    //!< The zone has a daylight saving time
+   Rule    start;     //!< Start of the daylight saving time
+   Rule    end;       //!< End of the daylight saving time
+
+   /* Days since 1970-01-01 of the date, month 1..12 */
+   static int64_t DaysFromCivil(int64_t y, int m, int d)
+   {
+      y -= m <= 2;
+      int64_t era = (y >= 0 ? y : y - 399) / 400;
+      int     yoe = (int) (y - era * 400);
+      int     doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+      int     doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+      return era * 146097 + doe - 719468;
+   }
+
+   /* Year of the days since 1970-01-01 */
+   static int YearOfDays(int64_t days)
+   {
+      days += 719468;
+      int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+      int     doe = (int) (days - era * 146097);
+      int     yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+      int     doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+      int     mp  = (5 * doy + 2) / 153;
+
+      return (int) (yoe + era * 400) + (mp >= 10);
+   }
+
+   static bool IsLeap(int year)
+   {
+      return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+   }
+
+   /* Parse the name of a zone, alphabetic or quoted in <> */
+   static bool ParseName(const char *&p)
+   {
+      const char *begin = p;
+
+      if (*p == '<') {
+         while (*p && *p != '>') {
+            p++;
+         }
+         if (*p != '>') {
+            return false;
+         }
+         p++;
+         return true;
+      }
+      while (isalpha(*p)) {
+         p++;
+      }
+      return p - begin >= 3;
+   }
+
+   /* Parse [+-]hh[:mm[:ss]] into seconds */
+   static bool ParseTime(const char *&p, int32_t &seconds)
+   {
+      int sign  = 1;
+      int parts = 0;
+
+      if (*p == '+' || *p == '-') {
+         sign = *p++ == '-' ? -1 : 1;
+      }
+      if (!isdigit(*p)) {
+         return false;
+      }
+      seconds = 0;
+      for (int32_t unit = 3600; parts < 3; unit /= 60) {
+         int value = 0;
+
+         while (isdigit(*p)) {
+            value = value * 10 + (*p++ - '0');
+         }
+         seconds += value * unit;
+         if (++parts == 3 || *p != ':' || !isdigit(p[1])) {
+            break;
+         }
+         p++;
+      }
+      seconds *= sign;
+      return true;
+   }
+
+   /* Parse a rule Mm.w.d, Jn or n with the optional /time */
+   static bool ParseRule(const char *&p, Rule &rule)
+   {
+      rule.time = 2 * 3600;
+      if (*p == 'M') {
+         rule.type = 'M';
+         rule.month = strtol(p + 1, (char **) &p, 10);
+         if (*p++ != '.') return false;
+         rule.week = strtol(p, (char **) &p, 10);
+         if (*p++ != '.') return false;
+         rule.day = strtol(p, (char **) &p, 10);
+         if (rule.month < 1 || rule.month > 12 || rule.week < 1 || rule.week > 5 || rule.day < 0 || rule.day > 6) {
+            return false;
+         }
+      } else if (*p == 'J' || isdigit(*p)) {
+         rule.type = *p == 'J' ? 'J' : 'N';
+         rule.day  = strtol(p + (*p == 'J'), (char **) &p, 10);
+      } else {
+         return false;
+      }
+      if (*p == '/') {
+         p++;
+         return ParseTime(p, rule.time);
+      }
+      return true;
+   }
+
+   /* Parse the TZ string, false leaves the zone at UTC */
+   bool Parse(const char *tz)
+   {
+      const char *p = tz;
+      int32_t     offset;
+
+      stdOffset = 0;
+      dstOffset = 0;
+      hasDst    = false;
+      if (!ParseName(p) || !ParseTime(p, offset)) {
+         return false;
+      }
+      stdOffset = -offset; // POSIX counts the hours west of Greenwich
+      dstOffset = stdOffset + 3600;
+      if (!*p) {
+         return true;
+      }
+      if (!ParseName(p)) {
+         return false;
+      }
+      if (*p && *p != ',') {
+         if (!ParseTime(p, offset)) {
+            return false;
+         }
+         dstOffset = -offset;
+      }
+      if (*p == ',') {
+         p++;
+         if (!ParseRule(p, start) || *p++ != ',' || !ParseRule(p, end)) {
+            return false;
+         }
+      } else {
+         // the POSIX default rules of the US
+         Rule us[2] = { { 'M', 3, 2, 0, 2 * 3600 }, { 'M', 11, 1, 0, 2 * 3600 } };
+
+         start = us[0];
+         end   = us[1];
+      }
+      hasDst = true;
+      return true;
+   }
+
+   /* Local time of the rule in the year as seconds since 1970 */
+   static int64_t RuleTime(const Rule &rule, int year)
+   {
+      int64_t days;
+
+      if (rule.type == 'M') {
+         int64_t first   = DaysFromCivil(year, rule.month, 1);
+         int     weekday = (int) ((first + 4) % 7 + 7) % 7; // 1970-01-01 was a Thursday
+         int     mday    = 1 + (rule.day - weekday + 7) % 7 + (rule.week - 1) * 7;
+         int     mdays   = rule.month == 12 ? 31 : (int) (DaysFromCivil(year, rule.month + 1, 1) - first);
+
+         while (mday > mdays) {
+            mday -= 7; // week 5 is the last one
+         }
+         days = first + mday - 1;
+      } else if (rule.type == 'J') {
+         // Jn counts 1..365 and never Feb 29
+         days = DaysFromCivil(year, 1, 1) + rule.day - 1 + (IsLeap(year) && rule.day >= 60);
+      } else {
+         days = DaysFromCivil(year, 1, 1) + rule.day;
+      }
+      return days * 86400 + rule.time;
+   }
+
+   /* Hash of the TZ string to detect a changed configuration */
+   static uint32_t Hash(const char *tz)
+   {
+      uint32_t hash = 2166136261u;
+
+      while (*tz) {
+         hash ^= (uint8_t) *tz++;
+         hash *= 16777619u;
+      }
+      return hash;
+   }
+
+   /* Compute the transitions of the table from the first year on */
+   void Build(Table &target, int firstYear)
+   {
+      memset(&target, 0, sizeof(target));
+      target.hash      = Hash(TIMEZONE);
+      target.firstYear = firstYear;
+      if (!Parse(TIMEZONE)) {
+         LOG(LOG_TIMEZONE_INVALID, TIMEZONE);
+      }
+      target.before = stdOffset;
+      if (!hasDst) {
+         return;
+      }
+      for (int year = firstYear; year < firstYear + TIMEZONE_YEARS; year++) {
+         Transition begin = { RuleTime(start, year) - stdOffset, dstOffset };
+         Transition until = { RuleTime(end, year) - dstOffset, stdOffset };
+
+         if (begin.utc < until.utc) {
+            target.transitions[target.count++] = begin;
+            target.transitions[target.count++] = until;
+         } else {
+            // southern hemisphere, the year starts in the daylight saving time
+            target.before = year == firstYear ? dstOffset : target.before;
+            target.transitions[target.count++] = until;
+            target.transitions[target.count++] = begin;
+         }
+      }
+   }
+
+   /* Table of the year, the stored one is rebuilt for a changed TZ string or a later year */
+   const Table &Load(int year)
+   {
+      if (!loaded) {
+         nvs_handle nvs_arg;
+         size_t     len = sizeof(table);
+
+         memset(&table, 0, sizeof(table));
+         if (nvs_open("Setting", NVS_READONLY, &nvs_arg) == ESP_OK) {
+            if (nvs_get_blob(nvs_arg, "timezone", &table, &len) != ESP_OK || len != sizeof(table)) {
+               memset(&table, 0, sizeof(table));
+            }
+            nvs_close(nvs_arg);
+         }
+         loaded = true;
+      }
+      uint32_t hash = Hash(TIMEZONE);
+
+      if (table.hash != hash || year >= table.firstYear + TIMEZONE_YEARS) {
+         nvs_handle nvs_arg;
+
+         Build(table, year);
+         if (nvs_open("Setting", NVS_READWRITE, &nvs_arg) == ESP_OK) {
+            nvs_set_blob(nvs_arg, "timezone", &table, sizeof(table));
+            nvs_commit(nvs_arg);
+            nvs_close(nvs_arg);
+         }
+      }
+      if (year >= table.firstYear) {
+         return table;
+      }
+      if (older.hash != hash || year < older.firstYear || year >= older.firstYear + TIMEZONE_YEARS) {
+         Build(older, year);
+      }
+      return older;
+   }
+
+public:
+   TimeZone()
+      : loaded(false)
+      , stdOffset(0)
+      , dstOffset(0)
+      , hasDst(false)
+   {
+      memset(&table, 0, sizeof(table));
+      memset(&older, 0, sizeof(older));
+   }
+
+   /* Offset of the local time to the UTC in seconds */
+   int32_t Offset(time_t utc)
+   {
+      const Table &rules  = Load(YearOfDays((int64_t) utc / 86400 - (utc < 0 && utc % 86400)));
+      int32_t      offset = rules.before;
+
+      for (int i = 0; i < rules.count && utc >= rules.transitions[i].utc; i++) {
+         offset = rules.transitions[i].offset;
+      }
+      return offset;
+   }
+
+   /* Convert the UTC to the local time */
+   time_t Local(time_t utc)
+   {
+      return utc ? utc + Offset(utc) : 0;
+   }
+};
+
+TimeZone timeZone; //!< Timezone of TIMEZONE
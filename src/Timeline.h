@@ -0,0 +1,236 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Timeline.h
+  *
+  * Profiler of the overlapping phases of one wake with an energy estimate.
+  */
+#pragma once
+#include <nvs.h>
+#include <esp_timer.h>
+#include "Memory.h"
+
+#define TIMELINE_PHASES  16  //!< Max phases of one wake
+#define TIMELINE_NAME    12  //!< Max length of a phase name with the terminating 0
+#define TIMELINE_WIDTH   50  //!< Width of the bars in the log
+#define TIMELINE_HISTORY  8  //!< Profiles of the last wakes in the NVS
+
+// Assumed currents, measure them for your board. The phases add their
+// current to the base current, so phases that overlap are not counted twice.
+#define CURRENT_BASE_MA   45  //!< ESP32 at 240 MHz, the board and the sensors
+#define CURRENT_WIFI_MA   80  //!< Radio during the association and the requests
+#define CURRENT_EPD_MA    60  //!< Power up and waveforms of the EPD
+#define CURRENT_RENDER_MA 25  //!< Second core of the parallel rendering
+
+/**
+  * Collects the start and the duration of the phases of a wake with
+  * microsecond timestamps, logs them as bars so the phases that run in
+  * parallel are visible, estimates the charge of the wake and keeps the
+  * profiles of the last wakes in the NVS. The heap is sampled at the
+  * boundaries of every phase.
+  */
+class Timeline
+{
+protected:
+   /* One phase of the wake */
+   struct Phase
+   {
+      char     name[TIMELINE_NAME]; //!< Name of the phase
+      uint32_t startUs;             //!< Start since the boot
+      uint32_t durationUs;          //!< Duration, 0 while running
+      uint16_t currentMA;           //!< Current on top of the base current
+   };
+
+   /* Profile of one wake, stored in the NVS */
+   struct Profile
+   {
+      uint32_t sequence;                 //!< Number of the wake
+      time_t   time;                     //!< RTC time of the wake
+      uint8_t  type;                     //!< Type of the wake
+      uint8_t  count;                    //!< Number of phases
+      uint32_t durationUs;               //!< Duration of the wake since the boot
+      float    mAh;                      //!< Estimated charge of the wake
+      Phase    phases[TIMELINE_PHASES];  //!< Phases in the order of their start
+   };
+
+   Profile profile;                  //!< Profile of the current wake
+   int     memory[TIMELINE_PHASES];  //!< Index of the phases in the memory tracker
+
+   /* Microseconds since the boot */
+   uint32_t Now()
+   {
+      return (uint32_t) esp_timer_get_time();
+   }
+
+   /* Estimate the charge of the profile */
+   float Charge(const Profile &p)
+   {
+      double mAus = (double) CURRENT_BASE_MA * p.durationUs;
+
+      for (int i = 0; i < p.count; i++) {
+         mAus += (double) p.phases[i].currentMA * p.phases[i].durationUs;
+      }
+      return mAus / 3600e6;
+   }
+
+   /* NVS key of the slot in the ring buffer */
+   String Key(uint32_t sequence)
+   {
+      return "profile" + String(sequence % TIMELINE_HISTORY);
+   }
+
+public:
+   Timeline()
+   {
+      memset(&profile, 0, sizeof(profile));
+   }
+
+   /* Start a phase with its additional current, returns its index for End() */
+   int Begin(const char *name, int currentMA = 0)
+   {
+      if (profile.count >= TIMELINE_PHASES) {
+         return -1;
+      }
+      Phase &phase = profile.phases[profile.count];
+
+      strncpy(phase.name, name, TIMELINE_NAME - 1);
+      phase.name[TIMELINE_NAME - 1] = 0;
+      phase.startUs    = Now();
+      phase.durationUs = 0;
+      phase.currentMA  = currentMA;
+      memory[profile.count] = memoryTracker.Begin(name);
+      return profile.count++;
+   }
+
+   /* End the phase, optional with the millis() the phase really ended */
+   void End(int index, uint32_t ms = 0)
+   {
+      if (index >= 0 && index < profile.count) {
+         Phase   &phase = profile.phases[index];
+         uint32_t end   = ms ? (uint32_t) (ms * 1000ull) : Now();
+
+         phase.durationUs = max(end - phase.startUs, (uint32_t) 1);
+         memoryTracker.End(memory[index]);
+      }
+   }
+
+   /* Log all phases as bars from the boot to the end of the last phase */
+   void Dump()
+   {
+      uint32_t now  = Now();
+      uint32_t span = 1;
+
+      for (int i = 0; i < profile.count; i++) {
+         Phase &phase = profile.phases[i];
+         span = max(span, phase.durationUs ? phase.startUs + phase.durationUs : now);
+      }
+      LOG(LOG_TIMELINE, (int) (span / 1000), (int) (span / 1000 + TIMELINE_WIDTH - 1) / TIMELINE_WIDTH);
+      for (int i = 0; i < profile.count; i++) {
+         Phase   &phase = profile.phases[i];
+         uint32_t end   = phase.durationUs ? phase.startUs + phase.durationUs : now;
+#if LOG_BINARY
+         // the bars are longer than a string argument of a record, the decoder gets the times
+         LOG(LOG_TIMELINE_PHASE, phase.name, (int) (phase.startUs / 1000), (int) (end / 1000), phase.durationUs ? "" : " running");
+#else
+         int      from  = (uint64_t) phase.startUs * TIMELINE_WIDTH / span;
+         int      to    = max(from + 1, (int) ((uint64_t) end * TIMELINE_WIDTH / span));
+         char     bar[TIMELINE_WIDTH + 2];
+
+         for (int x = 0; x < TIMELINE_WIDTH + 1; x++) {
+            bar[x] = x >= from && x < to ? '#' : '.';
+         }
+         bar[TIMELINE_WIDTH + 1] = 0;
+         Serial.printf("%-11s %6d %6d |%s|%s\n", phase.name, (int) (phase.startUs / 1000), (int) (end / 1000),
+            bar, phase.durationUs ? "" : " running");
+#endif
+      }
+   }
+
+   /* Close the profile of this wake, log its charge and store it in the ring buffer */
+   void Save(time_t time, uint8_t type)
+   {
+      nvs_handle nvs_arg;
+      uint32_t   sequence = 0;
+
+      profile.time       = time;
+      profile.type       = type;
+      profile.durationUs = Now();
+      profile.mAh        = Charge(profile);
+      LOG(LOG_WAKE_CHARGE, profile.mAh, (int) (profile.durationUs / 1000));
+
+      if (nvs_open("Setting", NVS_READWRITE, &nvs_arg) == ESP_OK) {
+         nvs_get_u32(nvs_arg, "profiles", &sequence);
+         profile.sequence = ++sequence;
+         nvs_set_blob(nvs_arg, Key(sequence).c_str(), &profile, sizeof(profile));
+         nvs_set_u32(nvs_arg, "profiles", sequence);
+         nvs_commit(nvs_arg);
+         nvs_close(nvs_arg);
+      }
+   }
+
+   /* Print the stored profiles as CSV, one line per phase and one total per wake */
+   void DumpCSV(Print &out)
+   {
+      nvs_handle nvs_arg;
+      uint32_t   sequence = 0;
+      Profile    p;
+
+      if (nvs_open("Setting", NVS_READONLY, &nvs_arg) != ESP_OK) {
+         return;
+      }
+      nvs_get_u32(nvs_arg, "profiles", &sequence);
+      out.println("wake,time,type,phase,start_us,duration_us,current_ma,mah");
+      for (uint32_t s = sequence >= TIMELINE_HISTORY ? sequence - TIMELINE_HISTORY + 1 : 1; s <= sequence; s++) {
+         size_t len = sizeof(p);
+
+         if (nvs_get_blob(nvs_arg, Key(s).c_str(), &p, &len) != ESP_OK || len != sizeof(p) || p.sequence != s) {
+            continue;
+         }
+         for (int i = 0; i < p.count && i < TIMELINE_PHASES; i++) {
+            Phase &phase = p.phases[i];
+            out.printf("%d,%d,%d,%s,%d,%d,%d,%.5f\n", (int) p.sequence, (int) p.time, p.type, phase.name,
+               (int) phase.startUs, (int) phase.durationUs, phase.currentMA,
+               (double) phase.currentMA * phase.durationUs / 3600e6);
+         }
+         out.printf("%d,%d,%d,total,0,%d,%d,%.5f\n", (int) p.sequence, (int) p.time, p.type,
+            (int) p.durationUs, CURRENT_BASE_MA, p.mAh);
+      }
+      nvs_close(nvs_arg);
+   }
+};
+
+Timeline timeline; //!< Phases of the current wake
+
+/**
+  * Phase of the timeline from the construction to the end of the scope.
+  */
+class TimelineScope
+{
+protected:
+   int index; //!< Index of the phase in the timeline
+
+public:
+   TimelineScope(const char *name, int currentMA = 0)
+      : index(timeline.Begin(name, currentMA))
+   {
+   }
+
+   ~TimelineScope()
+   {
+      timeline.End(index);
+   }
+};
@@ -0,0 +1,191 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Trace.h
+  *
+  * Trace events of scopes and counters in the chrome trace format.
+  *
+  * Enable it with "#define TRACE_ENABLED 1" in the Config.h, otherwise all
+  * the macros are empty. Load the exported json into chrome://tracing or
+  * ui.perfetto.dev for the flame chart of a wake.
+  *
+  *    TRACE_SCOPE("name");          // complete event until the end of the scope
+  *    TRACE_FUNCTION();             // same with the name of the function
+  *    TRACE_COUNTER("name", value); // counter event
+  */
+#pragma once
+
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 0
+#endif
+
+#ifndef TRACE_EVENTS
+#define TRACE_EVENTS 2048 //!< Preallocated events, the later events are dropped
+#endif
+
+#if TRACE_ENABLED
+
+#include <atomic>
+#ifdef ARDUINO
+#include <esp_timer.h>
+#else
+#include <chrono>
+#include <stdio.h>
+#endif
+
+/* One trace event, the names must be string literals */
+struct TraceEvent
+{
+   const char *name;  //!< Name of the scope or counter
+   uint32_t    ts;    //!< Start in microseconds since the boot
+   uint32_t    dur;   //!< Duration of a scope in microseconds
+   int32_t     value; //!< Value of a counter
+   char        phase; //!< 'X' complete scope, 'C' counter
+   uint8_t     tid;   //!< Core of the event
+};
+
+TraceEvent       traceEvents[TRACE_EVENTS]; //!< Preallocated event buffer
+std::atomic<int> traceCount(0);             //!< Used events, also the dropped ones
+
+/* Microseconds since the boot */
+inline uint32_t TraceNow()
+{
+#ifdef ARDUINO
+   return (uint32_t) esp_timer_get_time();
+#else
+   static auto start = std::chrono::steady_clock::now();
+   return (uint32_t) std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+#endif
+}
+
+/* Core of the current task */
+inline uint8_t TraceCore()
+{
+#ifdef ARDUINO
+   return xPortGetCoreID();
+#else
+   return 0;
+#endif
+}
+
+/* Reserve and fill the next event */
+inline void TraceAdd(const char *name, char phase, uint32_t ts, uint32_t dur, int32_t value)
+{
+   int index = traceCount.fetch_add(1);
+
+   if (index < TRACE_EVENTS) {
+      TraceEvent &event = traceEvents[index];
+      event.name  = name;
+      event.ts    = ts;
+      event.dur   = dur;
+      event.value = value;
+      event.phase = phase;
+      event.tid   = TraceCore();
+   }
+}
+
+/**
+  * Complete event from the construction to the end of the scope.
+  */
+class TraceScope
+{
+protected:
+   const char *name;  //!< Name of the scope
+   uint32_t    start; //!< Start of the scope
+
+public:
+   TraceScope(const char *n)
+      : name(n)
+      , start(TraceNow())
+   {
+   }
+
+   ~TraceScope()
+   {
+      TraceAdd(name, 'X', start, TraceNow() - start, 0);
+   }
+};
+
+/* Write the events as chrome trace json, piece by piece to the writer */
+template <class Writer> void TraceWrite(Writer write)
+{
+   char line[160];
+   int  count = traceCount < TRACE_EVENTS ? (int) traceCount : TRACE_EVENTS;
+
+   write("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+   for (int i = 0; i < count; i++) {
+      TraceEvent &event = traceEvents[i];
+
+      if (event.phase == 'X') {
+         snprintf(line, sizeof(line), "{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%u,\"dur\":%u,\"pid\":1,\"tid\":%d}%s\n",
+            event.name, (unsigned) event.ts, (unsigned) event.dur, event.tid, i + 1 < count ? "," : "");
+      } else {
+         snprintf(line, sizeof(line), "{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%u,\"pid\":1,\"args\":{\"value\":%d}}%s\n",
+            event.name, (unsigned) event.ts, (int) event.value, i + 1 < count ? "," : "");
+      }
+      write(line);
+   }
+   write("]}\n");
+}
+
+#ifdef ARDUINO
+/* Stream the events as chrome trace json, e.g. to the Serial */
+void TraceExport(Print &out)
+{
+   int count = traceCount;
+
+   if (count > TRACE_EVENTS) {
+      out.printf("Trace buffer full, %d events dropped\n", count - TRACE_EVENTS);
+   }
+   out.println("----- trace begin -----");
+   TraceWrite([&out](const char *text) { out.print(text); });
+   out.println("----- trace end -----");
+}
+#else
+/* Write the events as chrome trace json to the file */
+bool TraceExport(const char *path)
+{
+   FILE *file = fopen(path, "w");
+
+   if (!file) {
+      return false;
+   }
+   TraceWrite([file](const char *text) { fputs(text, file); });
+   fclose(file);
+   return true;
+}
+#endif
+
+#define TRACE_CONCAT2(a, b)           a ## b
+#define TRACE_CONCAT(a, b)            TRACE_CONCAT2(a, b)
+#define TRACE_SCOPE(name)             TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_FUNCTION()              TRACE_SCOPE(__func__)
+#define TRACE_COUNTER(name, value)    TraceAdd(name, 'C', TraceNow(), 0, (int32_t) (value))
+
+#else
+
+#define TRACE_SCOPE(name)
+#define TRACE_FUNCTION()
+#define TRACE_COUNTER(name, value)
+
+#ifdef ARDUINO
+inline void TraceExport(Print &out) {}
+#else
+inline bool TraceExport(const char *path) { return false; }
+#endif
+
+#endif
@@ -0,0 +1,291 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file Traffic.h
+  *
+  * Routes of the commute and the learned travel times in the 'traffic'
+  * flash partition.
+  */
+#pragma once
+#include <esp_partition.h>
+#include <nvs.h>
+#include <TimeLib.h>
+#include "Log.h"
+
+/* Place of the commute */
+struct CommutePlace
+{
+   const char *name;  //!< Name on the display
+   const char *coord; //!< "latitude,longitude" of the place
+};
+
+/* Route between two of the COMMUTE_PLACES */
+struct CommuteRoute
+{
+   int from; //!< Index of the origin
+   int to;   //!< Index of the destination
+};
+
+#ifndef COMMUTE_PLACES
+#define COMMUTE_PLACES { { CITY_NAME, HOME_COORD }, { WORK_NAME, WORK_COORD } } //!< Places of the routes
+#endif
+#ifndef COMMUTE_ROUTES
+#define COMMUTE_ROUTES { { 0, 1 }, { 1, 0 } } //!< Routes shown in the traffic panel
+#endif
+#define COMMUTE_MAX_ROUTES 4 //!< Max number of the COMMUTE_ROUTES
+
+const CommutePlace commutePlaces[] = COMMUTE_PLACES;
+const CommuteRoute commuteRoutes[] = COMMUTE_ROUTES;
+const int          commuteRouteCount = sizeof(commuteRoutes) / sizeof(commuteRoutes[0]);
+
+static_assert(sizeof(commuteRoutes) / sizeof(commuteRoutes[0]) <= COMMUTE_MAX_ROUTES, "Too many COMMUTE_ROUTES");
+
+#define TRAFFIC_PARTITION "traffic"  //!< Label of the partition in partitions.csv
+#define TRAFFIC_MAGIC     0x32465254 //!< 'TRF2'
+#define TRAFFIC_BUCKETS   (7 * 24 * 4) //!< 15 minute buckets of a week
+#define TRAFFIC_SLOT      (6 * 4096) //!< Flash of one copy of the table, a multiple of the sector
+#define TRAFFIC_FRACTION  16         //!< Fixed point steps of a second in the cells
+#define TRAFFIC_WINDOW    8          //!< Responses a bucket averages over, the older ones fade out
+#define TRAFFIC_MIN_COUNT 3          //!< Responses of a bucket before it predicts
+#define TRAFFIC_MAX_SKIPS 3          //!< Skipped requests of a route in a row, the next one checks the model
+#ifndef TRAFFIC_MAX_INTERVAL
+#define TRAFFIC_MAX_INTERVAL 120     //!< Max half width in seconds of the 95% interval of a prediction that skips the request
+#endif
+
+/**
+  * The duration in traffic of every route per weekday and 15 minute
+  * bucket, learned from the responses of the distance matrix. A bucket
+  * keeps the moving mean and the mean absolute deviation of its last
+  * responses in 1/16 seconds, so the rounded steps of the averages
+  * neither drift nor stop short of a small deviation. If the deviation
+  * is small enough, the mean is shown instead of a new request, but
+  * never more than TRAFFIC_MAX_SKIPS times in a row, so the error of the
+  * predictions is still measured.
+  *
+  * The table is written to the next of the slots of the partition after
+  * every response, the newest valid slot is loaded. The counters of the
+  * hits and the errors are kept in the NVS.
+  */
+class TrafficModel
+{
+protected:
+   /* Learned duration of one route and bucket */
+   struct Cell
+   {
+      uint32_t mean;   //!< Mean duration in 1/TRAFFIC_FRACTION seconds
+      uint16_t spread; //!< Mean absolute deviation in 1/TRAFFIC_FRACTION seconds
+      uint8_t  count;  //!< Responses of the bucket
+      uint8_t  unused; //!< Alignment
+   };
+
+   /* Table stored in a slot of the partition */
+   struct Table
+   {
+      uint32_t magic;                                     //!< TRAFFIC_MAGIC, written after the rest of the slot
+      uint32_t sequence;                                  //!< Increments with every store, the highest one is loaded
+      uint32_t keys[COMMUTE_MAX_ROUTES];                  //!< Hash of the places of the route of the cells
+      Cell     cells[COMMUTE_MAX_ROUTES][TRAFFIC_BUCKETS]; //!< Learned durations
+   };
+
+   static_assert(sizeof(Table) <= TRAFFIC_SLOT, "The traffic table does not fit into a slot");
+
+   /* Counters stored in the non volatile memory */
+   struct Stats
+   {
+      uint32_t routes;                    //!< Routes needed by the wakes
+      uint32_t predicted;                 //!< Routes shown from the model without a request
+      uint32_t checks;                    //!< Responses of the buckets that could predict
+      uint32_t errorSum;                  //!< Sum of the absolute errors of the checks in seconds
+      uint32_t elements;                  //!< Requested matrix elements
+      uint8_t  skips[COMMUTE_MAX_ROUTES]; //!< Skipped requests of the route in a row
+   };
+
+   Table *table;  //!< Table of the wake, NULL before Load()
+   int    slot;   //!< Slot of the loaded table
+   Stats  stats;  //!< Current counters
+   bool   dirty;  //!< The table changed since the Load()
+
+   const esp_partition_t *Partition()
+   {
+      return esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, TRAFFIC_PARTITION);
+   }
+
+   /* Hash of the coordinates of the route */
+   static uint32_t Key(int route)
+   {
+      String   places = String(commutePlaces[commuteRoutes[route].from].coord) + "|" + commutePlaces[commuteRoutes[route].to].coord;
+      uint32_t hash   = 2166136261u;
+
+      for (unsigned i = 0; i < places.length(); i++) {
+         hash ^= (uint8_t) places[i];
+         hash *= 16777619u;
+      }
+      return hash;
+   }
+
+   /* Step of a moving average towards the difference, rounded to the nearest */
+   static int32_t Step(int32_t difference, int window)
+   {
+      return (difference + (difference < 0 ? -window : window) / 2) / window;
+   }
+
+   /* Bucket of the local time, weekday and quarter of an hour */
+   static int Bucket(time_t local)
+   {
+      return (weekday(local) - 1) * 96 + hour(local) * 4 + minute(local) / 15;
+   }
+
+public:
+   TrafficModel()
+      : table(NULL)
+      , slot(-1)
+      , dirty(false)
+   {
+      memset(&stats, 0, sizeof(stats));
+   }
+
+   /* Load the newest table and the counters, the buckets of changed routes start empty */
+   void Load()
+   {
+      const esp_partition_t *partition = Partition();
+      nvs_handle             nvs_arg;
+      size_t                 len = sizeof(stats);
+      uint32_t               sequence = 0;
+
+      if (table) {
+         return;
+      }
+      memset(&stats, 0, sizeof(stats));
+      if (nvs_open("Setting", NVS_READONLY, &nvs_arg) == ESP_OK) {
+         if (nvs_get_blob(nvs_arg, "traffic", &stats, &len) != ESP_OK || len != sizeof(stats)) {
+            memset(&stats, 0, sizeof(stats));
+         }
+         nvs_close(nvs_arg);
+      }
+      if (!(table = (Table *) malloc(sizeof(Table)))) {
+         return;
+      }
+      for (int s = 0; partition && s < (int) (partition->size / TRAFFIC_SLOT); s++) {
+         uint32_t header[2];
+
+         if (esp_partition_read(partition, s * TRAFFIC_SLOT, header, sizeof(header)) == ESP_OK &&
+             header[0] == TRAFFIC_MAGIC && header[1] >= sequence) {
+            sequence = header[1];
+            slot     = s;
+         }
+      }
+      if (slot < 0 || esp_partition_read(partition, slot * TRAFFIC_SLOT, table, sizeof(Table)) != ESP_OK) {
+         memset(table, 0, sizeof(Table));
+         table->magic = TRAFFIC_MAGIC;
+      }
+      for (int r = 0; r < commuteRouteCount; r++) {
+         if (table->keys[r] != Key(r)) {
+            table->keys[r] = Key(r);
+            memset(table->cells[r], 0, sizeof(table->cells[r]));
+            dirty = true;
+         }
+      }
+   }
+
+   /* Store a changed table to the next slot and the counters, then free the table */
+   void Save()
+   {
+      const esp_partition_t *partition = Partition();
+      nvs_handle             nvs_arg;
+
+      if (!table) {
+         return;
+      }
+      if (dirty && partition && partition->size >= TRAFFIC_SLOT) {
+         int next = (slot + 1) % (partition->size / TRAFFIC_SLOT);
+
+         uint32_t header  = 2 * sizeof(uint32_t); // magic and sequence
+         uint32_t address = next * TRAFFIC_SLOT;
+
+         // the header is written last, an interrupted write leaves a slot that Load() skips
+         table->sequence++;
+         if (esp_partition_erase_range(partition, address, TRAFFIC_SLOT) == ESP_OK &&
+             esp_partition_write(partition, address + header, (uint8_t *) table + header, sizeof(Table) - header) == ESP_OK &&
+             esp_partition_write(partition, address, table, header) == ESP_OK) {
+            slot = next;
+         }
+      }
+      nvs_open("Setting", NVS_READWRITE, &nvs_arg);
+      nvs_set_blob(nvs_arg, "traffic", &stats, sizeof(stats));
+      nvs_commit(nvs_arg);
+      nvs_close(nvs_arg);
+
+      LOG(LOG_TRAFFIC_STATS, (int) stats.predicted, (int) stats.routes, (int) (stats.checks ? stats.errorSum / stats.checks : 0),
+         (int) stats.checks, (int) stats.elements);
+      free(table);
+      table = NULL;
+      dirty = false;
+   }
+
+   /* Check if the route is shown from the model, the seconds are its prediction */
+   bool Predict(int route, time_t local, uint32_t &seconds)
+   {
+      Load();
+      stats.routes++;
+      if (!table) {
+         return false;
+      }
+      const Cell &cell     = table->cells[route][Bucket(local)];
+      uint32_t    interval = cell.spread * 5 / 2 / TRAFFIC_FRACTION; // the deviation is about 0.8 sigma
+
+      if (cell.count < TRAFFIC_MIN_COUNT || interval > TRAFFIC_MAX_INTERVAL || stats.skips[route] >= TRAFFIC_MAX_SKIPS) {
+         return false;
+      }
+      seconds = (cell.mean + TRAFFIC_FRACTION / 2) / TRAFFIC_FRACTION;
+      stats.skips[route]++;
+      stats.predicted++;
+      return true;
+   }
+
+   /* Learn the duration of a response, measures the error of the bucket before */
+   void Learn(int route, time_t local, uint32_t seconds)
+   {
+      Load();
+      if (!table) {
+         return;
+      }
+      Cell    &cell    = table->cells[route][Bucket(local)];
+      int32_t  measured = min(seconds, (uint32_t) UINT16_MAX) * TRAFFIC_FRACTION;
+      int32_t  error    = measured - (int32_t) cell.mean;
+      int      window   = min(cell.count + 1, TRAFFIC_WINDOW);
+
+      if (cell.count >= TRAFFIC_MIN_COUNT) {
+         stats.checks++;
+         stats.errorSum += (abs(error) + TRAFFIC_FRACTION / 2) / TRAFFIC_FRACTION;
+         LOG(LOG_TRAFFIC_CHECK, commutePlaces[commuteRoutes[route].from].name, commutePlaces[commuteRoutes[route].to].name,
+            (int) ((cell.mean + TRAFFIC_FRACTION / 2) / TRAFFIC_FRACTION), (int) seconds);
+      }
+      cell.mean   = cell.count ? cell.mean + Step(error, window) : measured;
+      cell.spread = cell.count ? min(cell.spread + Step(abs(error) - cell.spread, window), (int32_t) UINT16_MAX) : 0;
+      cell.count  = min(cell.count + 1, 255);
+      stats.skips[route] = 0;
+      dirty = true;
+   }
+
+   /* Count the elements of a matrix request */
+   void Requested(int elements)
+   {
+      stats.elements += elements;
+   }
+};
+
+TrafficModel trafficModel; //!< Learned durations of the commute routes
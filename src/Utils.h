@@ -23,24 +23,7 @@
 #include <time.h>
 #include <TimeLib.h> 
 
-/* Convert the RTC date time to DD.MM.YYYY HH:MM:SS */
-String getRTCDateTimeString() 
-{
-   char       buff[32];
-   rtc_date_t date_struct;
-   rtc_time_t time_struct;
-   
-   M5.RTC.getDate(&date_struct);
-   M5.RTC.getTime(&time_struct);
-
-   sprintf(buff,"%02d.%02d.%04d %02d:%02d:%02d",
-      date_struct.day,  date_struct.mon, date_struct.year,
-      time_struct.hour, time_struct.min, time_struct.sec);
-
-   return (String) buff;
-}
-
-/* Read the RTC timestamp */
+/* Read the RTC timestamp, use wakeClock.Now() for the time of the wake */
 time_t GetRTCTime()
 {
   tmElements_t tmSet;
@@ -60,40 +43,12 @@ time_t GetRTCTime()
   return makeTime(tmSet);
 }
 
-/* Convert the date part of the RTC timestamp */
-String getRTCDateString() 
-{
-   char       buff[32];
-   rtc_date_t date_struct;
-   
-   M5.RTC.getDate(&date_struct);
-
-   sprintf(buff,"%d.%d.%04d",
-      date_struct.day,  date_struct.mon, date_struct.year);
-
-   return (String) buff;
-}
-
-/* Convert the time part of the RTC timestamp */
-String getRTCTimeString() 
-{
-   char       buff[32];
-   rtc_time_t time_struct;
-   
-   M5.RTC.getTime(&time_struct);
-
-   sprintf(buff,"%d:%02d:%02d",      
-      time_struct.hour, time_struct.min, time_struct.sec);
-
-   return (String) buff;
-}
-
 /* Convert the time_t to the DD.MM.YYYY HH:MM:SS format */
 String getDateTimeString(time_t rawtime)
 {
-   char buff[32];
+   char buff[72]; // six int fields of up to 11 characters
    
-   sprintf(buff,"%02d.%02d.%04d %02d:%02d:%02d",
+   snprintf(buff, sizeof(buff), "%02d.%02d.%04d %02d:%02d:%02d",
       day(rawtime), month(rawtime), year(rawtime),
       hour(rawtime), minute(rawtime), second(rawtime));
 
@@ -211,4 +166,14 @@ String GermanDate(String intDateString)
       return intDateString.substring(8,10) + separator + intDateString.substring(5,7) + separator + intDateString.substring(0,4);
    }
    return intDateString;
-}
\ No newline at end of file
+}
+
+/* FNV-1a hash of a memory block, e.g. to detect changed frame buffers */
+uint32_t HashBytes(const uint8_t *data, size_t len, uint32_t hash = 2166136261u)
+{
+   for (size_t i = 0; i < len; i++) {
+      hash ^= data[i];
+      hash *= 16777619u;
+   }
+   return hash;
+}
@@ -17,28 +17,32 @@
 /**
   * @file Weather.h
   * 
-  * Class for reading all the weather data from openweathermap.
+  * Weather data of all the providers.
   */
 #pragma once
-#include <HTTPClient.h>
-#include <WiFiClient.h>
-#include <ArduinoJson.h>
 #include "Utils.h"
+#include "TimeZone.h"
+#include "Decimator.h"
 
 #define MAX_FORECAST_DAILY 5
-#define MAX_FORECAST_HORLY 25
 #define MIN_RAIN 10
 
+#ifndef FORECAST_HOURS
+#define FORECAST_HOURS  12  //!< Hours of the forecast graph, up to the 48 of the onecall response
+#endif
+#define FORECAST_POINTS 25  //!< Max points of the forecast graph, about 15 pixels apart
+#define NOWCAST_BARS    30  //!< Max bars of the rain strip of the next hour, about 4 pixels wide
+
 /**
-  * Class for reading all the weather data from openweathermap.
+  * Weather data in the units of openweathermap, filled by one of the
+  * providers of WeatherService.h.
   */
 class Weather
 {
 public:
    bool   success;                        // success of request
 
-   time_t currentTime;                     //!< Current timestamp
-   int    currentTimeOffset;               //!< Current timezone
+   time_t currentTime;                     //!< Current UTC timestamp
 
    time_t sunrise;                         //!< Sunrise timestamp
    time_t sunset;                          //!< Sunset timestamp
@@ -46,6 +50,12 @@ public:
    float  temp;                       
    float  tempFeelsLike;              
    float  humidity;                   
+   float  pressure;                        //!< Air pressure in hPa
+   int    airQuality;                      //!< Air quality index of openweathermap, 1 good .. 5 very poor, 0 unknown
+   float  airPm25;                         //!< Fine particles in ug/m3
+   float  airPm10;                         //!< Coarse particles in ug/m3
+   float  airNo2;                          //!< Nitrogen dioxide in ug/m3
+   float  airO3;                           //!< Ozone in ug/m3
 
    time_t dailyTime[MAX_FORECAST_DAILY];          //!< timestamp of the hourly forecast
    float  dailyMaxTemp[MAX_FORECAST_DAILY];       //!< max temperature forecast
@@ -55,120 +65,48 @@ public:
    int    maxRain;                         //!< maximum rain in mm of the hourly forecast
    int    maxTemp;                         //!< maximum temp in C of the hourly forecast
    int    minTemp;                         //!< minimum temp in C of the hourly forecast
-   float  forecastHourlyTemp[MAX_FORECAST_HORLY];   //!< hourly temperature
-   float  forecastHourlyRain[MAX_FORECAST_HORLY];      //!< rain in mm/h
-   float  forecastHourlySnow[MAX_FORECAST_HORLY];      //!< rain in mm/h
+   Decimator<FORECAST_POINTS> forecastTemp; //!< temperature of the next FORECAST_HOURS
+   Decimator<FORECAST_POINTS> forecastRain; //!< rain in mm/h of the next FORECAST_HOURS
+   Decimator<FORECAST_POINTS> forecastSnow; //!< snow in mm/h of the next FORECAST_HOURS
+   Decimator<NOWCAST_BARS>    nowcastRain;  //!< rain in mm/h of the next hour, empty without minutely data
 
-protected:
+public:
    /* Convert UTC time to local time */
-   time_t LocalTime(time_t time)
-   {
-      return time + currentTimeOffset;
-   }
-
-   /* Calls the openweathermap request and deserialisation the json data. */
-   bool GetOpenWeatherJsonDoc(DynamicJsonDocument &doc)
+   static time_t LocalTime(time_t time)
    {
-      WiFiClient client;
-      HTTPClient http;
-      String     uri;
-      
-      uri += "/data/2.5/onecall";
-      uri += "?lat=" + String((float) LATITUDE, 5);
-      uri += "&lon=" + String((float) LONGITUDE, 5);
-      uri += "&units=metric&lang=de&exclude=minutely";
-      uri += "&appid=" + (String) OPENWEATHER_API;
-
-      Serial.printf("Requesting %s to %s:%d\n", uri.c_str(), OPENWEATHER_SRV, OPENWEATHER_PORT);
-
-      client.stop();
-      http.begin(client, OPENWEATHER_SRV, OPENWEATHER_PORT, uri);
-      
-      int httpCode = http.GET();
-      
-      Serial.printf("Read %d bytes\n", http.getSize());
-
-      if (httpCode != HTTP_CODE_OK) {
-         Serial.printf("GetWeather failed, error: %s", http.errorToString(httpCode).c_str());
-         client.stop();
-         http.end();
-         return false;
-      } else {
-         DeserializationError error = deserializeJson(doc, http.getStream());
-         
-         if (error) {
-            Serial.print(F("deserializeJson() failed: "));
-            Serial.println(error.c_str());
-            return false;
-         } else {
-            return true;
-         }
-      }
+      return timeZone.Local(time);
    }
 
-   /* Fill from the json data into the internal data. */
-   bool Fill(const JsonObject &root) 
+   /* Scales of the forecast graph from the filled series */
+   void Finish()
    {
-      Clear();
-
-      currentTimeOffset = root["timezone_offset"].as<int>();
-      currentTime       = LocalTime(root["current"]["dt"].as<int>());
-
-      sunrise           = LocalTime(root["current"]["sunrise"].as<int>());
-      sunset            = LocalTime(root["current"]["sunset"].as<int>());
-      windspeed         = root["current"]["wind_speed"].as<float>();
-      temp              = root["current"]["temp"].as<float>();
-      tempFeelsLike     = root["current"]["feels_like"].as<float>();
-      humidity          = root["current"]["humidity"].as<float>();
-
-      JsonArray daily_list = root["daily"];
-      for (int i = 0; i < MAX_FORECAST_DAILY; i++) {
-         if (i < daily_list.size()) {
-            dailyTime[i]    = LocalTime(daily_list[i]["dt"].as<int>());
-            dailyMaxTemp[i] = daily_list[i]["temp"]["max"].as<float>();
-            dailyMain[i]    = daily_list[i]["weather"][0]["main"].as<char *>();
-            dailyIcon[i]    = daily_list[i]["weather"][0]["icon"].as<char *>();
-         }
-      }
-
-      JsonArray hourly_list = root["hourly"];
       maxRain = 1;
       minTemp = 0;
       maxTemp = 5;
-      for (int i = 0; i < MAX_FORECAST_HORLY; i++) {
-         if (i < hourly_list.size()) {
-            forecastHourlyTemp[i]  = hourly_list[i]["temp"].as<float>();
-            if (forecastHourlyTemp[i] > maxTemp) {
-               maxTemp = forecastHourlyTemp[i] + 1;
-            }
-            if (forecastHourlyTemp[i] < minTemp) {
-               minTemp = forecastHourlyTemp[i] - 1;
-            }
-            forecastHourlyRain[i]     = hourly_list[i]["rain"]["1h"].as<float>();
-            if (forecastHourlyRain[i] > maxRain) {
-               maxRain = forecastHourlyRain[i] + 1;
-            }
-            forecastHourlySnow[i]     = hourly_list[i]["snow"]["1h"].as<float>();
-            if (forecastHourlySnow[i] > maxRain) {
-               maxRain = forecastHourlySnow[i] + 1;
-            }
+      if (forecastTemp.Size()) {
+         if (forecastTemp.Highest() > maxTemp) {
+            maxTemp = forecastTemp.Highest() + 1;
          }
-      } 
-      
-
-      return true;
+         if (forecastTemp.Lowest() < minTemp) {
+            minTemp = forecastTemp.Lowest() - 1;
+         }
+         if (max(forecastRain.Highest(), forecastSnow.Highest()) > maxRain) {
+            maxRain = max(forecastRain.Highest(), forecastSnow.Highest()) + 1;
+         }
+      }
    }
 
 public:
    Weather()
       : currentTime(0)
-      , currentTimeOffset(0)
       , sunrise(0)
       , sunset(0)
       , windspeed(0)
       , temp(0)
       , tempFeelsLike(0)
       , humidity(0)
+      , pressure(0)
+      , airQuality(0)
       , maxRain(MIN_RAIN)
    {
       Clear();
@@ -178,28 +116,23 @@ public:
    void Clear()
    {
       currentTime       = 0;
-      currentTimeOffset = 0;
       sunrise           = 0;
       sunset            = 0;
       windspeed         = 0;
       temp              = 0;
       tempFeelsLike     = 0;
       humidity          = 0;
+      pressure          = 0;
+      airQuality        = 0;
+      airPm25           = 0;
+      airPm10           = 0;
+      airNo2            = 0;
+      airO3             = 0;
       maxRain           = MIN_RAIN;
       memset(dailyMaxTemp,       0, sizeof(dailyMaxTemp));
-      memset(forecastHourlyTemp, 0, sizeof(forecastHourlyTemp));
-      memset(forecastHourlyRain, 0, sizeof(forecastHourlyRain));
-      memset(forecastHourlySnow, 0, sizeof(forecastHourlySnow));
-   }
-
-   /* Start the request and the filling. */
-   bool Get()
-   {
-      DynamicJsonDocument doc(35 * 1024);
-   
-      success = GetOpenWeatherJsonDoc(doc);
-      success = success && Fill(doc.as<JsonObject>());
-      
-      return success;
+      forecastTemp.Begin(0);
+      forecastRain.Begin(0);
+      forecastSnow.Begin(0);
+      nowcastRain.Begin(0);
    }
 };
@@ -0,0 +1,46 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file WeatherProvider.h
+  *
+  * Common interface of the weather services.
+  */
+#pragma once
+#include "Weather.h"
+#include "HttpFetch.h"
+
+/**
+  * A weather service that fills all the fields of the Weather in the
+  * units of openweathermap. Fetch() runs in a task of its own, so it
+  * only uses the given weather and the thread safe HttpFetchJson().
+  */
+class WeatherProvider
+{
+public:
+   virtual ~WeatherProvider()
+   {
+   }
+
+   /* Name of the provider in the log */
+   virtual const char *Name() = 0;
+
+   /* Source of the requests in the NetStats */
+   virtual NetSource Source() = 0;
+
+   /* Request and fill the weather, false on any error */
+   virtual bool Fetch(Weather &weather) = 0;
+};
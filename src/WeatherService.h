@@ -0,0 +1,190 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file WeatherService.h
+  *
+  * Hedged requests and the failover across the weather providers.
+  */
+#pragma once
+#include "Weather.h"
+#include "OpenWeather.h"
+#include "OpenMeteo.h"
+#include "Timeline.h"
+#include "Trace.h"
+#include "Log.h"
+
+OpenWeather openWeather; //!< Onecall request of openweathermap
+OpenMeteo   openMeteo;   //!< Forecast request of open-meteo
+
+#ifndef WEATHER_PROVIDERS
+#define WEATHER_PROVIDERS { &openWeather, &openMeteo } //!< Providers in the order of the requests, the primary first
+#endif
+#ifndef WEATHER_HEDGE_PERCENT
+#define WEATHER_HEDGE_PERCENT 90    //!< Percentile of the request time of a provider before the next one is requested too
+#endif
+#define WEATHER_HEDGE_MS      3000  //!< Hedge delay of a provider without statistics
+#define WEATHER_TIMEOUT_MS    20000 //!< Max wait for the first answer
+#define WEATHER_JOIN_MS       8000  //!< Max wait for the slower requests before the WiFi stops
+#define WEATHER_TASK_STACK    12288 //!< Stack of a request task, the TLS handshake runs in it
+
+WeatherProvider *weatherProviders[] = WEATHER_PROVIDERS;
+
+#define WEATHER_PROVIDER_COUNT ((int) (sizeof(weatherProviders) / sizeof(weatherProviders[0])))
+
+/**
+  * Requests the primary provider in a task of its own. If it did not
+  * answer within the WEATHER_HEDGE_PERCENT percentile of its request times
+  * of the NetStats, the next provider is requested in parallel, a failed
+  * provider is replaced at once. The first complete answer is taken, the
+  * slower requests go on until Join(), their answers are dropped.
+  *
+  * The percentile is the upper bound of the log2 bucket, so the hedge
+  * starts a bit late rather than too early.
+  */
+class WeatherService
+{
+protected:
+   /* One request of a provider */
+   struct Attempt
+   {
+      WeatherProvider   *provider; //!< Provider of the request
+      Weather           *weather;  //!< Filled by the task, owned by the attempt
+      EventGroupHandle_t events;   //!< Signals the end of the task
+      EventBits_t        bit;      //!< Bit of the attempt
+      uint32_t           start;    //!< Start in ms
+      uint32_t           ms;       //!< Request time in ms
+      volatile bool      running;  //!< The task still runs
+      bool               success;  //!< The weather is complete
+   };
+
+   Attempt            attempts[WEATHER_PROVIDER_COUNT]; //!< Requests of the current wake
+   EventGroupHandle_t events;                           //!< Bits of the finished attempts
+
+   /* Task of one request */
+   static void FetchTask(void *param)
+   {
+      Attempt *attempt = (Attempt *) param;
+
+      attempt->success = attempt->provider->Fetch(*attempt->weather);
+      attempt->ms      = millis() - attempt->start;
+      attempt->running = false;
+      xEventGroupSetBits(attempt->events, attempt->bit);
+      vTaskDelete(NULL);
+   }
+
+   /* Start the request of the provider */
+   void Start(int index)
+   {
+      Attempt &attempt = attempts[index];
+
+      attempt.provider = weatherProviders[index];
+      attempt.weather  = new Weather();
+      attempt.events   = events;
+      attempt.bit      = 1 << index;
+      attempt.start    = millis();
+      attempt.ms       = 0;
+      attempt.running  = true;
+      attempt.success  = false;
+      // the arduino loop task waits on core 1, the requests run next to the WiFi stack on core 0
+      xTaskCreatePinnedToCore(FetchTask, "WeatherTask", WEATHER_TASK_STACK, &attempt, 1, NULL, 0);
+   }
+
+   /* Time in ms after the start of the provider until the next one is requested */
+   uint32_t HedgeMs(int index)
+   {
+      int ms = netStats.Latency(weatherProviders[index]->Source(), NET_TOTAL, WEATHER_HEDGE_PERCENT);
+
+      return ms < 0 ? WEATHER_HEDGE_MS : ms;
+   }
+
+public:
+   WeatherService()
+      : events(NULL)
+   {
+      memset(attempts, 0, sizeof(attempts));
+   }
+
+   /* Request the providers until the first answer, true if the weather was filled */
+   bool Get(Weather &weather)
+   {
+      TimelineScope phase("weather", CURRENT_WIFI_MA);
+      TRACE_FUNCTION();
+      uint32_t start   = millis();
+      int      started = 0;
+      int      failed  = 0;
+      int      winner  = -1;
+
+      if (!events) {
+         events = xEventGroupCreate();
+      }
+      xEventGroupClearBits(events, (1 << WEATHER_PROVIDER_COUNT) - 1);
+      HttpFetchBegin();
+      Start(started++);
+
+      while (winner < 0 && failed < started && millis() - start < WEATHER_TIMEOUT_MS) {
+         uint32_t    elapsed = millis() - attempts[started - 1].start;
+         uint32_t    hedge   = started < WEATHER_PROVIDER_COUNT ? HedgeMs(started - 1) : WEATHER_TIMEOUT_MS - (attempts[started - 1].start - start);
+         uint32_t    timeout = elapsed < hedge ? hedge - elapsed : 0;
+         EventBits_t bits    = xEventGroupWaitBits(events, (1 << started) - 1, pdTRUE, pdFALSE, pdMS_TO_TICKS(timeout));
+
+         for (int i = 0; i < started; i++) {
+            if (!(bits & attempts[i].bit)) {
+               continue;
+            }
+            if (attempts[i].success && winner < 0) {
+               winner = i;
+            } else if (!attempts[i].success) {
+               LOG(LOG_WEATHER_FAILED, attempts[i].provider->Name(), (int) attempts[i].ms);
+               failed++;
+            }
+         }
+         if (winner < 0 && started < WEATHER_PROVIDER_COUNT && (!bits || failed == started)) {
+            if (!bits) {
+               LOG(LOG_WEATHER_HEDGE, attempts[started - 1].provider->Name(), (int) hedge, weatherProviders[started]->Name());
+            }
+            Start(started++);
+         }
+      }
+
+      if (winner >= 0) {
+         weather         = *attempts[winner].weather;
+         weather.success = true;
+         LOG(LOG_WEATHER, attempts[winner].provider->Name(), (int) attempts[winner].ms, started, WEATHER_PROVIDER_COUNT);
+      } else {
+         weather.success = false;
+      }
+      return weather.success;
+   }
+
+   /* Wait for the slower requests and free the attempts, an attempt still running after WEATHER_JOIN_MS is left to the deep sleep */
+   void Join()
+   {
+      uint32_t start = millis();
+
+      for (int i = 0; i < WEATHER_PROVIDER_COUNT; i++) {
+         while (attempts[i].running && millis() - start < WEATHER_JOIN_MS) {
+            xEventGroupWaitBits(events, attempts[i].bit, pdTRUE, pdFALSE, pdMS_TO_TICKS(WEATHER_JOIN_MS - (millis() - start)));
+         }
+         if (attempts[i].weather && !attempts[i].running) {
+            delete attempts[i].weather;
+            attempts[i].weather = NULL;
+         }
+      }
+   }
+};
+
+WeatherService weatherService; //!< Weather of the first answering provider
@@ -0,0 +1,293 @@
+/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file WidgetCache.h
+  * 
+  * Cache of rendered widget pixels in the 'widgets' flash partition.
+  */
+#pragma once
+#include <esp_partition.h>
+#include <nvs.h>
+#include "Utils.h"
+#include "Log.h"
+
+#define WIDGET_CACHE_PARTITION "widgets"   //!< Label of the partition in partitions.csv
+#define WIDGET_CACHE_SLOT      8192        //!< Bytes of one cache slot, a multiple of the 4 KB flash sector
+#define WIDGET_CACHE_BYTES     (32 * WIDGET_CACHE_SLOT) //!< Byte budget of the cache
+#define WIDGET_CACHE_SLOTS     (WIDGET_CACHE_BYTES / WIDGET_CACHE_SLOT)
+
+/**
+  * Widgets that change rarely store their rendered pixels keyed by a hash 
+  * of their inputs. On a hit the widget is copied from the flash instead of
+  * drawn again. The PSRAM does not survive the shutdown of the M5Paper, 
+  * so the pixels are kept in the flash and the index in the NVS. 
+  * The least recently used slot is replaced when the budget is used up.
+  *
+  * The pixels are copied row by row with memcpy between the frame buffer
+  * of the canvas and the slot, only the half bytes at an odd left or
+  * right edge are merged. A stored widget is kept in the memory until
+  * SaveNVS(), so no flash sector is erased while the frame is rendered.
+  */
+class WidgetCache
+{
+protected:
+   /* One cached widget */
+   struct Slot
+   {
+      uint32_t key;     //!< Hash of the widget inputs, 0 = free slot
+      uint16_t x;       //!< Left position, the rows keep its half byte alignment
+      uint16_t dx;      //!< Width of the widget
+      uint16_t dy;      //!< Height of the widget
+      uint16_t unused;  //!< Padding
+      uint32_t lastUse; //!< Use counter value of the last hit or store
+   };
+
+   /* Index stored in the non volatile memory */
+   struct Index
+   {
+      uint32_t useCounter;               //!< Incremented on every lookup
+      uint32_t hits;                     //!< Hits of all wakes
+      uint32_t misses;                   //!< Misses of all wakes
+      Slot     slots[WIDGET_CACHE_SLOTS]; //!< The cache slots
+   };
+
+   Index             index;      //!< Current index
+   uint8_t          *pending[WIDGET_CACHE_SLOTS]; //!< Pixels stored in this wake, written to the flash by SaveNVS()
+   uint32_t          wakeHits;   //!< Hits of this wake
+   uint32_t          wakeMisses; //!< Misses of this wake
+   SemaphoreHandle_t mutex;      //!< The render workers use the cache in parallel
+
+   const esp_partition_t *Partition()
+   {
+      return esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, WIDGET_CACHE_PARTITION);
+   }
+
+   /* Bytes of a row, the row starts at the byte of the pixel x in the frame buffer */
+   static int RowBytes(int x, int dx)
+   {
+      return (x + dx - 1) / 2 - x / 2 + 1;
+   }
+
+   /* Only widgets completely inside the canvas are cached */
+   bool IsInside(M5EPD_Canvas &canvas, int x, int y, int dx, int dy)
+   {
+      return canvas.frameBuffer(1) && (canvas.width() & 1) == 0 && dx > 0 && dy > 0 &&
+         x >= 0 && y >= 0 && x + dx <= canvas.width() && y + dy <= canvas.height() &&
+         RowBytes(x, dx) * dy <= WIDGET_CACHE_SLOT;
+   }
+
+   /* Find the slot of a key, -1 if not cached */
+   int Find(uint32_t key, int x, int dx, int dy)
+   {
+      for (int i = 0; i < WIDGET_CACHE_SLOTS; i++) {
+         Slot &slot = index.slots[i];
+         if (slot.key == key && (slot.x & 1) == (x & 1) && slot.dx == dx && slot.dy == dy) {
+            return i;
+         }
+      }
+      return -1;
+   }
+
+   /* Copy the rows of the widget into the canvas, the pixels left and right of it stay */
+   static void WriteRows(M5EPD_Canvas &canvas, int x, int y, int dx, int dy, const uint8_t *pixels)
+   {
+      uint8_t *frame = (uint8_t *) canvas.frameBuffer(1);
+      int      bytes = RowBytes(x, dx);
+
+      for (int row = 0; row < dy; row++) {
+         uint8_t       *dst   = frame + ((y + row) * canvas.width() + x) / 2;
+         const uint8_t *src   = pixels + row * bytes;
+         uint8_t        first = dst[0];
+         uint8_t        last  = dst[bytes - 1];
+
+         memcpy(dst, src, bytes);
+         if (x & 1) {
+            dst[0] = (first & 0xF0) | (src[0] & 0x0F);
+         }
+         if ((x + dx) & 1) {
+            dst[bytes - 1] = (src[bytes - 1] & 0xF0) | (last & 0x0F);
+         }
+      }
+   }
+
+   /* Copy the rows of the widget out of the canvas */
+   static void ReadRows(M5EPD_Canvas &canvas, int x, int y, int dx, int dy, uint8_t *pixels)
+   {
+      const uint8_t *frame = (const uint8_t *) canvas.frameBuffer(1);
+      int            bytes = RowBytes(x, dx);
+
+      for (int row = 0; row < dy; row++) {
+         memcpy(pixels + row * bytes, frame + ((y + row) * canvas.width() + x) / 2, bytes);
+      }
+   }
+
+   /* Free slot or the least recently used one */
+   int Evict()
+   {
+      int lru = 0;
+
+      for (int i = 0; i < WIDGET_CACHE_SLOTS; i++) {
+         if (index.slots[i].key == 0) {
+            return i;
+         }
+         if (index.slots[i].lastUse < index.slots[lru].lastUse) {
+            lru = i;
+         }
+      }
+      return lru;
+   }
+
+public:
+   WidgetCache()
+      : wakeHits(0)
+      , wakeMisses(0)
+      , mutex(NULL)
+   {
+      memset(&index, 0, sizeof(index));
+      memset(pending, 0, sizeof(pending));
+   }
+
+   /* Load the index from the non volatile memory */
+   void LoadNVS()
+   {
+      nvs_handle nvs_arg;
+      size_t     len = sizeof(index);
+
+      if (!mutex) {
+         mutex = xSemaphoreCreateMutex();
+      }
+      memset(&index, 0, sizeof(index));
+      if (nvs_open("Setting", NVS_READONLY, &nvs_arg) == ESP_OK) {
+         if (nvs_get_blob(nvs_arg, "widgets", &index, &len) != ESP_OK || len != sizeof(index)) {
+            memset(&index, 0, sizeof(index));
+         }
+         nvs_close(nvs_arg);
+      }
+   }
+
+   /* Write the widgets stored in this wake to the flash and the index to the non volatile memory */
+   void SaveNVS()
+   {
+      const esp_partition_t *partition = Partition();
+      nvs_handle             nvs_arg;
+
+      for (int i = 0; i < WIDGET_CACHE_SLOTS; i++) {
+         if (!pending[i]) {
+            continue;
+         }
+         Slot  &slot = index.slots[i];
+         size_t len  = RowBytes(slot.x, slot.dx) * slot.dy;
+
+         if (!partition || esp_partition_erase_range(partition, i * WIDGET_CACHE_SLOT, WIDGET_CACHE_SLOT) != ESP_OK ||
+             esp_partition_write(partition, i * WIDGET_CACHE_SLOT, pending[i], len) != ESP_OK) {
+            slot.key = 0;
+         }
+         free(pending[i]);
+         pending[i] = NULL;
+      }
+      nvs_open("Setting", NVS_READWRITE, &nvs_arg);
+      nvs_set_blob(nvs_arg, "widgets", &index, sizeof(index));
+      nvs_commit(nvs_arg);
+      nvs_close(nvs_arg);
+   }
+
+   /* Copy the cached widget into the canvas, false on a miss */
+   bool Blit(M5EPD_Canvas &canvas, int x, int y, int dx, int dy, uint32_t key)
+   {
+      const esp_partition_t *partition = Partition();
+      
+      if (!partition || !mutex || !IsInside(canvas, x, y, dx, dy)) {
+         return false;
+      }
+
+      xSemaphoreTake(mutex, portMAX_DELAY);
+      int slot = Find(key, x, dx, dy);
+      index.useCounter++;
+      if (slot >= 0) {
+         index.slots[slot].lastUse = index.useCounter;
+         index.hits++;
+         wakeHits++;
+      } else {
+         index.misses++;
+         wakeMisses++;
+      }
+      xSemaphoreGive(mutex);
+      if (slot < 0) {
+         return false;
+      }
+
+      size_t   len    = RowBytes(x, dx) * dy;
+      uint8_t *pixels = (uint8_t *) malloc(len);
+
+      if (!pixels) {
+         return false;
+      }
+      bool read = true;
+
+      // a widget stored in this wake is not in the flash yet
+      xSemaphoreTake(mutex, portMAX_DELAY);
+      if (pending[slot]) {
+         memcpy(pixels, pending[slot], len);
+      } else {
+         read = esp_partition_read(partition, slot * WIDGET_CACHE_SLOT, pixels, len) == ESP_OK;
+      }
+      xSemaphoreGive(mutex);
+      if (read) {
+         WriteRows(canvas, x, y, dx, dy, pixels);
+      }
+      free(pixels);
+      return read;
+   }
+
+   /* Store the drawn widget in the cache, it is written to the flash by SaveNVS() */
+   bool Store(M5EPD_Canvas &canvas, int x, int y, int dx, int dy, uint32_t key)
+   {
+      const esp_partition_t *partition = Partition();
+
+      if (!partition || !mutex || !IsInside(canvas, x, y, dx, dy) || 
+          partition->size < WIDGET_CACHE_BYTES) {
+         return false;
+      }
+
+      uint8_t *pixels = (uint8_t *) malloc(RowBytes(x, dx) * dy);
+
+      if (!pixels) {
+         return false;
+      }
+      ReadRows(canvas, x, y, dx, dy, pixels);
+
+      xSemaphoreTake(mutex, portMAX_DELAY);
+      int   slot  = Evict();
+      Slot &entry = index.slots[slot];
+
+      free(pending[slot]);
+      pending[slot] = pixels;
+      entry.key     = key;
+      entry.x       = x;
+      entry.dx      = dx;
+      entry.dy      = dy;
+      entry.lastUse = ++index.useCounter;
+      xSemaphoreGive(mutex);
+      return true;
+   }
+
+   /* Print the hit and miss counters */
+   void Dump()
+   {
+      LOG(LOG_WIDGET_CACHE, (int) wakeHits, (int) wakeMisses, (int) index.hits, (int) index.misses);
+   }
+};
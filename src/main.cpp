@@ -31,85 +31,202 @@
 #include "EPDWifi.h"
 #include "SHT30.h"
 #include "Utils.h"
-#include "Weather.h"
+#include "WeatherService.h"
 #include "Astronaut.h"
 #include "Corona.h"
 #include "Maps.h"
+#include "Proxy.h"
+#include "FrameClient.h"
+#include "Sleep.h"
+#include "Timeline.h"
+#include "Trace.h"
+#include "Clock.h"
+#include "History.h"
 
 MyData         myData;            // The collection of the global data
 Astronaut      astronaut;         // REST client for astonauts
 Corona         corona;         // REST client for corona date
 Maps           maps;             // google maps client
+Proxy          proxy;            // aggregation proxy of all the data
+FrameClient    frameClient;      // frames of the render server
 WeatherDisplay myDisplay(myData); // The global display helper class
+SleepScheduler sleepScheduler;    // Chooses the time of the next wake
 
-bool SetRTCDateTime(MyData &myData)
+void shutdown(WakeType type) 
+{   
+   int minutes = sleepScheduler.SleepMinutes(wakeClock.Now());
+
+   timeline.Dump();
+   memoryTracker.Dump();
+   memoryTracker.SaveNVS();
+   timeline.Save(wakeClock.Now(), type);
+   netStats.SaveNVS();
+   sleepScheduler.LogWake(type, millis());
+   TraceExport(Serial);
+   logger.Flush();
+   ShutdownEPD(minutes * 60);
+}
+
+/* Append the values of this wake to the history, the values not read in this wake repeat the last ones */
+void recordHistory(time_t now)
 {
-   time_t time = myData.weather.currentTime;
-
-   if (time > 0) {
-      rtc_time_t RTCtime;
-      rtc_date_t RTCDate;
-   
-      Serial.println("Epochtime: " + String(time));
-      
-      RTCDate.year = year(time);
-      RTCDate.mon  = month(time);
-      RTCDate.day  = day(time);
-      M5.RTC.setDate(&RTCDate);
-   
-      RTCtime.hour = hour(time);
-      RTCtime.min  = minute(time);
-      RTCtime.sec  = second(time);
-      M5.RTC.setTime(&RTCtime);
-      return true;
-   } 
-   return false;
+   float values[HISTORY_SERIES];
+
+   if (!wakeClock.Valid()) {
+      return;
+   }
+   values[HISTORY_INDOOR_TEMP]     = myData.sht30Temperatur;
+   values[HISTORY_INDOOR_HUMIDITY] = myData.sht30Humidity;
+   values[HISTORY_OUTDOOR_TEMP]    = myData.weather.success ? myData.weather.temp : NAN;
+   values[HISTORY_PRESSURE]        = myData.weather.success ? myData.weather.pressure : NAN;
+   values[HISTORY_BATTERY]         = myData.batteryVolt > 0 ? myData.batteryVolt : NAN;
+   history.Append(now, values);
 }
 
-void getSleepTime(MyData &myData)
+/* Sync the clock if it is due, an invalid clock is set from the time of the data */
+void syncClock(bool valid, time_t time)
 {
-   rtc_time_t RTCtime;
-   M5.RTC.getTime(&RTCtime);
-   int8_t hour = RTCtime.hour;
-   int8_t minute = RTCtime.min;
-
-   if (!myData.weather.success) {
-      myData.sleepForMinutes = 2;
-   } else if (hour < 5) {
-      // less frequent update between 0:00 and 5:00 
-      myData.sleepForMinutes = min((5 - hour) * 60 - minute, 120);
-   } else {
-      myData.sleepForMinutes = 30;
+   if (wakeClock.SyncDue()) {
+      int phase = timeline.Begin("ntp", CURRENT_WIFI_MA);
+      if (!wakeClock.Sync() && !wakeClock.Valid() && valid) {
+         wakeClock.Set(time);
+      }
+      timeline.End(phase);
    }
 }
 
-void shutdown(int sleepForMinutes) 
-{   
-   ShutdownEPD(sleepForMinutes * 60);
+/* Show the frame of the render server, false if the panel has to fetch and draw the data itself */
+bool renderedWake()
+{
+#ifdef RENDER_SRV
+   time_t now = wakeClock.Now();
+
+   // the frame shows the next wake, so it is scheduled as if the weather is there
+   myData.weather.success = true;
+   sleepScheduler.Schedule(myData, now);
+   if (!frameClient.Get(myData, now)) {
+      myData.weather.success = false;
+      return false;
+   }
+   syncClock(myData.weather.success, frameClient.Time());
+   now = wakeClock.Now();
+   sleepScheduler.DisableLocalWakes();
+   recordHistory(now);
+   StopWiFi();
+
+   int phase = timeline.Begin("push", CURRENT_EPD_MA);
+   frameClient.Update(now, myData.batteryDegraded);
+   timeline.End(phase);
+   sleepScheduler.FrameShown(now);
+   return true;
+#else
+   return false;
+#endif
 }
 
-/* Start and M5Paper instance */
-void setup()
+/* Fetch all the data and show the whole frame, the association was started in setup() */
+void networkWake(int wifiPhase)
 {
-   InitEPD(false);
-   if (StartWiFi(myData.wifiRSSI)) {
-      GetBatteryValues(myData);
-      GetSHT30Values(myData);
-      astronaut.GetAstronauts(myData);
-      corona.GetCorona(myData);
-      maps.GetMaps(myData);
-      if (myData.weather.Get()) {
-         SetRTCDateTime(myData);
+   int phase = timeline.Begin("battery");
+   GetBatteryValues(myData, wakeClock.Now());
+   timeline.End(phase);
+
+   phase = timeline.Begin("sht30");
+   GetSHT30Values(myData);
+   timeline.End(phase);
+
+   bool connected = WaitWiFi(myData.wifiRSSI);
+
+   timeline.End(wifiPhase, wifiLinkUpMs);
+   if (connected && !renderedWake()) {
+      // one request to the proxy if there is one, otherwise all the services
+      bool weather = proxy.Get(myData);
+
+      if (!weather) {
+         if (!myData.batteryDegraded) {
+            astronaut.GetAstronauts(myData);
+            corona.GetCorona(myData);
+            maps.GetMaps(myData);
+         }
+         weather = weatherService.Get(myData.weather);
       }
 
-      getSleepTime(myData);
-      M5.EPD.Clear(true);
+      syncClock(weather, myData.weather.currentTime);
+
+      time_t now = wakeClock.Now();
+
+      sleepScheduler.Schedule(myData, now);
+      recordHistory(now);
       myData.Dump();
-      myDisplay.Show();
+      weatherService.Join();
       StopWiFi();
+
+      myDisplay.Show(now);
+      sleepScheduler.FrameShown(now);
+   } else if (!connected) {
+      // no weather request, the scheduler backs off like on a failed one
+      sleepScheduler.Schedule(myData, wakeClock.Now());
+      recordHistory(wakeClock.Now());
+   }
+   shutdown(WAKE_NETWORK);
+}
+
+/* Refresh only the indoor values and the status of the shown frame without WiFi */
+void localWake()
+{
+   int phase = timeline.Begin("sht30");
+   GetSHT30Values(myData);
+   timeline.End(phase);
+   recordHistory(wakeClock.Now());
+
+   myData.sleepForMinutes = sleepScheduler.NetworkMinutes(wakeClock.Now());
+   myDisplay.ShowLocal(wakeClock.Now(), sleepScheduler.Updated());
+   shutdown(WAKE_LOCAL);
+}
+
+/* 
+ * Start and M5Paper instance.
+ * The wifi association runs in the background during the slow 
+ * initialization of the EPD and the reading of the sensors.
+ */
+void setup()
+{
+   int wifiPhase = -1;
+
+   InitPower();
+   // holding the button while switching on forces a network wake,
+   // holding it up prints the stored wake profiles and request statistics
+   M5.BtnP.read();
+   M5.BtnL.read();
+   bool local   = !M5.BtnP.isPressed() && sleepScheduler.IsLocalWake(wakeClock.Now());
+   bool profile = M5.BtnL.isPressed();
+
+   if (!local) {
+      wifiPhase = timeline.Begin("wifi", CURRENT_WIFI_MA);
+      BeginWiFi();
+   }
+
+   // a local wake skips the fixed second of M5.begin()
+   int phase = timeline.Begin("epd", CURRENT_EPD_MA);
+   if (local) {
+      InitEPDLocal();
+   } else {
+      InitEPD(false);
    }
+   timeline.End(phase);
+   logger.Begin();
 
-   shutdown(myData.sleepForMinutes);
+   if (profile) {
+      timeline.DumpCSV(Serial);
+      netStats.Dump(Serial);
+      logger.PrintPersisted(Serial);
+      history.Dump(Serial);
+   }
+   if (local) {
+      localWake();
+   } else {
+      networkWake(wifiPhase);
+   }
 }
 
 /* Main loop. Never reached because of shutdown */
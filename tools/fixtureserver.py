@@ -0,0 +1,268 @@
+#!/usr/bin/env python3
+#
+#   Copyright (C) 2021 SFini
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 3 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+"""
+Local fixture server of the weather providers, to test the providers and
+the hedging of src/WeatherService.h without the real services.
+
+   tools/fixtureserver.py --port 8080 --delay openweathermap=2500 --fail open-meteo=0.5
+
+and point the firmware at the host in the Config.h:
+
+   #define OPENWEATHER_SRV  "192.168.1.2"
+   #define OPENWEATHER_PORT 8080
+   #define OPENMETEO_SRV    "192.168.1.2"
+   #define OPENMETEO_PORT   8080
+
+The onecall request of openweathermap and the forecast request of
+open-meteo are answered with the same synthetic weather of the current
+hour, a passing rain front and a cold night, so both providers must show
+the same frame. The air pollution request of openweathermap answers a
+moderate air quality. With --fixtures DIR the files onecall.json,
+air_pollution.json and forecast.json of the directory are served
+instead, e.g. recorded responses of the real services, as well as
+astros.json, districts.json, germany.json and distancematrix.json.
+
+The other services of the panel are answered too, so the aggregation
+proxy of host/proxy can poll all its sections from this server:
+/astros.json of open-notify, /districts/<ags> and /germany of the corona
+api and the distance matrix of google, 10 minutes slower in the rush
+hour from 16 to 18.
+
+The connections are kept open like the real services do, --chunked sends
+the bodies with the chunked transfer encoding instead of a Content-Length,
+both must leave the connection ready for the next request of the
+HttpSession.
+
+--delay adds the milliseconds to every answer of the provider, --fail
+answers the fraction of the requests with a 503. Every request is printed
+with the provider, the delay and the status.
+"""
+import argparse
+import json
+import math
+import os
+import random
+import sys
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import parse_qs, urlparse
+
+PROVIDERS = {"/data/2.5/onecall": "openweathermap", "/data/2.5/air_pollution": "openweathermap", "/v1/forecast": "open-meteo",
+             "/astros.json": "open-notify", "/districts/": "corona", "/germany": "corona",
+             "/maps/api/distancematrix/json": "maps"}
+FIXTURES  = {"/data/2.5/onecall": "onecall.json", "/data/2.5/air_pollution": "air_pollution.json", "/v1/forecast": "forecast.json",
+             "/astros.json": "astros.json", "/districts/": "districts.json", "/germany": "germany.json",
+             "/maps/api/distancematrix/json": "distancematrix.json"}
+
+# WMO weather code of the open-meteo days and the main text and icon of openweathermap
+CONDITIONS = [(0, "Clear", "01d"), (3, "Clouds", "04d"), (61, "Rain", "10d"), (71, "Snow", "13d"), (2, "Clouds", "03d")]
+
+
+def weather(now):
+    """ Synthetic weather of the hours from now, in the units of openweathermap """
+    hour  = now - now % 3600
+    hours = []
+    for h in range(49):
+        t    = hour + h * 3600
+        temp = 8 + 6 * math.sin((t % 86400) / 86400 * 2 * math.pi - math.pi / 2)
+        rain = max(0.0, 2.5 - abs(h - 6) * 0.8)   # front passing in six hours
+        snow = 0.7 if 30 <= h < 34 else 0.0       # snow in the next night
+        hours.append((t, round(temp, 2), round(rain, 2), round(snow, 2)))
+    minutes = [(hour + 60 * m, round(max(0.0, (m - 40) * 0.1), 2)) for m in range(61)]
+    days    = [(hour - hour % 86400 + d * 86400, 10 + d, CONDITIONS[d % len(CONDITIONS)]) for d in range(5)]
+    return {
+        "time": now, "temp": hours[0][1], "feels": hours[0][1] - 2, "humidity": 71, "pressure": 1013,
+        "wind": 3.4, "sunrise": now - now % 86400 + 6 * 3600, "sunset": now - now % 86400 + 19 * 3600,
+        "hours": hours, "minutes": minutes, "days": days,
+    }
+
+
+def onecall(w):
+    """ Onecall response of openweathermap """
+    return {
+        "current": {"dt": w["time"], "sunrise": w["sunrise"], "sunset": w["sunset"], "temp": w["temp"],
+                    "feels_like": w["feels"], "pressure": w["pressure"], "humidity": w["humidity"],
+                    "wind_speed": w["wind"]},
+        "minutely": [{"dt": t, "precipitation": p} for t, p in w["minutes"]],
+        "hourly": [dict({"dt": t, "temp": temp}, **({"rain": {"1h": rain}} if rain else {}),
+                        **({"snow": {"1h": snow}} if snow else {})) for t, temp, rain, snow in w["hours"]],
+        "daily": [{"dt": t + 12 * 3600, "temp": {"max": tmax}, "weather": [{"main": main, "icon": icon}]}
+                  for t, tmax, (_, main, icon) in w["days"]],
+    }
+
+
+def air_pollution(w):
+    """ Air pollution response of openweathermap of the current hour """
+    return {
+        "coord": {"lon": 0, "lat": 0},
+        "list": [{"dt": w["time"] - w["time"] % 3600, "main": {"aqi": 3},
+                  "components": {"co": 230.31, "no": 0.5, "no2": 21.42, "o3": 88.69, "so2": 1.67,
+                                 "pm2_5": 14.8, "pm10": 19.31, "nh3": 2.41}}],
+    }
+
+
+def astros():
+    """ Astronauts of open-notify """
+    people = ["Astronaut %d" % i for i in range(7)]
+    return {"message": "success", "number": len(people), "people": [{"name": n, "craft": "ISS"} for n in people]}
+
+
+def district(ags):
+    """ Incidence of the district of the corona api """
+    return {"data": {ags: {"ags": ags, "name": "Bremen", "weekIncidence": 42.3}},
+            "meta": {"lastUpdate": time.strftime("%Y-%m-%dT%H:%M:%S.000Z", time.gmtime())}}
+
+
+def distancematrix(query):
+    """ Distance matrix of the origins and destinations, slower from 16 to 18 """
+    origins      = query.get("origins", [""])[0].split("|")
+    destinations = query.get("destinations", [""])[0].split("|")
+    rush         = 16 <= time.localtime().tm_hour < 18
+    rows         = []
+    for o in range(len(origins)):
+        elements = []
+        for d in range(len(destinations)):
+            seconds = 0 if o == d else 1500 + 120 * (o + d) + (600 if rush else 0)
+            elements.append({"status": "OK", "duration": {"value": 1500}, "duration_in_traffic": {"value": seconds}})
+        rows.append({"elements": elements})
+    return {"status": "OK", "origin_addresses": origins, "destination_addresses": destinations, "rows": rows}
+
+
+def endpoint(path):
+    """ Known path of the request, the districts end with the ags """
+    if path.startswith("/districts/"):
+        return "/districts/"
+    return path if path in PROVIDERS else None
+
+
+def forecast(w, query):
+    """ Forecast response of open-meteo, the hours and the quarters as requested """
+    hours    = w["hours"][:int(query.get("forecast_hours", ["49"])[0])]
+    quarters = [(w["minutes"][q * 15][0], round(sum(p for _, p in w["minutes"][q * 15:q * 15 + 15]) / 60, 2))
+                for q in range(int(query.get("forecast_minutely_15", ["4"])[0]))]
+    days     = w["days"][:int(query.get("forecast_days", ["5"])[0])]
+    return {
+        "current": {"time": w["time"], "interval": 900, "temperature_2m": w["temp"], "relative_humidity_2m": w["humidity"],
+                    "apparent_temperature": w["feels"], "pressure_msl": w["pressure"], "wind_speed_10m": w["wind"]},
+        "minutely_15": {"time": [t for t, _ in quarters], "precipitation": [p for _, p in quarters]},
+        "hourly": {"time": [h[0] for h in hours], "temperature_2m": [h[1] for h in hours],
+                   "rain": [h[2] for h in hours], "showers": [0.0 for _ in hours],
+                   "snowfall": [round(h[3] * 0.7, 2) for h in hours]},
+        "daily": {"time": [d[0] for d in days], "weather_code": [d[2][0] for d in days],
+                  "temperature_2m_max": [d[1] for d in days],
+                  "sunrise": [w["sunrise"] + i * 86400 for i in range(len(days))],
+                  "sunset": [w["sunset"] + i * 86400 for i in range(len(days))]},
+    }
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    disable_nagle_algorithm = True  # no delayed ack between the header and the body
+
+    def do_GET(self):
+        url      = urlparse(self.path)
+        path     = endpoint(url.path)
+        provider = PROVIDERS.get(path)
+        options  = self.server.options
+        status   = 200
+        if provider is None:
+            status = 404
+            body   = b'{"error": "unknown request"}'
+        else:
+            delay = options.delay.get(provider, 0) + random.uniform(0, options.jitter)
+            time.sleep(delay / 1000)
+            if random.random() < options.fail.get(provider, 0):
+                status = 503
+                body   = b'{"error": "fixture failure"}'
+            else:
+                body = json.dumps(self.answer(path, url.path, parse_qs(url.query))).encode()
+        self.send_response(status)
+        self.send_header("Content-Type", "application/json")
+        if options.chunked:
+            self.send_header("Transfer-Encoding", "chunked")
+            self.end_headers()
+            for start in range(0, len(body), 1024):
+                chunk = body[start:start + 1024]
+                self.wfile.write(b"%x\r\n%s\r\n" % (len(chunk), chunk))
+            self.wfile.write(b"0\r\n\r\n")
+        else:
+            self.send_header("Content-Length", str(len(body)))
+            self.end_headers()
+            self.wfile.write(body)
+        self.requests += 1
+        sys.stdout.write("%s %-14s %5d bytes %s, request %d of the connection\n" % (
+            time.strftime("%H:%M:%S"), provider or url.path, len(body), status, self.requests))
+        sys.stdout.flush()
+
+    def setup(self):
+        super().setup()
+        self.requests = 0
+
+    def answer(self, path, full, query):
+        if self.server.options.fixtures:
+            with open(os.path.join(self.server.options.fixtures, FIXTURES[path])) as f:
+                return json.load(f)
+        w = weather(int(time.time()))
+        if path == "/data/2.5/onecall":
+            return onecall(w)
+        if path == "/data/2.5/air_pollution":
+            return air_pollution(w)
+        if path == "/astros.json":
+            return astros()
+        if path == "/districts/":
+            return district(full[len(path):])
+        if path == "/germany":
+            return {"weekIncidence": 51.7}
+        if path == "/maps/api/distancematrix/json":
+            return distancematrix(query)
+        return forecast(w, query)
+
+    def log_message(self, format, *args):
+        pass
+
+
+def provider_values(text, cast):
+    values = {}
+    for item in text or []:
+        name, value = item.split("=")
+        if name not in PROVIDERS.values():
+            sys.exit("unknown provider %s, one of %s" % (name, ", ".join(sorted(set(PROVIDERS.values())))))
+        values[name] = cast(value)
+    return values
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--delay", action="append", metavar="PROVIDER=MS", help="delay of every answer")
+    parser.add_argument("--jitter", type=float, default=0, metavar="MS", help="random extra delay of every answer")
+    parser.add_argument("--fail", action="append", metavar="PROVIDER=FRACTION", help="fraction of 503 answers")
+    parser.add_argument("--chunked", action="store_true", help="chunked bodies instead of a Content-Length")
+    parser.add_argument("--fixtures", metavar="DIR", help="serve the recorded responses of the directory")
+    options       = parser.parse_args()
+    options.delay = provider_values(options.delay, float)
+    options.fail  = provider_values(options.fail, float)
+
+    server         = ThreadingHTTPServer(("", options.port), Handler)
+    server.options = options
+    print("Serving %s on port %d" % (", ".join(sorted(set(PROVIDERS.values()))), options.port))
+    server.serve_forever()
+
+
+if __name__ == "__main__":
+    main()
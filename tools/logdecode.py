@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+#
+#   Copyright (C) 2021 SFini
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 3 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+"""
+Decode the binary log records of the M5Paper.
+
+Capture the raw serial output, for example with
+
+   pio device monitor --raw > monitor.bin
+
+and call:
+
+   tools/logdecode.py monitor.bin
+
+The records are printed with their time since the boot, the text output
+in between (the diagnostic tables, the boot messages) is passed through.
+The formats are read from src/LogMessages.h, decode the log with the
+same version of the table as the firmware.
+"""
+import os
+import re
+import struct
+import sys
+
+SYNC     = 0x1e
+MESSAGES = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "src", "LogMessages.h")
+
+
+def load_formats(path):
+    formats = []
+    with open(path) as f:
+        for match in re.finditer(r'LOG_MESSAGE\((\w+),\s*"(.*)"\)', f.read()):
+            formats.append((match.group(1), match.group(2).replace("%u", "%d")))
+    return formats
+
+
+def decode_args(payload):
+    args = []
+    pos  = 0
+    while pos < len(payload):
+        tag  = chr(payload[pos])
+        pos += 1
+        if tag == 'i':
+            args.append(struct.unpack_from("<i", payload, pos)[0])
+            pos += 4
+        elif tag == 'u':
+            args.append(struct.unpack_from("<I", payload, pos)[0])
+            pos += 4
+        elif tag == 'f':
+            args.append(struct.unpack_from("<f", payload, pos)[0])
+            pos += 4
+        elif tag == 's':
+            size = payload[pos]
+            args.append(payload[pos + 1:pos + 1 + size].decode("utf-8", "replace"))
+            pos += 1 + size
+        else:
+            raise ValueError("unknown argument type %r" % tag)
+    return tuple(args)
+
+
+def decode_record(payload, formats):
+    ms, id = struct.unpack_from("<IH", payload, 0)
+    if id >= len(formats):
+        return "%8d.%03d unknown message %d" % (ms // 1000, ms % 1000, id)
+    name, format = formats[id]
+    try:
+        text = format % decode_args(payload[6:])
+    except (ValueError, TypeError, struct.error) as e:
+        text = "%s: %s" % (name, e)
+    return "%8d.%03d %s" % (ms // 1000, ms % 1000, text)
+
+
+def decode(data, formats, out):
+    pos  = 0
+    text = bytearray()
+    while pos < len(data):
+        if data[pos] == SYNC and pos + 2 < len(data):
+            size = data[pos + 1]
+            end  = pos + 2 + size
+            if size >= 6 and end < len(data):
+                payload = data[pos + 2:end]
+                if sum(payload) & 0xff == data[end]:
+                    if text:
+                        out.write(text.decode("utf-8", "replace"))
+                        text = bytearray()
+                    out.write(decode_record(payload, formats) + "\n")
+                    pos = end + 1
+                    continue
+        text.append(data[pos])
+        pos += 1
+    if text:
+        out.write(text.decode("utf-8", "replace"))
+
+
+def main():
+    if len(sys.argv) < 2:
+        print(__doc__)
+        sys.exit(1)
+    formats = load_formats(MESSAGES)
+    for path in sys.argv[1:]:
+        with open(path, "rb") as f:
+            decode(f.read(), formats, sys.stdout)
+
+
+if __name__ == "__main__":
+    main()
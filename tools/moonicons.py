@@ -0,0 +1,110 @@
+#!/usr/bin/env python3
+#
+#   Copyright (C) 2021 SFini
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 3 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+"""
+Render the moon phase icons of src/MoonIcons.h.
+
+   tools/moonicons.py > src/MoonIcons.h
+
+Every icon is a 4 bit gray image in the layout of the M5EPD canvas, two
+pixels per byte with the left pixel in the high nibble, 0 is white and
+15 black. The display copies the rows into the frame buffer as they are.
+Bucket 0 is the new moon, bucket 8 the full moon, the waxing moon is lit
+on the right side like on the northern hemisphere.
+"""
+import math
+
+PHASES  = 16
+SIZE    = 48
+RADIUS  = 22.5
+SAMPLES = 4     # supersampling per axis for the anti-aliasing
+LIT     = 0     # gray of the lit part
+DARK    = 10    # gray of the shadow
+OUTLINE = 15    # gray of the outline
+
+
+def pixel(phase, px, py):
+    """Gray of the pixel, mixed from the supersamples."""
+    elongation = 2 * math.pi * phase / PHASES
+    gray       = 0.0
+    for sy in range(SAMPLES):
+        for sx in range(SAMPLES):
+            x = px + (sx + 0.5) / SAMPLES - SIZE / 2
+            y = py + (sy + 0.5) / SAMPLES - SIZE / 2
+            r = math.hypot(x, y)
+            if r > RADIUS:
+                continue  # white background
+            if r > RADIUS - 1.5:
+                gray += OUTLINE
+                continue
+            half = math.sqrt(RADIUS * RADIUS - y * y)
+            # the terminator is the projection of the half circle
+            if elongation <= math.pi:
+                lit = x > half * math.cos(elongation)
+            else:
+                lit = x < -half * math.cos(elongation)
+            gray += LIT if lit else DARK
+    return int(round(gray / (SAMPLES * SAMPLES)))
+
+
+def icon(phase):
+    data = []
+    for y in range(SIZE):
+        for x in range(0, SIZE, 2):
+            data.append(pixel(phase, x, y) << 4 | pixel(phase, x + 1, y))
+    return data
+
+
+def main():
+    print("""/*
+   Copyright (C) 2021 SFini
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+  * @file MoonIcons.h
+  *
+  * Moon phase icons in the 4 bit layout of the canvas.
+  * Generated by tools/moonicons.py, do not edit.
+  */
+#pragma once
+""")
+    print("#define MOON_ICON_SIZE %d //!< Width and height of the moon icons" % SIZE)
+    print()
+    print("static const uint8_t MOON_ICONS[%d][%d] = {" % (PHASES, SIZE * SIZE // 2))
+    for phase in range(PHASES):
+        data = icon(phase)
+        print("   { // phase %d" % phase)
+        for i in range(0, len(data), 24):
+            print("      " + ", ".join("0x%02x" % b for b in data[i:i + 24]) + ",")
+        print("   },")
+    print("};")
+
+
+if __name__ == "__main__":
+    main()
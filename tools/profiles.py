@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+#
+#   Copyright (C) 2021 SFini
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation, either version 3 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+"""
+Summarize the wake profiles of the M5Paper.
+
+Hold the button up while switching the M5Paper on, it prints the stored
+profiles as CSV. Save the serial log of one or more of these dumps and
+call:
+
+   tools/profiles.py monitor.log [more.log ...]
+
+The other lines of the log are ignored, wakes found in several dumps
+are counted once.
+"""
+import sys
+
+HEADER = "wake,time,type,phase,start_us,duration_us,current_ma,mah"
+TYPES  = { 0: "network", 1: "local" }
+
+
+def percentile(values, p):
+    values = sorted(values)
+    index  = min(len(values) - 1, max(0, int(round(p / 100.0 * (len(values) - 1)))))
+    return values[index]
+
+
+def read(files):
+    rows = {}
+    for name in files:
+        with open(name, errors="replace") as f:
+            for line in f:
+                fields = line.strip().split(",")
+                if len(fields) != 8 or line.startswith(HEADER):
+                    continue
+                try:
+                    wake, time, kind = int(fields[0]), int(fields[1]), int(fields[2])
+                    row = (fields[3], int(fields[5]), float(fields[7]))
+                except ValueError:
+                    continue
+                rows.setdefault((wake, time, kind), {})[row[0]] = row
+    return rows
+
+
+def main(files):
+    wakes = read(files)
+    if not wakes:
+        print("no profiles found")
+        return 1
+
+    for kind in sorted(set(k for _, _, k in wakes)):
+        phases = {}
+        for (wake, time, k), rows in wakes.items():
+            if k != kind:
+                continue
+            for phase, duration, mah in rows.values():
+                phases.setdefault(phase, []).append((duration / 1000.0, mah))
+
+        count = len(phases.get("total", []))
+        print("%s wakes: %d" % (TYPES.get(kind, str(kind)), count))
+        print("  %-11s %6s %8s %8s %8s %8s %9s" % ("phase", "n", "p50 ms", "p90 ms", "p99 ms", "max ms", "p50 mAh"))
+        for phase in sorted(phases, key=lambda p: (p == "total", p)):
+            ms  = [d for d, _ in phases[phase]]
+            mah = [m for _, m in phases[phase]]
+            print("  %-11s %6d %8.0f %8.0f %8.0f %8.0f %9.4f" % (phase, len(ms),
+                percentile(ms, 50), percentile(ms, 90), percentile(ms, 99), max(ms), percentile(mah, 50)))
+        if count:
+            total = sum(m for _, m in phases["total"])
+            print("  average charge %.4f mAh per wake" % (total / count))
+    return 0
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        print(__doc__)
+        sys.exit(1)
+    sys.exit(main(sys.argv[1:]))